@@ -0,0 +1,2204 @@
+/* A Bison parser, made by GNU Bison 3.8.2.  */
+
+/* Bison implementation for Yacc-like parsers in C
+
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+/* As a special exception, you may create a larger work that contains
+   part or all of the Bison parser skeleton and distribute that work
+   under terms of your choice, so long as that work isn't itself a
+   parser generator using the skeleton or a modified version thereof
+   as a parser skeleton.  Alternatively, if you modify or redistribute
+   the parser skeleton itself, you may (at your option) remove this
+   special exception, which will cause the skeleton and the resulting
+   Bison output files to be licensed under the GNU General Public
+   License without this special exception.
+
+   This special exception was added by the Free Software Foundation in
+   version 2.2 of Bison.  */
+
+/* C LALR(1) parser skeleton written by Richard Stallman, by
+   simplifying the original so-called "semantic" parser.  */
+
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
+/* All symbols defined below should begin with yy or YY, to avoid
+   infringing on user name space.  This should be done even for local
+   variables, as they might otherwise be expanded by user macros.
+   There are some unavoidable exceptions within include files to
+   define necessary library symbols; they are noted "INFRINGES ON
+   USER NAME SPACE" below.  */
+
+/* Identify Bison output, and Bison version.  */
+#define YYBISON 30802
+
+/* Bison version string.  */
+#define YYBISON_VERSION "3.8.2"
+
+/* Skeleton name.  */
+#define YYSKELETON_NAME "yacc.c"
+
+/* Pure parsers.  */
+#define YYPURE 0
+
+/* Push parsers.  */
+#define YYPUSH 0
+
+/* Pull parsers.  */
+#define YYPULL 1
+
+
+
+
+/* First part of user prologue.  */
+#line 8 "src/z80.y"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "expr.h"
+#include "opcode.h"
+#include "tixasm.h"
+
+extern int yylineno;
+FILE *yyout;
+
+int yylex(void);
+void yyerror(char *);
+
+int instr_match_and_output(const struct opcode *oc,
+        struct operand *op1, struct operand *op2);
+
+#line 89 "y.tab.c"
+
+# ifndef YY_CAST
+#  ifdef __cplusplus
+#   define YY_CAST(Type, Val) static_cast<Type> (Val)
+#   define YY_REINTERPRET_CAST(Type, Val) reinterpret_cast<Type> (Val)
+#  else
+#   define YY_CAST(Type, Val) ((Type) (Val))
+#   define YY_REINTERPRET_CAST(Type, Val) ((Type) (Val))
+#  endif
+# endif
+# ifndef YY_NULLPTR
+#  if defined __cplusplus
+#   if 201103L <= __cplusplus
+#    define YY_NULLPTR nullptr
+#   else
+#    define YY_NULLPTR 0
+#   endif
+#  else
+#   define YY_NULLPTR ((void*)0)
+#  endif
+# endif
+
+/* Use api.header.include to #include this header
+   instead of duplicating it here.  */
+#ifndef YY_YY_Y_TAB_H_INCLUDED
+# define YY_YY_Y_TAB_H_INCLUDED
+/* Debug traces.  */
+#ifndef YYDEBUG
+# define YYDEBUG 0
+#endif
+#if YYDEBUG
+extern int yydebug;
+#endif
+
+/* Token kinds.  */
+#ifndef YYTOKENTYPE
+# define YYTOKENTYPE
+  enum yytokentype
+  {
+    YYEMPTY = -2,
+    YYEOF = 0,                     /* "end of file"  */
+    YYerror = 256,                 /* error  */
+    YYUNDEF = 257,                 /* "invalid token"  */
+    T_EOL = 258,                   /* T_EOL  */
+    T_ERROR = 259,                 /* T_ERROR  */
+    T_TEXT = 260,                  /* T_TEXT  */
+    T_DATA = 261,                  /* T_DATA  */
+    T_ABS = 262,                   /* T_ABS  */
+    T_ORG = 263,                   /* T_ORG  */
+    T_DB = 264,                    /* T_DB  */
+    T_DW = 265,                    /* T_DW  */
+    T_FILL = 266,                  /* T_FILL  */
+    T_EQU = 267,                   /* T_EQU  */
+    T_DEFINE = 268,                /* T_DEFINE  */
+    T_UNDEFINE = 269,              /* T_UNDEFINE  */
+    T_LITERAL = 270,               /* T_LITERAL  */
+    T_STRING = 271,                /* T_STRING  */
+    T_OPCODE = 272,                /* T_OPCODE  */
+    T_SYMBOL = 273,                /* T_SYMBOL  */
+    T_LABEL = 274,                 /* T_LABEL  */
+    T_LLABEL = 275,                /* T_LLABEL  */
+    T_FLABEL = 276,                /* T_FLABEL  */
+    T_A = 277,                     /* T_A  */
+    T_B = 278,                     /* T_B  */
+    T_C = 279,                     /* T_C  */
+    T_D = 280,                     /* T_D  */
+    T_E = 281,                     /* T_E  */
+    T_F = 282,                     /* T_F  */
+    T_H = 283,                     /* T_H  */
+    T_L = 284,                     /* T_L  */
+    T_IXH = 285,                   /* T_IXH  */
+    T_IXL = 286,                   /* T_IXL  */
+    T_IYH = 287,                   /* T_IYH  */
+    T_IYL = 288,                   /* T_IYL  */
+    T_I = 289,                     /* T_I  */
+    T_R = 290,                     /* T_R  */
+    T_AF = 291,                    /* T_AF  */
+    T_BC = 292,                    /* T_BC  */
+    T_DE = 293,                    /* T_DE  */
+    T_HL = 294,                    /* T_HL  */
+    T_SP = 295,                    /* T_SP  */
+    T_IX = 296,                    /* T_IX  */
+    T_IY = 297,                    /* T_IY  */
+    T_sAF = 298,                   /* T_sAF  */
+    T_fNZ = 299,                   /* T_fNZ  */
+    T_fZ = 300,                    /* T_fZ  */
+    T_fNC = 301,                   /* T_fNC  */
+    T_fC = 302,                    /* T_fC  */
+    T_fPO = 303,                   /* T_fPO  */
+    T_fPE = 304,                   /* T_fPE  */
+    T_fP = 305,                    /* T_fP  */
+    T_fM = 306,                    /* T_fM  */
+    T_EQ = 307,                    /* T_EQ  */
+    T_NE = 308,                    /* T_NE  */
+    T_LE = 309,                    /* T_LE  */
+    T_GE = 310,                    /* T_GE  */
+    T_LOR = 311,                   /* T_LOR  */
+    T_LAND = 312,                  /* T_LAND  */
+    UNARY = 313                    /* UNARY  */
+  };
+  typedef enum yytokentype yytoken_kind_t;
+#endif
+/* Token kinds.  */
+#define YYEMPTY -2
+#define YYEOF 0
+#define YYerror 256
+#define YYUNDEF 257
+#define T_EOL 258
+#define T_ERROR 259
+#define T_TEXT 260
+#define T_DATA 261
+#define T_ABS 262
+#define T_ORG 263
+#define T_DB 264
+#define T_DW 265
+#define T_FILL 266
+#define T_EQU 267
+#define T_DEFINE 268
+#define T_UNDEFINE 269
+#define T_LITERAL 270
+#define T_STRING 271
+#define T_OPCODE 272
+#define T_SYMBOL 273
+#define T_LABEL 274
+#define T_LLABEL 275
+#define T_FLABEL 276
+#define T_A 277
+#define T_B 278
+#define T_C 279
+#define T_D 280
+#define T_E 281
+#define T_F 282
+#define T_H 283
+#define T_L 284
+#define T_IXH 285
+#define T_IXL 286
+#define T_IYH 287
+#define T_IYL 288
+#define T_I 289
+#define T_R 290
+#define T_AF 291
+#define T_BC 292
+#define T_DE 293
+#define T_HL 294
+#define T_SP 295
+#define T_IX 296
+#define T_IY 297
+#define T_sAF 298
+#define T_fNZ 299
+#define T_fZ 300
+#define T_fNC 301
+#define T_fC 302
+#define T_fPO 303
+#define T_fPE 304
+#define T_fP 305
+#define T_fM 306
+#define T_EQ 307
+#define T_NE 308
+#define T_LE 309
+#define T_GE 310
+#define T_LOR 311
+#define T_LAND 312
+#define UNARY 313
+
+/* Value type.  */
+#if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
+union YYSTYPE
+{
+#line 26 "src/z80.y"
+
+    int i;
+    char *str;
+    struct {
+        int len;
+        uint8_t *data;
+    } buf;
+    struct expr_node *expr;
+    struct operand op;
+    const struct opcode *oc;
+    const struct symbol_ent *sym;
+
+#line 271 "y.tab.c"
+
+};
+typedef union YYSTYPE YYSTYPE;
+# define YYSTYPE_IS_TRIVIAL 1
+# define YYSTYPE_IS_DECLARED 1
+#endif
+
+
+extern YYSTYPE yylval;
+
+
+int yyparse (void);
+
+
+#endif /* !YY_YY_Y_TAB_H_INCLUDED  */
+/* Symbol kind.  */
+enum yysymbol_kind_t
+{
+  YYSYMBOL_YYEMPTY = -2,
+  YYSYMBOL_YYEOF = 0,                      /* "end of file"  */
+  YYSYMBOL_YYerror = 1,                    /* error  */
+  YYSYMBOL_YYUNDEF = 2,                    /* "invalid token"  */
+  YYSYMBOL_T_EOL = 3,                      /* T_EOL  */
+  YYSYMBOL_T_ERROR = 4,                    /* T_ERROR  */
+  YYSYMBOL_T_TEXT = 5,                     /* T_TEXT  */
+  YYSYMBOL_T_DATA = 6,                     /* T_DATA  */
+  YYSYMBOL_T_ABS = 7,                      /* T_ABS  */
+  YYSYMBOL_T_ORG = 8,                      /* T_ORG  */
+  YYSYMBOL_T_DB = 9,                       /* T_DB  */
+  YYSYMBOL_T_DW = 10,                      /* T_DW  */
+  YYSYMBOL_T_FILL = 11,                    /* T_FILL  */
+  YYSYMBOL_T_EQU = 12,                     /* T_EQU  */
+  YYSYMBOL_T_DEFINE = 13,                  /* T_DEFINE  */
+  YYSYMBOL_T_UNDEFINE = 14,                /* T_UNDEFINE  */
+  YYSYMBOL_T_LITERAL = 15,                 /* T_LITERAL  */
+  YYSYMBOL_T_STRING = 16,                  /* T_STRING  */
+  YYSYMBOL_T_OPCODE = 17,                  /* T_OPCODE  */
+  YYSYMBOL_T_SYMBOL = 18,                  /* T_SYMBOL  */
+  YYSYMBOL_T_LABEL = 19,                   /* T_LABEL  */
+  YYSYMBOL_T_LLABEL = 20,                  /* T_LLABEL  */
+  YYSYMBOL_T_FLABEL = 21,                  /* T_FLABEL  */
+  YYSYMBOL_T_A = 22,                       /* T_A  */
+  YYSYMBOL_T_B = 23,                       /* T_B  */
+  YYSYMBOL_T_C = 24,                       /* T_C  */
+  YYSYMBOL_T_D = 25,                       /* T_D  */
+  YYSYMBOL_T_E = 26,                       /* T_E  */
+  YYSYMBOL_T_F = 27,                       /* T_F  */
+  YYSYMBOL_T_H = 28,                       /* T_H  */
+  YYSYMBOL_T_L = 29,                       /* T_L  */
+  YYSYMBOL_T_IXH = 30,                     /* T_IXH  */
+  YYSYMBOL_T_IXL = 31,                     /* T_IXL  */
+  YYSYMBOL_T_IYH = 32,                     /* T_IYH  */
+  YYSYMBOL_T_IYL = 33,                     /* T_IYL  */
+  YYSYMBOL_T_I = 34,                       /* T_I  */
+  YYSYMBOL_T_R = 35,                       /* T_R  */
+  YYSYMBOL_T_AF = 36,                      /* T_AF  */
+  YYSYMBOL_T_BC = 37,                      /* T_BC  */
+  YYSYMBOL_T_DE = 38,                      /* T_DE  */
+  YYSYMBOL_T_HL = 39,                      /* T_HL  */
+  YYSYMBOL_T_SP = 40,                      /* T_SP  */
+  YYSYMBOL_T_IX = 41,                      /* T_IX  */
+  YYSYMBOL_T_IY = 42,                      /* T_IY  */
+  YYSYMBOL_T_sAF = 43,                     /* T_sAF  */
+  YYSYMBOL_T_fNZ = 44,                     /* T_fNZ  */
+  YYSYMBOL_T_fZ = 45,                      /* T_fZ  */
+  YYSYMBOL_T_fNC = 46,                     /* T_fNC  */
+  YYSYMBOL_T_fC = 47,                      /* T_fC  */
+  YYSYMBOL_T_fPO = 48,                     /* T_fPO  */
+  YYSYMBOL_T_fPE = 49,                     /* T_fPE  */
+  YYSYMBOL_T_fP = 50,                      /* T_fP  */
+  YYSYMBOL_T_fM = 51,                      /* T_fM  */
+  YYSYMBOL_52_ = 52,                       /* '#'  */
+  YYSYMBOL_T_EQ = 53,                      /* T_EQ  */
+  YYSYMBOL_T_NE = 54,                      /* T_NE  */
+  YYSYMBOL_55_ = 55,                       /* '<'  */
+  YYSYMBOL_56_ = 56,                       /* '>'  */
+  YYSYMBOL_T_LE = 57,                      /* T_LE  */
+  YYSYMBOL_T_GE = 58,                      /* T_GE  */
+  YYSYMBOL_T_LOR = 59,                     /* T_LOR  */
+  YYSYMBOL_T_LAND = 60,                    /* T_LAND  */
+  YYSYMBOL_61_ = 61,                       /* '|'  */
+  YYSYMBOL_62_ = 62,                       /* '^'  */
+  YYSYMBOL_63_ = 63,                       /* '&'  */
+  YYSYMBOL_64_ = 64,                       /* '+'  */
+  YYSYMBOL_65_ = 65,                       /* '-'  */
+  YYSYMBOL_66_ = 66,                       /* '*'  */
+  YYSYMBOL_67_ = 67,                       /* '/'  */
+  YYSYMBOL_68_ = 68,                       /* '%'  */
+  YYSYMBOL_69_ = 69,                       /* '~'  */
+  YYSYMBOL_70_ = 70,                       /* '!'  */
+  YYSYMBOL_UNARY = 71,                     /* UNARY  */
+  YYSYMBOL_72_ = 72,                       /* ','  */
+  YYSYMBOL_73_ = 73,                       /* '('  */
+  YYSYMBOL_74_ = 74,                       /* ')'  */
+  YYSYMBOL_75_ = 75,                       /* '$'  */
+  YYSYMBOL_YYACCEPT = 76,                  /* $accept  */
+  YYSYMBOL_program = 77,                   /* program  */
+  YYSYMBOL_line = 78,                      /* line  */
+  YYSYMBOL_label = 79,                     /* label  */
+  YYSYMBOL_directive = 80,                 /* directive  */
+  YYSYMBOL_db_operand = 81,                /* db_operand  */
+  YYSYMBOL_db_operand_list = 82,           /* db_operand_list  */
+  YYSYMBOL_dw_operand = 83,                /* dw_operand  */
+  YYSYMBOL_dw_operand_list = 84,           /* dw_operand_list  */
+  YYSYMBOL_instruction = 85,               /* instruction  */
+  YYSYMBOL_instr_operand = 86,             /* instr_operand  */
+  YYSYMBOL_register_8 = 87,                /* register_8  */
+  YYSYMBOL_register_16_nonidx = 88,        /* register_16_nonidx  */
+  YYSYMBOL_register_16_idx = 89,           /* register_16_idx  */
+  YYSYMBOL_register_16 = 90,               /* register_16  */
+  YYSYMBOL_register_shadow = 91,           /* register_shadow  */
+  YYSYMBOL_register = 92,                  /* register  */
+  YYSYMBOL_register_indir = 93,            /* register_indir  */
+  YYSYMBOL_register_idx_indir = 94,        /* register_idx_indir  */
+  YYSYMBOL_flag = 95,                      /* flag  */
+  YYSYMBOL_expr_top = 96,                  /* expr_top  */
+  YYSYMBOL_expr = 97                       /* expr  */
+};
+typedef enum yysymbol_kind_t yysymbol_kind_t;
+
+
+
+
+#ifdef short
+# undef short
+#endif
+
+/* On compilers that do not define __PTRDIFF_MAX__ etc., make sure
+   <limits.h> and (if available) <stdint.h> are included
+   so that the code can choose integer types of a good width.  */
+
+#ifndef __PTRDIFF_MAX__
+# include <limits.h> /* INFRINGES ON USER NAME SPACE */
+# if defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stdint.h> /* INFRINGES ON USER NAME SPACE */
+#  define YY_STDINT_H
+# endif
+#endif
+
+/* Narrow types that promote to a signed type and that can represent a
+   signed or unsigned integer of at least N bits.  In tables they can
+   save space and decrease cache pressure.  Promoting to a signed type
+   helps avoid bugs in integer arithmetic.  */
+
+#ifdef __INT_LEAST8_MAX__
+typedef __INT_LEAST8_TYPE__ yytype_int8;
+#elif defined YY_STDINT_H
+typedef int_least8_t yytype_int8;
+#else
+typedef signed char yytype_int8;
+#endif
+
+#ifdef __INT_LEAST16_MAX__
+typedef __INT_LEAST16_TYPE__ yytype_int16;
+#elif defined YY_STDINT_H
+typedef int_least16_t yytype_int16;
+#else
+typedef short yytype_int16;
+#endif
+
+/* Work around bug in HP-UX 11.23, which defines these macros
+   incorrectly for preprocessor constants.  This workaround can likely
+   be removed in 2023, as HPE has promised support for HP-UX 11.23
+   (aka HP-UX 11i v2) only through the end of 2022; see Table 2 of
+   <https://h20195.www2.hpe.com/V2/getpdf.aspx/4AA4-7673ENW.pdf>.  */
+#ifdef __hpux
+# undef UINT_LEAST8_MAX
+# undef UINT_LEAST16_MAX
+# define UINT_LEAST8_MAX 255
+# define UINT_LEAST16_MAX 65535
+#endif
+
+#if defined __UINT_LEAST8_MAX__ && __UINT_LEAST8_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST8_TYPE__ yytype_uint8;
+#elif (!defined __UINT_LEAST8_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST8_MAX <= INT_MAX)
+typedef uint_least8_t yytype_uint8;
+#elif !defined __UINT_LEAST8_MAX__ && UCHAR_MAX <= INT_MAX
+typedef unsigned char yytype_uint8;
+#else
+typedef short yytype_uint8;
+#endif
+
+#if defined __UINT_LEAST16_MAX__ && __UINT_LEAST16_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST16_TYPE__ yytype_uint16;
+#elif (!defined __UINT_LEAST16_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST16_MAX <= INT_MAX)
+typedef uint_least16_t yytype_uint16;
+#elif !defined __UINT_LEAST16_MAX__ && USHRT_MAX <= INT_MAX
+typedef unsigned short yytype_uint16;
+#else
+typedef int yytype_uint16;
+#endif
+
+#ifndef YYPTRDIFF_T
+# if defined __PTRDIFF_TYPE__ && defined __PTRDIFF_MAX__
+#  define YYPTRDIFF_T __PTRDIFF_TYPE__
+#  define YYPTRDIFF_MAXIMUM __PTRDIFF_MAX__
+# elif defined PTRDIFF_MAX
+#  ifndef ptrdiff_t
+#   include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  endif
+#  define YYPTRDIFF_T ptrdiff_t
+#  define YYPTRDIFF_MAXIMUM PTRDIFF_MAX
+# else
+#  define YYPTRDIFF_T long
+#  define YYPTRDIFF_MAXIMUM LONG_MAX
+# endif
+#endif
+
+#ifndef YYSIZE_T
+# ifdef __SIZE_TYPE__
+#  define YYSIZE_T __SIZE_TYPE__
+# elif defined size_t
+#  define YYSIZE_T size_t
+# elif defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  define YYSIZE_T size_t
+# else
+#  define YYSIZE_T unsigned
+# endif
+#endif
+
+#define YYSIZE_MAXIMUM                                  \
+  YY_CAST (YYPTRDIFF_T,                                 \
+           (YYPTRDIFF_MAXIMUM < YY_CAST (YYSIZE_T, -1)  \
+            ? YYPTRDIFF_MAXIMUM                         \
+            : YY_CAST (YYSIZE_T, -1)))
+
+#define YYSIZEOF(X) YY_CAST (YYPTRDIFF_T, sizeof (X))
+
+
+/* Stored state numbers (used for stacks). */
+typedef yytype_uint8 yy_state_t;
+
+/* State numbers in computations.  */
+typedef int yy_state_fast_t;
+
+#ifndef YY_
+# if defined YYENABLE_NLS && YYENABLE_NLS
+#  if ENABLE_NLS
+#   include <libintl.h> /* INFRINGES ON USER NAME SPACE */
+#   define YY_(Msgid) dgettext ("bison-runtime", Msgid)
+#  endif
+# endif
+# ifndef YY_
+#  define YY_(Msgid) Msgid
+# endif
+#endif
+
+
+#ifndef YY_ATTRIBUTE_PURE
+# if defined __GNUC__ && 2 < __GNUC__ + (96 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_PURE __attribute__ ((__pure__))
+# else
+#  define YY_ATTRIBUTE_PURE
+# endif
+#endif
+
+#ifndef YY_ATTRIBUTE_UNUSED
+# if defined __GNUC__ && 2 < __GNUC__ + (7 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_UNUSED __attribute__ ((__unused__))
+# else
+#  define YY_ATTRIBUTE_UNUSED
+# endif
+#endif
+
+/* Suppress unused-variable warnings by "using" E.  */
+#if ! defined lint || defined __GNUC__
+# define YY_USE(E) ((void) (E))
+#else
+# define YY_USE(E) /* empty */
+#endif
+
+/* Suppress an incorrect diagnostic about yylval being uninitialized.  */
+#if defined __GNUC__ && ! defined __ICC && 406 <= __GNUC__ * 100 + __GNUC_MINOR__
+# if __GNUC__ * 100 + __GNUC_MINOR__ < 407
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")
+# else
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")              \
+    _Pragma ("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+# endif
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END      \
+    _Pragma ("GCC diagnostic pop")
+#else
+# define YY_INITIAL_VALUE(Value) Value
+#endif
+#ifndef YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+# define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END
+#endif
+#ifndef YY_INITIAL_VALUE
+# define YY_INITIAL_VALUE(Value) /* Nothing. */
+#endif
+
+#if defined __cplusplus && defined __GNUC__ && ! defined __ICC && 6 <= __GNUC__
+# define YY_IGNORE_USELESS_CAST_BEGIN                          \
+    _Pragma ("GCC diagnostic push")                            \
+    _Pragma ("GCC diagnostic ignored \"-Wuseless-cast\"")
+# define YY_IGNORE_USELESS_CAST_END            \
+    _Pragma ("GCC diagnostic pop")
+#endif
+#ifndef YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_END
+#endif
+
+
+#define YY_ASSERT(E) ((void) (0 && (E)))
+
+#if !defined yyoverflow
+
+/* The parser invokes alloca or malloc; define the necessary symbols.  */
+
+# ifdef YYSTACK_USE_ALLOCA
+#  if YYSTACK_USE_ALLOCA
+#   ifdef __GNUC__
+#    define YYSTACK_ALLOC __builtin_alloca
+#   elif defined __BUILTIN_VA_ARG_INCR
+#    include <alloca.h> /* INFRINGES ON USER NAME SPACE */
+#   elif defined _AIX
+#    define YYSTACK_ALLOC __alloca
+#   elif defined _MSC_VER
+#    include <malloc.h> /* INFRINGES ON USER NAME SPACE */
+#    define alloca _alloca
+#   else
+#    define YYSTACK_ALLOC alloca
+#    if ! defined _ALLOCA_H && ! defined EXIT_SUCCESS
+#     include <stdlib.h> /* INFRINGES ON USER NAME SPACE */
+      /* Use EXIT_SUCCESS as a witness for stdlib.h.  */
+#     ifndef EXIT_SUCCESS
+#      define EXIT_SUCCESS 0
+#     endif
+#    endif
+#   endif
+#  endif
+# endif
+
+# ifdef YYSTACK_ALLOC
+   /* Pacify GCC's 'empty if-body' warning.  */
+#  define YYSTACK_FREE(Ptr) do { /* empty */; } while (0)
+#  ifndef YYSTACK_ALLOC_MAXIMUM
+    /* The OS might guarantee only one guard page at the bottom of the stack,
+       and a page size can be as small as 4096 bytes.  So we cannot safely
+       invoke alloca (N) if N exceeds 4096.  Use a slightly smaller number
+       to allow for a few compiler-allocated temporary stack slots.  */
+#   define YYSTACK_ALLOC_MAXIMUM 4032 /* reasonable circa 2006 */
+#  endif
+# else
+#  define YYSTACK_ALLOC YYMALLOC
+#  define YYSTACK_FREE YYFREE
+#  ifndef YYSTACK_ALLOC_MAXIMUM
+#   define YYSTACK_ALLOC_MAXIMUM YYSIZE_MAXIMUM
+#  endif
+#  if (defined __cplusplus && ! defined EXIT_SUCCESS \
+       && ! ((defined YYMALLOC || defined malloc) \
+             && (defined YYFREE || defined free)))
+#   include <stdlib.h> /* INFRINGES ON USER NAME SPACE */
+#   ifndef EXIT_SUCCESS
+#    define EXIT_SUCCESS 0
+#   endif
+#  endif
+#  ifndef YYMALLOC
+#   define YYMALLOC malloc
+#   if ! defined malloc && ! defined EXIT_SUCCESS
+void *malloc (YYSIZE_T); /* INFRINGES ON USER NAME SPACE */
+#   endif
+#  endif
+#  ifndef YYFREE
+#   define YYFREE free
+#   if ! defined free && ! defined EXIT_SUCCESS
+void free (void *); /* INFRINGES ON USER NAME SPACE */
+#   endif
+#  endif
+# endif
+#endif /* !defined yyoverflow */
+
+#if (! defined yyoverflow \
+     && (! defined __cplusplus \
+         || (defined YYSTYPE_IS_TRIVIAL && YYSTYPE_IS_TRIVIAL)))
+
+/* A type that is properly aligned for any stack member.  */
+union yyalloc
+{
+  yy_state_t yyss_alloc;
+  YYSTYPE yyvs_alloc;
+};
+
+/* The size of the maximum gap between one aligned stack and the next.  */
+# define YYSTACK_GAP_MAXIMUM (YYSIZEOF (union yyalloc) - 1)
+
+/* The size of an array large to enough to hold all stacks, each with
+   N elements.  */
+# define YYSTACK_BYTES(N) \
+     ((N) * (YYSIZEOF (yy_state_t) + YYSIZEOF (YYSTYPE)) \
+      + YYSTACK_GAP_MAXIMUM)
+
+# define YYCOPY_NEEDED 1
+
+/* Relocate STACK from its old location to the new one.  The
+   local variables YYSIZE and YYSTACKSIZE give the old and new number of
+   elements in the stack, and YYPTR gives the new location of the
+   stack.  Advance YYPTR to a properly aligned location for the next
+   stack.  */
+# define YYSTACK_RELOCATE(Stack_alloc, Stack)                           \
+    do                                                                  \
+      {                                                                 \
+        YYPTRDIFF_T yynewbytes;                                         \
+        YYCOPY (&yyptr->Stack_alloc, Stack, yysize);                    \
+        Stack = &yyptr->Stack_alloc;                                    \
+        yynewbytes = yystacksize * YYSIZEOF (*Stack) + YYSTACK_GAP_MAXIMUM; \
+        yyptr += yynewbytes / YYSIZEOF (*yyptr);                        \
+      }                                                                 \
+    while (0)
+
+#endif
+
+#if defined YYCOPY_NEEDED && YYCOPY_NEEDED
+/* Copy COUNT objects from SRC to DST.  The source and destination do
+   not overlap.  */
+# ifndef YYCOPY
+#  if defined __GNUC__ && 1 < __GNUC__
+#   define YYCOPY(Dst, Src, Count) \
+      __builtin_memcpy (Dst, Src, YY_CAST (YYSIZE_T, (Count)) * sizeof (*(Src)))
+#  else
+#   define YYCOPY(Dst, Src, Count)              \
+      do                                        \
+        {                                       \
+          YYPTRDIFF_T yyi;                      \
+          for (yyi = 0; yyi < (Count); yyi++)   \
+            (Dst)[yyi] = (Src)[yyi];            \
+        }                                       \
+      while (0)
+#  endif
+# endif
+#endif /* !YYCOPY_NEEDED */
+
+/* YYFINAL -- State number of the termination state.  */
+#define YYFINAL  83
+/* YYLAST -- Last index in YYTABLE.  */
+#define YYLAST   320
+
+/* YYNTOKENS -- Number of terminals.  */
+#define YYNTOKENS  76
+/* YYNNTS -- Number of nonterminals.  */
+#define YYNNTS  22
+/* YYNRULES -- Number of rules.  */
+#define YYNRULES  98
+/* YYNSTATES -- Number of states.  */
+#define YYNSTATES  142
+
+/* YYMAXUTOK -- Last valid token kind.  */
+#define YYMAXUTOK   313
+
+
+/* YYTRANSLATE(TOKEN-NUM) -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex, with out-of-bounds checking.  */
+#define YYTRANSLATE(YYX)                                \
+  (0 <= (YYX) && (YYX) <= YYMAXUTOK                     \
+   ? YY_CAST (yysymbol_kind_t, yytranslate[YYX])        \
+   : YYSYMBOL_YYUNDEF)
+
+/* YYTRANSLATE[TOKEN-NUM] -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex.  */
+static const yytype_int8 yytranslate[] =
+{
+       0,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,    70,     2,    52,    75,    68,    63,     2,
+      73,    74,    66,    64,    72,    65,     2,    67,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+      55,     2,    56,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,    62,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,    61,     2,    69,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     1,     2,     3,     4,
+       5,     6,     7,     8,     9,    10,    11,    12,    13,    14,
+      15,    16,    17,    18,    19,    20,    21,    22,    23,    24,
+      25,    26,    27,    28,    29,    30,    31,    32,    33,    34,
+      35,    36,    37,    38,    39,    40,    41,    42,    43,    44,
+      45,    46,    47,    48,    49,    50,    51,    53,    54,    57,
+      58,    59,    60,    71
+};
+
+#if YYDEBUG
+/* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
+static const yytype_int16 yyrline[] =
+{
+       0,    86,    86,    87,    90,    91,    92,    93,    94,    97,
+      98,    99,   102,   103,   104,   105,   109,   110,   111,   122,
+     134,   135,   138,   143,   150,   158,   159,   162,   171,   172,
+     175,   177,   179,   183,   185,   187,   189,   191,   193,   197,
+     198,   199,   200,   201,   202,   203,   204,   205,   206,   207,
+     208,   209,   210,   213,   214,   215,   216,   217,   220,   221,
+     224,   224,   227,   230,   230,   230,   233,   235,   237,   241,
+     244,   247,   250,   253,   256,   261,   262,   263,   264,   265,
+     266,   267,   268,   271,   272,   273,   274,   275,   276,   277,
+     278,   279,   280,   281,   282,   283,   284,   287,   288
+};
+#endif
+
+/** Accessing symbol of state STATE.  */
+#define YY_ACCESSING_SYMBOL(State) YY_CAST (yysymbol_kind_t, yystos[State])
+
+#if YYDEBUG || 0
+/* The user-facing name of the symbol whose (internal) number is
+   YYSYMBOL.  No bounds checking.  */
+static const char *yysymbol_name (yysymbol_kind_t yysymbol) YY_ATTRIBUTE_UNUSED;
+
+/* YYTNAME[SYMBOL-NUM] -- String name of the symbol SYMBOL-NUM.
+   First, the terminals, then, starting at YYNTOKENS, nonterminals.  */
+static const char *const yytname[] =
+{
+  "\"end of file\"", "error", "\"invalid token\"", "T_EOL", "T_ERROR",
+  "T_TEXT", "T_DATA", "T_ABS", "T_ORG", "T_DB", "T_DW", "T_FILL", "T_EQU",
+  "T_DEFINE", "T_UNDEFINE", "T_LITERAL", "T_STRING", "T_OPCODE",
+  "T_SYMBOL", "T_LABEL", "T_LLABEL", "T_FLABEL", "T_A", "T_B", "T_C",
+  "T_D", "T_E", "T_F", "T_H", "T_L", "T_IXH", "T_IXL", "T_IYH", "T_IYL",
+  "T_I", "T_R", "T_AF", "T_BC", "T_DE", "T_HL", "T_SP", "T_IX", "T_IY",
+  "T_sAF", "T_fNZ", "T_fZ", "T_fNC", "T_fC", "T_fPO", "T_fPE", "T_fP",
+  "T_fM", "'#'", "T_EQ", "T_NE", "'<'", "'>'", "T_LE", "T_GE", "T_LOR",
+  "T_LAND", "'|'", "'^'", "'&'", "'+'", "'-'", "'*'", "'/'", "'%'", "'~'",
+  "'!'", "UNARY", "','", "'('", "')'", "'$'", "$accept", "program", "line",
+  "label", "directive", "db_operand", "db_operand_list", "dw_operand",
+  "dw_operand_list", "instruction", "instr_operand", "register_8",
+  "register_16_nonidx", "register_16_idx", "register_16",
+  "register_shadow", "register", "register_indir", "register_idx_indir",
+  "flag", "expr_top", "expr", YY_NULLPTR
+};
+
+static const char *
+yysymbol_name (yysymbol_kind_t yysymbol)
+{
+  return yytname[yysymbol];
+}
+#endif
+
+#define YYPACT_NINF (-67)
+
+#define yypact_value_is_default(Yyn) \
+  ((Yyn) == YYPACT_NINF)
+
+#define YYTABLE_NINF (-35)
+
+#define yytable_value_is_error(Yyn) \
+  0
+
+/* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
+   STATE-NUM.  */
+static const yytype_int16 yypact[] =
+{
+     182,   -67,   -67,   -67,    99,    35,    99,    99,    -7,    -6,
+      10,   111,   -67,   -67,   -67,    27,   -67,    15,   -67,   -67,
+     -67,   -67,    99,    99,    99,    99,   -67,   -67,   239,   -67,
+     -67,   -49,   239,   -67,   -38,   239,   227,    99,   -67,   -67,
+     -67,   -67,   -67,   -67,   -67,   -67,   -67,   -67,   -67,   -67,
+     -67,   -67,   -67,   -67,   -67,   -67,   -67,   -67,   -67,   -67,
+     -67,   -67,   -67,   -67,   -67,   -67,   -67,   -67,   -67,   -67,
+       7,   -37,   -67,   -67,   -67,   -67,   -67,   -67,   -67,   -67,
+     -67,     5,   239,   -67,   182,   -67,   -12,   -67,   -67,   143,
+      99,    99,    99,    99,    99,    99,    99,    99,    35,    99,
+      99,   239,   -22,   -17,   -16,   -50,   157,   111,   -67,   -67,
+     246,   252,   -26,   -12,   -12,   -67,   -67,   -67,   -67,   -67,
+     239,   -67,   -67,   -67,    99,    99,   -67,    -5,     6,   -67,
+     171,   185,   -48,   -67,   -67,    99,    99,   -67,   199,   213,
+     -67,   -67
+};
+
+/* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
+   Performed when YYTABLE does not specify something else to do.  Zero
+   means the default is an error.  */
+static const yytype_int8 yydefact[] =
+{
+       4,    12,    13,    14,     0,     0,     0,     0,     0,     0,
+       0,    30,     9,    10,    11,     0,     2,     5,     8,     7,
+      84,    85,     0,     0,     0,     0,    83,    97,    15,    24,
+      25,    16,    23,    28,    17,    27,    18,     0,    21,    22,
+      39,    40,    41,    42,    43,    44,    45,    46,    47,    48,
+      49,    50,    51,    52,    53,    54,    55,    56,    57,    58,
+      59,    62,    75,    76,    77,    78,    79,    80,    81,    82,
+       0,    31,    63,    60,    61,    64,    65,    35,    36,    37,
+      38,    97,     0,     1,     4,     6,    86,    87,    88,     0,
+       0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+       0,    20,     0,     0,     0,     0,     0,     0,     3,    98,
+      96,    95,    94,    92,    93,    89,    90,    91,    26,    29,
+      19,    67,    68,    66,     0,     0,    69,     0,    98,    32,
+       0,     0,     0,    70,    71,     0,     0,    72,     0,     0,
+      73,    74
+};
+
+/* YYPGOTO[NTERM-NUM].  */
+static const yytype_int8 yypgoto[] =
+{
+     -67,   -67,   -21,   -67,   -67,   -36,   -67,   -34,   -67,    50,
+     -33,   -67,    -1,   -66,   -67,   -67,   -67,   -67,   -67,   -67,
+     -10,    -4
+};
+
+/* YYDEFGOTO[NTERM-NUM].  */
+static const yytype_int8 yydefgoto[] =
+{
+       0,    15,    16,    17,    18,    30,    31,    33,    34,    19,
+      71,    72,    73,    74,    75,    76,    77,    78,    79,    80,
+      27,    32
+};
+
+/* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
+   positive, shift that token.  If negative, reduce the rule whose
+   number is the opposite.  If YYTABLE_NINF, syntax error.  */
+static const yytype_int16 yytable[] =
+{
+      28,    81,    35,    36,   105,   -33,   -34,    82,   -33,   -34,
+      20,    37,    38,    21,   124,   125,   135,   136,    86,    87,
+      88,    89,    20,    98,   126,    21,   137,    83,    39,   102,
+      84,   103,    11,   101,    99,   107,    59,    60,    93,    94,
+      95,    96,    97,    54,    55,    56,    57,    58,    59,    60,
+      20,    29,   121,    21,    95,    96,    97,   122,   123,    22,
+      23,   132,   118,   108,    24,   119,   106,    85,    25,   104,
+      26,    22,    23,     0,   129,     0,    24,   -33,   -34,     0,
+      25,     0,    26,     0,     0,     0,   110,   111,   112,   113,
+     114,   115,   116,   117,     0,    35,   120,    81,     0,    22,
+      23,     0,     0,    82,    24,     0,     0,     0,    25,     0,
+      26,     0,     0,     0,    20,     0,     0,    21,     0,     0,
+     130,   131,     0,   113,     0,     0,    20,     0,     0,    21,
+       0,   138,   139,    40,    41,    42,    43,    44,    45,    46,
+      47,    48,    49,    50,    51,    52,    53,    54,    55,    56,
+      57,    58,    59,    60,    61,    62,    63,    64,    65,    66,
+      67,    68,    69,    22,    23,     0,     0,     0,    24,     0,
+       0,     0,    25,     0,    26,    22,    23,     0,     0,     0,
+      24,     0,     0,     0,    70,     0,    26,     1,     2,     3,
+       4,     5,     6,     7,     8,     9,    10,     0,     0,    11,
+       0,    12,    13,    14,    90,    91,    92,    93,    94,    95,
+      96,    97,     0,     0,     0,     0,     0,   109,    90,    91,
+      92,   127,    94,    95,    96,    97,     0,     0,     0,     0,
+       0,   128,    90,    91,    92,    93,    94,    95,    96,    97,
+       0,     0,     0,     0,     0,   133,    90,    91,    92,    93,
+      94,    95,    96,    97,     0,     0,     0,     0,     0,   134,
+      90,    91,    92,    93,    94,    95,    96,    97,     0,     0,
+       0,     0,     0,   140,    90,    91,    92,    93,    94,    95,
+      96,    97,     0,     0,     0,     0,     0,   141,    90,    91,
+      92,    93,    94,    95,    96,    97,     0,     0,     0,   100,
+      90,    91,    92,    93,    94,    95,    96,    97,    91,    92,
+      93,    94,    95,    96,    97,    92,    93,    94,    95,    96,
+      97
+};
+
+static const yytype_int16 yycheck[] =
+{
+       4,    11,     6,     7,    70,     0,     0,    11,     3,     3,
+      15,    18,    18,    18,    64,    65,    64,    65,    22,    23,
+      24,    25,    15,    72,    74,    18,    74,     0,    18,    22,
+       3,    24,    17,    37,    72,    72,    41,    42,    64,    65,
+      66,    67,    68,    36,    37,    38,    39,    40,    41,    42,
+      15,    16,    74,    18,    66,    67,    68,    74,    74,    64,
+      65,   127,    98,    84,    69,    99,    70,    17,    73,    70,
+      75,    64,    65,    -1,   107,    -1,    69,    72,    72,    -1,
+      73,    -1,    75,    -1,    -1,    -1,    90,    91,    92,    93,
+      94,    95,    96,    97,    -1,    99,   100,   107,    -1,    64,
+      65,    -1,    -1,   107,    69,    -1,    -1,    -1,    73,    -1,
+      75,    -1,    -1,    -1,    15,    -1,    -1,    18,    -1,    -1,
+     124,   125,    -1,   127,    -1,    -1,    15,    -1,    -1,    18,
+      -1,   135,   136,    22,    23,    24,    25,    26,    27,    28,
+      29,    30,    31,    32,    33,    34,    35,    36,    37,    38,
+      39,    40,    41,    42,    43,    44,    45,    46,    47,    48,
+      49,    50,    51,    64,    65,    -1,    -1,    -1,    69,    -1,
+      -1,    -1,    73,    -1,    75,    64,    65,    -1,    -1,    -1,
+      69,    -1,    -1,    -1,    73,    -1,    75,     5,     6,     7,
+       8,     9,    10,    11,    12,    13,    14,    -1,    -1,    17,
+      -1,    19,    20,    21,    61,    62,    63,    64,    65,    66,
+      67,    68,    -1,    -1,    -1,    -1,    -1,    74,    61,    62,
+      63,    64,    65,    66,    67,    68,    -1,    -1,    -1,    -1,
+      -1,    74,    61,    62,    63,    64,    65,    66,    67,    68,
+      -1,    -1,    -1,    -1,    -1,    74,    61,    62,    63,    64,
+      65,    66,    67,    68,    -1,    -1,    -1,    -1,    -1,    74,
+      61,    62,    63,    64,    65,    66,    67,    68,    -1,    -1,
+      -1,    -1,    -1,    74,    61,    62,    63,    64,    65,    66,
+      67,    68,    -1,    -1,    -1,    -1,    -1,    74,    61,    62,
+      63,    64,    65,    66,    67,    68,    -1,    -1,    -1,    72,
+      61,    62,    63,    64,    65,    66,    67,    68,    62,    63,
+      64,    65,    66,    67,    68,    63,    64,    65,    66,    67,
+      68
+};
+
+/* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
+   state STATE-NUM.  */
+static const yytype_int8 yystos[] =
+{
+       0,     5,     6,     7,     8,     9,    10,    11,    12,    13,
+      14,    17,    19,    20,    21,    77,    78,    79,    80,    85,
+      15,    18,    64,    65,    69,    73,    75,    96,    97,    16,
+      81,    82,    97,    83,    84,    97,    97,    18,    18,    18,
+      22,    23,    24,    25,    26,    27,    28,    29,    30,    31,
+      32,    33,    34,    35,    36,    37,    38,    39,    40,    41,
+      42,    43,    44,    45,    46,    47,    48,    49,    50,    51,
+      73,    86,    87,    88,    89,    90,    91,    92,    93,    94,
+      95,    96,    97,     0,     3,    85,    97,    97,    97,    97,
+      61,    62,    63,    64,    65,    66,    67,    68,    72,    72,
+      72,    97,    22,    24,    88,    89,    97,    72,    78,    74,
+      97,    97,    97,    97,    97,    97,    97,    97,    81,    83,
+      97,    74,    74,    74,    64,    65,    74,    64,    74,    86,
+      97,    97,    89,    74,    74,    64,    65,    74,    97,    97,
+      74,    74
+};
+
+/* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr1[] =
+{
+       0,    76,    77,    77,    78,    78,    78,    78,    78,    79,
+      79,    79,    80,    80,    80,    80,    80,    80,    80,    80,
+      80,    80,    80,    81,    81,    82,    82,    83,    84,    84,
+      85,    85,    85,    86,    86,    86,    86,    86,    86,    87,
+      87,    87,    87,    87,    87,    87,    87,    87,    87,    87,
+      87,    87,    87,    88,    88,    88,    88,    88,    89,    89,
+      90,    90,    91,    92,    92,    92,    93,    93,    93,    94,
+      94,    94,    94,    94,    94,    95,    95,    95,    95,    95,
+      95,    95,    95,    96,    96,    96,    96,    96,    96,    96,
+      96,    96,    96,    96,    96,    96,    96,    97,    97
+};
+
+/* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr2[] =
+{
+       0,     2,     1,     3,     0,     1,     2,     1,     1,     1,
+       1,     1,     1,     1,     1,     2,     2,     2,     2,     4,
+       3,     2,     2,     1,     1,     1,     3,     1,     1,     3,
+       1,     2,     4,     1,     3,     1,     1,     1,     1,     1,
+       1,     1,     1,     1,     1,     1,     1,     1,     1,     1,
+       1,     1,     1,     1,     1,     1,     1,     1,     1,     1,
+       1,     1,     1,     1,     1,     1,     3,     3,     3,     3,
+       5,     5,     5,     7,     7,     1,     1,     1,     1,     1,
+       1,     1,     1,     1,     1,     1,     2,     2,     2,     3,
+       3,     3,     3,     3,     3,     3,     3,     1,     3
+};
+
+
+enum { YYENOMEM = -2 };
+
+#define yyerrok         (yyerrstatus = 0)
+#define yyclearin       (yychar = YYEMPTY)
+
+#define YYACCEPT        goto yyacceptlab
+#define YYABORT         goto yyabortlab
+#define YYERROR         goto yyerrorlab
+#define YYNOMEM         goto yyexhaustedlab
+
+
+#define YYRECOVERING()  (!!yyerrstatus)
+
+#define YYBACKUP(Token, Value)                                    \
+  do                                                              \
+    if (yychar == YYEMPTY)                                        \
+      {                                                           \
+        yychar = (Token);                                         \
+        yylval = (Value);                                         \
+        YYPOPSTACK (yylen);                                       \
+        yystate = *yyssp;                                         \
+        goto yybackup;                                            \
+      }                                                           \
+    else                                                          \
+      {                                                           \
+        yyerror (YY_("syntax error: cannot back up")); \
+        YYERROR;                                                  \
+      }                                                           \
+  while (0)
+
+/* Backward compatibility with an undocumented macro.
+   Use YYerror or YYUNDEF. */
+#define YYERRCODE YYUNDEF
+
+
+/* Enable debugging if requested.  */
+#if YYDEBUG
+
+# ifndef YYFPRINTF
+#  include <stdio.h> /* INFRINGES ON USER NAME SPACE */
+#  define YYFPRINTF fprintf
+# endif
+
+# define YYDPRINTF(Args)                        \
+do {                                            \
+  if (yydebug)                                  \
+    YYFPRINTF Args;                             \
+} while (0)
+
+
+
+
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)                    \
+do {                                                                      \
+  if (yydebug)                                                            \
+    {                                                                     \
+      YYFPRINTF (stderr, "%s ", Title);                                   \
+      yy_symbol_print (stderr,                                            \
+                  Kind, Value); \
+      YYFPRINTF (stderr, "\n");                                           \
+    }                                                                     \
+} while (0)
+
+
+/*-----------------------------------.
+| Print this symbol's value on YYO.  |
+`-----------------------------------*/
+
+static void
+yy_symbol_value_print (FILE *yyo,
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+{
+  FILE *yyoutput = yyo;
+  YY_USE (yyoutput);
+  if (!yyvaluep)
+    return;
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  YY_USE (yykind);
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+}
+
+
+/*---------------------------.
+| Print this symbol on YYO.  |
+`---------------------------*/
+
+static void
+yy_symbol_print (FILE *yyo,
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+{
+  YYFPRINTF (yyo, "%s %s (",
+             yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
+
+  yy_symbol_value_print (yyo, yykind, yyvaluep);
+  YYFPRINTF (yyo, ")");
+}
+
+/*------------------------------------------------------------------.
+| yy_stack_print -- Print the state stack from its BOTTOM up to its |
+| TOP (included).                                                   |
+`------------------------------------------------------------------*/
+
+static void
+yy_stack_print (yy_state_t *yybottom, yy_state_t *yytop)
+{
+  YYFPRINTF (stderr, "Stack now");
+  for (; yybottom <= yytop; yybottom++)
+    {
+      int yybot = *yybottom;
+      YYFPRINTF (stderr, " %d", yybot);
+    }
+  YYFPRINTF (stderr, "\n");
+}
+
+# define YY_STACK_PRINT(Bottom, Top)                            \
+do {                                                            \
+  if (yydebug)                                                  \
+    yy_stack_print ((Bottom), (Top));                           \
+} while (0)
+
+
+/*------------------------------------------------.
+| Report that the YYRULE is going to be reduced.  |
+`------------------------------------------------*/
+
+static void
+yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
+                 int yyrule)
+{
+  int yylno = yyrline[yyrule];
+  int yynrhs = yyr2[yyrule];
+  int yyi;
+  YYFPRINTF (stderr, "Reducing stack by rule %d (line %d):\n",
+             yyrule - 1, yylno);
+  /* The symbols being reduced.  */
+  for (yyi = 0; yyi < yynrhs; yyi++)
+    {
+      YYFPRINTF (stderr, "   $%d = ", yyi + 1);
+      yy_symbol_print (stderr,
+                       YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
+                       &yyvsp[(yyi + 1) - (yynrhs)]);
+      YYFPRINTF (stderr, "\n");
+    }
+}
+
+# define YY_REDUCE_PRINT(Rule)          \
+do {                                    \
+  if (yydebug)                          \
+    yy_reduce_print (yyssp, yyvsp, Rule); \
+} while (0)
+
+/* Nonzero means print parse trace.  It is left uninitialized so that
+   multiple parsers can coexist.  */
+int yydebug;
+#else /* !YYDEBUG */
+# define YYDPRINTF(Args) ((void) 0)
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)
+# define YY_STACK_PRINT(Bottom, Top)
+# define YY_REDUCE_PRINT(Rule)
+#endif /* !YYDEBUG */
+
+
+/* YYINITDEPTH -- initial size of the parser's stacks.  */
+#ifndef YYINITDEPTH
+# define YYINITDEPTH 200
+#endif
+
+/* YYMAXDEPTH -- maximum size the stacks can grow to (effective only
+   if the built-in stack extension method is used).
+
+   Do not make this value too large; the results are undefined if
+   YYSTACK_ALLOC_MAXIMUM < YYSTACK_BYTES (YYMAXDEPTH)
+   evaluated with infinite-precision integer arithmetic.  */
+
+#ifndef YYMAXDEPTH
+# define YYMAXDEPTH 10000
+#endif
+
+
+
+
+
+
+/*-----------------------------------------------.
+| Release the memory associated to this symbol.  |
+`-----------------------------------------------*/
+
+static void
+yydestruct (const char *yymsg,
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep)
+{
+  YY_USE (yyvaluep);
+  if (!yymsg)
+    yymsg = "Deleting";
+  YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
+
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  YY_USE (yykind);
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+}
+
+
+/* Lookahead token kind.  */
+int yychar;
+
+/* The semantic value of the lookahead symbol.  */
+YYSTYPE yylval;
+/* Number of syntax errors so far.  */
+int yynerrs;
+
+
+
+
+/*----------.
+| yyparse.  |
+`----------*/
+
+int
+yyparse (void)
+{
+    yy_state_fast_t yystate = 0;
+    /* Number of tokens to shift before error messages enabled.  */
+    int yyerrstatus = 0;
+
+    /* Refer to the stacks through separate pointers, to allow yyoverflow
+       to reallocate them elsewhere.  */
+
+    /* Their size.  */
+    YYPTRDIFF_T yystacksize = YYINITDEPTH;
+
+    /* The state stack: array, bottom, top.  */
+    yy_state_t yyssa[YYINITDEPTH];
+    yy_state_t *yyss = yyssa;
+    yy_state_t *yyssp = yyss;
+
+    /* The semantic value stack: array, bottom, top.  */
+    YYSTYPE yyvsa[YYINITDEPTH];
+    YYSTYPE *yyvs = yyvsa;
+    YYSTYPE *yyvsp = yyvs;
+
+  int yyn;
+  /* The return value of yyparse.  */
+  int yyresult;
+  /* Lookahead symbol kind.  */
+  yysymbol_kind_t yytoken = YYSYMBOL_YYEMPTY;
+  /* The variables used to return semantic value and location from the
+     action routines.  */
+  YYSTYPE yyval;
+
+
+
+#define YYPOPSTACK(N)   (yyvsp -= (N), yyssp -= (N))
+
+  /* The number of symbols on the RHS of the reduced rule.
+     Keep to zero when no symbol should be popped.  */
+  int yylen = 0;
+
+  YYDPRINTF ((stderr, "Starting parse\n"));
+
+  yychar = YYEMPTY; /* Cause a token to be read.  */
+
+  goto yysetstate;
+
+
+/*------------------------------------------------------------.
+| yynewstate -- push a new state, which is found in yystate.  |
+`------------------------------------------------------------*/
+yynewstate:
+  /* In all cases, when you get here, the value and location stacks
+     have just been pushed.  So pushing a state here evens the stacks.  */
+  yyssp++;
+
+
+/*--------------------------------------------------------------------.
+| yysetstate -- set current state (the top of the stack) to yystate.  |
+`--------------------------------------------------------------------*/
+yysetstate:
+  YYDPRINTF ((stderr, "Entering state %d\n", yystate));
+  YY_ASSERT (0 <= yystate && yystate < YYNSTATES);
+  YY_IGNORE_USELESS_CAST_BEGIN
+  *yyssp = YY_CAST (yy_state_t, yystate);
+  YY_IGNORE_USELESS_CAST_END
+  YY_STACK_PRINT (yyss, yyssp);
+
+  if (yyss + yystacksize - 1 <= yyssp)
+#if !defined yyoverflow && !defined YYSTACK_RELOCATE
+    YYNOMEM;
+#else
+    {
+      /* Get the current used size of the three stacks, in elements.  */
+      YYPTRDIFF_T yysize = yyssp - yyss + 1;
+
+# if defined yyoverflow
+      {
+        /* Give user a chance to reallocate the stack.  Use copies of
+           these so that the &'s don't force the real ones into
+           memory.  */
+        yy_state_t *yyss1 = yyss;
+        YYSTYPE *yyvs1 = yyvs;
+
+        /* Each stack pointer address is followed by the size of the
+           data in use in that stack, in bytes.  This used to be a
+           conditional around just the two extra args, but that might
+           be undefined if yyoverflow is a macro.  */
+        yyoverflow (YY_("memory exhausted"),
+                    &yyss1, yysize * YYSIZEOF (*yyssp),
+                    &yyvs1, yysize * YYSIZEOF (*yyvsp),
+                    &yystacksize);
+        yyss = yyss1;
+        yyvs = yyvs1;
+      }
+# else /* defined YYSTACK_RELOCATE */
+      /* Extend the stack our own way.  */
+      if (YYMAXDEPTH <= yystacksize)
+        YYNOMEM;
+      yystacksize *= 2;
+      if (YYMAXDEPTH < yystacksize)
+        yystacksize = YYMAXDEPTH;
+
+      {
+        yy_state_t *yyss1 = yyss;
+        union yyalloc *yyptr =
+          YY_CAST (union yyalloc *,
+                   YYSTACK_ALLOC (YY_CAST (YYSIZE_T, YYSTACK_BYTES (yystacksize))));
+        if (! yyptr)
+          YYNOMEM;
+        YYSTACK_RELOCATE (yyss_alloc, yyss);
+        YYSTACK_RELOCATE (yyvs_alloc, yyvs);
+#  undef YYSTACK_RELOCATE
+        if (yyss1 != yyssa)
+          YYSTACK_FREE (yyss1);
+      }
+# endif
+
+      yyssp = yyss + yysize - 1;
+      yyvsp = yyvs + yysize - 1;
+
+      YY_IGNORE_USELESS_CAST_BEGIN
+      YYDPRINTF ((stderr, "Stack size increased to %ld\n",
+                  YY_CAST (long, yystacksize)));
+      YY_IGNORE_USELESS_CAST_END
+
+      if (yyss + yystacksize - 1 <= yyssp)
+        YYABORT;
+    }
+#endif /* !defined yyoverflow && !defined YYSTACK_RELOCATE */
+
+
+  if (yystate == YYFINAL)
+    YYACCEPT;
+
+  goto yybackup;
+
+
+/*-----------.
+| yybackup.  |
+`-----------*/
+yybackup:
+  /* Do appropriate processing given the current state.  Read a
+     lookahead token if we need one and don't already have one.  */
+
+  /* First try to decide what to do without reference to lookahead token.  */
+  yyn = yypact[yystate];
+  if (yypact_value_is_default (yyn))
+    goto yydefault;
+
+  /* Not known => get a lookahead token if don't already have one.  */
+
+  /* YYCHAR is either empty, or end-of-input, or a valid lookahead.  */
+  if (yychar == YYEMPTY)
+    {
+      YYDPRINTF ((stderr, "Reading a token\n"));
+      yychar = yylex ();
+    }
+
+  if (yychar <= YYEOF)
+    {
+      yychar = YYEOF;
+      yytoken = YYSYMBOL_YYEOF;
+      YYDPRINTF ((stderr, "Now at end of input.\n"));
+    }
+  else if (yychar == YYerror)
+    {
+      /* The scanner already issued an error message, process directly
+         to error recovery.  But do not keep the error token as
+         lookahead, it is too special and may lead us to an endless
+         loop in error recovery. */
+      yychar = YYUNDEF;
+      yytoken = YYSYMBOL_YYerror;
+      goto yyerrlab1;
+    }
+  else
+    {
+      yytoken = YYTRANSLATE (yychar);
+      YY_SYMBOL_PRINT ("Next token is", yytoken, &yylval, &yylloc);
+    }
+
+  /* If the proper action on seeing token YYTOKEN is to reduce or to
+     detect an error, take that action.  */
+  yyn += yytoken;
+  if (yyn < 0 || YYLAST < yyn || yycheck[yyn] != yytoken)
+    goto yydefault;
+  yyn = yytable[yyn];
+  if (yyn <= 0)
+    {
+      if (yytable_value_is_error (yyn))
+        goto yyerrlab;
+      yyn = -yyn;
+      goto yyreduce;
+    }
+
+  /* Count tokens shifted since error; after three, turn off error
+     status.  */
+  if (yyerrstatus)
+    yyerrstatus--;
+
+  /* Shift the lookahead token.  */
+  YY_SYMBOL_PRINT ("Shifting", yytoken, &yylval, &yylloc);
+  yystate = yyn;
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  *++yyvsp = yylval;
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+
+  /* Discard the shifted token.  */
+  yychar = YYEMPTY;
+  goto yynewstate;
+
+
+/*-----------------------------------------------------------.
+| yydefault -- do the default action for the current state.  |
+`-----------------------------------------------------------*/
+yydefault:
+  yyn = yydefact[yystate];
+  if (yyn == 0)
+    goto yyerrlab;
+  goto yyreduce;
+
+
+/*-----------------------------.
+| yyreduce -- do a reduction.  |
+`-----------------------------*/
+yyreduce:
+  /* yyn is the number of a rule to reduce with.  */
+  yylen = yyr2[yyn];
+
+  /* If YYLEN is nonzero, implement the default value of the action:
+     '$$ = $1'.
+
+     Otherwise, the following line sets YYVAL to garbage.
+     This behavior is undocumented and Bison
+     users should not rely upon it.  Assigning to YYVAL
+     unconditionally makes the parser a bit smaller, and it avoids a
+     GCC warning that YYVAL may be used uninitialized.  */
+  yyval = yyvsp[1-yylen];
+
+
+  YY_REDUCE_PRINT (yyn);
+  switch (yyn)
+    {
+  case 12: /* directive: T_TEXT  */
+#line 102 "src/z80.y"
+                                    { asm_set_sec(SEC_TEXT); }
+#line 1489 "y.tab.c"
+    break;
+
+  case 13: /* directive: T_DATA  */
+#line 103 "src/z80.y"
+                                    { asm_set_sec(SEC_DATA); }
+#line 1495 "y.tab.c"
+    break;
+
+  case 14: /* directive: T_ABS  */
+#line 104 "src/z80.y"
+                                    { asm_set_sec(SEC_ABS); }
+#line 1501 "y.tab.c"
+    break;
+
+  case 15: /* directive: T_ORG expr  */
+#line 105 "src/z80.y"
+                      {
+                /* TODO Allow setting inside a section? */
+                asm_set_pc_expr((yyvsp[0].expr));
+            }
+#line 1510 "y.tab.c"
+    break;
+
+  case 18: /* directive: T_FILL expr  */
+#line 111 "src/z80.y"
+                       {
+                if (!EXPR_IS_ABS((yyvsp[0].expr))) {
+                    fprintf(stderr, "ORG address must be defined.\n");
+                }
+
+                int len = (yyvsp[0].expr)->value;
+                asm_inc_pc(len);
+                while (len --> 0) {
+                    fputc(0, yyout);
+                }
+            }
+#line 1526 "y.tab.c"
+    break;
+
+  case 19: /* directive: T_FILL expr ',' expr  */
+#line 122 "src/z80.y"
+                                {
+                if (!EXPR_IS_ABS((yyvsp[-2].expr)) || !EXPR_IS_ABS((yyvsp[0].expr))) {
+                    fprintf(stderr, "FILL values must be absolute");
+                }
+
+                int len = (yyvsp[-2].expr)->value;
+                int byte = (yyvsp[0].expr)->value & 0xFF;
+                asm_inc_pc(len);
+                while (len --> 0) {
+                    fputc(byte, yyout);
+                }
+            }
+#line 1543 "y.tab.c"
+    break;
+
+  case 21: /* directive: T_DEFINE T_SYMBOL  */
+#line 135 "src/z80.y"
+                             {
+                symtab_add(asm_symbol_table, (yyvsp[0].sym)->name, ST_OBJECT, SEC_ABS, 1);
+            }
+#line 1551 "y.tab.c"
+    break;
+
+  case 22: /* directive: T_UNDEFINE T_SYMBOL  */
+#line 138 "src/z80.y"
+                               {
+                symtab_add(asm_symbol_table, (yyvsp[0].sym)->name, ST_UNDEF, SEC_UNDEF, 0);
+            }
+#line 1559 "y.tab.c"
+    break;
+
+  case 23: /* db_operand: expr  */
+#line 143 "src/z80.y"
+                 {
+                reltab_add_expr(asm_reloc_table,
+                        RT_8_BIT, asm_get_pc()->sec, asm_get_pc()->value, 0, (yyvsp[0].expr));
+                expr_free((yyvsp[0].expr));
+                fputc(0, yyout);
+                asm_inc_pc(1);
+            }
+#line 1571 "y.tab.c"
+    break;
+
+  case 24: /* db_operand: T_STRING  */
+#line 150 "src/z80.y"
+                     {
+                int len = strlen((yyvsp[0].str));
+                fwrite((yyvsp[0].str), 1, len, yyout);
+                asm_inc_pc(len);
+                free((yyvsp[0].str));
+            }
+#line 1582 "y.tab.c"
+    break;
+
+  case 27: /* dw_operand: expr  */
+#line 162 "src/z80.y"
+                 {
+                reltab_add_expr(asm_reloc_table,
+                        RT_16_BIT, asm_get_pc()->sec, asm_get_pc()->value, 0, (yyvsp[0].expr));
+                expr_free((yyvsp[0].expr));
+                fputc(0, yyout);
+                asm_inc_pc(2);
+            }
+#line 1594 "y.tab.c"
+    break;
+
+  case 30: /* instruction: T_OPCODE  */
+#line 176 "src/z80.y"
+                { instr_match_and_output((yyvsp[0].oc), 0, 0); }
+#line 1600 "y.tab.c"
+    break;
+
+  case 31: /* instruction: T_OPCODE instr_operand  */
+#line 178 "src/z80.y"
+                { instr_match_and_output((yyvsp[-1].oc), &(yyvsp[0].op), 0); }
+#line 1606 "y.tab.c"
+    break;
+
+  case 32: /* instruction: T_OPCODE instr_operand ',' instr_operand  */
+#line 180 "src/z80.y"
+                { instr_match_and_output((yyvsp[-3].oc), &(yyvsp[-2].op), &(yyvsp[0].op)); }
+#line 1612 "y.tab.c"
+    break;
+
+  case 33: /* instr_operand: expr_top  */
+#line 184 "src/z80.y"
+                { (yyval.op).type = OP_IMM; (yyval.op).expr = (yyvsp[0].expr); }
+#line 1618 "y.tab.c"
+    break;
+
+  case 34: /* instr_operand: '(' expr ')'  */
+#line 186 "src/z80.y"
+                { (yyval.op).type = OP_EXT; (yyval.op).expr = (yyvsp[-1].expr); }
+#line 1624 "y.tab.c"
+    break;
+
+  case 35: /* instr_operand: register  */
+#line 188 "src/z80.y"
+                { (yyval.op) = (yyvsp[0].op); }
+#line 1630 "y.tab.c"
+    break;
+
+  case 36: /* instr_operand: register_indir  */
+#line 190 "src/z80.y"
+                { (yyval.op) = (yyvsp[0].op); }
+#line 1636 "y.tab.c"
+    break;
+
+  case 37: /* instr_operand: register_idx_indir  */
+#line 192 "src/z80.y"
+                { (yyval.op) = (yyvsp[0].op); }
+#line 1642 "y.tab.c"
+    break;
+
+  case 38: /* instr_operand: flag  */
+#line 194 "src/z80.y"
+                { (yyval.op) = (yyvsp[0].op); }
+#line 1648 "y.tab.c"
+    break;
+
+  case 39: /* register_8: T_A  */
+#line 197 "src/z80.y"
+                    { (yyval.op).type = OP_A; }
+#line 1654 "y.tab.c"
+    break;
+
+  case 40: /* register_8: T_B  */
+#line 198 "src/z80.y"
+                    { (yyval.op).type = OP_B; }
+#line 1660 "y.tab.c"
+    break;
+
+  case 41: /* register_8: T_C  */
+#line 199 "src/z80.y"
+                    { (yyval.op).type = OP_C; }
+#line 1666 "y.tab.c"
+    break;
+
+  case 42: /* register_8: T_D  */
+#line 200 "src/z80.y"
+                    { (yyval.op).type = OP_D; }
+#line 1672 "y.tab.c"
+    break;
+
+  case 43: /* register_8: T_E  */
+#line 201 "src/z80.y"
+                    { (yyval.op).type = OP_E; }
+#line 1678 "y.tab.c"
+    break;
+
+  case 44: /* register_8: T_F  */
+#line 202 "src/z80.y"
+                    { (yyval.op).type = OP_F; }
+#line 1684 "y.tab.c"
+    break;
+
+  case 45: /* register_8: T_H  */
+#line 203 "src/z80.y"
+                    { (yyval.op).type = OP_H; }
+#line 1690 "y.tab.c"
+    break;
+
+  case 46: /* register_8: T_L  */
+#line 204 "src/z80.y"
+                    { (yyval.op).type = OP_L; }
+#line 1696 "y.tab.c"
+    break;
+
+  case 47: /* register_8: T_IXH  */
+#line 205 "src/z80.y"
+                    { (yyval.op).type = OP_IXH; }
+#line 1702 "y.tab.c"
+    break;
+
+  case 48: /* register_8: T_IXL  */
+#line 206 "src/z80.y"
+                    { (yyval.op).type = OP_IXL; }
+#line 1708 "y.tab.c"
+    break;
+
+  case 49: /* register_8: T_IYH  */
+#line 207 "src/z80.y"
+                    { (yyval.op).type = OP_IYH; }
+#line 1714 "y.tab.c"
+    break;
+
+  case 50: /* register_8: T_IYL  */
+#line 208 "src/z80.y"
+                    { (yyval.op).type = OP_IYL; }
+#line 1720 "y.tab.c"
+    break;
+
+  case 51: /* register_8: T_I  */
+#line 209 "src/z80.y"
+                    { (yyval.op).type = OP_I; }
+#line 1726 "y.tab.c"
+    break;
+
+  case 52: /* register_8: T_R  */
+#line 210 "src/z80.y"
+                    { (yyval.op).type = OP_R; }
+#line 1732 "y.tab.c"
+    break;
+
+  case 53: /* register_16_nonidx: T_AF  */
+#line 213 "src/z80.y"
+                            { (yyval.op).type = OP_AF; }
+#line 1738 "y.tab.c"
+    break;
+
+  case 54: /* register_16_nonidx: T_BC  */
+#line 214 "src/z80.y"
+                            { (yyval.op).type = OP_BC; }
+#line 1744 "y.tab.c"
+    break;
+
+  case 55: /* register_16_nonidx: T_DE  */
+#line 215 "src/z80.y"
+                            { (yyval.op).type = OP_DE; }
+#line 1750 "y.tab.c"
+    break;
+
+  case 56: /* register_16_nonidx: T_HL  */
+#line 216 "src/z80.y"
+                            { (yyval.op).type = OP_HL; }
+#line 1756 "y.tab.c"
+    break;
+
+  case 57: /* register_16_nonidx: T_SP  */
+#line 217 "src/z80.y"
+                            { (yyval.op).type = OP_SP; }
+#line 1762 "y.tab.c"
+    break;
+
+  case 58: /* register_16_idx: T_IX  */
+#line 220 "src/z80.y"
+                        { (yyval.op).type = OP_IX; }
+#line 1768 "y.tab.c"
+    break;
+
+  case 59: /* register_16_idx: T_IY  */
+#line 221 "src/z80.y"
+                        { (yyval.op).type = OP_IY; }
+#line 1774 "y.tab.c"
+    break;
+
+  case 62: /* register_shadow: T_sAF  */
+#line 227 "src/z80.y"
+                        { (yyval.op).type = OP_sAF; }
+#line 1780 "y.tab.c"
+    break;
+
+  case 66: /* register_indir: '(' register_16_nonidx ')'  */
+#line 234 "src/z80.y"
+                { (yyval.op).type = op_type_indir((yyvsp[-1].op).type); }
+#line 1786 "y.tab.c"
+    break;
+
+  case 67: /* register_indir: '(' T_A ')'  */
+#line 236 "src/z80.y"
+                { (yyval.op).type = OP_iA; }
+#line 1792 "y.tab.c"
+    break;
+
+  case 68: /* register_indir: '(' T_C ')'  */
+#line 238 "src/z80.y"
+                { (yyval.op).type = OP_iC; }
+#line 1798 "y.tab.c"
+    break;
+
+  case 69: /* register_idx_indir: '(' register_16_idx ')'  */
+#line 242 "src/z80.y"
+                      { (yyval.op).type = op_type_indir((yyvsp[-1].op).type);
+                        (yyval.op).expr = expr_alloc_const(SEC_ABS, 0); }
+#line 1805 "y.tab.c"
+    break;
+
+  case 70: /* register_idx_indir: '(' register_16_idx '+' expr ')'  */
+#line 245 "src/z80.y"
+                      { (yyval.op).type = op_type_indir((yyvsp[-3].op).type);
+                        (yyval.op).expr = (yyvsp[-1].expr); }
+#line 1812 "y.tab.c"
+    break;
+
+  case 71: /* register_idx_indir: '(' register_16_idx '-' expr ')'  */
+#line 248 "src/z80.y"
+                      { (yyval.op).type = op_type_indir((yyvsp[-3].op).type);
+                        (yyval.op).expr = expr_alloc(ET_NEG, (yyvsp[-1].expr), NULL); }
+#line 1819 "y.tab.c"
+    break;
+
+  case 72: /* register_idx_indir: '(' expr '+' register_16_idx ')'  */
+#line 251 "src/z80.y"
+                      { (yyval.op).type = op_type_indir((yyvsp[-1].op).type);
+                        (yyval.op).expr = (yyvsp[-3].expr); }
+#line 1826 "y.tab.c"
+    break;
+
+  case 73: /* register_idx_indir: '(' expr '+' register_16_idx '+' expr ')'  */
+#line 254 "src/z80.y"
+                      { (yyval.op).type = op_type_indir((yyvsp[-3].op).type);
+                        (yyval.op).expr = expr_alloc('+', (yyvsp[-5].expr), (yyvsp[-1].expr)); }
+#line 1833 "y.tab.c"
+    break;
+
+  case 74: /* register_idx_indir: '(' expr '+' register_16_idx '-' expr ')'  */
+#line 257 "src/z80.y"
+                      { (yyval.op).type = op_type_indir((yyvsp[-3].op).type);
+                        (yyval.op).expr = expr_alloc('-', (yyvsp[-5].expr), (yyvsp[-1].expr)); }
+#line 1840 "y.tab.c"
+    break;
+
+  case 75: /* flag: T_fNZ  */
+#line 261 "src/z80.y"
+            { (yyval.op).type = OP_fNZ; }
+#line 1846 "y.tab.c"
+    break;
+
+  case 76: /* flag: T_fZ  */
+#line 262 "src/z80.y"
+            { (yyval.op).type = OP_fZ; }
+#line 1852 "y.tab.c"
+    break;
+
+  case 77: /* flag: T_fNC  */
+#line 263 "src/z80.y"
+            { (yyval.op).type = OP_fNC; }
+#line 1858 "y.tab.c"
+    break;
+
+  case 78: /* flag: T_fC  */
+#line 264 "src/z80.y"
+            { (yyval.op).type = OP_fC; }
+#line 1864 "y.tab.c"
+    break;
+
+  case 79: /* flag: T_fPO  */
+#line 265 "src/z80.y"
+            { (yyval.op).type = OP_fPO; }
+#line 1870 "y.tab.c"
+    break;
+
+  case 80: /* flag: T_fPE  */
+#line 266 "src/z80.y"
+            { (yyval.op).type = OP_fPE; }
+#line 1876 "y.tab.c"
+    break;
+
+  case 81: /* flag: T_fP  */
+#line 267 "src/z80.y"
+            { (yyval.op).type = OP_fP; }
+#line 1882 "y.tab.c"
+    break;
+
+  case 82: /* flag: T_fM  */
+#line 268 "src/z80.y"
+            { (yyval.op).type = OP_fM; }
+#line 1888 "y.tab.c"
+    break;
+
+  case 83: /* expr_top: '$'  */
+#line 271 "src/z80.y"
+                                { (yyval.expr) = expr_clone(asm_get_pc()); }
+#line 1894 "y.tab.c"
+    break;
+
+  case 84: /* expr_top: T_LITERAL  */
+#line 272 "src/z80.y"
+                                { (yyval.expr) = expr_alloc_const(SEC_ABS, (yyvsp[0].i)); }
+#line 1900 "y.tab.c"
+    break;
+
+  case 85: /* expr_top: T_SYMBOL  */
+#line 273 "src/z80.y"
+                                { (yyval.expr) = expr_alloc_sym((yyvsp[0].sym)); }
+#line 1906 "y.tab.c"
+    break;
+
+  case 86: /* expr_top: '+' expr  */
+#line 274 "src/z80.y"
+                                { (yyval.expr) = (yyvsp[0].expr); }
+#line 1912 "y.tab.c"
+    break;
+
+  case 87: /* expr_top: '-' expr  */
+#line 275 "src/z80.y"
+                                { (yyval.expr) = expr_alloc(ET_NEG, (yyvsp[0].expr), NULL); }
+#line 1918 "y.tab.c"
+    break;
+
+  case 88: /* expr_top: '~' expr  */
+#line 276 "src/z80.y"
+                                { (yyval.expr) = expr_alloc('~', (yyvsp[0].expr), NULL); }
+#line 1924 "y.tab.c"
+    break;
+
+  case 89: /* expr_top: expr '*' expr  */
+#line 277 "src/z80.y"
+                                { (yyval.expr) = expr_alloc('*', (yyvsp[-2].expr), (yyvsp[0].expr)); }
+#line 1930 "y.tab.c"
+    break;
+
+  case 90: /* expr_top: expr '/' expr  */
+#line 278 "src/z80.y"
+                                { (yyval.expr) = expr_alloc('/', (yyvsp[-2].expr), (yyvsp[0].expr)); }
+#line 1936 "y.tab.c"
+    break;
+
+  case 91: /* expr_top: expr '%' expr  */
+#line 279 "src/z80.y"
+                                { (yyval.expr) = expr_alloc('%', (yyvsp[-2].expr), (yyvsp[0].expr)); }
+#line 1942 "y.tab.c"
+    break;
+
+  case 92: /* expr_top: expr '+' expr  */
+#line 280 "src/z80.y"
+                                { (yyval.expr) = expr_alloc('+', (yyvsp[-2].expr), (yyvsp[0].expr)); }
+#line 1948 "y.tab.c"
+    break;
+
+  case 93: /* expr_top: expr '-' expr  */
+#line 281 "src/z80.y"
+                                { (yyval.expr) = expr_alloc('-', (yyvsp[-2].expr), (yyvsp[0].expr)); }
+#line 1954 "y.tab.c"
+    break;
+
+  case 94: /* expr_top: expr '&' expr  */
+#line 282 "src/z80.y"
+                                { (yyval.expr) = expr_alloc('&', (yyvsp[-2].expr), (yyvsp[0].expr)); }
+#line 1960 "y.tab.c"
+    break;
+
+  case 95: /* expr_top: expr '^' expr  */
+#line 283 "src/z80.y"
+                                { (yyval.expr) = expr_alloc('^', (yyvsp[-2].expr), (yyvsp[0].expr)); }
+#line 1966 "y.tab.c"
+    break;
+
+  case 96: /* expr_top: expr '|' expr  */
+#line 284 "src/z80.y"
+                                { (yyval.expr) = expr_alloc('|', (yyvsp[-2].expr), (yyvsp[0].expr)); }
+#line 1972 "y.tab.c"
+    break;
+
+  case 97: /* expr: expr_top  */
+#line 287 "src/z80.y"
+                    { (yyval.expr) = (yyvsp[0].expr); }
+#line 1978 "y.tab.c"
+    break;
+
+  case 98: /* expr: '(' expr ')'  */
+#line 288 "src/z80.y"
+                    { (yyval.expr) = (yyvsp[-1].expr); }
+#line 1984 "y.tab.c"
+    break;
+
+
+#line 1988 "y.tab.c"
+
+      default: break;
+    }
+  /* User semantic actions sometimes alter yychar, and that requires
+     that yytoken be updated with the new translation.  We take the
+     approach of translating immediately before every use of yytoken.
+     One alternative is translating here after every semantic action,
+     but that translation would be missed if the semantic action invokes
+     YYABORT, YYACCEPT, or YYERROR immediately after altering yychar or
+     if it invokes YYBACKUP.  In the case of YYABORT or YYACCEPT, an
+     incorrect destructor might then be invoked immediately.  In the
+     case of YYERROR or YYBACKUP, subsequent parser actions might lead
+     to an incorrect destructor call or verbose syntax error message
+     before the lookahead is translated.  */
+  YY_SYMBOL_PRINT ("-> $$ =", YY_CAST (yysymbol_kind_t, yyr1[yyn]), &yyval, &yyloc);
+
+  YYPOPSTACK (yylen);
+  yylen = 0;
+
+  *++yyvsp = yyval;
+
+  /* Now 'shift' the result of the reduction.  Determine what state
+     that goes to, based on the state we popped back to and the rule
+     number reduced by.  */
+  {
+    const int yylhs = yyr1[yyn] - YYNTOKENS;
+    const int yyi = yypgoto[yylhs] + *yyssp;
+    yystate = (0 <= yyi && yyi <= YYLAST && yycheck[yyi] == *yyssp
+               ? yytable[yyi]
+               : yydefgoto[yylhs]);
+  }
+
+  goto yynewstate;
+
+
+/*--------------------------------------.
+| yyerrlab -- here on detecting error.  |
+`--------------------------------------*/
+yyerrlab:
+  /* Make sure we have latest lookahead translation.  See comments at
+     user semantic actions for why this is necessary.  */
+  yytoken = yychar == YYEMPTY ? YYSYMBOL_YYEMPTY : YYTRANSLATE (yychar);
+  /* If not already recovering from an error, report this error.  */
+  if (!yyerrstatus)
+    {
+      ++yynerrs;
+      yyerror (YY_("syntax error"));
+    }
+
+  if (yyerrstatus == 3)
+    {
+      /* If just tried and failed to reuse lookahead token after an
+         error, discard it.  */
+
+      if (yychar <= YYEOF)
+        {
+          /* Return failure if at end of input.  */
+          if (yychar == YYEOF)
+            YYABORT;
+        }
+      else
+        {
+          yydestruct ("Error: discarding",
+                      yytoken, &yylval);
+          yychar = YYEMPTY;
+        }
+    }
+
+  /* Else will try to reuse lookahead token after shifting the error
+     token.  */
+  goto yyerrlab1;
+
+
+/*---------------------------------------------------.
+| yyerrorlab -- error raised explicitly by YYERROR.  |
+`---------------------------------------------------*/
+yyerrorlab:
+  /* Pacify compilers when the user code never invokes YYERROR and the
+     label yyerrorlab therefore never appears in user code.  */
+  if (0)
+    YYERROR;
+  ++yynerrs;
+
+  /* Do not reclaim the symbols of the rule whose action triggered
+     this YYERROR.  */
+  YYPOPSTACK (yylen);
+  yylen = 0;
+  YY_STACK_PRINT (yyss, yyssp);
+  yystate = *yyssp;
+  goto yyerrlab1;
+
+
+/*-------------------------------------------------------------.
+| yyerrlab1 -- common code for both syntax error and YYERROR.  |
+`-------------------------------------------------------------*/
+yyerrlab1:
+  yyerrstatus = 3;      /* Each real token shifted decrements this.  */
+
+  /* Pop stack until we find a state that shifts the error token.  */
+  for (;;)
+    {
+      yyn = yypact[yystate];
+      if (!yypact_value_is_default (yyn))
+        {
+          yyn += YYSYMBOL_YYerror;
+          if (0 <= yyn && yyn <= YYLAST && yycheck[yyn] == YYSYMBOL_YYerror)
+            {
+              yyn = yytable[yyn];
+              if (0 < yyn)
+                break;
+            }
+        }
+
+      /* Pop the current state because it cannot handle the error token.  */
+      if (yyssp == yyss)
+        YYABORT;
+
+
+      yydestruct ("Error: popping",
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp);
+      YYPOPSTACK (1);
+      yystate = *yyssp;
+      YY_STACK_PRINT (yyss, yyssp);
+    }
+
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  *++yyvsp = yylval;
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+
+
+  /* Shift the error token.  */
+  YY_SYMBOL_PRINT ("Shifting", YY_ACCESSING_SYMBOL (yyn), yyvsp, yylsp);
+
+  yystate = yyn;
+  goto yynewstate;
+
+
+/*-------------------------------------.
+| yyacceptlab -- YYACCEPT comes here.  |
+`-------------------------------------*/
+yyacceptlab:
+  yyresult = 0;
+  goto yyreturnlab;
+
+
+/*-----------------------------------.
+| yyabortlab -- YYABORT comes here.  |
+`-----------------------------------*/
+yyabortlab:
+  yyresult = 1;
+  goto yyreturnlab;
+
+
+/*-----------------------------------------------------------.
+| yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
+`-----------------------------------------------------------*/
+yyexhaustedlab:
+  yyerror (YY_("memory exhausted"));
+  yyresult = 2;
+  goto yyreturnlab;
+
+
+/*----------------------------------------------------------.
+| yyreturnlab -- parsing is finished, clean up and return.  |
+`----------------------------------------------------------*/
+yyreturnlab:
+  if (yychar != YYEMPTY)
+    {
+      /* Make sure we have latest lookahead translation.  See comments at
+         user semantic actions for why this is necessary.  */
+      yytoken = YYTRANSLATE (yychar);
+      yydestruct ("Cleanup: discarding lookahead",
+                  yytoken, &yylval);
+    }
+  /* Do not reclaim the symbols of the rule whose action triggered
+     this YYABORT or YYACCEPT.  */
+  YYPOPSTACK (yylen);
+  YY_STACK_PRINT (yyss, yyssp);
+  while (yyssp != yyss)
+    {
+      yydestruct ("Cleanup: popping",
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp);
+      YYPOPSTACK (1);
+    }
+#ifndef yyoverflow
+  if (yyss != yyssa)
+    YYSTACK_FREE (yyss);
+#endif
+
+  return yyresult;
+}
+
+#line 291 "src/z80.y"
+
+
+int instr_match_and_output(const struct opcode *oc,
+        struct operand *op1, struct operand *op2) {
+    const struct instruction *instr = opcode_match(oc, op1, op2);
+    int ret;
+
+    if (instr) {
+        ret = instr_output(instr, op1, op2, yyout);
+    } else {
+        yyerror("Undefined instruction");
+        ret = -1;
+    }
+
+    /* The expressions can be freed now since the operands go out of scope after
+     * this function is called in the instruction rule.
+     */
+    operand_free_expr(op1);
+    operand_free_expr(op2);
+
+    return ret;
+}
+
+/* vim: set tw=80 ft=yacc: */
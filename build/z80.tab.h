@@ -0,0 +1,210 @@
+/* A Bison parser, made by GNU Bison 3.8.2.  */
+
+/* Bison interface for Yacc-like parsers in C
+
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+/* As a special exception, you may create a larger work that contains
+   part or all of the Bison parser skeleton and distribute that work
+   under terms of your choice, so long as that work isn't itself a
+   parser generator using the skeleton or a modified version thereof
+   as a parser skeleton.  Alternatively, if you modify or redistribute
+   the parser skeleton itself, you may (at your option) remove this
+   special exception, which will cause the skeleton and the resulting
+   Bison output files to be licensed under the GNU General Public
+   License without this special exception.
+
+   This special exception was added by the Free Software Foundation in
+   version 2.2 of Bison.  */
+
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
+#ifndef YY_YY_Y_TAB_H_INCLUDED
+# define YY_YY_Y_TAB_H_INCLUDED
+/* Debug traces.  */
+#ifndef YYDEBUG
+# define YYDEBUG 0
+#endif
+#if YYDEBUG
+extern int yydebug;
+#endif
+
+/* Token kinds.  */
+#ifndef YYTOKENTYPE
+# define YYTOKENTYPE
+  enum yytokentype
+  {
+    YYEMPTY = -2,
+    YYEOF = 0,                     /* "end of file"  */
+    YYerror = 256,                 /* error  */
+    YYUNDEF = 257,                 /* "invalid token"  */
+    T_EOL = 258,                   /* T_EOL  */
+    T_ERROR = 259,                 /* T_ERROR  */
+    T_TEXT = 260,                  /* T_TEXT  */
+    T_DATA = 261,                  /* T_DATA  */
+    T_ABS = 262,                   /* T_ABS  */
+    T_ORG = 263,                   /* T_ORG  */
+    T_DB = 264,                    /* T_DB  */
+    T_DW = 265,                    /* T_DW  */
+    T_FILL = 266,                  /* T_FILL  */
+    T_EQU = 267,                   /* T_EQU  */
+    T_DEFINE = 268,                /* T_DEFINE  */
+    T_UNDEFINE = 269,              /* T_UNDEFINE  */
+    T_LITERAL = 270,               /* T_LITERAL  */
+    T_STRING = 271,                /* T_STRING  */
+    T_OPCODE = 272,                /* T_OPCODE  */
+    T_SYMBOL = 273,                /* T_SYMBOL  */
+    T_LABEL = 274,                 /* T_LABEL  */
+    T_LLABEL = 275,                /* T_LLABEL  */
+    T_FLABEL = 276,                /* T_FLABEL  */
+    T_A = 277,                     /* T_A  */
+    T_B = 278,                     /* T_B  */
+    T_C = 279,                     /* T_C  */
+    T_D = 280,                     /* T_D  */
+    T_E = 281,                     /* T_E  */
+    T_F = 282,                     /* T_F  */
+    T_H = 283,                     /* T_H  */
+    T_L = 284,                     /* T_L  */
+    T_IXH = 285,                   /* T_IXH  */
+    T_IXL = 286,                   /* T_IXL  */
+    T_IYH = 287,                   /* T_IYH  */
+    T_IYL = 288,                   /* T_IYL  */
+    T_I = 289,                     /* T_I  */
+    T_R = 290,                     /* T_R  */
+    T_AF = 291,                    /* T_AF  */
+    T_BC = 292,                    /* T_BC  */
+    T_DE = 293,                    /* T_DE  */
+    T_HL = 294,                    /* T_HL  */
+    T_SP = 295,                    /* T_SP  */
+    T_IX = 296,                    /* T_IX  */
+    T_IY = 297,                    /* T_IY  */
+    T_sAF = 298,                   /* T_sAF  */
+    T_fNZ = 299,                   /* T_fNZ  */
+    T_fZ = 300,                    /* T_fZ  */
+    T_fNC = 301,                   /* T_fNC  */
+    T_fC = 302,                    /* T_fC  */
+    T_fPO = 303,                   /* T_fPO  */
+    T_fPE = 304,                   /* T_fPE  */
+    T_fP = 305,                    /* T_fP  */
+    T_fM = 306,                    /* T_fM  */
+    T_EQ = 307,                    /* T_EQ  */
+    T_NE = 308,                    /* T_NE  */
+    T_LE = 309,                    /* T_LE  */
+    T_GE = 310,                    /* T_GE  */
+    T_LOR = 311,                   /* T_LOR  */
+    T_LAND = 312,                  /* T_LAND  */
+    UNARY = 313                    /* UNARY  */
+  };
+  typedef enum yytokentype yytoken_kind_t;
+#endif
+/* Token kinds.  */
+#define YYEMPTY -2
+#define YYEOF 0
+#define YYerror 256
+#define YYUNDEF 257
+#define T_EOL 258
+#define T_ERROR 259
+#define T_TEXT 260
+#define T_DATA 261
+#define T_ABS 262
+#define T_ORG 263
+#define T_DB 264
+#define T_DW 265
+#define T_FILL 266
+#define T_EQU 267
+#define T_DEFINE 268
+#define T_UNDEFINE 269
+#define T_LITERAL 270
+#define T_STRING 271
+#define T_OPCODE 272
+#define T_SYMBOL 273
+#define T_LABEL 274
+#define T_LLABEL 275
+#define T_FLABEL 276
+#define T_A 277
+#define T_B 278
+#define T_C 279
+#define T_D 280
+#define T_E 281
+#define T_F 282
+#define T_H 283
+#define T_L 284
+#define T_IXH 285
+#define T_IXL 286
+#define T_IYH 287
+#define T_IYL 288
+#define T_I 289
+#define T_R 290
+#define T_AF 291
+#define T_BC 292
+#define T_DE 293
+#define T_HL 294
+#define T_SP 295
+#define T_IX 296
+#define T_IY 297
+#define T_sAF 298
+#define T_fNZ 299
+#define T_fZ 300
+#define T_fNC 301
+#define T_fC 302
+#define T_fPO 303
+#define T_fPE 304
+#define T_fP 305
+#define T_fM 306
+#define T_EQ 307
+#define T_NE 308
+#define T_LE 309
+#define T_GE 310
+#define T_LOR 311
+#define T_LAND 312
+#define UNARY 313
+
+/* Value type.  */
+#if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
+union YYSTYPE
+{
+#line 26 "src/z80.y"
+
+    int i;
+    char *str;
+    struct {
+        int len;
+        uint8_t *data;
+    } buf;
+    struct expr_node *expr;
+    struct operand op;
+    const struct opcode *oc;
+    const struct symbol_ent *sym;
+
+#line 196 "y.tab.h"
+
+};
+typedef union YYSTYPE YYSTYPE;
+# define YYSTYPE_IS_TRIVIAL 1
+# define YYSTYPE_IS_DECLARED 1
+#endif
+
+
+extern YYSTYPE yylval;
+
+
+int yyparse (void);
+
+
+#endif /* !YY_YY_Y_TAB_H_INCLUDED  */
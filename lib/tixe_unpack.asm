@@ -0,0 +1,65 @@
+; tixe_unpack.asm
+; Unpacks the image of a packed TIXE executable (see src/pack.h for the
+; format). Run this in place of copying the image; it leaves the registers set
+; up for tixe_load, so the two can be called one after the other:
+;     call tixe_unpack
+;     call tixe_load
+;
+; Each command is a run of literal bytes or a copy of earlier output, and is
+; done with a single ldir, so the time is mostly the 21 T-states per byte of
+; the copies themselves:
+;   literals (1 - 128 bytes)      40 + 21n
+;   match (3 - 129 bytes)        127 + 21n
+;   end                           76
+;   setup                         18
+; tixasm reports the total for each image it packs.
+;
+; In:  HL = packed image
+;      DE = load address
+; Out: HL = load address
+;      BC = address after the packed image (the relocation table)
+;      DE = address after the unpacked image
+;      AF is destroyed
+
+tixe_unpack:
+    push de
+
+    ; B stays 0, since each ldir leaves BC at 0
+    ld b, 0
+
+.next:
+    ld a, (hl)
+    inc hl
+    cp $80
+    jr nc, .match
+
+    ld c, a
+    inc c
+    ldir
+    jp .next
+
+.match:
+    ; $FF becomes 0, and $80 - $FE become 3 - 129 after the subtraction
+    inc a
+    jr z, .end
+    sub $7E
+    ld c, a
+
+    ; Copy from the load position plus the (negative) offset
+    push hl
+    ld a, (hl)
+    inc hl
+    ld h, (hl)
+    ld l, a
+    add hl, de
+    ldir
+    pop hl
+    inc hl
+    inc hl
+    jp .next
+
+.end:
+    ld b, h
+    ld c, l
+    pop hl
+    ret
@@ -0,0 +1,536 @@
+/**
+ * @file chunk.c
+ *
+ * The assembler (like the parser and scanner) keeps its state in globals, so
+ * chunks are assembled by forked processes rather than threads. Each one gets
+ * a copy of the parent's memory, including the mapped source file, and sends
+ * back its object in the .tixo format through a pipe.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "chunk.h"
+#include "include.h"
+#include "opcode.h"
+#include "tixasm.h"
+#include "z80.tab.h"
+
+#define ARR_LEN(arr) (sizeof(arr) / sizeof(*(arr)))
+
+extern int yylineno;
+
+/**
+ * Directives which prevent a file from being split.
+ * The scanners match directives as prefixes of identifiers, so these are too.
+ * .incbin is safe to assemble in a chunk, but then the chunk's object would
+ * depend on more than its own text, which chunk_reassemble() relies on.
+ */
+static const char *const chunk_unsafe[] = {
+    "org", "abs", "if", "else", "endif", "macro", "endm", "rept", "endr",
+    "include", "incbin", "once", "undefine",
+};
+
+/**
+ * A range of lines of the file.
+ */
+struct chunk {
+    size_t start;
+    size_t size;
+
+    /**
+     * Line number of the first line.
+     */
+    int line;
+
+    /**
+     * Section at the start of the chunk.
+     */
+    enum section sec;
+
+    pid_t pid;
+
+    /**
+     * Read end of the pipe the object is sent through.
+     */
+    int fd;
+
+    /**
+     * Output of the child, which is only shown if all of the chunks assemble.
+     */
+    FILE *log;
+};
+
+static int chunk_is_ident(char c) {
+    return isalnum((unsigned char) c) || c == '_';
+}
+
+/**
+ * Checks whether a directive (or local label) starts with a name, ignoring case
+ * as the scanners do.
+ * @return 1 if it is exactly @p name, 2 if it is longer, 0 if it does not
+ * start with @p name.
+ */
+static int chunk_match_dir(const char *ptr, const char *end, const char *name) {
+    size_t len = strlen(name);
+    if ((size_t) (end - ptr) < len || strncasecmp(ptr, name, len) != 0) {
+        return 0;
+    }
+
+    return ptr + len < end && chunk_is_ident(ptr[len]) ? 2 : 1;
+}
+
+int chunk_check_line(const char *line, const char *end, enum section *sec) {
+    for (const char *ptr = line; ptr < end; ptr++) {
+        switch (*ptr) {
+        case ';':
+            return 0;
+
+        case '"':
+            /* Strings can't be split across lines (safely, anyway) */
+            for (ptr++; ptr < end && *ptr != '"'; ptr++) {
+                if (*ptr == '\\') {
+                    ptr++;
+                }
+            }
+
+            if (ptr >= end) {
+                return -1;
+            }
+            break;
+
+        case '\'':
+            /* Skip character literals, which may be ';' or '"' (but not the
+             * quote of af')
+             */
+            if (ptr > line && chunk_is_ident(ptr[-1])) {
+                break;
+            }
+
+            ptr += ptr + 1 < end && ptr[1] == '\\' ? 3 : 2;
+            break;
+
+        case '.':
+            if (ptr > line && chunk_is_ident(ptr[-1])) {
+                break;
+            }
+
+            for (int i = 0; i < ARR_LEN(chunk_unsafe); i++) {
+                if (chunk_match_dir(ptr + 1, end, chunk_unsafe[i])) {
+                    return -1;
+                }
+            }
+
+            /* Whether a longer name is a local label or the directive followed
+             * by something else depends on the scanner state, so give up.
+             */
+            switch (chunk_match_dir(ptr + 1, end, "text")) {
+            case 1:
+                *sec = SEC_TEXT;
+                break;
+            case 2:
+                return -1;
+            }
+
+            switch (chunk_match_dir(ptr + 1, end, "data")) {
+            case 1:
+                *sec = SEC_DATA;
+                break;
+            case 2:
+                return -1;
+            }
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Checks whether a line starts with the definition of a global label.
+ */
+static int chunk_is_label(const char *line, const char *end) {
+    const char *ptr = line;
+
+    if (ptr >= end || !(isalpha((unsigned char) *ptr) || *ptr == '_')) {
+        return 0;
+    }
+
+    while (ptr < end && chunk_is_ident(*ptr)) {
+        ptr++;
+    }
+
+    /* _ is an anonymous label, which doesn't start a scope */
+    return ptr < end && *ptr == ':' && !(ptr - line == 1 && *line == '_');
+}
+
+/**
+ * Splits a file into chunks.
+ * @param file File to split.
+ * @param jobs Maximum number of chunks.
+ * @param[out] chunks Set to the chunks. This must have room for @p jobs.
+ * @return Number of chunks, or -1 if the file can't be split.
+ */
+static int chunk_split(const struct include_file *file, int jobs,
+        struct chunk chunks[]) {
+    const char *data = file->data;
+    const char *end = data + file->size;
+    size_t target = file->size / jobs;
+    enum section sec = SEC_ABS;
+    int count = 1;
+    int line = 1;
+
+    chunks[0].start = 0;
+    chunks[0].line = 1;
+    chunks[0].sec = SEC_ABS;
+
+    for (const char *ptr = data; ptr < end; line++) {
+        const char *eol = memchr(ptr, '\n', end - ptr);
+        if (!eol) {
+            eol = end;
+        }
+
+        /* The absolute section's program counter doesn't start at 0 in
+         * another chunk, so only split in text and data
+         */
+        if (count < jobs && (size_t) (ptr - data) >= count * target
+                && sec != SEC_ABS && chunk_is_label(ptr, eol)) {
+            chunks[count - 1].size = (ptr - data) - chunks[count - 1].start;
+            chunks[count].start = ptr - data;
+            chunks[count].line = line;
+            chunks[count].sec = sec;
+            count++;
+        }
+
+        if (chunk_check_line(ptr, eol, &sec) < 0) {
+            return -1;
+        }
+
+        ptr = eol + 1;
+    }
+
+    chunks[count - 1].size = file->size - chunks[count - 1].start;
+    return count;
+}
+
+/**
+ * Assembles a chunk and writes its object to a pipe. This runs in the child
+ * process and does not return.
+ */
+static void chunk_child(const struct include_file *file,
+        const struct chunk *chunk, int fd) {
+    struct include_file part = *file;
+    struct object obj;
+    FILE *out;
+    int ret = -1;
+
+    dup2(fileno(chunk->log), STDOUT_FILENO);
+    dup2(fileno(chunk->log), STDERR_FILENO);
+
+    /* This is the child's own copy of the file, so it can be cut off where the
+     * next chunk starts (the scanners need the two null bytes).
+     */
+    part.data += chunk->start;
+    part.size = chunk->size;
+    part.data[part.size] = 0;
+    part.data[part.size + 1] = 0;
+
+    if (asm_init() < 0) {
+        _exit(EXIT_FAILURE);
+    }
+
+    asm_set_sec(chunk->sec);
+    lex_push_file(&part);
+    yylineno = chunk->line;
+
+    if (yyparse() == 0) {
+        asm_close_scope();
+        ret = asm_to_object(&obj, file->path);
+    }
+
+    if (ret == 0) {
+        out = fdopen(fd, "wb");
+        if (!out || object_write(&obj, out) < 0 || fclose(out) != 0) {
+            ret = -1;
+        }
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    _exit(ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * Reads everything from a file descriptor.
+ * @return The data, or NULL on failure. This should be freed.
+ */
+static uint8_t *chunk_read_all(int fd, size_t *size) {
+    size_t capacity = 4096;
+    uint8_t *data = malloc(capacity);
+    ssize_t len;
+
+    *size = 0;
+    while (data) {
+        if (*size == capacity) {
+            uint8_t *tmp = realloc(data, capacity * 2);
+            if (!tmp) {
+                break;
+            }
+
+            data = tmp;
+            capacity *= 2;
+        }
+
+        len = read(fd, data + *size, capacity - *size);
+        if (len == 0) {
+            return data;
+        } else if (len < 0) {
+            break;
+        }
+
+        *size += len;
+    }
+
+    free(data);
+    return NULL;
+}
+
+/**
+ * Copies the output of a child to stderr.
+ */
+static void chunk_show_log(FILE *log) {
+    char buf[4096];
+    size_t len;
+
+    rewind(log);
+    while ((len = fread(buf, 1, sizeof(buf), log)) > 0) {
+        fwrite(buf, 1, len, stderr);
+    }
+}
+
+void chunk_cache_init(struct chunk_cache *cache) {
+    memset(cache, 0, sizeof(*cache));
+}
+
+void chunk_cache_destroy(struct chunk_cache *cache) {
+    for (int i = 0; i < cache->count; i++) {
+        free(cache->texts[i]);
+        object_destroy(&cache->objs[i]);
+    }
+
+    cache->count = 0;
+}
+
+/**
+ * Finds a cached chunk with the same text and starting section as a chunk.
+ * @param taken Which cached chunks have already been matched.
+ * @return Index of the cached chunk, or -1 if there is none.
+ */
+static int chunk_cache_find(const struct chunk_cache *cache,
+        const struct include_file *file, const struct chunk *chunk,
+        const int taken[]) {
+    for (int i = 0; i < cache->count; i++) {
+        if (!taken[i] && cache->texts[i] && cache->sizes[i] == chunk->size
+                && cache->secs[i] == chunk->sec
+                && memcmp(cache->texts[i], file->data + chunk->start,
+                    chunk->size) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int chunk_reassemble(const char *path, int jobs, struct chunk_cache *cache) {
+    struct chunk chunks[CHUNK_MAX_JOBS];
+    struct object objs[CHUNK_MAX_JOBS];
+    char *texts[CHUNK_MAX_JOBS];
+    int cached[CHUNK_MAX_JOBS];
+    int taken[CHUNK_MAX_JOBS] = { 0 };
+    struct include_file *file = include_get(path);
+    int count;
+    int started = 0;
+    int failed = 0;
+
+    if (!file || file->size < 2 * CHUNK_MIN_SIZE) {
+        return 0;
+    }
+
+    if (jobs > file->size / CHUNK_MIN_SIZE) {
+        jobs = file->size / CHUNK_MIN_SIZE;
+    }
+
+    if (jobs > CHUNK_MAX_JOBS) {
+        jobs = CHUNK_MAX_JOBS;
+    }
+
+    if (jobs < 2 || (count = chunk_split(file, jobs, chunks)) < 2) {
+        return 0;
+    }
+
+    memset(objs, 0, sizeof(objs));
+    cache->assembled = 0;
+    for (int i = 0; i < count; i++) {
+        cached[i] = chunk_cache_find(cache, file, &chunks[i], taken);
+        if (cached[i] >= 0) {
+            taken[cached[i]] = 1;
+        } else {
+            cache->assembled++;
+        }
+    }
+
+    /* Don't let the children flush anything buffered in the parent */
+    fflush(stdout);
+    fflush(stderr);
+
+    for (; started < count; started++) {
+        struct chunk *chunk = &chunks[started];
+        int fds[2];
+
+        chunk->pid = -1;
+        chunk->log = NULL;
+        if (cached[started] >= 0) {
+            continue;
+        }
+
+        chunk->log = tmpfile();
+        if (!chunk->log) {
+            failed = 1;
+            break;
+        }
+
+        if (pipe(fds) < 0) {
+            fclose(chunk->log);
+            chunk->log = NULL;
+            failed = 1;
+            break;
+        }
+
+        chunk->pid = fork();
+        if (chunk->pid == 0) {
+            close(fds[0]);
+            chunk_child(file, chunk, fds[1]);
+        }
+
+        close(fds[1]);
+        chunk->fd = fds[0];
+        if (chunk->pid < 0) {
+            close(chunk->fd);
+            fclose(chunk->log);
+            chunk->log = NULL;
+            failed = 1;
+            break;
+        }
+    }
+
+    /* Children are blocked until their objects are read, so read them all
+     * before waiting on any
+     */
+    for (int i = 0; i < started; i++) {
+        struct chunk *chunk = &chunks[i];
+        size_t size;
+        uint8_t *data;
+        int status;
+
+        if (chunk->pid < 0) {
+            continue;
+        }
+
+        data = failed ? NULL : chunk_read_all(chunk->fd, &size);
+        close(chunk->fd);
+        if (waitpid(chunk->pid, &status, 0) < 0 || !WIFEXITED(status)
+                || WEXITSTATUS(status) != EXIT_SUCCESS || !data
+                || object_read_data(&objs[i], data, size, path) < 0) {
+            failed = 1;
+        }
+
+        free(data);
+    }
+
+    for (int i = 0; i < started; i++) {
+        if (!chunks[i].log) {
+            continue;
+        }
+
+        if (!failed) {
+            chunk_show_log(chunks[i].log);
+        }
+
+        fclose(chunks[i].log);
+    }
+
+    if (failed) {
+        /* Objects which weren't read are still zeroed, which is safe */
+        for (int i = 0; i < count; i++) {
+            object_destroy(&objs[i]);
+        }
+
+        return 0;
+    }
+
+    /* Move the reused chunks over and drop the rest of the old ones. If the
+     * text of a chunk can't be copied, it just won't be reused.
+     */
+    for (int i = 0; i < count; i++) {
+        if (cached[i] >= 0) {
+            objs[i] = cache->objs[cached[i]];
+            texts[i] = cache->texts[cached[i]];
+        } else {
+            texts[i] = malloc(chunks[i].size ? chunks[i].size : 1);
+            if (texts[i]) {
+                memcpy(texts[i], file->data + chunks[i].start, chunks[i].size);
+            }
+        }
+    }
+
+    for (int i = 0; i < cache->count; i++) {
+        if (!taken[i]) {
+            free(cache->texts[i]);
+            object_destroy(&cache->objs[i]);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        cache->objs[i] = objs[i];
+        cache->texts[i] = texts[i];
+        cache->sizes[i] = chunks[i].size;
+        cache->secs[i] = chunks[i].sec;
+    }
+
+    cache->count = count;
+    return count;
+}
+
+int chunk_assemble(const char *path, int jobs, struct object **objs) {
+    struct chunk_cache cache;
+    int count;
+
+    chunk_cache_init(&cache);
+    count = chunk_reassemble(path, jobs, &cache);
+    if (count == 0) {
+        return 0;
+    }
+
+    *objs = calloc(count, sizeof(**objs));
+    if (!*objs) {
+        chunk_cache_destroy(&cache);
+        return 0;
+    }
+
+    /* Hand the objects over, and free only the texts */
+    memcpy(*objs, cache.objs, count * sizeof(**objs));
+    for (int i = 0; i < count; i++) {
+        free(cache.texts[i]);
+    }
+
+    return count;
+}
+
+/* vim: set tw=80 ft=c: */
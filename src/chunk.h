@@ -0,0 +1,115 @@
+/**
+ * @file chunk.h
+ */
+
+#ifndef CHUNK_H_
+#define CHUNK_H_
+
+#include "object.h"
+#include "section.h"
+
+/**
+ * Files smaller than this are always assembled serially, and no chunk is made
+ * smaller than this.
+ */
+#define CHUNK_MIN_SIZE (128 * 1024)
+
+/**
+ * Maximum number of chunks a file is split into.
+ */
+#define CHUNK_MAX_JOBS 64
+
+/**
+ * Assembles a large source file in parallel.
+ *
+ * The file is split at global labels (where no local label can be referenced
+ * across the split) into chunks of roughly equal size, and each chunk is
+ * assembled into its own object by a separate process. Symbols defined in one
+ * chunk and used in another become relocations, so linking the objects in
+ * order stitches them back together into the same output as assembling the
+ * file as a whole.
+ *
+ * Files using .org, .abs, conditionals, macros, repetition, or includes (or
+ * .incbin) are not split, since how they assemble depends on state which a
+ * chunk does not have. If any chunk fails to assemble (e.g. because an expression refers to
+ * symbols in other chunks in a way which cannot be relocated), nothing is
+ * reported; the file should then be assembled serially, which reports the
+ * errors properly.
+ *
+ * This has to be called while nothing else is being scanned or assembled.
+ * @param path Path of the file.
+ * @param jobs Maximum number of chunks (each one is assembled at the same
+ * time by its own process).
+ * @param[out] objs Set to an array of the objects of the chunks, in order.
+ * Each object and the array should be freed.
+ * @return Number of objects, or 0 if the file should be assembled serially.
+ */
+int chunk_assemble(const char *path, int jobs, struct object **objs);
+
+/**
+ * Objects of the chunks of a file, kept between assemblies so that chunks
+ * whose text has not changed don't have to be assembled again.
+ */
+struct chunk_cache {
+    int count;
+
+    /**
+     * Objects of the chunks, in order.
+     */
+    struct object objs[CHUNK_MAX_JOBS];
+
+    /**
+     * Copy of the text of each chunk and the section it starts in (the only
+     * things its object depends on).
+     */
+    char *texts[CHUNK_MAX_JOBS];
+    size_t sizes[CHUNK_MAX_JOBS];
+    enum section secs[CHUNK_MAX_JOBS];
+
+    /**
+     * Number of chunks which were assembled (as opposed to reused) by the
+     * last call to chunk_reassemble().
+     */
+    int assembled;
+};
+
+/**
+ * Initializes an empty chunk cache.
+ */
+void chunk_cache_init(struct chunk_cache *cache);
+
+/**
+ * Frees the objects and texts of a chunk cache.
+ */
+void chunk_cache_destroy(struct chunk_cache *cache);
+
+/**
+ * Assembles a large source file in parallel, as with chunk_assemble(), but
+ * reuses the objects of chunks which are unchanged since the last call.
+ * Since chunks are split at labels, an edit usually only changes the text of
+ * the one chunk it is in.
+ * @param path Path of the file.
+ * @param jobs Maximum number of chunks.
+ * @param cache Chunks of the last assembly, which are replaced by the new ones
+ * on success (and left alone on failure).
+ * @return Number of objects (in cache->objs), or 0 if the file should be
+ * assembled serially.
+ */
+int chunk_reassemble(const char *path, int jobs, struct chunk_cache *cache);
+
+/**
+ * Checks a line for directives which prevent the file from being split, and
+ * follows changes of section.
+ * This only has to be conservative: strings and comments are skipped so that
+ * they aren't mistaken for directives, but anything which looks like one is
+ * treated as one.
+ * @param line Start of the line.
+ * @param end End of the line (the newline or the end of the file).
+ * @param[in,out] sec Current section.
+ * @return 0 if the line is safe, -1 if not.
+ */
+int chunk_check_line(const char *line, const char *end, enum section *sec);
+
+#endif /* CHUNK_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,108 @@
+/**
+ * @file cond.c
+ */
+
+#include "cond.h"
+#include "macro.h"
+
+void yyerror(char *s);
+
+struct cond_level {
+    /**
+     * Whether one of the branches has been assembled.
+     */
+    int taken;
+
+    /**
+     * Whether the .else has been reached.
+     */
+    int in_else;
+};
+
+static struct cond_level cond_stack[COND_MAX_DEPTH];
+static int cond_top = 0;
+
+/**
+ * Starts skipping input, either in the expansion currently being replayed or
+ * in the scanner.
+ */
+static void cond_skip(void) {
+    if (macro_replaying()) {
+        macro_skip_cond();
+    } else {
+        lex_skip_cond();
+    }
+}
+
+int cond_if(int value) {
+    if (cond_top >= COND_MAX_DEPTH) {
+        yyerror("Conditionals nested too deeply");
+        return -1;
+    }
+
+    cond_stack[cond_top].taken = value;
+    cond_stack[cond_top].in_else = 0;
+    cond_top++;
+
+    if (!value) {
+        cond_skip();
+    }
+
+    return 0;
+}
+
+int cond_else(void) {
+    if (cond_top == 0) {
+        yyerror(".else without .if");
+        return -1;
+    }
+
+    struct cond_level *level = &cond_stack[cond_top-1];
+    if (level->in_else) {
+        yyerror("Multiple .else for one .if");
+        return -1;
+    }
+
+    /* The branch before this was assembled, so skip this one */
+    level->in_else = 1;
+    cond_skip();
+    return 0;
+}
+
+int cond_endif(void) {
+    if (cond_top == 0) {
+        yyerror(".endif without .if");
+        return -1;
+    }
+
+    cond_top--;
+    return 0;
+}
+
+int cond_skip_else(void) {
+    struct cond_level *level = &cond_stack[cond_top-1];
+    if (level->in_else) {
+        yyerror("Multiple .else for one .if");
+        return 0;
+    }
+
+    level->in_else = 1;
+    if (level->taken) {
+        return 0;
+    }
+
+    level->taken = 1;
+    return 1;
+}
+
+void cond_skip_endif(void) {
+    if (cond_top > 0) {
+        cond_top--;
+    }
+}
+
+int cond_depth(void) {
+    return cond_top;
+}
+
+/* vim: set tw=80 ft=c: */
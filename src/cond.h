@@ -0,0 +1,61 @@
+/**
+ * @file cond.h
+ */
+
+#ifndef COND_H_
+#define COND_H_
+
+/**
+ * Maximum nesting depth of conditional blocks.
+ */
+#define COND_MAX_DEPTH 64
+
+/**
+ * Starts a conditional block (.if, .ifdef, .ifndef).
+ * If the condition is false, input is skipped up until the matching .else or
+ * .endif.
+ * @param value Value of the condition.
+ * @return 0 on success, -1 if conditionals are nested too deeply.
+ */
+int cond_if(int value);
+
+/**
+ * Handles an .else which was reached while assembling (i.e. the branch before
+ * it was taken), so everything up until the matching .endif is skipped.
+ * @return 0 on success, -1 if there is no matching .if.
+ */
+int cond_else(void);
+
+/**
+ * Ends a conditional block.
+ * @return 0 on success, -1 if there is no matching .if.
+ */
+int cond_endif(void);
+
+/**
+ * Handles an .else at the same level as the block being skipped.
+ * @return Non-zero if assembly should resume after the .else, 0 if skipping
+ * should continue.
+ */
+int cond_skip_else(void);
+
+/**
+ * Handles the .endif of the block being skipped. Assembly resumes after it.
+ */
+void cond_skip_endif(void);
+
+/**
+ * Gets the nesting depth of conditional blocks.
+ */
+int cond_depth(void);
+
+/**
+ * Starts skipping a false branch in the scanner. This only looks for nested
+ * conditionals and line ends.
+ * Implemented in z80.l.
+ */
+void lex_skip_cond(void);
+
+#endif /* COND_H_ */
+
+/* vim: set tw=80 ft=c: */
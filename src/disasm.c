@@ -0,0 +1,536 @@
+/**
+ * @file disasm.c
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "disasm.h"
+
+/**
+ * Groups of instructions, by prefix. Each has its own decode table.
+ */
+enum disasm_group {
+    DG_NONE,
+    DG_CB,
+    DG_ED,
+    DG_DD,
+    DG_FD,
+    DG_DDCB,
+    DG_FDCB,
+
+    DG_COUNT,
+};
+
+struct disasm_entry {
+    const struct opcode *oc;
+    const struct instruction *instr;
+
+    /**
+     * Size of the instruction (copied so that finding the next one is a single
+     * read), or 0 if there is no instruction.
+     */
+    int size;
+};
+
+/**
+ * Decode index: the instruction for each opcode byte (after the prefix), per
+ * prefix group.
+ */
+static struct disasm_entry disasm_index[DG_COUNT][256];
+
+static int disasm_ready = 0;
+
+/**
+ * Opcodes whose 16-bit operand is a code address, which get a label when it
+ * does not have one.
+ */
+static const struct opcode *disasm_jp, *disasm_call;
+
+/**
+ * Interrupt mode for bits 3-4 of "im" (as in reltab_encode()); -1 is not
+ * indexed.
+ */
+static const int disasm_im_modes[4] = { 0, -1, 1, 2 };
+
+static const char *const disasm_op_names[OP_TYPE_COUNT] = {
+    [OP_A] = "a", [OP_F] = "f", [OP_B] = "b", [OP_C] = "c", [OP_D] = "d",
+    [OP_E] = "e", [OP_H] = "h", [OP_L] = "l", [OP_R] = "r", [OP_I] = "i",
+    [OP_IXH] = "ixh", [OP_IXL] = "ixl", [OP_IYH] = "iyh", [OP_IYL] = "iyl",
+    [OP_AF] = "af", [OP_BC] = "bc", [OP_DE] = "de", [OP_HL] = "hl",
+    [OP_IX] = "ix", [OP_IY] = "iy", [OP_SP] = "sp", [OP_sAF] = "af'",
+    [OP_iA] = "(a)", [OP_iC] = "(c)", [OP_iBC] = "(bc)", [OP_iDE] = "(de)",
+    [OP_iHL] = "(hl)", [OP_iSP] = "(sp)", [OP_iIX] = "ix", [OP_iIY] = "iy",
+    [OP_fNZ] = "nz", [OP_fZ] = "z", [OP_fNC] = "nc", [OP_fPO] = "po",
+    [OP_fPE] = "pe", [OP_fP] = "p", [OP_fM] = "m",
+};
+
+/**
+ * Gets the decode group of an instruction and the offset of its opcode byte.
+ */
+static enum disasm_group disasm_group_of(const struct instruction *instr,
+        int *opcode_off) {
+    const uint8_t *bytes = instr->bytes;
+
+    *opcode_off = 1;
+    switch (bytes[0]) {
+    case 0xCB:
+        return DG_CB;
+    case 0xED:
+        return DG_ED;
+    case 0xDD:
+    case 0xFD:
+        if (instr->size == 4 && bytes[1] == 0xCB) {
+            /* The displacement comes before the opcode */
+            *opcode_off = 3;
+            return bytes[0] == 0xDD ? DG_DDCB : DG_FDCB;
+        }
+
+        return bytes[0] == 0xDD ? DG_DD : DG_FD;
+    default:
+        *opcode_off = 0;
+        return DG_NONE;
+    }
+}
+
+void disasm_init(void) {
+    if (disasm_ready) {
+        return;
+    }
+
+    for (int i = 0; i < opcodes_builtin_count; i++) {
+        const struct opcode *oc = &opcodes_builtin[i];
+
+        for (int j = 0; j < oc->instr_count; j++) {
+            const struct instruction *instr = &oc->instrs[j];
+            int opcode_off;
+            enum disasm_group group = disasm_group_of(instr, &opcode_off);
+            uint8_t opcode = instr->bytes[opcode_off];
+            int count = 1, step = 0;
+
+            if (instr->alias) {
+                continue;
+            }
+
+            /* Operands encoded in the opcode take each of their values */
+            if (instr->op1 == OP_RST || instr->op1 == OP_BIT) {
+                count = 8;
+                step = 1 << 3;
+            }
+
+            for (int k = 0; k < count; k++) {
+                struct disasm_entry *ent =
+                    &disasm_index[group][opcode | k * step];
+                if (!ent->instr) {
+                    *ent = (struct disasm_entry) { oc, instr, instr->size };
+                }
+            }
+
+            if (instr->op1 == OP_IM) {
+                for (int k = 0; k < 4; k++) {
+                    if (disasm_im_modes[k] >= 0) {
+                        disasm_index[group][opcode | k << 3] =
+                            (struct disasm_entry) { oc, instr, instr->size };
+                    }
+                }
+            }
+        }
+    }
+
+    disasm_jp = opcode_search("jp");
+    disasm_call = opcode_search("call");
+    disasm_ready = 1;
+}
+
+/**
+ * Decodes an instruction with a prefix (cb, ed, dd, or fd).
+ * @return The decode entry, or NULL if there is none.
+ */
+static const struct disasm_entry *disasm_decode_prefixed(const uint8_t *data,
+        size_t size, int *unknown_size) {
+    if (size < 2) {
+        return NULL;
+    }
+
+    switch (data[0]) {
+    case 0xCB:
+        return &disasm_index[DG_CB][data[1]];
+    case 0xED:
+        /* ed never prefixes another instruction, so list both bytes */
+        *unknown_size = 2;
+        return &disasm_index[DG_ED][data[1]];
+    case 0xDD:
+    case 0xFD:
+        if (data[1] != 0xCB) {
+            return &disasm_index[data[0] == 0xDD ? DG_DD : DG_FD][data[1]];
+        }
+
+        *unknown_size = 4;
+        if (size < 4) {
+            return NULL;
+        }
+
+        return &disasm_index[data[0] == 0xDD ? DG_DDCB : DG_FDCB][data[3]];
+    default:
+        return NULL;
+    }
+}
+
+int disasm_decode(const uint8_t *data, size_t size, uint16_t pc,
+        struct disasm_instr *di) {
+    const struct disasm_entry *ent = &disasm_index[DG_NONE][data[0]];
+    int unknown_size = 1;
+
+    disasm_init();
+
+    /* The prefixes have no entry in the unprefixed table */
+    if (!ent->size) {
+        ent = disasm_decode_prefixed(data, size, &unknown_size);
+    }
+
+    di->pc = pc;
+    if (!ent || !ent->size || ent->size > size) {
+        di->oc = NULL;
+        di->instr = NULL;
+        di->size = unknown_size < size ? unknown_size : size;
+        return di->size;
+    }
+
+    di->oc = ent->oc;
+    di->instr = ent->instr;
+    di->size = ent->size;
+    return di->size;
+}
+
+int disasm_value(const struct disasm_instr *di, const uint8_t *data, int op) {
+    const struct instruction *instr = di->instr;
+    enum operand_type type = op ? instr->op2 : instr->op1;
+    int offset = op ? instr->op2_off : instr->op1_off;
+
+    if (offset < 0) {
+        return 0;
+    }
+
+    switch (type) {
+    case OP_IMM16:
+    case OP_EXT:
+        return data[offset] | data[offset + 1] << 8;
+    case OP_REL:
+        return (di->pc + di->size + (int8_t) data[offset]) & 0xFFFF;
+    case OP_iIX:
+    case OP_iIY:
+        return (int8_t) data[offset];
+    case OP_RST:
+        return data[offset] & 0x38;
+    case OP_BIT:
+        return data[offset] >> 3 & 0x07;
+    case OP_IM:
+        return disasm_im_modes[data[offset] >> 3 & 0x03];
+    default:
+        return data[offset];
+    }
+}
+
+/**
+ * Appends formatted text to a buffer, truncating it if it does not fit.
+ * @param buf Buffer to append to.
+ * @param len Size of @p buf.
+ * @param n Length of the string in @p buf, which is updated.
+ */
+static void disasm_append(char *buf, size_t len, int *n, const char *fmt, ...) {
+    va_list args;
+    int count;
+
+    va_start(args, fmt);
+    count = vsnprintf(buf + *n, len - *n, fmt, args);
+    va_end(args);
+
+    if (count > 0) {
+        *n += count;
+    }
+
+    if (*n >= len) {
+        *n = len - 1;
+    }
+}
+
+/**
+ * Formats an address, by its label if it has one.
+ */
+static void disasm_format_addr(char *buf, size_t len, int *n, int addr,
+        const struct disasm_labels *labels) {
+    if (labels && labels->names[addr]) {
+        disasm_append(buf, len, n, "%s", labels->names[addr]);
+    } else {
+        disasm_append(buf, len, n, "$%04X", addr);
+    }
+}
+
+/**
+ * Formats one operand of a decoded instruction.
+ */
+static void disasm_format_op(char *buf, size_t len, int *n,
+        enum operand_type type, int offset, int value,
+        const struct disasm_instr *di, const struct disasm_labels *labels) {
+    switch (type) {
+    case OP_IMM8:
+    case OP_RST:
+        disasm_append(buf, len, n, "$%02X", value);
+        break;
+    case OP_IMM16:
+        disasm_format_addr(buf, len, n, value, labels);
+        break;
+    case OP_REL:
+        if (labels && labels->names[value]) {
+            disasm_append(buf, len, n, "%s", labels->names[value]);
+        } else {
+            disasm_append(buf, len, n, "$%+d",
+                    (int16_t) (uint16_t) (value - di->pc));
+        }
+        break;
+    case OP_BIT:
+    case OP_IM:
+        disasm_append(buf, len, n, "%d", value);
+        break;
+    case OP_PORT:
+        disasm_append(buf, len, n, "($%02X)", value);
+        break;
+    case OP_EXT:
+        disasm_append(buf, len, n, "(");
+        disasm_format_addr(buf, len, n, value, labels);
+        disasm_append(buf, len, n, ")");
+        break;
+    case OP_iIX:
+    case OP_iIY:
+        /* jp (ix) has no displacement */
+        if (offset < 0) {
+            disasm_append(buf, len, n, "(%s)", disasm_op_names[type]);
+        } else {
+            disasm_append(buf, len, n, "(%s%+d)", disasm_op_names[type],
+                    value);
+        }
+        break;
+    default:
+        disasm_append(buf, len, n, "%s", disasm_op_names[type]);
+        break;
+    }
+}
+
+/**
+ * Formats bytes as a .db directive.
+ */
+static int disasm_format_db(char *buf, size_t len, const uint8_t *data,
+        int size) {
+    int n = 0;
+
+    disasm_append(buf, len, &n, ".db");
+    for (int i = 0; i < size; i++) {
+        disasm_append(buf, len, &n, "%s$%02X", i ? ", " : " ", data[i]);
+    }
+
+    return n;
+}
+
+int disasm_format(const struct disasm_instr *di, const uint8_t *data,
+        const struct disasm_labels *labels, char *buf, size_t len) {
+    const struct instruction *instr = di->instr;
+    int n = 0;
+
+    if (!di->oc) {
+        return disasm_format_db(buf, len, data, di->size);
+    }
+
+    disasm_append(buf, len, &n, "%s", di->oc->mnemonic);
+    if (instr->op1 != OP_NONE) {
+        disasm_append(buf, len, &n, " ");
+        disasm_format_op(buf, len, &n, instr->op1, instr->op1_off,
+                disasm_value(di, data, 0), di, labels);
+    }
+
+    if (instr->op2 != OP_NONE) {
+        disasm_append(buf, len, &n, ", ");
+        disasm_format_op(buf, len, &n, instr->op2, instr->op2_off,
+                disasm_value(di, data, 1), di, labels);
+    }
+
+    return n;
+}
+
+int disasm_labels_init(struct disasm_labels *labels) {
+    labels->names = calloc(DISASM_ADDR_COUNT, sizeof(*labels->names));
+    return labels->names ? 0 : -1;
+}
+
+void disasm_labels_destroy(struct disasm_labels *labels) {
+    if (!labels->names) {
+        return;
+    }
+
+    for (int i = 0; i < DISASM_ADDR_COUNT; i++) {
+        free(labels->names[i]);
+    }
+
+    free(labels->names);
+    labels->names = NULL;
+}
+
+int disasm_labels_add(struct disasm_labels *labels, uint16_t addr,
+        const char *name) {
+    if (labels->names[addr]) {
+        return 0;
+    }
+
+    labels->names[addr] = strdup(name);
+    return labels->names[addr] ? 0 : -1;
+}
+
+int disasm_labels_add_symbols(struct disasm_labels *labels,
+        struct symbol_table *st, uint16_t start, size_t size) {
+    /* The range may wrap around the end of the address space */
+    int ranges[2][2] = {
+        { start, start + size },
+        { 0, start + size > 0x10000 ? start + size - 0x10000 : 0 },
+    };
+
+    for (int r = 0; r < 2; r++) {
+        int first;
+        int count = symtab_range(st, ranges[r][0], ranges[r][1], &first);
+        if (count < 0) {
+            return -1;
+        }
+
+        for (int i = first; i < first + count; i++) {
+            const struct symbol_ent *sym = symtab_get_sorted(st, i);
+            if (disasm_labels_add(labels, sym->value, sym->name) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Gives a label to the targets of jumps and calls into a block of code.
+ */
+static int disasm_label_targets(const uint8_t *data, size_t size,
+        uint16_t base, struct disasm_labels *labels) {
+    struct disasm_instr di;
+    char name[16];
+
+    for (size_t i = 0; i < size; i += di.size) {
+        int target;
+
+        disasm_decode(data + i, size - i, base + i, &di);
+        if (!di.oc) {
+            continue;
+        }
+
+        if (di.instr->op1 == OP_REL || di.instr->op1 == OP_IMM16) {
+            target = disasm_value(&di, data + i, 0);
+        } else if (di.instr->op2 == OP_REL || di.instr->op2 == OP_IMM16) {
+            target = disasm_value(&di, data + i, 1);
+        } else {
+            continue;
+        }
+
+        if (di.instr->op1 != OP_REL && di.instr->op2 != OP_REL
+                && di.oc != disasm_jp && di.oc != disasm_call) {
+            continue;
+        }
+
+        /* Only label targets inside the block */
+        if ((uint16_t) (target - base) >= size || labels->names[target]) {
+            continue;
+        }
+
+        snprintf(name, sizeof(name), "L_%04X", target);
+        if (disasm_labels_add(labels, target, name) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Writes a line of a listing, with a comment of its address and bytes.
+ */
+static void disasm_write_line(FILE *out, const char *text, uint16_t addr,
+        const uint8_t *data, int size) {
+    static const char hex[] = "0123456789ABCDEF";
+    char bytes[3 * INSTR_MAX_LEN + 2];
+    int n = 0;
+
+    for (int i = 0; i < size && i < INSTR_MAX_LEN; i++) {
+        bytes[n++] = ' ';
+        bytes[n++] = hex[data[i] >> 4];
+        bytes[n++] = hex[data[i] & 0x0F];
+    }
+
+    bytes[n++] = '\n';
+    bytes[n] = '\0';
+    fprintf(out, "    %-28s; %04X %s", text, addr, bytes);
+}
+
+/**
+ * Gets the number of bytes from an offset in a block to the next label (or the
+ * end of the block), limited to @p max.
+ */
+static int disasm_label_distance(const struct disasm_labels *labels,
+        size_t offset, size_t size, uint16_t base, int max) {
+    int n = 1;
+
+    while (n < max && offset + n < size
+            && !labels->names[(uint16_t) (base + offset + n)]) {
+        n++;
+    }
+
+    return n;
+}
+
+int disasm_listing(FILE *out, const uint8_t *data, size_t size, uint16_t base,
+        int code, struct disasm_labels *labels) {
+    char line[DISASM_LINE_MAX];
+    size_t i = 0;
+
+    if (code && disasm_label_targets(data, size, base, labels) < 0) {
+        return -1;
+    }
+
+    while (i < size) {
+        uint16_t addr = base + i;
+        struct disasm_instr di;
+        int len;
+
+        if (labels->names[addr]) {
+            fprintf(out, "%s:\n", labels->names[addr]);
+        }
+
+        if (code) {
+            disasm_decode(data + i, size - i, addr, &di);
+            len = disasm_label_distance(labels, i, size, base, di.size);
+            if (len < di.size) {
+                /* A label points into the instruction */
+                di.oc = NULL;
+                di.size = len;
+            }
+
+            disasm_format(&di, data + i, labels, line, sizeof(line));
+        } else {
+            len = disasm_label_distance(labels, i, size, base,
+                    DISASM_DB_WIDTH);
+            di.size = len;
+            disasm_format_db(line, sizeof(line), data + i, len);
+        }
+
+        disasm_write_line(out, line, addr, data + i, di.size);
+        i += di.size;
+    }
+
+    return ferror(out) ? -1 : 0;
+}
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,158 @@
+/**
+ * @file disasm.h
+ */
+
+#ifndef DISASM_H_
+#define DISASM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "opcode.h"
+#include "symbol_table.h"
+
+/**
+ * Number of addresses in the Z80 address space (the size of a label table).
+ */
+#define DISASM_ADDR_COUNT 0x10000
+
+/**
+ * Maximum number of bytes in a .db line of a listing (at most INSTR_MAX_LEN,
+ * since the bytes of each line are also listed in a comment).
+ */
+#define DISASM_DB_WIDTH 8
+
+/**
+ * Maximum length of a formatted instruction.
+ */
+#define DISASM_LINE_MAX 128
+
+/**
+ * A decoded instruction.
+ */
+struct disasm_instr {
+    /**
+     * Opcode and instruction, or NULL if the bytes are not a known instruction
+     * (in which case they are listed as data).
+     */
+    const struct opcode *oc;
+    const struct instruction *instr;
+
+    /**
+     * Address and number of bytes of the instruction.
+     */
+    int pc;
+    int size;
+};
+
+/**
+ * Names of addresses, used to label a disassembly.
+ * This is a direct table indexed by address, so lookups are a single read.
+ */
+struct disasm_labels {
+    char **names;
+};
+
+/**
+ * Builds the decode index from the opcode tables.
+ * There is one table of 256 entries for each prefix (none, cb, ed, dd, fd,
+ * ddcb, and fdcb), indexed by the opcode byte. This is done automatically by
+ * the other functions, but is not thread-safe.
+ */
+void disasm_init(void);
+
+/**
+ * Decodes one instruction.
+ * Only the instruction is found; the values of its operands are read by
+ * disasm_value() when they are needed.
+ * @param data Bytes to decode.
+ * @param size Number of bytes available at @p data (at least 1).
+ * @param pc Address of the instruction, for relative jumps.
+ * @param[out] di Decoded instruction.
+ * @return Number of bytes decoded (di->size).
+ */
+int disasm_decode(const uint8_t *data, size_t size, uint16_t pc,
+        struct disasm_instr *di);
+
+/**
+ * Gets the value of an operand of a decoded instruction: an immediate, an
+ * absolute address (also for relative jumps), an index displacement, a bit
+ * index, etc.
+ * @param di Decoded instruction.
+ * @param data Bytes of the instruction.
+ * @param op Index of the operand (0 or 1).
+ * @return The value, or 0 if the operand has none.
+ */
+int disasm_value(const struct disasm_instr *di, const uint8_t *data, int op);
+
+/**
+ * Formats a decoded instruction in the assembler's syntax.
+ * @param di Instruction to format.
+ * @param data Bytes of the instruction.
+ * @param labels Labels to use for addresses, or NULL.
+ * @param buf Buffer to write to.
+ * @param len Size of @p buf.
+ * @return Length of the formatted string.
+ */
+int disasm_format(const struct disasm_instr *di, const uint8_t *data,
+        const struct disasm_labels *labels, char *buf, size_t len);
+
+/**
+ * Initializes an empty label table.
+ * @return 0 on success, -1 on failure.
+ */
+int disasm_labels_init(struct disasm_labels *labels);
+
+/**
+ * Frees a label table and its names.
+ */
+void disasm_labels_destroy(struct disasm_labels *labels);
+
+/**
+ * Names an address, unless it already has a name.
+ * @param labels Table to add to.
+ * @param addr Address to name.
+ * @param name Name of the address. This is copied.
+ * @return 0 on success, -1 on failure.
+ */
+int disasm_labels_add(struct disasm_labels *labels, uint16_t addr,
+        const char *name);
+
+/**
+ * Names the addresses of the symbols in a symbol table (e.g. one filled by
+ * link_objects()).
+ * Only symbols in the range which will be listed are added, since a listing
+ * only defines the labels inside it.
+ * @param labels Table to add to.
+ * @param st Symbols to add.
+ * @param start First address of the range.
+ * @param size Size of the range.
+ * @return 0 on success, -1 on failure.
+ */
+int disasm_labels_add_symbols(struct disasm_labels *labels,
+        struct symbol_table *st, uint16_t start, size_t size);
+
+/**
+ * Writes a listing of a block of memory which can be assembled back into the
+ * same bytes.
+ *
+ * Code is listed one instruction per line, with a comment of the address and
+ * bytes. Targets of jumps and calls into the block which have no label are
+ * given one, of the form L_XXXX (these are added to @p labels). Bytes which do
+ * not decode, or instructions which would hide a label, are listed with .db.
+ *
+ * @param out File to write to.
+ * @param data Bytes to list.
+ * @param size Number of bytes.
+ * @param base Address of the first byte.
+ * @param code Whether to decode the bytes as instructions, or list them as
+ * data.
+ * @param labels Labels to use.
+ * @return 0 on success, -1 on failure.
+ */
+int disasm_listing(FILE *out, const uint8_t *data, size_t size, uint16_t base,
+        int code, struct disasm_labels *labels);
+
+#endif /* DISASM_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -12,8 +12,9 @@
 /* These funcitons simplify low-level expressions, if possible.
  * They are used in expr_eval() and in expr_alloc() to simplify expressions at a
  * single depth.
- * If evaluation is possible, the operand(s) are freed and the result is stored
- * in @p res; if not, none of the parameters are modified or freed.
+ * If evaluation is possible, the result is stored in @p res; the operands are
+ * never modified. Symbols in the operands should already be resolved (see
+ * expr_leaf()).
  *
  * @param[out] res Place to store the result.
  * @param op1 First operand.
@@ -21,213 +22,405 @@
  * @return 0 if evaluation was possible, -1 if not.
  */
 static int expr_add(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2);
+        const struct expr_node *op1, const struct expr_node *op2);
 static int expr_sub(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2);
+        const struct expr_node *op1, const struct expr_node *op2);
 static int expr_mul(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2);
+        const struct expr_node *op1, const struct expr_node *op2);
 static int expr_div(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2);
+        const struct expr_node *op1, const struct expr_node *op2);
 static int expr_mod(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2);
+        const struct expr_node *op1, const struct expr_node *op2);
 static int expr_and(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2);
+        const struct expr_node *op1, const struct expr_node *op2);
 static int expr_xor(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2);
+        const struct expr_node *op1, const struct expr_node *op2);
 static int expr_or(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2);
-static int expr_neg(struct expr_node *res, struct expr_node *op);
-static int expr_not(struct expr_node *res, struct expr_node *op);
+        const struct expr_node *op1, const struct expr_node *op2);
+static int expr_neg(struct expr_node *res, const struct expr_node *op);
+static int expr_not(struct expr_node *res, const struct expr_node *op);
 
 /**
- * Attemps to resolve a symbol into a constant value, incorporating both the
- * symbol and the addend.
- * @param expr Expression to resolve.
- * @return 0 if the expression is resolved, -1 if not. If the expression was not
- * a symbol to begin with, this still returns 0, as the expression is not
- * unresolved. This also applies to operators: this will return 0 even if there
- * are child expressions which are unresolved symbols.
+ * Gets the value of a leaf node, resolving a defined symbol into a constant
+ * (incorporating both the symbol and the addend).
+ * Operators and other nodes are just copied.
+ * @param expr Node to resolve.
+ * @param[out] leaf Place to store the resolved value.
  */
-static int expr_resolve_sym(struct expr_node *expr);
+static void expr_leaf(const struct expr_node *expr, struct expr_node *leaf);
 
-struct expr_node *expr_alloc(enum expr_type type,
-        struct expr_node *op1, struct expr_node *op2) {
-    /* TODO Check the type? */
-    struct expr_node *expr = malloc(sizeof(*expr));
-    if (!expr) {
-        return NULL;
+/**
+ * Initial number of buckets in the table of unique nodes.
+ */
+#define EXPR_TABLE_INIT_SIZE 256
+
+/**
+ * Table of unique (hash-consed) nodes, chained through expr_node::next.
+ * The size is always a power of 2.
+ */
+static struct expr_node **expr_table = NULL;
+static uint32_t expr_table_size = 0;
+static uint32_t expr_table_count = 0;
+
+/**
+ * Incremented whenever a symbol is defined or undefined, to invalidate cached
+ * results which may have depended on it.
+ */
+static unsigned expr_generation = 0;
+
+static expr_pin_fn expr_pin_callback = NULL;
+
+void expr_set_pin_fn(expr_pin_fn fn) {
+    expr_pin_callback = fn;
+}
+
+void expr_pin(enum section sec, int value1, int value2) {
+    if (expr_pin_callback && sec != SEC_ABS) {
+        expr_pin_callback(sec, value1, value2);
+    }
+}
+
+/**
+ * Applies an operator to operands if they are simple enough.
+ * This is shared by expr_alloc() (to fold expressions as they are built) and
+ * expr_eval().
+ * @param[out] res Place to store the result.
+ * @param type Operator.
+ * @param op1 First operand.
+ * @param op2 Second operand (NULL for unary operators).
+ * @param[out] msg Set to an error message if the operator cannot be applied.
+ * @return 0 if evaluation was possible, -1 if not.
+ */
+static int expr_fold(struct expr_node *res, enum expr_type type,
+        const struct expr_node *op1, const struct expr_node *op2,
+        const char **msg) {
+    struct expr_node leaf1, leaf2;
+
+    expr_leaf(op1, &leaf1);
+    op1 = &leaf1;
+    if (op2) {
+        expr_leaf(op2, &leaf2);
+        op2 = &leaf2;
     }
 
-    /* Evaluate non-recursively to prevent simple expressions from taking up
-     * more memory than necessary (i.e. ones only involving constants).
-     */
-    /* TODO Share a function with expr_eval(). */
-    switch (expr->type) {
+    switch (type) {
     case '+':
-        if (expr_add(expr, op1, op2) == 0) {
-            return 0;
-        }
-        break;
-
+        *msg = "Could not add operands";
+        return expr_add(res, op1, op2);
     case '-':
-        if (expr_sub(expr, op1, op2) == 0) {
-            return 0;
-        }
-        break;
-
+        *msg = "Could not subtract operands";
+        return expr_sub(res, op1, op2);
     case '*':
-        if (expr_mul(expr, op1, op2) == 0) {
-            return 0;
-        }
-        break;
-
+        *msg = "Could not multiply operands";
+        return expr_mul(res, op1, op2);
     case '/':
-        if (expr_div(expr, op1, op2) == 0) {
-            return 0;
-        }
-        break;
-
+        *msg = "Could not divide operands";
+        return expr_div(res, op1, op2);
     case '%':
-        if (expr_mod(expr, op1, op2) == 0) {
-            return 0;
-        }
-        break;
-
+        *msg = "Could not modulo operands";
+        return expr_mod(res, op1, op2);
     case '&':
-        if (expr_and(expr, op1, op2) == 0) {
-            return 0;
-        }
-        break;
-
+        *msg = "Could not AND operands";
+        return expr_and(res, op1, op2);
     case '^':
-        if (expr_xor(expr, op1, op2) == 0) {
-            return 0;
-        }
-        break;
-
+        *msg = "Could not XOR operands";
+        return expr_xor(res, op1, op2);
     case '|':
-        if (expr_or(expr, op1, op2) == 0) {
-            return 0;
-        }
+        *msg = "Could not OR operands";
+        return expr_or(res, op1, op2);
+    case ET_NEG:
+        *msg = "Could not negate operand";
+        return expr_neg(res, op1);
+    case '~':
+        *msg = "Could not complement operand";
+        return expr_not(res, op1);
+    default:
+        *msg = "Invalid expression type";
+        return -1;
+    }
+}
+
+void expr_invalidate(void) {
+    expr_generation++;
+}
+
+/**
+ * Computes the hash of a node from its contents.
+ * Operands are hashed by address, since equal operands are the same node.
+ */
+static uint32_t expr_hash(const struct expr_node *expr) {
+    uint64_t a, b;
+
+    switch (expr->type) {
+    case ET_CONST:
+        a = expr->sec;
+        b = (unsigned) expr->value;
         break;
+    case ET_SYM:
+        a = (uintptr_t) expr->sym;
+        b = (unsigned) expr->addend;
+        break;
+    default:
+        a = (uintptr_t) expr->operands[0];
+        b = (uintptr_t) expr->operands[1];
+        break;
+    }
 
-    case ET_NEG:
-        if (expr_neg(expr, op1) == 0) {
-            return 0;
+    /* FNV-1a over the words, which is plenty for this */
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ expr->type) * 16777619u;
+    hash = (hash ^ (uint32_t) a) * 16777619u;
+    hash = (hash ^ (uint32_t) (a >> 32)) * 16777619u;
+    hash = (hash ^ (uint32_t) b) * 16777619u;
+    hash = (hash ^ (uint32_t) (b >> 32)) * 16777619u;
+    return hash;
+}
+
+/**
+ * Determines whether two nodes have the same contents.
+ */
+static int expr_equal(const struct expr_node *e1, const struct expr_node *e2) {
+    if (e1->type != e2->type) {
+        return 0;
+    }
+
+    switch (e1->type) {
+    case ET_CONST:
+        return e1->sec == e2->sec && e1->value == e2->value;
+    case ET_SYM:
+        return e1->sym == e2->sym && e1->addend == e2->addend;
+    default:
+        return e1->operands[0] == e2->operands[0]
+            && e1->operands[1] == e2->operands[1];
+    }
+}
+
+/**
+ * Doubles the number of buckets in the node table.
+ * @return 0 on success, -1 on failure.
+ */
+static int expr_table_grow(void) {
+    uint32_t size = expr_table_size > 0
+        ? expr_table_size * 2 : EXPR_TABLE_INIT_SIZE;
+    struct expr_node **table = calloc(size, sizeof(*table));
+    if (!table) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < expr_table_size; i++) {
+        struct expr_node *expr = expr_table[i];
+        while (expr) {
+            struct expr_node *next = expr->next;
+            uint32_t idx = expr->hash & (size - 1);
+            expr->next = table[idx];
+            table[idx] = expr;
+            expr = next;
         }
-        break;
+    }
 
-    case '~':
-        if (expr_not(expr, op1) == 0) {
-            return 0;
+    free(expr_table);
+    expr_table = table;
+    expr_table_size = size;
+    return 0;
+}
+
+/**
+ * Gets the unique node with the given contents, creating it if it doesn't
+ * exist yet.
+ * If @p key is an operator, this takes over the references to its operands.
+ * @param key Contents of the node (type and the type-specific fields).
+ * @return Reference to the node, or NULL on failure.
+ */
+static struct expr_node *expr_intern(const struct expr_node *key) {
+    uint32_t hash = expr_hash(key);
+    struct expr_node *expr;
+
+    if (expr_table_size > 0) {
+        for (expr = expr_table[hash & (expr_table_size - 1)];
+                expr; expr = expr->next) {
+            if (expr->hash == hash && expr_equal(expr, key)) {
+                expr->refs++;
+                if (EXPR_IS_OP(key)) {
+                    expr_free(key->operands[0]);
+                    expr_free(key->operands[1]);
+                }
+
+                return expr;
+            }
         }
-        break;
+    }
 
-    default:
-        /* TODO Error out? */
-        break;
+    if (expr_table_count >= expr_table_size && expr_table_grow() < 0) {
+        goto INTERN_FAIL;
     }
 
-    /* If the expression is not a simple evaluation, store it as a normal node
-     */
-    expr->type = type;
-    expr->operands[0] = op1;
-    expr->operands[1] = op2;
+    expr = malloc(sizeof(*expr));
+    if (!expr) {
+        goto INTERN_FAIL;
+    }
+
+    *expr = *key;
+    expr->refs = 1;
+    expr->hash = hash;
+    expr->result = NULL;
+    expr->result_gen = 0;
+
+    expr->next = expr_table[hash & (expr_table_size - 1)];
+    expr_table[hash & (expr_table_size - 1)] = expr;
+    expr_table_count++;
     return expr;
+
+INTERN_FAIL:
+    if (EXPR_IS_OP(key)) {
+        expr_free(key->operands[0]);
+        expr_free(key->operands[1]);
+    }
+
+    return NULL;
 }
 
-struct expr_node *expr_alloc_const(enum section sec, int value) {
-    struct expr_node *expr = malloc(sizeof(*expr));
-    if (!expr) {
+/**
+ * Removes a node from the node table, freeing the table once it is empty.
+ */
+static void expr_unintern(struct expr_node *expr) {
+    struct expr_node **link = &expr_table[expr->hash & (expr_table_size - 1)];
+
+    while (*link != expr) {
+        link = &(*link)->next;
+    }
+
+    *link = expr->next;
+    if (--expr_table_count == 0) {
+        free(expr_table);
+        expr_table = NULL;
+        expr_table_size = 0;
+    }
+}
+
+struct expr_node *expr_alloc(enum expr_type type,
+        struct expr_node *op1, struct expr_node *op2) {
+    struct expr_node key;
+    const char *msg;
+
+    /* Unary operators only have one operand */
+    int unary = type == ET_NEG || type == '~';
+    if (!op1 || (!unary && !op2)) {
+        expr_free(op1);
+        expr_free(op2);
         return NULL;
     }
 
-    expr->type = ET_CONST;
-    expr->sec = sec;
-    expr->value = value;
-    return expr;
+    /* Fold as the expression is built, so that expressions only involving
+     * constants and resolved symbols never become trees. Since the operands
+     * were already folded when they were built, this only has to look one
+     * level deep.
+     */
+    if (expr_fold(&key, type, op1, op2, &msg) == 0) {
+        expr_free(op1);
+        expr_free(op2);
+        return expr_intern(&key);
+    }
+
+    /* If the expression is not a simple evaluation, store it as a normal node
+     */
+    key.type = type;
+    key.operands[0] = op1;
+    key.operands[1] = op2;
+    return expr_intern(&key);
+}
+
+struct expr_node *expr_alloc_const(enum section sec, int value) {
+    struct expr_node key;
+
+    key.type = ET_CONST;
+    key.sec = sec;
+    key.value = value;
+    return expr_intern(&key);
 }
 
 struct expr_node *expr_alloc_sym(const struct symbol_ent *sym) {
+    struct expr_node key, leaf;
+
     if (!sym) {
         return NULL;
     }
 
+    key.type = ET_SYM;
+    key.sym = sym;
+    key.addend = 0;
+
+    /* Resolve the symbol now if it is already defined */
+    expr_leaf(&key, &leaf);
+    return expr_intern(&leaf);
+}
+
+struct expr_node *expr_alloc_inval(const char *msg) {
     struct expr_node *expr = malloc(sizeof(*expr));
     if (!expr) {
         return NULL;
     }
 
-    expr->type = ET_SYM;
-    expr->sym = sym;
-    expr->addend = 0;
-
-    /* Try to resolve the symbol, but don't worry if it cannot be resolved. */
-    expr_resolve_sym(expr);
+    /* Invalid expressions are not shared, so they are not in the table */
+    expr->type = ET_INVAL;
+    expr->refs = 1;
+    expr->hash = 0;
+    expr->next = NULL;
+    expr->result = NULL;
+    expr->result_gen = 0;
+    expr->msg = msg;
     return expr;
 }
 
 struct expr_node *expr_clone(const struct expr_node *expr) {
-    if (!expr) {
-        return NULL;
+    /* Nodes are never modified after they are created (except for their
+     * cached results), so they can just be shared.
+     */
+    struct expr_node *clone = (struct expr_node *) expr;
+    if (clone) {
+        clone->refs++;
     }
 
-    if (EXPR_IS_OP(expr)) {
-        return expr_alloc(expr->type, expr->operands[0], expr->operands[1]);
-    } else if (expr->type == ET_SYM) {
-        return expr_alloc_sym(expr->sym);
-    } else if (expr->type == ET_CONST) {
-        return expr_alloc_const(expr->sec, expr->value);
-    } else {
-        /* TODO Return invalid expression? */
-        return NULL;
-    }
+    return clone;
 }
 
 void expr_free(struct expr_node *expr) {
+    if (!expr || --expr->refs > 0) {
+        return;
+    }
+
+    if (expr->type != ET_INVAL) {
+        expr_unintern(expr);
+    }
+
     /* Only free operands if it should have any (just checking for NULL operands
      * does not work because the operand pointers are stored in a union).
-     * EXPR_IS_OP() returns false for NULL, so this doubles as a NULL check.
      */
     if (EXPR_IS_OP(expr)) {
         expr_free(expr->operands[0]);
         expr_free(expr->operands[1]);
     }
 
+    expr_free(expr->result);
     free(expr);
 }
 
-static int expr_resolve_sym(struct expr_node *expr) {
-    if (expr->type != ET_SYM) {
-        return 0;
-    }
-
-    if (expr->sym->type != ST_OBJECT) {
-        return -1;
+static void expr_leaf(const struct expr_node *expr, struct expr_node *leaf) {
+    *leaf = *expr;
+    if (expr->type == ET_SYM && expr->sym->type == ST_OBJECT) {
+        leaf->type = ET_CONST;
+        leaf->sec = expr->sym->sec;
+        leaf->value = expr->sym->value + expr->addend;
     }
-
-    /* Compute the value here because they are stored in a union with the
-     * value and sec fields
-     */
-    enum section sec = expr->sym->sec;
-    int value = expr->sym->value + expr->addend;
-
-    expr->type = ET_CONST;
-    expr->sec = sec;
-    expr->value = value;
-    return 0;
 }
 
 static int expr_add(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2) {
+        const struct expr_node *op1, const struct expr_node *op2) {
     /* Symbols and constants can be added together in any configuration, as long
      * as at least one is absolute. expr_resolve_sym() is called on each operand
      * first, so that the case of SYM + SYM can be ruled out, as that means
      * neither symbol was resolvable.
      */
 
-    expr_resolve_sym(op1);
-    expr_resolve_sym(op2);
 
     if (op1->type == ET_CONST && op2->type == ET_CONST) {
         if (op1->sec != SEC_ABS && op2->sec != SEC_ABS) {
@@ -257,21 +450,38 @@ static int expr_add(struct expr_node *res,
         return -1;
     }
 
-    expr_free(op1);
-    expr_free(op2);
     return 0;
 }
 
 static int expr_sub(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2) {
+        const struct expr_node *op1, const struct expr_node *op2) {
     /* Symbols and constants can be added as long as the subtrahend (fancy,
      * old-school term for the second one) is absolute. We try to resolve
      * symbols first so that the only condition that needs to be checked is that
      * op2 is an absolute constant (and that op1 is a symbol or constant).
      */
 
-    expr_resolve_sym(op1);
-    expr_resolve_sym(op2);
+
+    /* The difference of two values in the same section (like labels) does
+     * not depend on where the section is placed, so it is absolute. The same
+     * goes for two offsets from the same unresolved symbol.
+     */
+    if (op1->type == ET_CONST && op2->type == ET_CONST
+            && op1->sec == op2->sec) {
+        expr_pin(op1->sec, op1->value, op2->value);
+        res->type = ET_CONST;
+        res->sec = SEC_ABS;
+        res->value = op1->value - op2->value;
+        return 0;
+    }
+
+    if (op1->type == ET_SYM && op2->type == ET_SYM && op1->sym == op2->sym) {
+        int value = op1->addend - op2->addend;
+        res->type = ET_CONST;
+        res->sec = SEC_ABS;
+        res->value = value;
+        return 0;
+    }
 
     if (!EXPR_IS_ABS(op2)) {
         return -1;
@@ -289,270 +499,290 @@ static int expr_sub(struct expr_node *res,
         return -1;
     }
 
-    expr_free(op1);
-    expr_free(op2);
     return 0;
 }
 
 /* For all other operations, both operands must be absolute constants */
 
 static int expr_mul(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2) {
-    expr_resolve_sym(op1);
-    expr_resolve_sym(op2);
-    if (EXPR_IS_ABS(op1) && EXPR_IS_ABS(op2)) {
+        const struct expr_node *op1, const struct expr_node *op2) {
+    if (!EXPR_IS_ABS(op1) || !EXPR_IS_ABS(op2)) {
         return -1;
     }
 
     res->type = ET_CONST;
     res->sec = SEC_ABS;
     res->value = op1->value * op2->value;
-    expr_free(op1);
-    expr_free(op2);
     return 0;
 }
 
 static int expr_div(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2) {
-    expr_resolve_sym(op1);
-    expr_resolve_sym(op2);
-    if (EXPR_IS_ABS(op1) && EXPR_IS_ABS(op2)) {
+        const struct expr_node *op1, const struct expr_node *op2) {
+    if (!EXPR_IS_ABS(op1) || !EXPR_IS_ABS(op2)) {
+        return -1;
+    }
+
+    if (op2->value == 0) {
         return -1;
     }
 
     res->type = ET_CONST;
     res->sec = SEC_ABS;
     res->value = op1->value / op2->value;
-    expr_free(op1);
-    expr_free(op2);
     return 0;
 }
 
 static int expr_mod(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2) {
-    expr_resolve_sym(op1);
-    expr_resolve_sym(op2);
-    if (EXPR_IS_ABS(op1) && EXPR_IS_ABS(op2)) {
+        const struct expr_node *op1, const struct expr_node *op2) {
+    if (!EXPR_IS_ABS(op1) || !EXPR_IS_ABS(op2)) {
+        return -1;
+    }
+
+    if (op2->value == 0) {
         return -1;
     }
 
     res->type = ET_CONST;
     res->sec = SEC_ABS;
     res->value = op1->value % op2->value;
-    expr_free(op1);
-    expr_free(op2);
     return 0;
 }
 
 static int expr_and(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2) {
-    expr_resolve_sym(op1);
-    expr_resolve_sym(op2);
-    if (EXPR_IS_ABS(op1) && EXPR_IS_ABS(op2)) {
+        const struct expr_node *op1, const struct expr_node *op2) {
+    if (!EXPR_IS_ABS(op1) || !EXPR_IS_ABS(op2)) {
         return -1;
     }
 
     res->type = ET_CONST;
     res->sec = SEC_ABS;
     res->value = op1->value & op2->value;
-    expr_free(op1);
-    expr_free(op2);
     return 0;
 }
 
 static int expr_xor(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2) {
-    expr_resolve_sym(op1);
-    expr_resolve_sym(op2);
-    if (EXPR_IS_ABS(op1) && EXPR_IS_ABS(op2)) {
+        const struct expr_node *op1, const struct expr_node *op2) {
+    if (!EXPR_IS_ABS(op1) || !EXPR_IS_ABS(op2)) {
         return -1;
     }
 
     res->type = ET_CONST;
     res->sec = SEC_ABS;
     res->value = op1->value ^ op2->value;
-    expr_free(op1);
-    expr_free(op2);
     return 0;
 }
 
 static int expr_or(struct expr_node *res,
-        struct expr_node *op1, struct expr_node *op2) {
-    expr_resolve_sym(op1);
-    expr_resolve_sym(op2);
-    if (EXPR_IS_ABS(op1) && EXPR_IS_ABS(op2)) {
+        const struct expr_node *op1, const struct expr_node *op2) {
+    if (!EXPR_IS_ABS(op1) || !EXPR_IS_ABS(op2)) {
         return -1;
     }
 
     res->type = ET_CONST;
     res->sec = SEC_ABS;
     res->value = op1->value | op2->value;
-    expr_free(op1);
-    expr_free(op2);
     return 0;
 }
 
-static int expr_neg(struct expr_node *res, struct expr_node *op) {
-    expr_resolve_sym(op);
-    if (EXPR_IS_ABS(op)) {
+static int expr_neg(struct expr_node *res, const struct expr_node *op) {
+    if (!EXPR_IS_ABS(op)) {
         return -1;
     }
 
     res->type = ET_CONST;
     res->sec = SEC_ABS;
     res->value = -op->value;
-    expr_free(op);
     return 0;
 }
 
-static int expr_not(struct expr_node *res, struct expr_node *op) {
-    expr_resolve_sym(op);
-    if (EXPR_IS_ABS(op)) {
+static int expr_not(struct expr_node *res, const struct expr_node *op) {
+    if (!EXPR_IS_ABS(op)) {
         return -1;
     }
 
     res->type = ET_CONST;
     res->sec = SEC_ABS;
     res->value = ~op->value;
-    expr_free(op);
     return 0;
 }
 
-int expr_eval(struct expr_node *expr) {
-    /* Used to pass the error message to the EXPR_INVAL label when there is an
-     * error in evaluation.
-     */
-    const char *msg = NULL;
-    struct expr_node *op1, *op2;
-
+const struct symbol_ent *expr_find_undef(const struct expr_node *expr) {
     if (!expr) {
-        return -1;
+        return NULL;
     }
 
-    /* Test for leaf nodes first */
-    switch (expr->type) {
-    case ET_CONST:
-        return 0;
-    case ET_SYM:
-        /* Try to resolve the symbol, but still return it if the symbol cannot
-         * be resolved.
-         */
-        expr_resolve_sym(expr);
-        return 0;
-    case ET_INVAL:
-        return -1;
-    default:
-        break;
+    if (EXPR_IS_OP(expr)) {
+        const struct symbol_ent *sym = expr_find_undef(expr->operands[0]);
+        return sym ? sym : expr_find_undef(expr->operands[1]);
     }
 
-    op1 = expr->operands[0];
-    if (expr_eval(op1) < 0) {
-        msg = op1->msg;
-        goto EXPR_INVAL;
+    if (expr->type == ET_SYM && expr->sym->type == ST_UNDEF) {
+        return expr->sym;
     }
 
-    op2 = expr->operands[1];
-    if (expr_eval(op2) < 0) {
-        msg = op2->msg;
-        goto EXPR_INVAL;
+    return NULL;
+}
+
+struct expr_node *expr_resolve_scope(struct expr_node *expr,
+        const struct symbol_table *scope) {
+    struct expr_node *op1, *op2, *res;
+
+    if (!expr) {
+        return NULL;
     }
 
-    /* Both operands were successfully evaluated, so both are ET_CONSTs. */
-    /* TODO Improve qualiity of error messages, probably by returning them from
-     * expr_*() partial evaluation functions.
-     */
-    switch (expr->type) {
-    case '+':
-        if (expr_add(expr, op1, op2) == 0) {
-            return 0;
-        } else {
-            msg = "Could not add operands";
-            break;
+    if (EXPR_IS_OP(expr)) {
+        op1 = expr_resolve_scope(expr_clone(expr->operands[0]), scope);
+        op2 = expr_resolve_scope(expr_clone(expr->operands[1]), scope);
+
+        /* Shared subexpressions are left alone unless they actually change */
+        if (op1 == expr->operands[0] && op2 == expr->operands[1]) {
+            expr_free(op1);
+            expr_free(op2);
+            return expr;
         }
 
-    case '-':
-        if (expr_sub(expr, op1, op2) == 0) {
-            return 0;
+        if (op1 && op1->type == ET_INVAL) {
+            res = expr_clone(op1);
+        } else if (op2 && op2->type == ET_INVAL) {
+            res = expr_clone(op2);
         } else {
-            msg = "Could not subtract operands";
-            break;
+            res = expr_alloc(expr->type, expr_clone(op1), expr_clone(op2));
         }
 
-    case '*':
-        if (expr_mul(expr, op1, op2) == 0) {
-            return 0;
-        } else {
-            msg = "Could not multiply operands";
-            break;
-        }
+        expr_free(op1);
+        expr_free(op2);
+        expr_free(expr);
+        return res;
+    }
 
-    case '/':
-        if (expr_div(expr, op1, op2) == 0) {
-            return 0;
-        } else {
-            msg = "Could not divide operands";
-            break;
-        }
+    if (expr->type != ET_SYM
+            || symtab_search(scope, expr->sym->name) != expr->sym) {
+        return expr;
+    }
 
-    case '%':
-        if (expr_mod(expr, op1, op2) == 0) {
-            return 0;
-        } else {
-            msg = "Could not modulo operands";
-            break;
-        }
+    /* The symbol is about to be freed, so it can't be left here */
+    if (expr->sym->type != ST_OBJECT) {
+        res = expr_alloc_inval("Undefined local label");
+    } else {
+        res = expr_alloc_const(expr->sym->sec,
+                expr->sym->value + expr->addend);
+    }
 
-    case '&':
-        if (expr_and(expr, op1, op2) == 0) {
-            return 0;
-        } else {
-            msg = "Could not AND operands";
-            break;
-        }
+    expr_free(expr);
+    return res;
+}
 
-    case '^':
-        if (expr_xor(expr, op1, op2) == 0) {
-            return 0;
-        } else {
-            msg = "Could not XOR operands";
-            break;
-        }
+struct expr_node *expr_map_leaves(const struct expr_node *expr,
+        expr_leaf_fn fn, void *arg) {
+    struct expr_node *op1, *op2 = NULL;
 
-    case '|':
-        if (expr_or(expr, op1, op2) == 0) {
-            return 0;
-        } else {
-            msg = "Could not OR operands";
-            break;
-        }
+    if (!expr) {
+        return NULL;
+    }
 
-    case ET_NEG:
-        if (expr_neg(expr, op1) == 0) {
-            return 0;
-        } else {
-            msg = "Could not negate operand";
-            break;
-        }
+    switch (expr->type) {
+    case ET_CONST:
+    case ET_SYM:
+        return fn(expr, arg);
+    case ET_INVAL:
+        return expr_clone(expr);
+    default:
+        break;
+    }
 
-    case '~':
-        if (expr_not(expr, op1) == 0) {
-            return 0;
-        } else {
-            msg = "Could not complement operand";
-            break;
+    op1 = expr_map_leaves(expr->operands[0], fn, arg);
+    if (expr->operands[1]) {
+        op2 = expr_map_leaves(expr->operands[1], fn, arg);
+        if (!op2) {
+            expr_free(op1);
+            return NULL;
         }
+    }
+
+    return expr_alloc(expr->type, op1, op2);
+}
 
+const struct expr_node *expr_eval(const struct expr_node *expr) {
+    /* The result is cached in the node, which is not otherwise modified */
+    struct expr_node *node = (struct expr_node *) expr;
+    struct expr_node key;
+    const struct expr_node *op1, *op2 = NULL;
+    struct expr_node *res;
+    const char *msg;
+
+    if (!expr) {
+        return NULL;
+    }
+
+    /* Test for leaf nodes first */
+    switch (expr->type) {
+    case ET_CONST:
+    case ET_INVAL:
+        return expr;
+    case ET_SYM:
+        /* Still return the symbol if it cannot be resolved */
+        if (expr->sym->type != ST_OBJECT) {
+            return expr;
+        }
+        break;
     default:
-        msg = "Invalid expression type";
         break;
     }
 
-EXPR_INVAL:
-    expr->type = ET_INVAL;
-    expr_free(expr->operands[0]);
-    expr_free(expr->operands[1]);
-    expr->msg = msg;
-    return -1;
+    /* Any result could have depended on a symbol which has been defined or
+     * undefined since (even a constant, see asm_undefine_sym()).
+     */
+    if (node->result && node->result_gen == expr_generation) {
+        return node->result;
+    }
+
+    if (expr->type == ET_SYM) {
+        expr_leaf(expr, &key);
+        res = expr_alloc_const(key.sec, key.value);
+        goto EVAL_END;
+    }
+
+    op1 = expr_eval(expr->operands[0]);
+    if (!op1) {
+        return NULL;
+    } else if (op1->type == ET_INVAL) {
+        res = expr_clone(op1);
+        goto EVAL_END;
+    }
+
+    /* Unary operators have no second operand */
+    if (expr->operands[1]) {
+        op2 = expr_eval(expr->operands[1]);
+        if (!op2) {
+            return NULL;
+        } else if (op2->type == ET_INVAL) {
+            res = expr_clone(op2);
+            goto EVAL_END;
+        }
+    }
+
+    /* Both operands were successfully evaluated, so each is a constant or a
+     * symbol (plus an addend).
+     */
+    /* TODO Improve qualiity of error messages, probably by returning them from
+     * expr_*() partial evaluation functions.
+     */
+    if (expr_fold(&key, expr->type, op1, op2, &msg) == 0) {
+        res = expr_intern(&key);
+    } else {
+        res = expr_alloc_inval(msg);
+    }
+
+EVAL_END:
+    if (!res) {
+        return NULL;
+    }
+
+    expr_free(node->result);
+    node->result = res;
+    node->result_gen = expr_generation;
+    return res;
 }
 
 /* vim: set tw=80 ft=c: */
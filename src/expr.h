@@ -8,6 +8,8 @@
 #ifndef EXPR_H_
 #define EXPR_H_
 
+#include <stdint.h>
+
 #include "symbol_table.h"
 
 #define EXPR_IS_OP(e) ((e) && (e)->type > ET_OP_START)
@@ -52,10 +54,33 @@ enum expr_type {
 /**
  * Structure for storing an expression as a tree for later evaluation (for when
  * there are unresolved symbols).
+ *
+ * Nodes are hash-consed: structurally identical expressions are the same node,
+ * so the trees form a DAG. Nodes must not be modified once they are created;
+ * they are shared by reference count (see expr_clone() and expr_free()).
  */
 struct expr_node {
     enum expr_type type;
 
+    /**
+     * Number of references to this node.
+     */
+    int refs;
+
+    /**
+     * Hash of the node's contents, and the next node in the same bucket of the
+     * table of unique nodes. Invalid expressions are never shared.
+     */
+    uint32_t hash;
+    struct expr_node *next;
+
+    /**
+     * Cached result of expr_eval(), and the symbol generation it was computed
+     * in (see expr_invalidate()).
+     */
+    struct expr_node *result;
+    unsigned result_gen;
+
     union {
         /**
          * If type is ET_CONST, a section and value of the constant.
@@ -89,18 +114,45 @@ struct expr_node {
     };
 };
 
+/**
+ * Function called when a value is folded from the distance between two values
+ * in the same section (see expr_set_pin_fn()).
+ */
+typedef void (*expr_pin_fn)(enum section sec, int value1, int value2);
+
+/**
+ * Sets the function called whenever the distance between two values in the
+ * same section is folded into a constant. The assembler uses this to keep the
+ * code between them together, since it can no longer be moved apart.
+ * @param fn Function to call, or NULL for none.
+ */
+void expr_set_pin_fn(expr_pin_fn fn);
+
+/**
+ * Reports that the distance between two values in a section was folded into a
+ * constant (by calling the function set by expr_set_pin_fn()).
+ * @param sec Section of the values.
+ * @param value1 First value.
+ * @param value2 Second value.
+ */
+void expr_pin(enum section sec, int value1, int value2);
+
+/**
+ * Notifies the expression module that a symbol has been defined or undefined,
+ * so cached evaluations which depended on it have to be redone.
+ */
+void expr_invalidate(void);
+
 /**
  * Creates/allocates an expression node from its operands and type.
  * For unary operator types, the second operand (@p op2) should be NULL.
- * This allocates a new node and assumes that the operands are also dynamically
- * allocated and will not be freed by external code. When expr_free() is called
- * on a head expression node, all of the children will be freed as well; this
- * means that child nodes should not be freed before their head nodes.
+ * This takes over the caller's references to the operands. If an identical
+ * node already exists, it is shared instead of allocating a new one.
  *
  * @param type Type of the node to create.
  * @param op1 First operand.
  * @param op2 Second operand.
- * @return Newly allocated expression node, or NULL if there is an error.
+ * @return Reference to the expression node, or NULL if there is an error.
  */
 struct expr_node *expr_alloc(enum expr_type type,
         struct expr_node *op1, struct expr_node *op2);
@@ -109,7 +161,7 @@ struct expr_node *expr_alloc(enum expr_type type,
  * Creates/allocates an expression node representing a offset into a section.
  * @param sec Section of the value.
  * @param offset Offset into section @p sec.
- * @return Newly allocated expression node, or NULL if there is an error.
+ * @return Reference to the expression node, or NULL if there is an error.
  */
 struct expr_node *expr_alloc_const(enum section sec, int offset);
 
@@ -117,34 +169,83 @@ struct expr_node *expr_alloc_const(enum section sec, int offset);
  * Creates/allocates an expression node representing an entry in the symbol
  * table.
  * @param sym Symbol this expression points to.
- * @return Newly allocated expression node, or NULL if there is an error.
+ * @return Reference to the expression node, or NULL if there is an error.
  */
 struct expr_node *expr_alloc_sym(const struct symbol_ent *sym);
 
 /**
- * Makes a deep clone of an expression node.
+ * Creates/allocates an invalid expression.
+ * @param msg Error message describing why the expression is invalid.
+ * @return Reference to the expression node, or NULL if there is an error.
+ */
+struct expr_node *expr_alloc_inval(const char *msg);
+
+/**
+ * Acquires another reference to an expression.
+ * Since nodes are immutable, this does not copy anything.
  * @param expr Expression to clone.
- * @return Clone of @p expr.
+ * @return @p expr.
  */
 struct expr_node *expr_clone(const struct expr_node *expr);
 
 /**
- * Frees an expression node and all of its children.
+ * Releases a reference to an expression node, freeing it (and releasing its
+ * children) if it was the last one.
  * @param expr Expression to free.
  */
 void expr_free(struct expr_node *expr);
 
 /**
- * Attempts to evaluate an expression.
- * If the evaluation results in an error (e.g. subtracting symbols from
- * different, non-absolute sections), the expression type will be set to
- * ET_INVAL and all of its children will be freed.
- * If evaluation was successful, @p expr will be of type ET_CONST and all of its
- * children (if it had any) will be freed.
+ * Finds an undefined symbol referenced by an expression.
+ * @param expr Expression to search.
+ * @return The first undefined symbol found, or NULL if there are none.
+ */
+const struct symbol_ent *expr_find_undef(const struct expr_node *expr);
+
+/**
+ * Resolves all references to symbols in a (local label) scope.
+ * This should be done before the scope is freed. Resolved symbols are replaced
+ * by constants; if a symbol in the scope is still undefined, the result is an
+ * invalid expression.
+ * @param expr Expression to resolve. The reference to this is released.
+ * @param scope Table of the symbols to resolve.
+ * @return Reference to the resolved expression, or NULL on failure.
+ */
+struct expr_node *expr_resolve_scope(struct expr_node *expr,
+        const struct symbol_table *scope);
+
+/**
+ * Function called for each leaf of an expression by expr_map_leaves().
+ * @param leaf Leaf (of type ET_CONST or ET_SYM).
+ * @param arg Argument passed to expr_map_leaves().
+ * @return Reference to the expression to replace the leaf with, or NULL on
+ * failure.
+ */
+typedef struct expr_node *(*expr_leaf_fn)(const struct expr_node *leaf,
+        void *arg);
+
+/**
+ * Builds a copy of an expression with each constant and symbol replaced.
+ * The copy is folded as it is built, as by expr_alloc().
+ * @param expr Expression to copy.
+ * @param fn Function giving the replacement of each leaf.
+ * @param arg Argument to pass to @p fn.
+ * @return Reference to the new expression, or NULL on failure.
+ */
+struct expr_node *expr_map_leaves(const struct expr_node *expr,
+        expr_leaf_fn fn, void *arg);
+
+/**
+ * Evaluates an expression as far as possible.
+ * The result is cached in the expression, so each unique expression is only
+ * evaluated once no matter how many places reference it (until another symbol
+ * is defined).
  * @param expr Expression to evaluate.
- * @return 0 if the expression could be fully evaluated, -1 if not.
+ * @return The result, which is of type ET_CONST, ET_SYM (for a symbol which is
+ * still undefined, plus an addend), or ET_INVAL. This is owned by @p expr and
+ * is only valid as long as it is. NULL is returned if there is a memory error.
  */
-int expr_eval(struct expr_node *expr);
+const struct expr_node *expr_eval(const struct expr_node *expr);
 
 #endif /* EXPR_H_ */
 
@@ -71,6 +71,7 @@ int hashtab_init_size(struct hash_table *ht, size_t bucket_count) {
 
     ht->bucket_count = bucket_count;
     ht->size = 0;
+    return 0;
 }
 
 void hashtab_destroy(struct hash_table *ht) {
@@ -0,0 +1,315 @@
+/**
+ * @file include.c
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash_table.h"
+#include "include.h"
+#include "tixasm.h"
+
+void yyerror(char *s);
+
+/**
+ * All loaded files, keyed by canonical path.
+ */
+static struct hash_table include_cache;
+static int include_cache_init = 0;
+
+/**
+ * Files which were replaced in the cache because they were modified while
+ * still being scanned. These are freed in include_destroy().
+ */
+static struct include_file **include_stale = NULL;
+static int include_stale_count = 0;
+static int include_stale_cap = 0;
+
+static void include_file_free(struct include_file *file) {
+    if (!file) {
+        return;
+    }
+
+    if (file->mapped) {
+        munmap(file->data, file->size + 2);
+    } else {
+        free(file->data);
+    }
+
+    free(file->path);
+    free(file);
+}
+
+/**
+ * Loads the contents of a file.
+ * The file is mapped when the two trailing null bytes fit in the zero-filled
+ * tail of the last page; otherwise (or if mapping fails) it is read into a
+ * buffer.
+ */
+static int include_load(struct include_file *file, int fd, size_t size) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t tail = size % page_size;
+
+    file->size = size;
+    if (tail != 0 && tail <= page_size - 2) {
+        file->data = mmap(NULL, size + 2, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE, fd, 0);
+        if (file->data != MAP_FAILED) {
+            file->mapped = 1;
+            return 0;
+        }
+    }
+
+    file->mapped = 0;
+    file->data = malloc(size + 2);
+    if (!file->data) {
+        return -1;
+    }
+
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = read(fd, file->data + total, size - total);
+        if (n <= 0) {
+            free(file->data);
+            file->data = NULL;
+            return -1;
+        }
+
+        total += n;
+    }
+
+    file->data[size] = 0;
+    file->data[size+1] = 0;
+    return 0;
+}
+
+struct include_file *include_get(const char *path) {
+    char real[PATH_MAX];
+    struct stat st;
+    struct include_file *file;
+    char *old_path = NULL;
+    int fd;
+
+    if (!include_cache_init) {
+        if (hashtab_init_size(&include_cache, 64) < 0) {
+            return NULL;
+        }
+
+        include_cache_init = 1;
+    }
+
+    if (!realpath(path, real)) {
+        return NULL;
+    }
+
+    fd = open(real, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    file = hashtab_get(&include_cache, real);
+    if (file) {
+        if (file->mtime.tv_sec == st.st_mtim.tv_sec
+                && file->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            close(fd);
+            return file;
+        }
+
+        /* Modified since it was loaded. If it is still being scanned, the old
+         * contents have to stay around until the end.
+         */
+        if (file->active > 0) {
+            if (include_stale_count == include_stale_cap) {
+                int cap = include_stale_cap ? include_stale_cap * 2 : 8;
+                struct include_file **stale = realloc(include_stale,
+                        cap * sizeof(*stale));
+                if (!stale) {
+                    close(fd);
+                    return NULL;
+                }
+
+                include_stale = stale;
+                include_stale_cap = cap;
+            }
+
+            include_stale[include_stale_count++] = file;
+        } else {
+            /* Relocations refer to the path for error messages, so it is
+             * passed on to the new contents
+             */
+            old_path = file->path;
+            file->path = NULL;
+            include_file_free(file);
+        }
+
+        hashtab_remove(&include_cache, real);
+    }
+
+    file = calloc(1, sizeof(*file));
+    if (!file) {
+        free(old_path);
+        close(fd);
+        return NULL;
+    }
+
+    file->path = old_path ? old_path : strdup(real);
+    file->mtime = st.st_mtim;
+    if (!file->path || include_load(file, fd, st.st_size) < 0) {
+        close(fd);
+        free(file->path);
+        free(file);
+        return NULL;
+    }
+
+    /* The mapping stays valid after the descriptor is closed */
+    close(fd);
+
+    if (hashtab_set(&include_cache, real, file) < 0) {
+        include_file_free(file);
+        return NULL;
+    }
+
+    return file;
+}
+
+/**
+ * Gets a file from the cache, resolving relative paths against the directory
+ * of the file currently being scanned first.
+ */
+static struct include_file *include_resolve(const char *path) {
+    struct include_file *cur = lex_current_file();
+    struct include_file *file = NULL;
+
+    /* Relative paths are relative to the including file */
+    if (path[0] != '/' && cur) {
+        const char *slash = strrchr(cur->path, '/');
+        int dir_len = slash - cur->path;
+        char *full = malloc(dir_len + strlen(path) + 2);
+        if (!full) {
+            return NULL;
+        }
+
+        sprintf(full, "%.*s/%s", dir_len, cur->path, path);
+        file = include_get(full);
+        free(full);
+    }
+
+    if (!file) {
+        file = include_get(path);
+    }
+
+    return file;
+}
+
+int include_push(const char *path) {
+    struct include_file *file = include_resolve(path);
+    if (!file) {
+        fprintf(stderr, "Could not open include file \"%s\".\n", path);
+        return -1;
+    }
+
+    /* Checked before anything is pushed, so the file is never scanned */
+    if (file->once && file->open_count > 0) {
+        return 0;
+    }
+
+    return lex_push_file(file);
+}
+
+int include_binary(const char *path, int offset, int len) {
+    struct include_file *file = include_resolve(path);
+    uint8_t *bytes;
+
+    if (!file) {
+        fprintf(stderr, "Could not open binary file \"%s\".\n", path);
+        return -1;
+    }
+
+    if (offset < 0 || offset > file->size) {
+        fprintf(stderr, "Offset %d is past the end of \"%s\".\n", offset, path);
+        return -1;
+    }
+
+    if (len < 0) {
+        len = file->size - offset;
+    } else if (len > file->size - offset) {
+        fprintf(stderr, "Length %d is past the end of \"%s\".\n", len, path);
+        return -1;
+    }
+
+    if (len == 0) {
+        return 0;
+    }
+
+    /* The file is already mapped (and stays cached for repeated includes), so
+     * this is the only pass over the data.
+     */
+    bytes = asm_emit_reserve(len);
+    if (!bytes) {
+        return -1;
+    }
+
+    memcpy(bytes, file->data + offset, len);
+    return 0;
+}
+
+void include_mark_once(void) {
+    struct include_file *cur = lex_current_file();
+    if (cur) {
+        cur->once = 1;
+    }
+}
+
+int include_foreach(int (*fn)(const struct include_file *file, void *arg),
+        void *arg) {
+    if (!include_cache_init) {
+        return 0;
+    }
+
+    for (int i = 0; i < include_cache.bucket_count; i++) {
+        for (struct hash_bucket *b = include_cache.buckets[i]; b; b = b->next) {
+            if (fn(b->data, arg) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void include_destroy(void) {
+    for (int i = 0; i < include_stale_count; i++) {
+        include_file_free(include_stale[i]);
+    }
+
+    free(include_stale);
+    include_stale = NULL;
+    include_stale_count = 0;
+    include_stale_cap = 0;
+
+    if (!include_cache_init) {
+        return;
+    }
+
+    for (int i = 0; i < include_cache.bucket_count; i++) {
+        for (struct hash_bucket *b = include_cache.buckets[i]; b; b = b->next) {
+            include_file_free(b->data);
+        }
+    }
+
+    hashtab_destroy(&include_cache);
+    include_cache_init = 0;
+}
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,142 @@
+/**
+ * @file include.h
+ */
+
+#ifndef INCLUDE_H_
+#define INCLUDE_H_
+
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * Maximum depth of nested includes.
+ */
+#define INCLUDE_MAX_DEPTH 32
+
+/**
+ * A source file in the include cache.
+ * Files are mapped into memory once per process and shared by every include of
+ * them. The contents are followed by two null bytes so that flex can scan them
+ * in place.
+ */
+struct include_file {
+    /**
+     * Canonical path of the file (this is the key in the cache).
+     */
+    char *path;
+
+    /**
+     * Modification time of the file when it was loaded.
+     */
+    struct timespec mtime;
+
+    /**
+     * Contents of the file. This is writable (but private) since flex
+     * temporarily modifies the buffer it is scanning.
+     */
+    char *data;
+
+    /**
+     * Size of the contents, not including the trailing null bytes.
+     */
+    size_t size;
+
+    /**
+     * Whether @c data was mapped with mmap() (as opposed to malloc()).
+     */
+    int mapped;
+
+    /**
+     * Set by .once: the file should not be opened again after the first time.
+     */
+    int once;
+
+    /**
+     * Number of times the file has been opened for scanning.
+     */
+    int open_count;
+
+    /**
+     * Number of times the file is currently on the include stack.
+     */
+    int active;
+};
+
+/**
+ * Gets a file from the include cache, loading it if it has not been loaded yet
+ * or if it has been modified since it was loaded.
+ * @param path Path of the file.
+ * @return The cached file, or NULL if it could not be loaded.
+ */
+struct include_file *include_get(const char *path);
+
+/**
+ * Opens a file and starts scanning it, resolving relative paths against the
+ * directory of the file currently being scanned.
+ * If the file has been marked with .once and has already been opened, it is
+ * skipped without being scanned.
+ * @param path Path of the file, as written in the source.
+ * @return 0 if the file was opened or skipped, -1 on failure.
+ */
+int include_push(const char *path);
+
+/**
+ * Outputs the contents of a binary file to the current section.
+ * Relative paths are resolved in the same way as for include_push(), and the
+ * file is shared with the include cache.
+ * @param path Path of the file, as written in the source.
+ * @param offset Offset of the first byte to output.
+ * @param len Number of bytes to output, or -1 for the rest of the file.
+ * @return 0 on success, -1 on failure.
+ */
+int include_binary(const char *path, int offset, int len);
+
+/**
+ * Marks the file currently being scanned so that it is only ever included
+ * once.
+ */
+void include_mark_once(void);
+
+/**
+ * Calls a function on each file in the include cache: every file which has
+ * been scanned or included since the cache was last destroyed.
+ * @param fn Function to call.
+ * @param arg Passed to @p fn.
+ * @return 0 on success, or -1 as soon as @p fn returns -1.
+ */
+int include_foreach(int (*fn)(const struct include_file *file, void *arg),
+        void *arg);
+
+/**
+ * Unmaps and frees all cached files.
+ */
+void include_destroy(void);
+
+/* These are implemented in z80.l since they need access to the flex buffer
+ * stack.
+ */
+
+/**
+ * Starts scanning a file. Scanning continues with the previous buffer once the
+ * end of the file is reached.
+ * @param file File to scan.
+ * @return 0 on success, -1 if includes are nested too deeply.
+ */
+int lex_push_file(struct include_file *file);
+
+/**
+ * Gets the file currently being scanned.
+ * @return The file, or NULL if reading from yyin.
+ */
+struct include_file *lex_current_file(void);
+
+/**
+ * Gets the line of the statement being parsed. Unlike yylineno, this does not
+ * move on to the next line once the parser has read the end of the statement.
+ * @return Line of the last token before the end of a line.
+ */
+int lex_line(void);
+
+#endif /* INCLUDE_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,1340 @@
+/**
+ * @file lines.c
+ *
+ * Lines are encoded with the normal scanner, parser, and assembler, one at a
+ * time in the same assembler state: the output and relocations are cleared
+ * before each line, and the symbols it defines are undefined after it, so that
+ * every reference to another line is left as a relocation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chunk.h"
+#include "include.h"
+#include "lines.h"
+#include "opcode.h"
+#include "scan.h"
+#include "tixasm.h"
+#include "z80.tab.h"
+
+extern int yylineno;
+
+/**
+ * A symbol defined by the line being encoded, as reported by asm_define_sym().
+ */
+struct lines_sym {
+    const struct symbol_ent *sym;
+    char *name;
+    int local;
+    enum section sec;
+    int value;
+
+    /**
+     * Number of scopes opened when the symbol was defined. A local symbol is
+     * freed once its scope is closed.
+     */
+    int scope;
+};
+
+static struct lines_sym *lines_syms = NULL;
+static int lines_sym_count = 0, lines_sym_capacity = 0;
+
+/**
+ * Reference being resolved, which folded distances are pinned to.
+ */
+static struct lines_ref *lines_pin_ref = NULL;
+
+/**
+ * Records the symbols defined while a line is encoded. This is the define
+ * function of the assembler.
+ */
+static void lines_on_define(const struct symbol_ent *sym, int local) {
+    if (lines_sym_count == lines_sym_capacity) {
+        int capacity = lines_sym_capacity ? lines_sym_capacity * 2 : 8;
+        struct lines_sym *syms = realloc(lines_syms,
+                capacity * sizeof(*syms));
+        if (!syms) {
+            return;
+        }
+
+        lines_syms = syms;
+        lines_sym_capacity = capacity;
+    }
+
+    struct lines_sym *ls = &lines_syms[lines_sym_count];
+    ls->name = strdup(sym->name);
+    if (!ls->name) {
+        return;
+    }
+
+    ls->sym = sym;
+    ls->local = local;
+    ls->sec = sym->sec;
+    ls->value = sym->value;
+    ls->scope = asm_get_scope_count();
+    lines_sym_count++;
+}
+
+/**
+ * Extends the range of the reference being resolved to cover two values. This
+ * is the pin function of expressions while resolving.
+ */
+static void lines_pin(enum section sec, int value1, int value2) {
+    struct lines_ref *ref = lines_pin_ref;
+    int start = value1 < value2 ? value1 : value2;
+    int end = value1 < value2 ? value2 : value1;
+
+    if (!ref) {
+        return;
+    }
+
+    if (ref->pin_sec == SEC_UNDEF) {
+        ref->pin_sec = sec;
+        ref->pin_start = start;
+        ref->pin_end = end;
+    } else if (ref->pin_sec == sec) {
+        if (start < ref->pin_start) {
+            ref->pin_start = start;
+        }
+
+        if (end > ref->pin_end) {
+            ref->pin_end = end;
+        }
+    }
+}
+
+int lines_init(struct lines *ls) {
+    ls->count = 0;
+    ls->capacity = 0;
+    ls->lines = NULL;
+    ls->encoded = 0;
+    ls->resolved = 0;
+
+    if (hashtab_init_size(&ls->globals, LINES_BUCKET_COUNT) < 0) {
+        return -1;
+    }
+
+    if (hashtab_init_size(&ls->locals, LINES_BUCKET_COUNT) < 0) {
+        hashtab_destroy(&ls->globals);
+        return -1;
+    }
+
+    if (vector_init(&ls->dirty) < 0) {
+        hashtab_destroy(&ls->globals);
+        hashtab_destroy(&ls->locals);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void lines_free_line(struct lines_line *line) {
+    if (!line) {
+        return;
+    }
+
+    for (int i = 0; i < line->ref_count; i++) {
+        expr_free(line->refs[i].expr);
+    }
+
+    free(line->refs);
+    free(line->defs);
+    free(line->bytes);
+    free(line->text);
+    free(line);
+}
+
+/**
+ * Frees the names in a table of struct lines_name.
+ */
+static void lines_free_names(struct hash_table *names) {
+    for (int i = 0; i < names->bucket_count; i++) {
+        for (struct hash_bucket *b = names->buckets[i]; b; b = b->next) {
+            struct lines_name *name = b->data;
+            vector_destroy(&name->users);
+            free((char *) name->sym.name);
+            free(name);
+        }
+    }
+
+    hashtab_destroy(names);
+}
+
+void lines_destroy(struct lines *ls) {
+    for (int i = 0; i < ls->count; i++) {
+        lines_free_line(ls->lines[i]);
+    }
+
+    free(ls->lines);
+    ls->lines = NULL;
+    ls->count = ls->capacity = 0;
+
+    lines_free_names(&ls->globals);
+    lines_free_names(&ls->locals);
+    vector_destroy(&ls->dirty);
+}
+
+/**
+ * Gets a name, adding it if it is not there yet.
+ * @return The name, or NULL on failure.
+ */
+static struct lines_name *lines_get_name(struct lines *ls, const char *str,
+        int local) {
+    struct hash_table *names = local ? &ls->locals : &ls->globals;
+    struct lines_name *name = hashtab_get(names, str);
+    if (name) {
+        return name;
+    }
+
+    name = calloc(1, sizeof(*name));
+    if (!name) {
+        return NULL;
+    }
+
+    name->sym.name = strdup(str);
+    name->sym.type = ST_UNDEF;
+    name->sym.sec = SEC_UNDEF;
+    name->local = local;
+    if (!name->sym.name || vector_init(&name->users) < 0
+            || hashtab_set(names, str, name) < 0) {
+        free((char *) name->sym.name);
+        free(name);
+        return NULL;
+    }
+
+    return name;
+}
+
+/**
+ * Queues a reference to be resolved.
+ */
+static void lines_mark(struct lines *ls, struct lines_ref *ref) {
+    if (!ref->dirty && vector_add(&ls->dirty, ref) == 0) {
+        ref->dirty = 1;
+    }
+}
+
+/**
+ * Queues the references which depend on a global name.
+ */
+static void lines_mark_users(struct lines *ls, struct lines_name *name) {
+    for (int i = 0; i < name->users.size; i++) {
+        lines_mark(ls, name->users.elements[i]);
+    }
+}
+
+/**
+ * Adds a reference to (or removes it from) the users of the global names in an
+ * expression.
+ * @return 0 on success, -1 on failure.
+ */
+static int lines_link_users(struct lines_ref *ref,
+        const struct expr_node *expr, int add) {
+    if (EXPR_IS_OP(expr)) {
+        if (lines_link_users(ref, expr->operands[0], add) < 0) {
+            return -1;
+        }
+
+        return expr->operands[1]
+            ? lines_link_users(ref, expr->operands[1], add) : 0;
+    }
+
+    if (expr->type != ET_SYM) {
+        return 0;
+    }
+
+    struct lines_name *name = (struct lines_name *) expr->sym;
+    if (name->local) {
+        return 0;
+    }
+
+    if (add) {
+        return vector_add(&name->users, ref);
+    }
+
+    for (int i = 0; i < name->users.size; i++) {
+        if (name->users.elements[i] == ref) {
+            name->users.elements[i] = name->users.elements[--name->users.size];
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * State while capturing the relocations of a line.
+ */
+struct lines_capture {
+    struct lines *ls;
+
+    /**
+     * Set if a local label is referenced.
+     */
+    int local;
+};
+
+/**
+ * Replaces a symbol of the assembler with the name it refers to, which stays
+ * valid after the assembler state is gone. This is a leaf function for
+ * expr_map_leaves().
+ */
+static struct expr_node *lines_capture_leaf(const struct expr_node *leaf,
+        void *arg) {
+    struct lines_capture *cap = arg;
+    const struct symbol_ent *sym = leaf->sym;
+    struct lines_name *name;
+    struct expr_node *expr;
+    int local;
+
+    if (leaf->type != ET_SYM) {
+        return expr_clone(leaf);
+    }
+
+    /* Only symbols defined later on the same line can be defined here */
+    if (sym->type != ST_UNDEF) {
+        return expr_alloc_const(sym->sec, sym->value + leaf->addend);
+    }
+
+    local = asm_local_table && symtab_search(asm_local_table, sym->name) == sym;
+    name = lines_get_name(cap->ls, sym->name, local);
+    if (!name) {
+        return NULL;
+    }
+
+    cap->local |= local;
+    expr = expr_alloc_sym(&name->sym);
+    if (leaf->addend != 0) {
+        expr = expr_alloc('+', expr, expr_alloc_const(SEC_ABS, leaf->addend));
+    }
+
+    return expr;
+}
+
+/**
+ * Copies the output, symbols, and relocations of the line which was just
+ * assembled into its record.
+ * @return 0 on success, -1 if the line can't be encoded on its own.
+ */
+static int lines_capture(struct lines *ls, struct lines_line *line,
+        int scope) {
+    const struct section_buf *buf;
+    struct lines_capture cap = { ls, 0 };
+    int count = 0;
+
+    line->sec = asm_get_sec();
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        enum section sec = OBJ_IDX_SEC(i);
+        if (sec != line->sec && asm_get_section(sec)->size > 0) {
+            return -1;
+        }
+    }
+
+    /* Absolute output moves the program counter of the absolute section,
+     * which every line would start at 0.
+     */
+    buf = asm_get_section(line->sec);
+    if (line->sec == SEC_ABS && buf->size > 0) {
+        return -1;
+    }
+
+    line->size = buf->size;
+    line->terminal = asm_get_terminal();
+    if (line->size > 0) {
+        line->bytes = malloc(line->size);
+        if (!line->bytes) {
+            return -1;
+        }
+
+        memcpy(line->bytes, buf->data, line->size);
+    }
+
+    line->global = asm_get_scope_count() != scope;
+    if (lines_sym_count > 0) {
+        line->defs = calloc(lines_sym_count, sizeof(*line->defs));
+        if (!line->defs) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < lines_sym_count; i++) {
+        const struct lines_sym *sym = &lines_syms[i];
+        struct lines_def *def = &line->defs[line->def_count];
+
+        def->name = lines_get_name(ls, sym->name, sym->local);
+        if (!def->name) {
+            return -1;
+        }
+
+        def->line = line;
+        def->sec = sym->sec;
+        def->value = sym->value;
+        line->def_count++;
+    }
+
+    for (int i = 0; i < reltab_get_size(asm_reloc_table); i++) {
+        if (reltab_get(asm_reloc_table, i)->type != RT_UNDEF) {
+            count++;
+        }
+    }
+
+    if (count > 0) {
+        line->refs = calloc(count, sizeof(*line->refs));
+        if (!line->refs) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < reltab_get_size(asm_reloc_table); i++) {
+        const struct reloc_ent *ent = reltab_get(asm_reloc_table, i);
+        struct lines_ref *ref = &line->refs[line->ref_count];
+        struct expr_node *expr;
+
+        if (ent->type == RT_UNDEF) {
+            continue;
+        }
+
+        if (ent->sec != line->sec) {
+            return -1;
+        }
+
+        expr = ent->type & RT_EXPR
+            ? expr_clone(ent->expr) : expr_alloc_sym(ent->sym);
+
+        cap.local = 0;
+        ref->expr = expr_map_leaves(expr, lines_capture_leaf, &cap);
+        expr_free(expr);
+        if (!ref->expr || ref->expr->type == ET_INVAL) {
+            expr_free(ref->expr);
+            return -1;
+        }
+
+        ref->line = line;
+        ref->type = ent->type & ~RT_EXPR;
+        ref->offset = ent->offset;
+        ref->value = ent->value;
+        ref->local = cap.local;
+        ref->pin_sec = SEC_UNDEF;
+        line->ref_count++;
+    }
+
+    return 0;
+}
+
+/**
+ * Makes the symbols defined by the line which was just assembled undefined
+ * again, so that the next lines refer to them through relocations.
+ */
+static void lines_forget_syms(void) {
+    int scope = asm_get_scope_count();
+
+    for (int i = 0; i < lines_sym_count; i++) {
+        const struct lines_sym *sym = &lines_syms[i];
+
+        /* Local symbols are gone once a global label closes their scope */
+        if (!sym->local || sym->scope == scope) {
+            asm_undefine_sym(sym->sym);
+        }
+
+        free(sym->name);
+    }
+
+    lines_sym_count = 0;
+}
+
+/**
+ * Assembles a line on its own.
+ * @param path Path of the file, for error messages.
+ * @param text Text of the line (without the newline).
+ * @param len Length of @p text.
+ * @param lineno Line number.
+ * @param sec Section at the start of the line.
+ * @return The record of the line, or NULL if it can't be encoded on its own.
+ */
+static struct lines_line *lines_encode(struct lines *ls, const char *path,
+        const char *text, size_t len, int lineno, enum section sec) {
+    struct include_file part;
+    struct lines_line *line;
+    int scope = asm_get_scope_count();
+    int ret;
+
+    line = calloc(1, sizeof(*line));
+    if (!line) {
+        return NULL;
+    }
+
+    /* The scanners need two null bytes at the end, and flex writes to the
+     * buffer it scans
+     */
+    line->text = malloc(len + 3);
+    if (!line->text) {
+        free(line);
+        return NULL;
+    }
+
+    memcpy(line->text, text, len);
+    line->text[len] = '\n';
+    line->text[len + 1] = 0;
+    line->text[len + 2] = 0;
+    line->len = len;
+    line->start_sec = sec;
+
+    memset(&part, 0, sizeof(part));
+    part.path = (char *) path;
+    part.data = line->text;
+    part.size = len + 1;
+
+    asm_clear_output();
+    asm_set_sec(sec);
+    lex_reset();
+    lex_push_file(&part);
+    yylineno = lineno;
+
+    ret = yyparse();
+    lex_reset();
+
+    if (ret != 0 || lines_capture(ls, line, scope) < 0) {
+        ret = -1;
+    }
+
+    lines_forget_syms();
+    if (ret != 0) {
+        lines_free_line(line);
+        return NULL;
+    }
+
+    return line;
+}
+
+/**
+ * Finds the definition of a local label in the scope of a line.
+ * @param idx Index of the line.
+ * @return The definition, or NULL if there is none.
+ */
+static const struct lines_def *lines_find_local(const struct lines *ls,
+        int idx, const struct lines_name *name) {
+    int scope = idx;
+
+    while (scope > 0 && !ls->lines[scope]->global) {
+        scope--;
+    }
+
+    for (int i = scope; i < ls->count; i++) {
+        const struct lines_line *line = ls->lines[i];
+        if (i > scope && line->global) {
+            break;
+        }
+
+        for (int j = 0; j < line->def_count; j++) {
+            if (line->defs[j].name == name) {
+                return &line->defs[j];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * State while resolving a reference.
+ */
+struct lines_resolve {
+    const struct lines *ls;
+
+    /**
+     * Index of the line of the reference.
+     */
+    int idx;
+};
+
+/**
+ * Gets the current value of a leaf of a reference's expression. This is a leaf
+ * function for expr_map_leaves().
+ */
+static struct expr_node *lines_resolve_leaf(const struct expr_node *leaf,
+        void *arg) {
+    const struct lines_resolve *res = arg;
+    const struct lines_line *line = res->ls->lines[res->idx];
+    const struct lines_name *name;
+    const struct lines_def *def;
+    int value;
+
+    if (leaf->type == ET_CONST) {
+        return leaf->sec == SEC_ABS ? expr_clone(leaf)
+            : expr_alloc_const(leaf->sec, leaf->value + line->offset);
+    }
+
+    name = (const struct lines_name *) leaf->sym;
+    def = name->local ? lines_find_local(res->ls, res->idx, name) : name->def;
+    if (!def) {
+        /* A global symbol which isn't defined here is left for the linker */
+        return name->local ? expr_alloc_inval("Undefined local label")
+            : expr_clone(leaf);
+    }
+
+    value = def->value + leaf->addend;
+    if (def->sec != SEC_ABS) {
+        value += def->line->offset;
+    }
+
+    return expr_alloc_const(def->sec, value);
+}
+
+/**
+ * Resolves a reference: patches it into the bytes of its line if its value is
+ * known, or otherwise leaves it as a relocation to a symbol or section.
+ * @param idx Index of the line of the reference.
+ * @return 0 on success, -1 if the value is invalid or out of range.
+ */
+static int lines_resolve_ref(const struct lines *ls, int idx,
+        struct lines_ref *ref) {
+    struct lines_resolve arg = { ls, idx };
+    struct lines_line *line = ref->line;
+    const struct expr_node *res;
+    struct expr_node *expr;
+    uint8_t *field = &line->bytes[ref->offset];
+    uint8_t bytes[2];
+    int value = ref->value;
+    int ret = 0;
+
+    if (ref->type == RT_REL_JUMP) {
+        value += line->offset;
+    }
+
+    ref->pin_sec = SEC_UNDEF;
+    lines_pin_ref = ref;
+    expr = expr_map_leaves(ref->expr, lines_resolve_leaf, &arg);
+    res = expr_eval(expr);
+    lines_pin_ref = NULL;
+
+    ref->relocated = 0;
+    ref->target = NULL;
+    if (!res || res->type == ET_INVAL) {
+        ret = -1;
+    } else if (res->type == ET_CONST && (res->sec == SEC_ABS
+                || (ref->type == RT_REL_JUMP && res->sec == line->sec))) {
+        int len = reltab_encode(ref->type, value, res->value, bytes);
+        if (len < 0) {
+            ret = -1;
+        } else {
+            memcpy(field, bytes, len);
+            if (res->sec != SEC_ABS) {
+                /* From the last byte of the jump, which is always in its
+                 * own fragment (unlike its end)
+                 */
+                lines_pin_ref = ref;
+                lines_pin(res->sec, value - 1, res->value);
+                lines_pin_ref = NULL;
+            }
+        }
+    } else if (res->type == ET_CONST || res->type == ET_SYM) {
+        ref->relocated = 1;
+        if (res->type == ET_CONST) {
+            ref->target_sec = res->sec;
+            ref->addend = res->value;
+        } else {
+            ref->target = (struct lines_name *) res->sym;
+            ref->target_sec = SEC_UNDEF;
+            ref->addend = res->addend;
+        }
+
+        /* Put back the placeholder in case the field was patched before */
+        switch (ref->type) {
+        case RT_RST:
+        case RT_IM:
+        case RT_BIT:
+            field[0] = ref->value;
+            break;
+        case RT_16_BIT:
+        case RT_U_16_BIT:
+        case RT_S_16_BIT:
+            field[1] = 0;
+            /* Fall through */
+        default:
+            field[0] = 0;
+            break;
+        }
+    } else {
+        /* Too complex to relocate */
+        ret = -1;
+    }
+
+    expr_free(expr);
+    return ret;
+}
+
+/**
+ * Splits a file into lines.
+ * @param[out] starts Set to the offset of each line. This should be freed.
+ * @param[out] lens Set to the length of each line. This should be freed.
+ * @return Number of lines, or -1 on failure.
+ */
+static int lines_split(const struct include_file *file, size_t **starts,
+        size_t **lens) {
+    const char *data = file->data;
+    const char *end = data + file->size;
+    int count = 0;
+
+    for (const char *ptr = data; ptr < end; count++) {
+        const char *eol = memchr(ptr, '\n', end - ptr);
+        ptr = eol ? eol + 1 : end;
+    }
+
+    *starts = malloc((count ? count : 1) * sizeof(**starts));
+    *lens = malloc((count ? count : 1) * sizeof(**lens));
+    if (!*starts || !*lens) {
+        free(*starts);
+        free(*lens);
+        return -1;
+    }
+
+    count = 0;
+    for (const char *ptr = data; ptr < end; count++) {
+        const char *eol = memchr(ptr, '\n', end - ptr);
+        if (!eol) {
+            eol = end;
+        }
+
+        (*starts)[count] = ptr - data;
+        (*lens)[count] = eol - ptr;
+        ptr = eol + 1;
+    }
+
+    return count;
+}
+
+static int lines_same(const struct lines_line *line, const char *text,
+        size_t len) {
+    return line->len == len && memcmp(line->text, text, len) == 0;
+}
+
+/**
+ * Removes a line which is no longer in the file: its symbols are undefined,
+ * and the references which used them are queued.
+ */
+static void lines_remove(struct lines *ls, struct lines_line *line) {
+    for (int i = 0; i < line->def_count; i++) {
+        struct lines_def *def = &line->defs[i];
+        if (def->name->def == def) {
+            def->name->def = NULL;
+            lines_mark_users(ls, def->name);
+        }
+    }
+
+    for (int i = 0; i < line->ref_count; i++) {
+        struct lines_ref *ref = &line->refs[i];
+        lines_link_users(ref, ref->expr, 0);
+
+        /* Taken out of the queue before the line is freed */
+        ref->dirty = 2;
+    }
+}
+
+/**
+ * Adds the symbols and references of a newly encoded line.
+ * @return 0 on success, -1 if a symbol is already defined (or on failure).
+ */
+static int lines_add(struct lines *ls, struct lines_line *line) {
+    int ret = 0;
+
+    for (int i = 0; i < line->def_count; i++) {
+        struct lines_def *def = &line->defs[i];
+        if (def->name->local) {
+            continue;
+        }
+
+        if (def->name->def) {
+            ret = -1;
+            continue;
+        }
+
+        def->name->def = def;
+        lines_mark_users(ls, def->name);
+    }
+
+    for (int i = 0; i < line->ref_count; i++) {
+        struct lines_ref *ref = &line->refs[i];
+        if (lines_link_users(ref, ref->expr, 1) < 0) {
+            ret = -1;
+        }
+
+        lines_mark(ls, ref);
+    }
+
+    return ret;
+}
+
+/**
+ * Sends stderr to a temporary file, so that errors from lines which turn out
+ * not to be encodable on their own aren't shown.
+ * @param[out] log Set to the file.
+ * @return Descriptor of the original stderr, or -1 on failure.
+ */
+static int lines_hide_errors(FILE **log) {
+    int saved;
+
+    *log = tmpfile();
+    if (!*log) {
+        return -1;
+    }
+
+    fflush(stderr);
+    saved = dup(STDERR_FILENO);
+    if (saved < 0 || dup2(fileno(*log), STDERR_FILENO) < 0) {
+        if (saved >= 0) {
+            close(saved);
+        }
+
+        fclose(*log);
+        return -1;
+    }
+
+    return saved;
+}
+
+/**
+ * Restores stderr after lines_hide_errors().
+ * @return 1 if anything was written to it in the meantime, 0 if not.
+ */
+static int lines_restore_errors(int saved, FILE *log) {
+    long size;
+
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+
+    fseek(log, 0, SEEK_END);
+    size = ftell(log);
+    fclose(log);
+    return size != 0;
+}
+
+/**
+ * Gets the index of a symbol in an object being created, adding it as a
+ * reference if it is not already there (as in asm_to_object()).
+ */
+static int lines_object_sym(struct object *obj, struct hash_table *indices,
+        const char *name) {
+    intptr_t idx = (intptr_t) hashtab_get(indices, name);
+    if (idx > 0) {
+        return idx - 1;
+    }
+
+    idx = object_add_sym(obj, name, SEC_UNDEF, 0);
+    if (idx < 0 || hashtab_set(indices, name, (void *) (idx + 1)) < 0) {
+        return -1;
+    }
+
+    return idx;
+}
+
+/**
+ * Finds the last fragment of a section starting at or before an offset.
+ * @param idx Indices (in obj->frags) of the section's fragments, in order.
+ */
+static int lines_frag_at(const struct object *obj, const int idx[], int count,
+        int offset) {
+    int lo = 0, hi = count - 1;
+
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (obj->frags[idx[mid]].offset <= offset) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return lo;
+}
+
+/**
+ * Splits the sections of an object into fragments at global labels, as the
+ * assembler does, and pins together the fragments which references folded
+ * distances across.
+ * @return 0 on success, -1 on failure.
+ */
+static int lines_make_frags(const struct lines *ls, struct object *obj) {
+    int *idx[OBJ_SEC_COUNT] = { NULL };
+    int count[OBJ_SEC_COUNT] = { 0 };
+    int terminal[OBJ_SEC_COUNT] = { 0 };
+    int ret = -1;
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        idx[i] = malloc((ls->count + 1) * sizeof(*idx[i]));
+        if (!idx[i]) {
+            goto FRAGS_END;
+        }
+    }
+
+    for (int s = SEC_TEXT; s <= SEC_DATA; s++) {
+        struct obj_fragment frag = { s, 0, 0, 1, 0 };
+        idx[OBJ_SEC_IDX(s)][count[OBJ_SEC_IDX(s)]++] = obj->frag_count;
+        if (object_add_frag(obj, &frag) < 0) {
+            goto FRAGS_END;
+        }
+    }
+
+    for (int i = 0; i < ls->count; i++) {
+        const struct lines_line *line = ls->lines[i];
+        int s = OBJ_SEC_IDX(line->sec);
+
+        if (line->sec == SEC_ABS) {
+            continue;
+        }
+
+        if (line->global) {
+            struct obj_fragment *cur = &obj->frags[idx[s][count[s] - 1]];
+
+            /* Nothing has been output in the current fragment */
+            if (cur->offset == line->offset) {
+                cur->pc = line->offset;
+            } else {
+                struct obj_fragment frag = {
+                    line->sec, line->offset, line->offset, 1, 0,
+                };
+
+                cur->falls_through = !terminal[s];
+                idx[s][count[s]++] = obj->frag_count;
+                if (object_add_frag(obj, &frag) < 0) {
+                    goto FRAGS_END;
+                }
+            }
+        }
+
+        if (line->size > 0) {
+            terminal[s] = line->terminal;
+        }
+    }
+
+    for (int s = SEC_TEXT; s <= SEC_DATA; s++) {
+        int i = OBJ_SEC_IDX(s);
+        obj->frags[idx[i][count[i] - 1]].falls_through = !terminal[i];
+    }
+
+    for (int i = 0; i < ls->count; i++) {
+        const struct lines_line *line = ls->lines[i];
+
+        for (int j = 0; j < line->ref_count; j++) {
+            const struct lines_ref *ref = &line->refs[j];
+            int s = OBJ_SEC_IDX(ref->pin_sec);
+            int first, last;
+
+            if (ref->pin_sec != SEC_TEXT && ref->pin_sec != SEC_DATA) {
+                continue;
+            }
+
+            first = lines_frag_at(obj, idx[s], count[s], ref->pin_start);
+            last = lines_frag_at(obj, idx[s], count[s], ref->pin_end);
+            for (int k = first; k < last; k++) {
+                obj->frags[idx[s][k]].pinned = 1;
+            }
+        }
+    }
+
+    ret = 0;
+
+FRAGS_END:
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        free(idx[i]);
+    }
+
+    return ret;
+}
+
+/**
+ * Creates an object from the records.
+ * @return 0 on success, -1 on failure.
+ */
+static int lines_to_object(const struct lines *ls, struct object *obj,
+        const char *name) {
+    struct hash_table indices;
+
+    if (object_init(obj, name) < 0) {
+        return -1;
+    }
+
+    if (hashtab_init_size(&indices, LINES_BUCKET_COUNT) < 0) {
+        object_destroy(obj);
+        return -1;
+    }
+
+    for (int i = 0; i < ls->count; i++) {
+        const struct lines_line *line = ls->lines[i];
+        struct section_buf *buf = &obj->sections[OBJ_SEC_IDX(line->sec)];
+
+        if (line->size > 0) {
+            uint8_t *bytes = secbuf_reserve(buf, line->size);
+            if (!bytes) {
+                goto TO_OBJ_FAIL;
+            }
+
+            memcpy(bytes, line->bytes, line->size);
+        }
+
+        for (int j = 0; j < line->def_count; j++) {
+            const struct lines_def *def = &line->defs[j];
+            intptr_t idx;
+
+            if (def->name->local) {
+                continue;
+            }
+
+            idx = object_add_sym(obj, def->name->sym.name, def->sec,
+                    def->sec == SEC_ABS ? def->value
+                    : def->value + line->offset);
+            if (idx < 0 || hashtab_set(&indices, def->name->sym.name,
+                        (void *) (idx + 1)) < 0) {
+                goto TO_OBJ_FAIL;
+            }
+        }
+    }
+
+    for (int i = 0; i < ls->count; i++) {
+        const struct lines_line *line = ls->lines[i];
+
+        for (int j = 0; j < line->ref_count; j++) {
+            const struct lines_ref *ref = &line->refs[j];
+            struct obj_reloc rel;
+
+            if (!ref->relocated) {
+                continue;
+            }
+
+            rel.type = ref->type;
+            rel.sec = line->sec;
+            rel.offset = line->offset + ref->offset;
+            rel.value = ref->value;
+            if (ref->type == RT_REL_JUMP) {
+                rel.value += line->offset;
+            }
+
+            rel.target_sec = ref->target_sec;
+            rel.addend = ref->addend;
+            rel.expr_start = 0;
+            rel.expr_len = 0;
+            rel.sym = -1;
+            if (ref->target) {
+                rel.sym = lines_object_sym(obj, &indices,
+                        ref->target->sym.name);
+                if (rel.sym < 0) {
+                    goto TO_OBJ_FAIL;
+                }
+            }
+
+            if (object_add_reloc(obj, &rel) < 0) {
+                goto TO_OBJ_FAIL;
+            }
+        }
+    }
+
+    if (lines_make_frags(ls, obj) < 0) {
+        goto TO_OBJ_FAIL;
+    }
+
+    hashtab_destroy(&indices);
+    return 0;
+
+TO_OBJ_FAIL:
+    hashtab_destroy(&indices);
+    object_destroy(obj);
+    return -1;
+}
+
+/**
+ * Lays out the lines: each one is placed after the previous one in its
+ * section. Lines which move have all of their references (and the references
+ * to their symbols) queued.
+ */
+static void lines_layout(struct lines *ls) {
+    int offsets[OBJ_SEC_COUNT] = { 0 };
+
+    for (int i = 0; i < ls->count; i++) {
+        struct lines_line *line = ls->lines[i];
+        int *offset = &offsets[OBJ_SEC_IDX(line->sec)];
+
+        if (line->offset != *offset) {
+            line->offset = *offset;
+
+            for (int j = 0; j < line->ref_count; j++) {
+                lines_mark(ls, &line->refs[j]);
+            }
+
+            for (int j = 0; j < line->def_count; j++) {
+                const struct lines_def *def = &line->defs[j];
+                if (!def->name->local && def->sec != SEC_ABS
+                        && def->name->def == def) {
+                    lines_mark_users(ls, def->name);
+                }
+            }
+        }
+
+        *offset += line->size;
+    }
+}
+
+/**
+ * Queues the references to local labels in the scopes containing a range of
+ * lines, since what they refer to may have changed.
+ */
+static void lines_mark_scopes(struct lines *ls, int first, int last) {
+    if (ls->count == 0) {
+        return;
+    }
+
+    if (last >= ls->count) {
+        last = ls->count - 1;
+    }
+
+    /* A global label at the start of the range also changes the scope of the
+     * line before it
+     */
+    if (first > 0) {
+        first--;
+    }
+
+    while (first > 0 && !ls->lines[first]->global) {
+        first--;
+    }
+
+    while (last + 1 < ls->count && !ls->lines[last + 1]->global) {
+        last++;
+    }
+
+    for (int i = first; i <= last; i++) {
+        struct lines_line *line = ls->lines[i];
+        for (int j = 0; j < line->ref_count; j++) {
+            if (line->refs[j].local) {
+                lines_mark(ls, &line->refs[j]);
+            }
+        }
+    }
+}
+
+/**
+ * Resolves the queued references. References which fail stay queued.
+ * @return 0 on success, -1 if any failed.
+ */
+static int lines_resolve_all(struct lines *ls) {
+    int failed = 0;
+    int kept = 0;
+
+    /* References only know their line, so find the lines' indices */
+    for (int i = 0; i < ls->count; i++) {
+        ls->lines[i]->index = i;
+    }
+
+    expr_set_pin_fn(lines_pin);
+    for (int i = 0; i < ls->dirty.size; i++) {
+        struct lines_ref *ref = ls->dirty.elements[i];
+
+        if (lines_resolve_ref(ls, ref->line->index, ref) < 0) {
+            ls->dirty.elements[kept++] = ref;
+            failed = 1;
+        } else {
+            ref->dirty = 0;
+            ls->resolved++;
+        }
+    }
+
+    expr_set_pin_fn(NULL);
+    ls->dirty.size = kept;
+    return failed ? -1 : 0;
+}
+
+int lines_update(struct lines *ls, const char *path, struct object *obj) {
+    struct include_file *file = include_get(path);
+    struct lines_line **next = NULL;
+    struct lines_line **removed = NULL;
+    size_t *starts = NULL, *lens = NULL;
+    int count, prefix = 0, suffix = 0, removed_count = 0;
+    int first = -1, last = -1;
+    int started = 0, saved = -1;
+    enum section sec = SEC_ABS;
+    FILE *log = NULL;
+    int ret = -1;
+
+    ls->encoded = 0;
+    ls->resolved = 0;
+    if (!file || (count = lines_split(file, &starts, &lens)) < 0) {
+        return -1;
+    }
+
+    next = calloc(count ? count : 1, sizeof(*next));
+    removed = malloc((ls->count ? ls->count : 1) * sizeof(*removed));
+    if (!next || !removed) {
+        goto UPDATE_END;
+    }
+
+    /* Match up the unchanged lines at the start and end, and line by line in
+     * between if the number of lines is the same
+     */
+    while (prefix < count && prefix < ls->count && lines_same(
+                ls->lines[prefix], file->data + starts[prefix], lens[prefix])) {
+        next[prefix] = ls->lines[prefix];
+        prefix++;
+    }
+
+    while (suffix < count - prefix && suffix < ls->count - prefix) {
+        struct lines_line *line = ls->lines[ls->count - 1 - suffix];
+        int i = count - 1 - suffix;
+        if (!lines_same(line, file->data + starts[i], lens[i])) {
+            break;
+        }
+
+        next[i] = line;
+        suffix++;
+    }
+
+    for (int i = prefix; i < ls->count - suffix; i++) {
+        struct lines_line *line = ls->lines[i];
+        if (count == ls->count
+                && lines_same(line, file->data + starts[i], lens[i])) {
+            next[i] = line;
+        } else {
+            removed[removed_count++] = line;
+        }
+    }
+
+    if (removed_count > 0) {
+        first = last = prefix;
+    }
+
+    /* Only new lines have to be checked */
+    for (int i = prefix; i < count - suffix; i++) {
+        enum section dummy = SEC_TEXT;
+        const char *text = file->data + starts[i];
+        if (!next[i] && chunk_check_line(text, text + lens[i], &dummy) < 0) {
+            goto UPDATE_END;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        /* A line which now starts in another section has to be encoded again */
+        if (next[i] && next[i]->start_sec != sec) {
+            removed[removed_count++] = next[i];
+            next[i] = NULL;
+        }
+
+        if (!next[i]) {
+            if (!started) {
+                saved = lines_hide_errors(&log);
+                if (saved < 0 || asm_init() < 0) {
+                    goto UPDATE_END;
+                }
+
+                asm_set_define_fn(lines_on_define);
+                started = 1;
+            }
+
+            next[i] = lines_encode(ls, file->path, file->data + starts[i],
+                    lens[i], i + 1, sec);
+            if (!next[i]) {
+                goto UPDATE_END;
+            }
+
+            next[i]->offset = -1;
+            ls->encoded++;
+            if (first < 0 || i < first) {
+                first = i;
+            }
+
+            if (i > last) {
+                last = i;
+            }
+        }
+
+        sec = next[i]->sec;
+    }
+
+    if (started) {
+        asm_set_define_fn(NULL);
+        asm_destroy();
+        started = 0;
+        if (lines_restore_errors(saved, log)) {
+            saved = -1;
+            goto UPDATE_END;
+        }
+
+        saved = -1;
+    }
+
+    /* Everything is encoded, so the records can be updated */
+    for (int i = 0; i < removed_count; i++) {
+        lines_remove(ls, removed[i]);
+    }
+
+    int kept = 0;
+    for (int i = 0; i < ls->dirty.size; i++) {
+        struct lines_ref *ref = ls->dirty.elements[i];
+        if (ref->dirty != 2) {
+            ls->dirty.elements[kept++] = ref;
+        }
+    }
+
+    ls->dirty.size = kept;
+    for (int i = 0; i < removed_count; i++) {
+        lines_free_line(removed[i]);
+    }
+
+    free(ls->lines);
+    ls->lines = next;
+    ls->count = ls->capacity = count;
+    next = NULL;
+
+    ret = 0;
+    for (int i = first; first >= 0 && i <= last && i < count; i++) {
+        if (ls->lines[i]->offset < 0 && lines_add(ls, ls->lines[i]) < 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret < 0) {
+        /* A symbol is defined twice. Which definition is used depends on the
+         * order of the lines, so start over next time.
+         */
+        lines_destroy(ls);
+        lines_init(ls);
+        goto UPDATE_END;
+    }
+
+    lines_layout(ls);
+    if (first >= 0) {
+        lines_mark_scopes(ls, first, last);
+    }
+
+    ret = lines_resolve_all(ls);
+    if (ret == 0) {
+        ret = lines_to_object(ls, obj, file->path);
+    }
+
+UPDATE_END:
+    if (started) {
+        asm_set_define_fn(NULL);
+        asm_destroy();
+    }
+
+    if (saved >= 0) {
+        lines_restore_errors(saved, log);
+    }
+
+    /* Lines encoded for an update which failed are dropped */
+    if (next) {
+        for (int i = 0; i < count; i++) {
+            if (next[i] && next[i]->offset < 0) {
+                lines_free_line(next[i]);
+            }
+        }
+    }
+
+    free(next);
+    free(removed);
+    free(starts);
+    free(lens);
+    return ret;
+}
+
+/* vim: set tw=80 ft=c: */
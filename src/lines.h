@@ -0,0 +1,226 @@
+/**
+ * @file lines.h
+ */
+
+#ifndef LINES_H_
+#define LINES_H_
+
+#include <stdint.h>
+
+#include "expr.h"
+#include "hash_table.h"
+#include "object.h"
+#include "symbol_table.h"
+#include "vector.h"
+
+/**
+ * Number of buckets in the tables of names referenced by a file.
+ */
+#define LINES_BUCKET_COUNT 4096
+
+struct lines_line;
+
+/**
+ * A name referenced or defined by the lines of a file.
+ * Expressions in the records refer to names through @c sym, which is always
+ * undefined, so that they are never folded into the value a name had when the
+ * line was encoded.
+ */
+struct lines_name {
+    /**
+     * Symbol used in expressions. This has to be the first member, since a
+     * name is found from the symbol of a leaf.
+     */
+    struct symbol_ent sym;
+
+    int local;
+
+    /**
+     * For a global name, its definition, or NULL if it is defined in another
+     * file. Local names are looked up in the scope of the line using them.
+     */
+    struct lines_def *def;
+
+    /**
+     * For a global name, the relocations which depend on it.
+     */
+    struct vector users;
+};
+
+/**
+ * A symbol defined by a line.
+ */
+struct lines_def {
+    struct lines_name *name;
+    struct lines_line *line;
+
+    /**
+     * Section of the symbol: SEC_ABS, or the section of the line, in which case
+     * @c value is relative to the start of the line.
+     */
+    enum section sec;
+    int value;
+};
+
+/**
+ * A field of a line which depends on other lines, or on where the line ends up.
+ */
+struct lines_ref {
+    struct lines_line *line;
+
+    /**
+     * Type of the field (without RT_EXPR), its offset from the start of the
+     * line, and the value field of its relocation (relative to the start of the
+     * line for RT_REL_JUMP).
+     */
+    enum reloc_type type;
+    int offset;
+    int value;
+
+    /**
+     * The operand expression. Constants in the section of the line are
+     * relative to its start, and symbols are those of struct lines_name.
+     */
+    struct expr_node *expr;
+
+    /**
+     * Whether the expression uses any local labels.
+     */
+    int local;
+
+    /**
+     * Whether the reference has to be resolved again.
+     */
+    int dirty;
+
+    /**
+     * Result of the last resolution: either the field was patched into the
+     * line's bytes, or it is left as a relocation of the object (whose offset
+     * and value are relative to the start of the line).
+     */
+    int relocated;
+    struct lines_name *target;
+    enum section target_sec;
+    int addend;
+
+    /**
+     * Range of the section which was folded into the field, which has to be
+     * kept together by --gc-sections (pin_sec is SEC_UNDEF if there is none).
+     */
+    enum section pin_sec;
+    int pin_start;
+    int pin_end;
+};
+
+/**
+ * Record of one line of a file: what it assembled to on its own.
+ */
+struct lines_line {
+    /**
+     * Text of the line (@c len bytes, without the newline), followed by a
+     * newline and the two null bytes the scanners need.
+     */
+    char *text;
+    size_t len;
+
+    /**
+     * Section the line was encoded in, and the section after it (which is
+     * different for .text and .data).
+     */
+    enum section start_sec;
+    enum section sec;
+
+    /**
+     * Offset of the line in @c sec, and its encoded bytes.
+     */
+    int offset;
+    int size;
+    uint8_t *bytes;
+
+    /**
+     * Whether the line defines a global label (starting a scope and a
+     * fragment), and whether its output ends with data or an instruction
+     * which never continues to the next line.
+     */
+    int global;
+    int terminal;
+
+    int def_count;
+    struct lines_def *defs;
+
+    int ref_count;
+    struct lines_ref *refs;
+
+    /**
+     * Index of the line, set while resolving references.
+     */
+    int index;
+};
+
+/**
+ * Per-line records of a source file, kept between assemblies so that an edit
+ * only re-encodes the lines which changed.
+ *
+ * Each line is assembled on its own, as if it were at the start of its section,
+ * so its bytes do not depend on where it ends up; everything which does
+ * (references to other lines' symbols, and to positions in the section) is
+ * kept as an expression in the record. After an edit, the records are matched
+ * up with the new lines by their text; only new lines are scanned and encoded,
+ * the lines after them are moved, and only the references whose symbols or
+ * positions changed are resolved again.
+ *
+ * This handles the same files as chunk_assemble() (no .org, .abs,
+ * conditionals, macros, or includes), as long as each line can be encoded on
+ * its own. Otherwise, the file should be assembled as a whole.
+ */
+struct lines {
+    int count;
+    int capacity;
+    struct lines_line **lines;
+
+    /**
+     * Global and local names, as struct lines_name.
+     */
+    struct hash_table globals;
+    struct hash_table locals;
+
+    /**
+     * References to resolve before the next object is made.
+     */
+    struct vector dirty;
+
+    /**
+     * Number of lines encoded, and references resolved, by the last call to
+     * lines_update().
+     */
+    int encoded;
+    int resolved;
+};
+
+/**
+ * Initializes an empty set of records.
+ * @return 0 on success, -1 on failure.
+ */
+int lines_init(struct lines *ls);
+
+/**
+ * Frees the records of a file.
+ */
+void lines_destroy(struct lines *ls);
+
+/**
+ * Brings the records up to date with a file and makes an object from them.
+ * Errors are not reported: if the file can't be handled, it should be
+ * assembled as a whole, which reports them properly. The records stay usable
+ * either way.
+ * This has to be called while nothing else is being scanned or assembled.
+ * @param ls Records of the file (from previous calls for the same file).
+ * @param path Path of the file.
+ * @param[out] obj Object to initialize.
+ * @return 0 on success, -1 if the file should be assembled as a whole.
+ */
+int lines_update(struct lines *ls, const char *path, struct object *obj);
+
+#endif /* LINES_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,1687 @@
+/**
+ * @file link.c
+ *
+ * Linking is done in these phases (all but garbage collection are run in
+ * parallel):
+ *
+ *  1. Partition: each thread takes a range of objects and scatters their
+ *     symbol definitions and references into per-thread lists by hash
+ *     partition.
+ *  2. Join: each thread takes a set of partitions, builds a hash table of the
+ *     definitions in each one (from every thread's lists), and probes it with
+ *     the references. No two threads touch the same partition, and every
+ *     reference is in exactly one partition, so no locking is needed.
+ *  3. Garbage collection (optional): fragments reachable from the entry point
+ *     are marked, and the rest are removed from the layout. The fragments are
+ *     then laid out, either back to back or (optionally) on flash pages, with
+ *     trampolines and a branch table for the calls between pages.
+ *  4. Address: each thread computes the final addresses of the symbols
+ *     defined in a range of objects.
+ *  5. Apply: each thread takes a range of objects, copies their sections into
+ *     the output, and patches their relocations. Objects occupy disjoint parts
+ *     of the output. If asked, the fields holding addresses are collected and
+ *     sorted afterwards.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "link.h"
+
+/**
+ * A symbol definition or reference in a partition.
+ */
+struct link_sym_ref {
+    uint32_t hash;
+    int obj;
+    int idx;
+};
+
+/**
+ * List of symbols in one partition, collected by one thread.
+ */
+struct link_list {
+    int size;
+    int capacity;
+    struct link_sym_ref *ents;
+};
+
+/**
+ * A fragment of a section in an object.
+ */
+struct link_frag {
+    int offset;
+    int pc;
+    int size;
+
+    /**
+     * Number of bytes removed before the fragment in the object's section.
+     */
+    int shift;
+
+    /**
+     * Relocations in the fragment, as a range of link_obj::reloc_order.
+     */
+    int reloc_start;
+    int reloc_count;
+
+    /**
+     * Final address of the start of the fragment, and its offset in the
+     * output section it is written to.
+     */
+    int addr;
+    int pos;
+
+    /**
+     * Index of the fragment among those placed on pages.
+     */
+    int unit;
+
+    uint8_t falls_through;
+    uint8_t pinned;
+    uint8_t live;
+};
+
+struct link_sec {
+    int frag_count;
+    struct link_frag *frags;
+
+    /**
+     * Size of the section after garbage collection.
+     */
+    int size;
+};
+
+/**
+ * Placement and resolved symbols of an object.
+ */
+struct link_obj {
+    /**
+     * Offset of each of the object's sections into the output sections.
+     */
+    int offset[OBJ_SEC_COUNT];
+
+    struct link_sec secs[OBJ_SEC_COUNT];
+
+    /**
+     * Fragment of each relocation, and relocation indices ordered by fragment.
+     */
+    int *reloc_frag;
+    int *reloc_order;
+
+    /**
+     * Object and index of the definition of each symbol, or -1 if it is
+     * undefined.
+     */
+    int *sym_def_obj;
+    int *sym_def_idx;
+
+    /**
+     * Final address of each symbol defined in the object.
+     */
+    int *sym_addr;
+
+    /**
+     * Trampoline each relocation goes through (an index into
+     * link_ctx::tramps), or -1. This is only allocated if the output is paged.
+     */
+    int *reloc_tramp;
+};
+
+/**
+ * Trampoline for calls from one page to an address on another.
+ */
+struct link_tramp {
+    int page;
+    int addr;
+    int pos;
+
+    /**
+     * Fragment and program counter called, and the page the fragment is on.
+     */
+    const struct link_frag *frag;
+    int pc;
+    int target_page;
+
+    /**
+     * Entry of the branch table which the trampoline calls through.
+     */
+    int branch;
+
+    /**
+     * Object and relocation of a call, while they are collected.
+     */
+    int obj;
+    int rel;
+};
+
+struct link_ctx {
+    const struct object *objs;
+    int count;
+    struct link_obj *lobjs;
+
+    /**
+     * Address of the start of each output section.
+     */
+    int base[OBJ_SEC_COUNT];
+
+    /**
+     * Offset of each output section in the image, and whether the fields
+     * holding addresses in it are collected (see link_options::fixups).
+     */
+    int start[OBJ_SEC_COUNT];
+    int collect_fixups;
+
+    /**
+     * Output section each section is written to.
+     */
+    int dest[OBJ_SEC_COUNT];
+
+    int tramp_count;
+    struct link_tramp *tramps;
+
+    /**
+     * Address and position in the image of the branch table (on the first
+     * page).
+     */
+    int branch_addr;
+    int branch_pos;
+
+    struct section_buf *out;
+
+    int thread_count;
+
+    /**
+     * Lists of definitions and references, per thread then per partition.
+     */
+    struct link_list (*defs)[LINK_PARTITION_COUNT];
+    struct link_list (*refs)[LINK_PARTITION_COUNT];
+};
+
+struct link_thread {
+    struct link_ctx *ctx;
+    int id;
+    pthread_t thread;
+
+    /**
+     * Set if creating the thread failed, in which case it was run inline.
+     */
+    int inline_run;
+
+    int errors;
+
+    /**
+     * Fields holding addresses which were patched by this thread.
+     */
+    struct link_fixups fixups;
+};
+
+/**
+ * FNV-1a hash of a symbol name.
+ * This is independent of the hash used by struct hash_table, so that
+ * partitioning does not correlate with bucket placement.
+ */
+static uint32_t link_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (uint8_t) *name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static int link_list_add(struct link_list *list, uint32_t hash,
+        int obj, int idx) {
+    if (list->size == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 64;
+        struct link_sym_ref *ents = realloc(list->ents,
+                capacity * sizeof(*ents));
+        if (!ents) {
+            return -1;
+        }
+
+        list->ents = ents;
+        list->capacity = capacity;
+    }
+
+    list->ents[list->size++] = (struct link_sym_ref) { hash, obj, idx };
+    return 0;
+}
+
+/**
+ * Gets the range of objects handled by a thread in the per-object phases.
+ */
+static void link_obj_range(const struct link_ctx *ctx, int id,
+        int *start, int *end) {
+    *start = (long) ctx->count * id / ctx->thread_count;
+    *end = (long) ctx->count * (id + 1) / ctx->thread_count;
+}
+
+static const struct obj_symbol *link_sym(const struct link_ctx *ctx,
+        const struct link_sym_ref *ref) {
+    return &ctx->objs[ref->obj].symbols[ref->idx];
+}
+
+/**
+ * Finds the fragment containing a program counter value in a section.
+ * Program counters normally increase with offset, so this is a binary search;
+ * if an .org moved the program counter backwards, it falls back to a scan.
+ */
+static int link_frag_by_pc(const struct link_sec *sec, int pc) {
+    int lo = 0, hi = sec->frag_count - 1;
+
+    if (sec->frag_count <= 1) {
+        return 0;
+    }
+
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (sec->frags[mid].pc <= pc) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    const struct link_frag *frag = &sec->frags[lo];
+    if (frag->pc <= pc && pc <= frag->pc + frag->size) {
+        return lo;
+    }
+
+    for (int i = 0; i < sec->frag_count; i++) {
+        frag = &sec->frags[i];
+        if (frag->pc <= pc && pc <= frag->pc + frag->size) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Finds the fragment containing an offset in a section.
+ */
+static int link_frag_by_offset(const struct link_sec *sec, int offset) {
+    int lo = 0, hi = sec->frag_count - 1;
+
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (sec->frags[mid].offset <= offset) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return lo;
+}
+
+/**
+ * Gets the final address of a program counter value in an object's section.
+ */
+static int link_address(const struct link_ctx *ctx, int o,
+        enum section sec, int pc) {
+    const struct link_obj *lobj = &ctx->lobjs[o];
+    int idx = OBJ_SEC_IDX(sec);
+
+    if (sec == SEC_ABS) {
+        return pc;
+    }
+
+    const struct link_sec *lsec = &lobj->secs[idx];
+    const struct link_frag *frag = &lsec->frags[link_frag_by_pc(lsec, pc)];
+    return frag->addr + pc - frag->pc;
+}
+
+/**
+ * Splits the sections of an object into fragments, and groups its relocations
+ * by fragment.
+ * @param split Whether to split the text and data sections (otherwise each is
+ * a single fragment).
+ * @param gc Whether fragments are marked live by garbage collection (otherwise
+ * they all are).
+ */
+static int link_split(struct link_obj *lobj, const struct object *obj,
+        int split, int gc) {
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        enum section sec = OBJ_IDX_SEC(i);
+        struct link_sec *lsec = &lobj->secs[i];
+        int count = 0;
+
+        lsec->frags = calloc(obj->frag_count + 1, sizeof(*lsec->frags));
+        if (!lsec->frags) {
+            return -1;
+        }
+
+        lsec->frags[count++] = (struct link_frag) {
+            .offset = 0,
+            .falls_through = 1,
+            .live = !gc || sec == SEC_ABS,
+        };
+
+        for (int j = 0; split && sec != SEC_ABS && j < obj->frag_count; j++) {
+            const struct obj_fragment *of = &obj->frags[j];
+            struct link_frag *frag;
+
+            if (of->sec != sec) {
+                continue;
+            }
+
+            /* The first one replaces the implicit fragment at the start */
+            frag = of->offset == 0 && count == 1
+                ? &lsec->frags[0] : &lsec->frags[count++];
+            frag->offset = of->offset;
+            frag->pc = of->pc;
+            frag->falls_through = of->falls_through;
+            frag->pinned = of->pinned;
+            frag->live = !gc;
+        }
+
+        for (int j = 0; j < count; j++) {
+            int end = j + 1 < count
+                ? lsec->frags[j+1].offset : obj->sections[i].size;
+            lsec->frags[j].size = end - lsec->frags[j].offset;
+        }
+
+        lsec->frag_count = count;
+    }
+
+    lobj->reloc_frag = malloc((obj->reloc_count + 1)
+            * sizeof(*lobj->reloc_frag));
+    lobj->reloc_order = malloc((obj->reloc_count + 1)
+            * sizeof(*lobj->reloc_order));
+    if (!lobj->reloc_frag || !lobj->reloc_order) {
+        return -1;
+    }
+
+    /* Counting sort of the relocations by fragment */
+    for (int i = 0; i < obj->reloc_count; i++) {
+        const struct obj_reloc *rel = &obj->relocs[i];
+        struct link_sec *lsec = &lobj->secs[OBJ_SEC_IDX(rel->sec)];
+        int frag = link_frag_by_offset(lsec, rel->offset);
+
+        lobj->reloc_frag[i] = frag;
+        lsec->frags[frag].reloc_count++;
+    }
+
+    int start = 0;
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        for (int j = 0; j < lobj->secs[i].frag_count; j++) {
+            struct link_frag *frag = &lobj->secs[i].frags[j];
+            frag->reloc_start = start;
+            start += frag->reloc_count;
+            frag->reloc_count = 0;
+        }
+    }
+
+    for (int i = 0; i < obj->reloc_count; i++) {
+        struct link_frag *frag = &lobj->secs[OBJ_SEC_IDX(obj->relocs[i].sec)]
+            .frags[lobj->reloc_frag[i]];
+        lobj->reloc_order[frag->reloc_start + frag->reloc_count++] = i;
+    }
+
+    return 0;
+}
+
+static void *link_partition(void *arg) {
+    struct link_thread *t = arg;
+    struct link_ctx *ctx = t->ctx;
+    int start, end;
+
+    link_obj_range(ctx, t->id, &start, &end);
+    for (int o = start; o < end; o++) {
+        const struct object *obj = &ctx->objs[o];
+        struct link_obj *lobj = &ctx->lobjs[o];
+
+        for (int i = 0; i < obj->sym_count; i++) {
+            const struct obj_symbol *sym = &obj->symbols[i];
+            uint32_t hash = link_hash(sym->name);
+            struct link_list *list;
+
+            if (sym->sec == SEC_UNDEF) {
+                lobj->sym_def_obj[i] = -1;
+                list = &ctx->refs[t->id][hash % LINK_PARTITION_COUNT];
+            } else {
+                lobj->sym_def_obj[i] = o;
+                lobj->sym_def_idx[i] = i;
+                list = &ctx->defs[t->id][hash % LINK_PARTITION_COUNT];
+            }
+
+            if (link_list_add(list, hash, o, i) < 0) {
+                t->errors++;
+                return NULL;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Joins the definitions and references in one partition.
+ * References which are not defined are left unresolved; they are only an
+ * error if a relocation which is kept uses them.
+ */
+static int link_join_partition(struct link_ctx *ctx, int p) {
+    const struct link_sym_ref **table;
+    size_t size = 1, mask;
+    int def_count = 0;
+    int errors = 0;
+
+    for (int t = 0; t < ctx->thread_count; t++) {
+        def_count += ctx->defs[t][p].size;
+    }
+
+    while (size < 2 * (size_t) def_count) {
+        size *= 2;
+    }
+
+    mask = size - 1;
+    table = calloc(size, sizeof(*table));
+    if (!table) {
+        return 1;
+    }
+
+    /* Build */
+    for (int t = 0; t < ctx->thread_count; t++) {
+        const struct link_list *list = &ctx->defs[t][p];
+        for (int i = 0; i < list->size; i++) {
+            const struct link_sym_ref *def = &list->ents[i];
+            const struct obj_symbol *sym = link_sym(ctx, def);
+            size_t slot = (def->hash / LINK_PARTITION_COUNT) & mask;
+
+            while (table[slot]) {
+                const struct link_sym_ref *other = table[slot];
+                const struct obj_symbol *other_sym = link_sym(ctx, other);
+                if (other->hash == def->hash
+                        && strcmp(other_sym->name, sym->name) == 0) {
+                    break;
+                }
+
+                slot = (slot + 1) & mask;
+            }
+
+            if (!table[slot]) {
+                table[slot] = def;
+                continue;
+            }
+
+            /* The same constant may be defined in several objects (usually
+             * from a shared include file), but anything else is ambiguous.
+             */
+            const struct link_sym_ref *other = table[slot];
+            const struct obj_symbol *other_sym = link_sym(ctx, other);
+            if (sym->sec != SEC_ABS || other_sym->sec != SEC_ABS
+                    || sym->value != other_sym->value) {
+                fprintf(stderr, "Symbol %s is defined in both %s and %s.\n",
+                        sym->name, ctx->objs[other->obj].name,
+                        ctx->objs[def->obj].name);
+                errors++;
+            }
+        }
+    }
+
+    /* Probe */
+    for (int t = 0; t < ctx->thread_count; t++) {
+        const struct link_list *list = &ctx->refs[t][p];
+        for (int i = 0; i < list->size; i++) {
+            const struct link_sym_ref *ref = &list->ents[i];
+            const struct obj_symbol *sym = link_sym(ctx, ref);
+            size_t slot = (ref->hash / LINK_PARTITION_COUNT) & mask;
+
+            for (; table[slot]; slot = (slot + 1) & mask) {
+                const struct link_sym_ref *def = table[slot];
+                if (def->hash == ref->hash
+                        && strcmp(link_sym(ctx, def)->name, sym->name) == 0) {
+                    struct link_obj *lobj = &ctx->lobjs[ref->obj];
+                    lobj->sym_def_obj[ref->idx] = def->obj;
+                    lobj->sym_def_idx[ref->idx] = def->idx;
+                    break;
+                }
+            }
+        }
+    }
+
+    free(table);
+    return errors;
+}
+
+static void *link_join(void *arg) {
+    struct link_thread *t = arg;
+    for (int p = t->id; p < LINK_PARTITION_COUNT; p += t->ctx->thread_count) {
+        t->errors += link_join_partition(t->ctx, p);
+    }
+
+    return NULL;
+}
+
+/**
+ * Marks a fragment as live and pushes it onto the work stack.
+ */
+static void link_mark(struct link_ctx *ctx, int o, int sec_idx, int frag,
+        int (*stack)[3], int *depth) {
+    struct link_frag *f = &ctx->lobjs[o].secs[sec_idx].frags[frag];
+    if (f->live) {
+        return;
+    }
+
+    f->live = 1;
+    stack[*depth][0] = o;
+    stack[*depth][1] = sec_idx;
+    stack[*depth][2] = frag;
+    (*depth)++;
+}
+
+/**
+ * Marks the fragment containing the target of a program counter value.
+ */
+static void link_mark_pc(struct link_ctx *ctx, int o, enum section sec,
+        int pc, int (*stack)[3], int *depth) {
+    if (sec == SEC_UNDEF || sec == SEC_ABS) {
+        return;
+    }
+
+    const struct link_sec *lsec = &ctx->lobjs[o].secs[OBJ_SEC_IDX(sec)];
+    link_mark(ctx, o, OBJ_SEC_IDX(sec), link_frag_by_pc(lsec, pc),
+            stack, depth);
+}
+
+/**
+ * Marks the fragments reachable from the entry point and the absolute
+ * section, then computes the layout without the rest.
+ */
+static int link_gc(struct link_ctx *ctx, const char *entry) {
+    int (*stack)[3];
+    int depth = 0, total = 0;
+    int removed = 0, removed_frags = 0;
+
+    for (int o = 0; o < ctx->count; o++) {
+        for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+            total += ctx->lobjs[o].secs[i].frag_count;
+        }
+    }
+
+    stack = malloc((total + 1) * sizeof(*stack));
+    if (!stack) {
+        return -1;
+    }
+
+    /* Roots */
+    if (entry) {
+        int found = 0;
+        for (int o = 0; o < ctx->count && !found; o++) {
+            const struct object *obj = &ctx->objs[o];
+            for (int i = 0; i < obj->sym_count; i++) {
+                const struct obj_symbol *sym = &obj->symbols[i];
+                if (sym->sec != SEC_UNDEF && strcmp(sym->name, entry) == 0) {
+                    link_mark_pc(ctx, o, sym->sec, sym->value, stack, &depth);
+                    found = 1;
+                    break;
+                }
+            }
+        }
+
+        if (!found) {
+            fprintf(stderr, "Entry point %s is not defined.\n", entry);
+            free(stack);
+            return -1;
+        }
+    } else if (ctx->count > 0) {
+        link_mark(ctx, 0, OBJ_SEC_IDX(SEC_TEXT), 0, stack, &depth);
+    }
+
+    for (int o = 0; o < ctx->count; o++) {
+        /* Already live, but its references have to be followed */
+        int abs_idx = OBJ_SEC_IDX(SEC_ABS);
+        stack[depth][0] = o;
+        stack[depth][1] = abs_idx;
+        stack[depth][2] = 0;
+        depth++;
+    }
+
+    /* Propagate */
+    while (depth > 0) {
+        depth--;
+        int o = stack[depth][0], sec_idx = stack[depth][1];
+        int frag = stack[depth][2];
+        const struct object *obj = &ctx->objs[o];
+        const struct link_obj *lobj = &ctx->lobjs[o];
+        const struct link_sec *lsec = &lobj->secs[sec_idx];
+        const struct link_frag *f = &lsec->frags[frag];
+
+        if (f->falls_through || f->pinned) {
+            if (frag + 1 < lsec->frag_count) {
+                link_mark(ctx, o, sec_idx, frag + 1, stack, &depth);
+            } else if (o + 1 < ctx->count) {
+                /* Sections of consecutive objects are laid out back to back,
+                 * so this continues into the next object
+                 */
+                link_mark(ctx, o + 1, sec_idx, 0, stack, &depth);
+            }
+        }
+
+        if (frag > 0 && lsec->frags[frag - 1].pinned) {
+            link_mark(ctx, o, sec_idx, frag - 1, stack, &depth);
+        }
+
+        for (int i = 0; i < f->reloc_count; i++) {
+            const struct obj_reloc *rel =
+                &obj->relocs[lobj->reloc_order[f->reloc_start + i]];
+
+            if (rel->sym < 0) {
+                link_mark_pc(ctx, o, rel->target_sec, rel->addend,
+                        stack, &depth);
+            } else if (lobj->sym_def_obj[rel->sym] >= 0) {
+                int def_obj = lobj->sym_def_obj[rel->sym];
+                const struct obj_symbol *def = &ctx->objs[def_obj]
+                    .symbols[lobj->sym_def_idx[rel->sym]];
+                link_mark_pc(ctx, def_obj, def->sec, def->value,
+                        stack, &depth);
+            }
+        }
+    }
+
+    free(stack);
+
+    /* Compute the shift of each fragment and the new section sizes */
+    for (int o = 0; o < ctx->count; o++) {
+        for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+            struct link_sec *lsec = &ctx->lobjs[o].secs[i];
+            int shift = 0;
+
+            for (int j = 0; j < lsec->frag_count; j++) {
+                struct link_frag *frag = &lsec->frags[j];
+                frag->shift = shift;
+                if (!frag->live && frag->size > 0) {
+                    shift += frag->size;
+                    removed += frag->size;
+                    removed_frags++;
+                }
+            }
+
+            lsec->size -= shift;
+        }
+    }
+
+    fprintf(stderr, "Removed %d bytes in %d unreferenced fragments.\n",
+            removed, removed_frags);
+    return 0;
+}
+
+/**
+ * Computes the final address and output offset of each fragment, with the
+ * sections of the objects laid out back to back.
+ */
+static void link_place(struct link_ctx *ctx) {
+    for (int o = 0; o < ctx->count; o++) {
+        struct link_obj *lobj = &ctx->lobjs[o];
+        for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+            struct link_sec *lsec = &lobj->secs[i];
+            for (int j = 0; j < lsec->frag_count; j++) {
+                struct link_frag *frag = &lsec->frags[j];
+                frag->addr = ctx->base[i] + lobj->offset[i] + frag->pc
+                    - frag->shift;
+                frag->pos = lobj->offset[i] + frag->offset - frag->shift;
+            }
+        }
+    }
+}
+
+/**
+ * Checks whether a relocation is the address of a call or an absolute jump,
+ * which can go through a trampoline if its target is on another page.
+ */
+static int link_is_call(const struct object *obj, const struct obj_reloc *rel) {
+    static const uint8_t opcodes[] = {
+        0xCD, 0xC4, 0xCC, 0xD4, 0xDC, 0xE4, 0xEC, 0xF4, 0xFC, /* call */
+        0xC3, 0xC2, 0xCA, 0xD2, 0xDA, 0xE2, 0xEA, 0xF2, 0xFA, /* jp */
+    };
+
+    if (rel->sec != SEC_TEXT || rel->offset < 1 || (rel->type != RT_16_BIT
+                && rel->type != RT_U_16_BIT && rel->type != RT_S_16_BIT)) {
+        return 0;
+    }
+
+    uint8_t op = obj->sections[OBJ_SEC_IDX(SEC_TEXT)].data[rel->offset - 1];
+    return memchr(opcodes, op, sizeof(opcodes)) != NULL;
+}
+
+/**
+ * Finds the fragment a relocation refers to.
+ * @param[out] pc Program counter of the target, relative to the fragment's
+ * section in its object.
+ * @return The fragment, or NULL if the target is not in the text or data
+ * section (or is undefined).
+ */
+static const struct link_frag *link_target(const struct link_ctx *ctx, int o,
+        const struct obj_reloc *rel, int *pc) {
+    const struct link_obj *lobj = &ctx->lobjs[o];
+    enum section sec = rel->target_sec;
+    int sym_pc = rel->addend;
+
+    *pc = rel->addend;
+    if (rel->sym >= 0) {
+        int def_obj = lobj->sym_def_obj[rel->sym];
+        if (def_obj < 0) {
+            return NULL;
+        }
+
+        const struct obj_symbol *def = &ctx->objs[def_obj]
+            .symbols[lobj->sym_def_idx[rel->sym]];
+        o = def_obj;
+        sec = def->sec;
+        sym_pc = def->value;
+        *pc = def->value + rel->addend;
+    }
+
+    if (sec != SEC_TEXT && sec != SEC_DATA) {
+        return NULL;
+    }
+
+    /* The target moves with the symbol's fragment, even if the addend takes
+     * it past the end
+     */
+    const struct link_sec *lsec = &ctx->lobjs[o].secs[OBJ_SEC_IDX(sec)];
+    return &lsec->frags[link_frag_by_pc(lsec, sym_pc)];
+}
+
+static int link_tramp_cmp(const void *a, const void *b) {
+    const struct link_tramp *t1 = a, *t2 = b;
+    if (t1->page != t2->page) {
+        return t1->page - t2->page;
+    }
+
+    if (t1->frag->unit != t2->frag->unit) {
+        return t1->frag->unit - t2->frag->unit;
+    }
+
+    return t1->pc - t2->pc;
+}
+
+/**
+ * Compares pointers to trampolines by the address they call, which has one
+ * branch table entry no matter which pages call it.
+ */
+static int link_branch_cmp(const void *a, const void *b) {
+    const struct link_tramp *t1 = *(struct link_tramp *const *) a;
+    const struct link_tramp *t2 = *(struct link_tramp *const *) b;
+    if (t1->frag->unit != t2->frag->unit) {
+        return t1->frag->unit - t2->frag->unit;
+    }
+
+    return t1->pc - t2->pc;
+}
+
+/**
+ * Weighs the calls by the number of times their targets are called in a
+ * profile, split evenly between the call sites. Calls to routines which are
+ * not in the profile keep a weight of 1.
+ * @param names Name of the routine each call is to, or NULL.
+ */
+static int link_weigh_calls(const struct page_profile *prof,
+        struct page_call *calls, const char **names, int count) {
+    int *sites = calloc(prof->count + 1, sizeof(*sites));
+    int *idx = malloc((count + 1) * sizeof(*idx));
+
+    if (!sites || !idx) {
+        free(sites);
+        free(idx);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        idx[i] = names[i] ? page_profile_find(prof, names[i]) : -1;
+        if (idx[i] >= 0) {
+            sites[idx[i]]++;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (idx[i] >= 0) {
+            calls[i].weight = (prof->ents[idx[i]].calls + sites[idx[i]] - 1)
+                / sites[idx[i]];
+        }
+    }
+
+    free(sites);
+    free(idx);
+    return 0;
+}
+
+/**
+ * Places the live fragments of the text and data sections on pages, and
+ * creates trampolines and a branch table for the calls which cross pages.
+ *
+ * A fragment has to be on the same page as the one after it if it falls
+ * through or is pinned to it, and as any fragment it refers to other than by
+ * a call or an absolute jump (e.g. with a relative jump or by loading an
+ * address). Calls are weighed as link_options::profile describes.
+ *
+ * @param[out] size Size of each output section.
+ */
+static int link_page(struct link_ctx *ctx, const struct link_options *opts,
+        int size[OBJ_SEC_COUNT]) {
+    static const enum section paged_secs[] = { SEC_TEXT, SEC_DATA };
+    struct link_frag **units = NULL;
+    int *sizes = NULL;
+    int (*links)[2] = NULL;
+    struct page_call *calls = NULL;
+    const char **names = NULL;
+    const char **unit_names = NULL;
+    int *pages = NULL;
+    int *used = NULL;
+    struct link_tramp **branches = NULL;
+    int unit_count = 0, link_count = 0, call_count = 0;
+    int reloc_total = 0, page_count = 0, branch_count = 0;
+    long weight = 0, cross_weight = 0;
+    int cross_count = 0;
+    int count = 0;
+    struct page_graph graph;
+    int ret = -1;
+
+    if (ctx->base[OBJ_SEC_IDX(SEC_TEXT)] < 0
+            || ctx->base[OBJ_SEC_IDX(SEC_TEXT)] + PAGE_CAPACITY > 0x10000) {
+        fprintf(stderr, "Pages mapped at %d don't fit in the address space.\n",
+                ctx->base[OBJ_SEC_IDX(SEC_TEXT)]);
+        return -1;
+    }
+
+    for (int o = 0; o < ctx->count; o++) {
+        if (ctx->objs[o].sections[OBJ_SEC_IDX(SEC_ABS)].size > 0) {
+            fprintf(stderr, "The absolute section of %s can't be placed on "
+                    "pages.\n", ctx->objs[o].name);
+            return -1;
+        }
+
+        reloc_total += ctx->objs[o].reloc_count;
+        for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+            unit_count += ctx->lobjs[o].secs[i].frag_count;
+        }
+    }
+
+    units = malloc((unit_count + 1) * sizeof(*units));
+    sizes = malloc((unit_count + 1) * sizeof(*sizes));
+    links = malloc((unit_count + reloc_total + 1) * sizeof(*links));
+    calls = malloc((reloc_total + 1) * sizeof(*calls));
+    names = malloc((reloc_total + 1) * sizeof(*names));
+    unit_names = calloc(unit_count + 1, sizeof(*unit_names));
+    pages = malloc((unit_count + 1) * sizeof(*pages));
+    ctx->tramps = malloc((reloc_total + 1) * sizeof(*ctx->tramps));
+    branches = malloc((reloc_total + 1) * sizeof(*branches));
+    if (!units || !sizes || !links || !calls || !names || !unit_names
+            || !pages || !ctx->tramps || !branches) {
+        goto PAGE_END;
+    }
+
+    /* Number the live fragments, text first */
+    unit_count = 0;
+    for (int s = 0; s < 2; s++) {
+        int idx = OBJ_SEC_IDX(paged_secs[s]);
+        for (int o = 0; o < ctx->count; o++) {
+            struct link_sec *lsec = &ctx->lobjs[o].secs[idx];
+            for (int j = 0; j < lsec->frag_count; j++) {
+                struct link_frag *frag = &lsec->frags[j];
+                frag->unit = -1;
+                if (frag->live) {
+                    frag->unit = unit_count;
+                    units[unit_count] = frag;
+                    sizes[unit_count++] = frag->size;
+                }
+            }
+        }
+    }
+
+    /* Calls to local labels have no symbol, so they are named by the label
+     * their fragment starts with
+     */
+    for (int o = 0; o < ctx->count; o++) {
+        const struct object *obj = &ctx->objs[o];
+        for (int i = 0; i < obj->sym_count; i++) {
+            const struct obj_symbol *sym = &obj->symbols[i];
+            const struct link_sec *lsec;
+            const struct link_frag *frag;
+
+            if (sym->sec != SEC_TEXT && sym->sec != SEC_DATA) {
+                continue;
+            }
+
+            lsec = &ctx->lobjs[o].secs[OBJ_SEC_IDX(sym->sec)];
+            frag = &lsec->frags[link_frag_by_pc(lsec, sym->value)];
+            if (frag->unit >= 0 && frag->pc == sym->value
+                    && !unit_names[frag->unit]) {
+                unit_names[frag->unit] = sym->name;
+            }
+        }
+    }
+
+    /* Code falls through into the next fragment, which may be in the next
+     * object; data is only kept with the next fragment if it is pinned
+     */
+    for (int s = 0; s < 2; s++) {
+        int idx = OBJ_SEC_IDX(paged_secs[s]);
+        const struct link_frag *prev = NULL;
+
+        for (int o = 0; o < ctx->count; o++) {
+            const struct link_sec *lsec = &ctx->lobjs[o].secs[idx];
+            for (int j = 0; j < lsec->frag_count; j++) {
+                const struct link_frag *frag = &lsec->frags[j];
+                if (!frag->live) {
+                    continue;
+                }
+
+                if (prev && (prev->pinned || (paged_secs[s] == SEC_TEXT
+                                && prev->falls_through))) {
+                    links[link_count][0] = prev->unit;
+                    links[link_count++][1] = frag->unit;
+                }
+
+                prev = frag;
+            }
+        }
+    }
+
+    for (int o = 0; o < ctx->count; o++) {
+        const struct object *obj = &ctx->objs[o];
+        struct link_obj *lobj = &ctx->lobjs[o];
+
+        lobj->reloc_tramp = malloc((obj->reloc_count + 1)
+                * sizeof(*lobj->reloc_tramp));
+        if (!lobj->reloc_tramp) {
+            goto PAGE_END;
+        }
+
+        for (int i = 0; i < obj->reloc_count; i++) {
+            const struct obj_reloc *rel = &obj->relocs[i];
+            const struct link_frag *from =
+                &lobj->secs[OBJ_SEC_IDX(rel->sec)].frags[lobj->reloc_frag[i]];
+            const struct link_frag *to;
+            int pc;
+
+            lobj->reloc_tramp[i] = -1;
+            if (!from->live || rel->sec == SEC_ABS
+                    || !(to = link_target(ctx, o, rel, &pc))) {
+                continue;
+            }
+
+            if (link_is_call(obj, rel)) {
+                calls[call_count] = (struct page_call) {
+                    from->unit, to->unit, pc, 1
+                };
+                names[call_count] = rel->sym >= 0
+                    ? obj->symbols[rel->sym].name
+                    : pc == to->pc ? unit_names[to->unit] : NULL;
+                ctx->tramps[call_count].obj = o;
+                ctx->tramps[call_count].rel = i;
+                ctx->tramps[call_count].frag = to;
+                ctx->tramps[call_count++].pc = pc;
+            } else if (from->unit != to->unit) {
+                links[link_count][0] = from->unit;
+                links[link_count++][1] = to->unit;
+            }
+        }
+    }
+
+    if (opts->profile && link_weigh_calls(opts->profile, calls, names,
+                call_count) < 0) {
+        goto PAGE_END;
+    }
+
+    graph = (struct page_graph) {
+        unit_count, sizes, link_count, (const int (*)[2]) links,
+        call_count, calls
+    };
+
+    page_count = page_assign(&graph, PAGE_CAPACITY, pages);
+    if (page_count < 0) {
+        goto PAGE_END;
+    }
+
+    used = calloc(page_count + 1, sizeof(*used));
+    if (!used) {
+        goto PAGE_END;
+    }
+
+    /* Each page has its units in order, then (on the first page) the branch
+     * table, then its trampolines
+     */
+    for (int u = 0; u < unit_count; u++) {
+        units[u]->addr = ctx->base[OBJ_SEC_IDX(SEC_TEXT)] + used[pages[u]];
+        units[u]->pos = pages[u] * PAGE_CAPACITY + used[pages[u]];
+        used[pages[u]] += sizes[u];
+    }
+
+    for (int i = 0; i < call_count; i++) {
+        struct link_tramp *tramp = &ctx->tramps[ctx->tramp_count];
+
+        weight += calls[i].weight;
+        if (pages[calls[i].from] == pages[calls[i].to]) {
+            continue;
+        }
+
+        cross_weight += calls[i].weight;
+        cross_count++;
+        *tramp = ctx->tramps[i];
+        tramp->page = pages[calls[i].from];
+        tramp->target_page = pages[calls[i].to];
+        ctx->tramp_count++;
+    }
+
+    qsort(ctx->tramps, ctx->tramp_count, sizeof(*ctx->tramps),
+            link_tramp_cmp);
+
+    /* Calls from a page to the same address share a trampoline */
+    for (int i = 0; i < ctx->tramp_count; i++) {
+        struct link_tramp *tramp = &ctx->tramps[i];
+        int o = tramp->obj, rel = tramp->rel;
+
+        if (count == 0
+                || link_tramp_cmp(&ctx->tramps[count - 1], tramp) != 0) {
+            ctx->tramps[count++] = *tramp;
+        }
+
+        ctx->lobjs[o].reloc_tramp[rel] = count - 1;
+    }
+
+    ctx->tramp_count = count;
+
+    /* Trampolines to the same address share a branch table entry */
+    for (int i = 0; i < ctx->tramp_count; i++) {
+        branches[i] = &ctx->tramps[i];
+    }
+
+    qsort(branches, ctx->tramp_count, sizeof(*branches), link_branch_cmp);
+    for (int i = 0; i < ctx->tramp_count; i++) {
+        if (i > 0 && link_branch_cmp(&branches[i - 1], &branches[i]) != 0) {
+            branch_count++;
+        }
+
+        branches[i]->branch = branch_count;
+    }
+
+    if (ctx->tramp_count > 0) {
+        branch_count++;
+        ctx->branch_addr = ctx->base[OBJ_SEC_IDX(SEC_TEXT)] + used[0];
+        ctx->branch_pos = used[0];
+        used[0] += branch_count * PAGE_BRANCH_SIZE;
+    }
+
+    for (int i = 0; i < ctx->tramp_count; i++) {
+        struct link_tramp *tramp = &ctx->tramps[i];
+
+        tramp->addr = ctx->base[OBJ_SEC_IDX(SEC_TEXT)] + used[tramp->page];
+        tramp->pos = tramp->page * PAGE_CAPACITY + used[tramp->page];
+        used[tramp->page] += PAGE_TRAMPOLINE_SIZE;
+    }
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        size[i] = 0;
+    }
+
+    if (page_count > 0) {
+        size[OBJ_SEC_IDX(SEC_TEXT)] = (page_count - 1) * PAGE_CAPACITY
+            + used[page_count - 1];
+    }
+
+    ctx->dest[OBJ_SEC_IDX(SEC_DATA)] = OBJ_SEC_IDX(SEC_TEXT);
+    fprintf(stderr, "Placed %d bytes on %d pages; %d of %d calls (weighing %ld "
+            "of %ld) cross pages, through %d trampolines and %d branch table "
+            "entries.\n", size[OBJ_SEC_IDX(SEC_TEXT)], page_count, cross_count,
+            call_count, cross_weight, weight, ctx->tramp_count, branch_count);
+    ret = 0;
+
+PAGE_END:
+    free(units);
+    free(sizes);
+    free(links);
+    free(calls);
+    free(names);
+    free(unit_names);
+    free(pages);
+    free(used);
+    free(branches);
+    return ret;
+}
+
+/**
+ * Writes the trampolines and branch table of a paged output (see page.h).
+ */
+static void link_write_tramps(const struct link_ctx *ctx) {
+    uint8_t *out = ctx->out[OBJ_SEC_IDX(SEC_TEXT)].data;
+
+    for (int i = 0; i < ctx->tramp_count; i++) {
+        const struct link_tramp *tramp = &ctx->tramps[i];
+        uint8_t *dst = out + tramp->pos;
+        uint8_t *ent = out + ctx->branch_pos + tramp->branch * PAGE_BRANCH_SIZE;
+        int target = tramp->frag->addr + tramp->pc - tramp->frag->pc;
+        int entry = ctx->branch_addr + tramp->branch * PAGE_BRANCH_SIZE;
+
+        /* Trampolines to the same address write the same entry */
+        ent[0] = target & 0xFF;
+        ent[1] = target >> 8;
+        ent[2] = tramp->target_page;
+
+        dst[0] = PAGE_TRAMPOLINE_RST;
+        dst[1] = entry & 0xFF;
+        dst[2] = entry >> 8;
+        dst[3] = PAGE_TRAMPOLINE_RET;
+    }
+}
+
+static void *link_addresses(void *arg) {
+    struct link_thread *t = arg;
+    struct link_ctx *ctx = t->ctx;
+    int start, end;
+
+    link_obj_range(ctx, t->id, &start, &end);
+    for (int o = start; o < end; o++) {
+        const struct object *obj = &ctx->objs[o];
+        for (int i = 0; i < obj->sym_count; i++) {
+            const struct obj_symbol *sym = &obj->symbols[i];
+            if (sym->sec != SEC_UNDEF) {
+                ctx->lobjs[o].sym_addr[i] =
+                    link_address(ctx, o, sym->sec, sym->value);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Evaluates the expression of a relocation (see struct obj_reloc).
+ * @param[out] value Result.
+ * @return 0 on success, -1 if a symbol is undefined or not absolute, or the
+ * expression divides by 0 (which is reported).
+ */
+static int link_eval_expr(const struct link_ctx *ctx, int o,
+        const struct obj_reloc *rel, int *value) {
+    const struct object *obj = &ctx->objs[o];
+    const struct link_obj *lobj = &ctx->lobjs[o];
+    int stack[rel->expr_len];
+    int depth = 0;
+
+    /* The object was checked to be well-formed when it was read or created */
+    for (int i = 0; i < rel->expr_len; i++) {
+        const struct obj_expr_op *op = &obj->exprs[rel->expr_start + i];
+        const struct obj_symbol *def;
+        int def_obj;
+        int a, b;
+
+        switch (op->type) {
+        case ET_CONST:
+            stack[depth++] = op->value;
+            continue;
+        case ET_SYM:
+            def_obj = lobj->sym_def_obj[op->value];
+            if (def_obj < 0) {
+                fprintf(stderr, "Undefined symbol %s in %s.\n",
+                        obj->symbols[op->value].name, obj->name);
+                return -1;
+            }
+
+            def = &ctx->objs[def_obj].symbols[lobj->sym_def_idx[op->value]];
+            if (def->sec != SEC_ABS) {
+                fprintf(stderr, "Symbol %s has to be absolute to be used in "
+                        "an expression in %s.\n", def->name, obj->name);
+                return -1;
+            }
+
+            stack[depth++] = def->value;
+            continue;
+        case ET_NOT:
+            stack[depth - 1] = ~stack[depth - 1];
+            continue;
+        case ET_NEG:
+            stack[depth - 1] = -stack[depth - 1];
+            continue;
+        default:
+            break;
+        }
+
+        b = stack[--depth];
+        a = stack[depth - 1];
+        if ((op->type == ET_DIV || op->type == ET_MOD) && b == 0) {
+            fprintf(stderr, "Division by 0 in an expression in %s.\n",
+                    obj->name);
+            return -1;
+        }
+
+        switch (op->type) {
+        case ET_ADD:
+            a += b;
+            break;
+        case ET_SUB:
+            a -= b;
+            break;
+        case ET_MUL:
+            a *= b;
+            break;
+        case ET_DIV:
+            a /= b;
+            break;
+        case ET_MOD:
+            a %= b;
+            break;
+        case ET_AND:
+            a &= b;
+            break;
+        case ET_XOR:
+            a ^= b;
+            break;
+        case ET_OR:
+            a |= b;
+            break;
+        default:
+            break;
+        }
+
+        stack[depth - 1] = a;
+    }
+
+    *value = stack[0];
+    return 0;
+}
+
+/**
+ * Records a patched field if its value depends on where the image is placed.
+ * @param target_sec Section the field's target is in.
+ * @param offset Offset of the field in the image.
+ * @param len Size of the field.
+ * @return 0 on success, -1 if the field can't be adjusted (which is reported)
+ * or on failure.
+ */
+static int link_add_fixup(struct link_thread *t, const struct object *obj,
+        const struct obj_reloc *rel, enum section target_sec, int offset,
+        int len) {
+    struct link_fixups *fixups = &t->fixups;
+
+    /* Relative jumps move along with their targets, unless only one of them is
+     * absolute
+     */
+    if (rel->type == RT_REL_JUMP) {
+        if ((rel->sec == SEC_ABS) == (target_sec == SEC_ABS)) {
+            return 0;
+        }
+    } else if (target_sec == SEC_ABS) {
+        return 0;
+    }
+
+    if (rel->type == RT_REL_JUMP || len != 2) {
+        fprintf(stderr, "Field at offset %d in %s depends on where the image "
+                "is placed, but can't be relocated.\n", rel->offset, obj->name);
+        return -1;
+    }
+
+    if (fixups->count == fixups->capacity) {
+        int capacity = fixups->capacity ? fixups->capacity * 2 : 64;
+        int *offsets = realloc(fixups->offsets,
+                capacity * sizeof(*offsets));
+        if (!offsets) {
+            return -1;
+        }
+
+        fixups->offsets = offsets;
+        fixups->capacity = capacity;
+    }
+
+    fixups->offsets[fixups->count++] = offset;
+    return 0;
+}
+
+/**
+ * Adds the final addresses of the defined symbols to a symbol table. Symbols in
+ * removed fragments are left out.
+ * @return 0 on success, -1 on failure.
+ */
+static int link_symbols(const struct link_ctx *ctx, struct symbol_table *st) {
+    for (int o = 0; o < ctx->count; o++) {
+        const struct object *obj = &ctx->objs[o];
+        const struct link_obj *lobj = &ctx->lobjs[o];
+
+        for (int i = 0; i < obj->sym_count; i++) {
+            const struct obj_symbol *sym = &obj->symbols[i];
+            if (sym->sec == SEC_UNDEF) {
+                continue;
+            }
+
+            const struct link_sec *lsec = &lobj->secs[OBJ_SEC_IDX(sym->sec)];
+            if (sym->sec != SEC_ABS
+                    && !lsec->frags[link_frag_by_pc(lsec, sym->value)].live) {
+                continue;
+            }
+
+            /* Duplicates were already reported, so keep the first */
+            if (!symtab_search(st, sym->name)
+                    && !symtab_add(st, sym->name, ST_OBJECT, sym->sec,
+                        lobj->sym_addr[i])) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void *link_apply(void *arg) {
+    struct link_thread *t = arg;
+    struct link_ctx *ctx = t->ctx;
+    int start, end;
+
+    link_obj_range(ctx, t->id, &start, &end);
+    for (int o = start; o < end; o++) {
+        const struct object *obj = &ctx->objs[o];
+        const struct link_obj *lobj = &ctx->lobjs[o];
+
+        for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+            const struct link_sec *lsec = &lobj->secs[i];
+            for (int j = 0; j < lsec->frag_count; j++) {
+                const struct link_frag *frag = &lsec->frags[j];
+                if (frag->live) {
+                    memcpy(ctx->out[ctx->dest[i]].data + frag->pos,
+                            obj->sections[i].data + frag->offset, frag->size);
+                }
+            }
+        }
+
+        for (int i = 0; i < obj->reloc_count; i++) {
+            const struct obj_reloc *rel = &obj->relocs[i];
+            int idx = OBJ_SEC_IDX(rel->sec);
+            const struct link_frag *frag =
+                &lobj->secs[idx].frags[lobj->reloc_frag[i]];
+            int value = rel->value;
+            enum section target_sec = rel->target_sec;
+            int target;
+            int offset;
+            uint8_t bytes[2];
+            int len;
+
+            if (!frag->live) {
+                continue;
+            }
+
+            if (rel->expr_len > 0) {
+                if (link_eval_expr(ctx, o, rel, &target) < 0) {
+                    t->errors++;
+                    continue;
+                }
+            } else if (rel->sym >= 0) {
+                int def_obj = lobj->sym_def_obj[rel->sym];
+                if (def_obj < 0) {
+                    fprintf(stderr, "Undefined symbol %s in %s.\n",
+                            obj->symbols[rel->sym].name, obj->name);
+                    t->errors++;
+                    continue;
+                }
+
+                target = ctx->lobjs[def_obj]
+                    .sym_addr[lobj->sym_def_idx[rel->sym]] + rel->addend;
+                target_sec = ctx->objs[def_obj]
+                    .symbols[lobj->sym_def_idx[rel->sym]].sec;
+            } else {
+                target = link_address(ctx, o, rel->target_sec, rel->addend);
+            }
+
+            if (lobj->reloc_tramp && lobj->reloc_tramp[i] >= 0) {
+                target = ctx->tramps[lobj->reloc_tramp[i]].addr;
+            }
+
+            /* Relative jumps are from the final address of the instruction,
+             * which is in the same fragment as the relocation.
+             */
+            if (rel->type == RT_REL_JUMP && rel->sec != SEC_ABS) {
+                value += frag->addr - frag->pc;
+            }
+
+            len = reltab_encode(rel->type, value, target, bytes);
+            if (len < 0) {
+                fprintf(stderr, "Value %d out of range in %s.\n",
+                        target, obj->name);
+                t->errors++;
+                continue;
+            }
+
+            offset = frag->pos + rel->offset - frag->offset;
+            memcpy(ctx->out[ctx->dest[idx]].data + offset, bytes, len);
+
+            if (ctx->collect_fixups && link_add_fixup(t, obj, rel, target_sec,
+                        ctx->start[idx] + offset, len) < 0) {
+                t->errors++;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Runs a phase on every thread and waits for them to finish.
+ * @return Total number of errors.
+ */
+static int link_run(struct link_thread *threads, int count,
+        void *(*phase)(void *)) {
+    int errors = 0;
+
+    for (int i = 0; i < count; i++) {
+        threads[i].errors = 0;
+        threads[i].inline_run = pthread_create(&threads[i].thread, NULL,
+                phase, &threads[i]) != 0;
+        if (threads[i].inline_run) {
+            phase(&threads[i]);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!threads[i].inline_run) {
+            pthread_join(threads[i].thread, NULL);
+        }
+
+        errors += threads[i].errors;
+    }
+
+    return errors;
+}
+
+static int link_offset_cmp(const void *a, const void *b) {
+    int o1 = *(const int *) a;
+    int o2 = *(const int *) b;
+    return (o1 > o2) - (o1 < o2);
+}
+
+/**
+ * Collects the fixups found by each thread into one sorted list.
+ */
+static int link_merge_fixups(const struct link_thread *threads, int count,
+        struct link_fixups *fixups) {
+    int total = fixups->count;
+
+    for (int t = 0; t < count; t++) {
+        total += threads[t].fixups.count;
+    }
+
+    if (total > fixups->capacity) {
+        int *offsets = realloc(fixups->offsets, total * sizeof(*offsets));
+        if (!offsets) {
+            return -1;
+        }
+
+        fixups->offsets = offsets;
+        fixups->capacity = total;
+    }
+
+    for (int t = 0; t < count; t++) {
+        memcpy(&fixups->offsets[fixups->count], threads[t].fixups.offsets,
+                threads[t].fixups.count * sizeof(*fixups->offsets));
+        fixups->count += threads[t].fixups.count;
+    }
+
+    qsort(fixups->offsets, fixups->count, sizeof(*fixups->offsets),
+            link_offset_cmp);
+    return 0;
+}
+
+int link_objects(const struct object *objs, int count,
+        const struct link_options *opts, struct section_buf out[OBJ_SEC_COUNT]) {
+    struct link_ctx ctx = { .objs = objs, .count = count, .out = out };
+    struct link_thread *threads = NULL;
+    int size[OBJ_SEC_COUNT] = { 0 };
+    int gc = opts && opts->gc_sections;
+    int paged = opts && opts->paged;
+    int errors = 0;
+    long cpus;
+
+    ctx.lobjs = calloc(count ? count : 1, sizeof(*ctx.lobjs));
+    if (!ctx.lobjs) {
+        return -1;
+    }
+
+    for (int o = 0; o < count; o++) {
+        struct link_obj *lobj = &ctx.lobjs[o];
+        int sym_count = objs[o].sym_count + 1;
+
+        lobj->sym_def_obj = malloc(sym_count * sizeof(*lobj->sym_def_obj));
+        lobj->sym_def_idx = malloc(sym_count * sizeof(*lobj->sym_def_idx));
+        lobj->sym_addr = malloc(sym_count * sizeof(*lobj->sym_addr));
+        if (!lobj->sym_def_obj || !lobj->sym_def_idx || !lobj->sym_addr
+                || link_split(lobj, &objs[o], gc || paged, gc) < 0) {
+            errors++;
+            goto LINK_END;
+        }
+
+        for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+            lobj->secs[i].size = objs[o].sections[i].size;
+        }
+    }
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    ctx.thread_count = cpus < 1 ? 1 : cpus;
+    if (ctx.thread_count > LINK_MAX_THREADS) {
+        ctx.thread_count = LINK_MAX_THREADS;
+    }
+
+    if (ctx.thread_count > count) {
+        ctx.thread_count = count ? count : 1;
+    }
+
+    threads = calloc(ctx.thread_count, sizeof(*threads));
+    ctx.defs = calloc(ctx.thread_count, sizeof(*ctx.defs));
+    ctx.refs = calloc(ctx.thread_count, sizeof(*ctx.refs));
+    if (!threads || !ctx.defs || !ctx.refs) {
+        errors++;
+        goto LINK_END;
+    }
+
+    for (int i = 0; i < ctx.thread_count; i++) {
+        threads[i].ctx = &ctx;
+        threads[i].id = i;
+    }
+
+    errors += link_run(threads, ctx.thread_count, link_partition);
+    if (errors == 0) {
+        errors += link_run(threads, ctx.thread_count, link_join);
+    }
+
+    if (errors == 0 && gc && link_gc(&ctx, opts->entry) < 0) {
+        errors++;
+    }
+
+    if (errors > 0) {
+        goto LINK_END;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        ctx.dest[i] = i;
+    }
+
+    /* Lay out the sections */
+    ctx.base[OBJ_SEC_IDX(SEC_TEXT)] = opts ? opts->base : 0;
+    if (paged) {
+        if (link_page(&ctx, opts, size) < 0) {
+            errors++;
+            goto LINK_END;
+        }
+    } else {
+        for (int o = 0; o < count; o++) {
+            struct link_obj *lobj = &ctx.lobjs[o];
+            for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+                lobj->offset[i] = size[i];
+                size[i] += lobj->secs[i].size;
+            }
+        }
+
+        ctx.base[OBJ_SEC_IDX(SEC_DATA)] =
+            ctx.base[OBJ_SEC_IDX(SEC_TEXT)] + size[OBJ_SEC_IDX(SEC_TEXT)];
+        ctx.base[OBJ_SEC_IDX(SEC_ABS)] = 0;
+
+        for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+            ctx.start[i] = i > 0 ? ctx.start[i - 1] + size[i - 1] : 0;
+        }
+
+        link_place(&ctx);
+    }
+
+    ctx.collect_fixups = opts && opts->fixups;
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        if (!secbuf_reserve(&out[i], size[i]) && size[i] > 0) {
+            errors++;
+            goto LINK_END;
+        }
+    }
+
+    if (paged && size[OBJ_SEC_IDX(SEC_TEXT)] > 0) {
+        memset(out[OBJ_SEC_IDX(SEC_TEXT)].data, PAGE_FILL,
+                size[OBJ_SEC_IDX(SEC_TEXT)]);
+        link_write_tramps(&ctx);
+    }
+
+    errors += link_run(threads, ctx.thread_count, link_addresses);
+    errors += link_run(threads, ctx.thread_count, link_apply);
+
+    if (errors == 0 && ctx.collect_fixups
+            && link_merge_fixups(threads, ctx.thread_count, opts->fixups) < 0) {
+        errors++;
+    }
+
+    if (errors == 0 && opts && opts->symbols
+            && link_symbols(&ctx, opts->symbols) < 0) {
+        errors++;
+    }
+
+LINK_END:
+    for (int t = 0; ctx.defs && ctx.refs && t < ctx.thread_count; t++) {
+        for (int p = 0; p < LINK_PARTITION_COUNT; p++) {
+            free(ctx.defs[t][p].ents);
+            free(ctx.refs[t][p].ents);
+        }
+    }
+
+    for (int t = 0; threads && t < ctx.thread_count; t++) {
+        free(threads[t].fixups.offsets);
+    }
+
+    for (int o = 0; o < count; o++) {
+        struct link_obj *lobj = &ctx.lobjs[o];
+        for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+            free(lobj->secs[i].frags);
+        }
+
+        free(lobj->reloc_frag);
+        free(lobj->reloc_order);
+        free(lobj->reloc_tramp);
+        free(lobj->sym_def_obj);
+        free(lobj->sym_def_idx);
+        free(lobj->sym_addr);
+    }
+
+    free(ctx.defs);
+    free(ctx.refs);
+    free(ctx.tramps);
+    free(ctx.lobjs);
+    free(threads);
+    return errors ? -1 : 0;
+}
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,115 @@
+/**
+ * @file link.h
+ */
+
+#ifndef LINK_H_
+#define LINK_H_
+
+#include "object.h"
+#include "page.h"
+#include "section.h"
+#include "symbol_table.h"
+
+/**
+ * Number of partitions global symbols are split into for resolution.
+ * Each partition is joined independently, so this bounds the parallelism.
+ */
+#define LINK_PARTITION_COUNT 64
+
+/**
+ * Maximum number of threads used for linking.
+ */
+#define LINK_MAX_THREADS 16
+
+/**
+ * Offsets of fields in a linked image.
+ */
+struct link_fixups {
+    int count;
+    int capacity;
+
+    /**
+     * Offsets from the start of the image (the output sections one after
+     * another), in increasing order. This is allocated with malloc().
+     */
+    int *offsets;
+};
+
+/**
+ * Options for linking.
+ */
+struct link_options {
+    /**
+     * Whether to remove fragments of the text and data sections which are not
+     * reachable from the entry point.
+     */
+    int gc_sections;
+
+    /**
+     * Symbol execution starts at, used as the root for garbage collection. If
+     * NULL, this is the start of the first object's text section.
+     */
+    const char *entry;
+
+    /**
+     * If not NULL, the final address of each defined symbol (which was not
+     * removed) is added to this table, e.g. to label a disassembly.
+     */
+    struct symbol_table *symbols;
+
+    /**
+     * Address the text section starts at (the data section follows it).
+     */
+    int base;
+
+    /**
+     * If not NULL, the offset of every 16-bit field which holds the address of
+     * something in the text or data section is added to this list, so that the
+     * image can be moved by adding to those fields. This should be empty.
+     * Linking fails if a field of another width holds such an address, since
+     * it can't be adjusted that way.
+     */
+    struct link_fixups *fixups;
+
+    /**
+     * Whether to split the text and data sections over flash pages of
+     * PAGE_CAPACITY bytes, each mapped at the base address. Fragments are
+     * placed so that few calls cross pages, and those that do go through
+     * trampolines and a branch table (see page.h). The absolute section must
+     * be empty.
+     */
+    int paged;
+
+    /**
+     * If not NULL, the number of times each routine is called, which is used
+     * to weigh the calls between pages. Otherwise each call site counts once.
+     */
+    const struct page_profile *profile;
+};
+
+/**
+ * Links objects into a single image.
+ *
+ * Like-named sections are concatenated in the order the objects are given.
+ * The text section starts at the base address (0 by default) and the data
+ * section directly follows it; the absolute section is placed after both, but
+ * its contents keep the addresses they were assembled at.
+ *
+ * If the output is paged, the pages are concatenated in the text section
+ * (padded to a full page with PAGE_FILL, except for the last), and the data
+ * and absolute sections are empty.
+ *
+ * @param objs Objects to link.
+ * @param count Number of objects.
+ * @param opts Options, or NULL for the defaults.
+ * @param out Output sections, indexed by OBJ_SEC_IDX(). These should be
+ * initialized and empty.
+ * @return 0 on success, -1 if there were undefined or multiply-defined symbols
+ * or relocations out of range.
+ */
+int link_objects(const struct object *objs, int count,
+        const struct link_options *opts, struct section_buf out[OBJ_SEC_COUNT]);
+
+#endif /* LINK_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,725 @@
+/**
+ * @file macro.c
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cond.h"
+#include "include.h"
+#include "macro.h"
+#include "opcode.h"
+#include "tixasm.h"
+#include "z80.tab.h"
+
+void yyerror(char *s);
+
+/**
+ * Default initial capacity of a token buffer.
+ */
+#define TOKBUF_DEF_INIT_CAP 32
+
+/**
+ * A single recorded token.
+ * The value is the exact semantic value the scanner produced, so the token can
+ * be handed back to the parser without lexing the text again.
+ * For labels, local symbols, T_STRING and T_IDENT, the value is a string owned by
+ * the buffer the token is stored in.
+ */
+struct macro_token {
+    int type;
+    YYSTYPE val;
+};
+
+/**
+ * Growable array of recorded tokens.
+ */
+struct macro_tokbuf {
+    size_t size;
+    size_t capacity;
+    struct macro_token *toks;
+};
+
+struct macro {
+    char *name;
+    int param_count;
+    struct macro_tokbuf body;
+
+    /**
+     * Whether the body invokes the macro itself. Such an invocation is recorded
+     * before the macro is defined, as a T_MACRO_CALL token without a symbol
+     * (see macro_unknown_token()).
+     */
+    int recursive;
+};
+
+/**
+ * An active expansion.
+ * Tokens are read from @c toks until it runs out, at which point the buffer is
+ * replayed again if there are repetitions left.
+ */
+struct macro_frame {
+    struct macro_tokbuf toks;
+    size_t pos;
+
+    /**
+     * Number of times the buffer still has to be replayed after this pass.
+     */
+    int reps;
+
+    /**
+     * Whether the strings in @c toks are owned by this frame. Macro expansions
+     * only borrow them from the definition and the arguments.
+     */
+    int owns_strs;
+
+    /**
+     * Arguments of a macro invocation, all in one buffer. These own their
+     * strings.
+     */
+    struct macro_tokbuf args;
+};
+
+/**
+ * All macro definitions. The value of an ST_MACRO symbol is an index into this.
+ */
+static struct vector macro_defs = { 0, 0, NULL };
+
+static struct macro_frame macro_stack[MACRO_MAX_DEPTH];
+static int macro_depth = 0;
+
+/**
+ * Parameters of the macro currently being recorded, or NULL if not recording
+ * a macro definition.
+ */
+static const struct vector *macro_rec_params = NULL;
+
+/**
+ * Name of the macro currently being recorded, or NULL if not recording a macro
+ * definition.
+ */
+static const char *macro_rec_name = NULL;
+
+/**
+ * Nesting level of recording (.rept blocks can be recorded while replaying
+ * another one).
+ */
+static int macro_rec_level = 0;
+
+/**
+ * Gets the index of a parameter of the macro being recorded.
+ * @return The index, or -1 if @p name is not a parameter.
+ */
+static int macro_param_index(const char *name) {
+    if (!macro_rec_params) {
+        return -1;
+    }
+
+    for (int i = 0; i < macro_rec_params->size; i++) {
+        if (strcmp(name, vector_get(macro_rec_params, i)) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int tokbuf_add(struct macro_tokbuf *buf, int type, const YYSTYPE *val) {
+    if (buf->size >= buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity * 2
+                                        : TOKBUF_DEF_INIT_CAP;
+        struct macro_token *toks =
+            realloc(buf->toks, sizeof(*toks) * capacity);
+        if (!toks) {
+            return -1;
+        }
+
+        buf->toks = toks;
+        buf->capacity = capacity;
+    }
+
+    buf->toks[buf->size].type = type;
+    buf->toks[buf->size].val = *val;
+    buf->size++;
+    return 0;
+}
+
+static int tok_has_str(int type) {
+    return type == T_LABEL || type == T_LLABEL || type == T_LSYMBOL
+        || type == T_STRING || type == T_IDENT;
+}
+
+static void tokbuf_free(struct macro_tokbuf *buf, int free_strs) {
+    if (free_strs) {
+        for (size_t i = 0; i < buf->size; i++) {
+            if (tok_has_str(buf->toks[i].type)) {
+                free(buf->toks[i].val.str);
+            }
+        }
+    }
+
+    free(buf->toks);
+    buf->toks = NULL;
+    buf->size = buf->capacity = 0;
+}
+
+static void macro_free(struct macro *m) {
+    if (!m) {
+        return;
+    }
+
+    free(m->name);
+    tokbuf_free(&m->body, 1);
+    free(m);
+}
+
+static void macro_pop(void) {
+    struct macro_frame *f = &macro_stack[--macro_depth];
+    tokbuf_free(&f->toks, f->owns_strs);
+    tokbuf_free(&f->args, 1);
+}
+
+static struct macro_frame *macro_push(void) {
+    if (macro_depth >= MACRO_MAX_DEPTH) {
+        yyerror("Macros nested too deeply");
+        return NULL;
+    }
+
+    struct macro_frame *f = &macro_stack[macro_depth++];
+    memset(f, 0, sizeof(*f));
+    return f;
+}
+
+/**
+ * Hands a recorded token back to the parser.
+ * Labels are only defined now (when they are replayed) and strings are copied
+ * since the parser frees them.
+ */
+static int macro_replay_token(const struct macro_token *tok) {
+    switch (tok->type) {
+    case T_LABEL:
+        return macro_label_token(tok->val.str, strlen(tok->val.str), 0);
+    case T_LLABEL:
+        return macro_label_token(tok->val.str, strlen(tok->val.str), 1);
+    case T_LSYMBOL:
+        return macro_local_symbol_token(tok->val.str);
+    case T_STRING:
+    case T_IDENT:
+        yylval.str = strdup(tok->val.str);
+        return tok->type;
+    default:
+        yylval = tok->val;
+        return tok->type;
+    }
+}
+
+/**
+ * Gets the next token from the innermost expansion or the scanner, without
+ * expanding macro invocations.
+ */
+static int macro_next_token(void) {
+    while (macro_depth > 0) {
+        struct macro_frame *f = &macro_stack[macro_depth-1];
+        if (f->pos < f->toks.size) {
+            return macro_replay_token(&f->toks.toks[f->pos++]);
+        }
+
+        if (f->reps > 0) {
+            f->reps--;
+            f->pos = 0;
+            continue;
+        }
+
+        macro_pop();
+    }
+
+    return yylex_raw();
+}
+
+/**
+ * Records tokens up until (not including) the matching end token.
+ * Nested definitions and .rept blocks are recorded as-is.
+ * @return 0 on success, -1 if the input ended first.
+ */
+static int macro_record(struct macro_tokbuf *buf, int end_tok) {
+    int level = 0;
+    int tok;
+
+    macro_rec_level++;
+    while ((tok = macro_next_token()) != 0) {
+        if (tok == T_MACRO || tok == T_REPT) {
+            level++;
+        } else if (tok == T_ENDM || tok == T_ENDR) {
+            if (level == 0) {
+                if (tok != end_tok) {
+                    yyerror(end_tok == T_ENDM ? "Expected .endm"
+                                              : "Expected .endr");
+                }
+
+                macro_rec_level--;
+                return 0;
+            }
+
+            level--;
+        } else if (tok == T_SYMBOL) {
+            /* Symbols replayed from another expansion did not go through
+             * macro_symbol_token(), so parameters have to be caught here.
+             */
+            int arg = macro_param_index(yylval.sym->name);
+            if (arg >= 0) {
+                tok = T_MACRO_ARG;
+                yylval.i = arg;
+            }
+        }
+
+        if (tokbuf_add(buf, tok, &yylval) < 0) {
+            break;
+        }
+    }
+
+    macro_rec_level--;
+    yyerror(end_tok == T_ENDM ? "Missing .endm" : "Missing .endr");
+    return -1;
+}
+
+/**
+ * Reads the arguments of a macro invocation up to the end of the line.
+ * Arguments are separated by commas outside of parentheses.
+ * @param[out] args All argument tokens.
+ * @param[out] starts Start index of each argument in @p args, with an extra
+ * entry at the end for the end of the last argument.
+ * @param max_args Maximum number of arguments to split.
+ * @param[out] nargs Number of arguments read.
+ * @return Type of the token which ended the line, or -1 on failure. The value
+ * of that token is left in yylval.
+ */
+static int macro_read_args(struct macro_tokbuf *args, size_t *starts,
+        int max_args, int *nargs) {
+    int parens = 0;
+    int tok;
+
+    *nargs = 0;
+    starts[0] = 0;
+    while ((tok = macro_next_token()) != 0 && tok != T_EOL) {
+        if (tok == '(') {
+            parens++;
+        } else if (tok == ')') {
+            parens--;
+        } else if (tok == ',' && parens == 0) {
+            if (++*nargs >= max_args) {
+                yyerror("Too many macro arguments");
+                return -1;
+            }
+
+            starts[*nargs] = args->size;
+            continue;
+        }
+
+        if (tokbuf_add(args, tok, &yylval) < 0) {
+            return -1;
+        }
+    }
+
+    /* A line with no tokens has no arguments, but anything else has one more
+     * argument than it has commas.
+     */
+    if (args->size > 0 || *nargs > 0) {
+        ++*nargs;
+    }
+
+    starts[*nargs] = args->size;
+    return tok;
+}
+
+/**
+ * Expands a macro invocation by pushing a frame with its body, arguments
+ * spliced in for the parameter slots.
+ */
+static int macro_expand(const struct macro *m) {
+    size_t starts[m->param_count + 2];
+    struct macro_tokbuf args = { 0, 0, NULL };
+    int nargs;
+    int end_tok;
+    YYSTYPE end_val;
+
+    end_tok = macro_read_args(&args, starts, m->param_count + 1, &nargs);
+    end_val = yylval;
+    if (end_tok < 0) {
+        tokbuf_free(&args, 1);
+        return -1;
+    }
+
+    if (nargs > m->param_count) {
+        yyerror("Too many macro arguments");
+        tokbuf_free(&args, 1);
+        return -1;
+    }
+
+    struct macro_frame *f = macro_push();
+    if (!f) {
+        tokbuf_free(&args, 1);
+        return -1;
+    }
+
+    f->args = args;
+    for (size_t i = 0; i < m->body.size; i++) {
+        const struct macro_token *tok = &m->body.toks[i];
+        if (tok->type != T_MACRO_ARG) {
+            tokbuf_add(&f->toks, tok->type, &tok->val);
+            continue;
+        }
+
+        /* Missing arguments expand to nothing */
+        int arg = tok->val.i;
+        if (arg >= nargs) {
+            continue;
+        }
+
+        for (size_t j = starts[arg]; j < starts[arg+1]; j++) {
+            tokbuf_add(&f->toks, f->args.toks[j].type, &f->args.toks[j].val);
+        }
+    }
+
+    /* The line the invocation was on still has to end */
+    if (end_tok != 0) {
+        tokbuf_add(&f->toks, end_tok, &end_val);
+    }
+
+    return 0;
+}
+
+int yylex(void) {
+    for (;;) {
+        int tok = macro_next_token();
+        if (tok != T_MACRO_CALL) {
+            return tok;
+        }
+
+        const struct macro *m = macro_get(yylval.sym);
+        if (!m) {
+            return T_ERROR;
+        }
+
+        /* Reported before the arguments are read, so that the line number is
+         * the one of the invocation.
+         */
+        if (m->recursive) {
+            yyerror("Recursive macro invocation");
+            return T_ERROR;
+        }
+
+        if (macro_expand(m) < 0) {
+            return T_ERROR;
+        }
+    }
+}
+
+int macro_define(char *name, struct vector *params) {
+    struct macro *m = calloc(1, sizeof(*m));
+    int ret = -1;
+
+    if (!m) {
+        goto DEFINE_END;
+    }
+
+    m->name = name;
+    m->param_count = params ? params->size : 0;
+    name = NULL;
+
+    macro_rec_params = params;
+    macro_rec_name = m->name;
+    ret = macro_record(&m->body, T_ENDM);
+    macro_rec_params = NULL;
+    macro_rec_name = NULL;
+    if (ret < 0) {
+        goto DEFINE_END;
+    }
+
+    for (size_t i = 0; i < m->body.size; i++) {
+        if (m->body.toks[i].type == T_MACRO_CALL && !m->body.toks[i].val.sym) {
+            m->recursive = 1;
+        }
+    }
+
+    ret = -1;
+    if (!symtab_add(asm_symbol_table, m->name,
+                ST_MACRO, SEC_UNDEF, macro_defs.size)) {
+        yyerror("Macro name already defined");
+        goto DEFINE_END;
+    }
+
+    if (vector_add(&macro_defs, m) < 0) {
+        goto DEFINE_END;
+    }
+
+    m = NULL;
+    ret = 0;
+
+DEFINE_END:
+    macro_free(m);
+    free(name);
+    if (params) {
+        vector_free_all(params);
+        vector_destroy(params);
+        free(params);
+    }
+
+    return ret;
+}
+
+int macro_rept(int count) {
+    struct macro_tokbuf body = { 0, 0, NULL };
+
+    if (macro_record(&body, T_ENDR) < 0) {
+        tokbuf_free(&body, 1);
+        return -1;
+    }
+
+    if (count <= 0 || body.size == 0) {
+        tokbuf_free(&body, 1);
+        return 0;
+    }
+
+    struct macro_frame *f = macro_push();
+    if (!f) {
+        tokbuf_free(&body, 1);
+        return -1;
+    }
+
+    f->toks = body;
+    f->reps = count - 1;
+    f->owns_strs = 1;
+    return 0;
+}
+
+void macro_skip_cond(void) {
+    int level = 0;
+
+    while (macro_depth > 0) {
+        struct macro_frame *f = &macro_stack[macro_depth-1];
+        if (f->pos >= f->toks.size) {
+            if (f->reps > 0) {
+                f->reps--;
+                f->pos = 0;
+            } else {
+                macro_pop();
+            }
+
+            continue;
+        }
+
+        switch (f->toks.toks[f->pos++].type) {
+        case T_IF:
+        case T_IFDEF:
+        case T_IFNDEF:
+            level++;
+            break;
+
+        case T_ELSE:
+            if (level == 0 && cond_skip_else()) {
+                return;
+            }
+            break;
+
+        case T_ENDIF:
+            if (level == 0) {
+                cond_skip_endif();
+                return;
+            }
+
+            level--;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    /* The rest of the branch is in the source itself */
+    lex_skip_cond();
+}
+
+int macro_recording(void) {
+    return macro_rec_level > 0;
+}
+
+int macro_replaying(void) {
+    return macro_depth > 0;
+}
+
+int macro_label_token(const char *name, int len, int local) {
+    if (macro_recording()) {
+        yylval.str = strndup(name, len);
+        return local ? T_LLABEL : T_LABEL;
+    }
+
+    if (local) {
+        yylval.sym = symtab_add_len(asm_local_table, name, len,
+                ST_OBJECT, asm_get_pc()->sec, asm_get_pc()->value);
+        if (!yylval.sym) {
+            yyerror("Local label already defined");
+            return T_ERROR;
+        }
+
+        asm_define_sym(yylval.sym);
+        return T_LLABEL;
+    }
+
+    /* The previous scope's labels are all defined by now */
+    asm_close_scope();
+    asm_open_scope();
+    asm_split_fragment();
+
+    /* A symbol from a snapshot is defined as if its header were included, even
+     * if nothing has looked it up yet
+     */
+    switch (asm_snapshot_has(name, len)) {
+    case 1:
+        yyerror("Symbol already defined");
+        /* Fall through */
+    case -1:
+        return T_ERROR;
+    default:
+        break;
+    }
+
+    yylval.sym = symtab_add_len(asm_symbol_table, name, len,
+            ST_OBJECT, asm_get_pc()->sec, asm_get_pc()->value);
+    if (!yylval.sym) {
+        yyerror("Symbol already defined");
+        return T_ERROR;
+    }
+
+    asm_define_sym(yylval.sym);
+    return T_LABEL;
+}
+
+int macro_symbol_token(const char *name) {
+    int arg = macro_param_index(name);
+    if (arg >= 0) {
+        yylval.i = arg;
+        return T_MACRO_ARG;
+    }
+
+    yylval.sym = symtab_search(asm_symbol_table, name);
+    if (!yylval.sym) {
+        yylval.sym = asm_snapshot_sym(name);
+    }
+
+    if (!yylval.sym) {
+        /* Create a new, empty symbol */
+        yylval.sym = symtab_add(asm_symbol_table, name,
+                ST_UNDEF, SEC_UNDEF, 0);
+        if (!yylval.sym) {
+            /* Memory error */
+            return T_ERROR;
+        }
+    }
+
+    return T_SYMBOL;
+}
+
+/**
+ * Determines whether a file has a line defining a macro (include_foreach()
+ * callback).
+ * @param arg Name of the macro.
+ * @return -1 if the file defines the macro (which stops the search), 0 if not.
+ */
+static int macro_find_def(const struct include_file *file, void *arg) {
+    const char *name = arg;
+    size_t len = strlen(name);
+    const char *p = file->data;
+    const char *end = file->data + file->size;
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            eol = end;
+        }
+
+        while (p < eol && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+
+        if (eol - p > 6 && strncasecmp(p, ".macro", 6) == 0
+                && (p[6] == ' ' || p[6] == '\t')) {
+            p += 6;
+            while (p < eol && (*p == ' ' || *p == '\t')) {
+                p++;
+            }
+
+            if ((size_t) (eol - p) >= len && strncmp(p, name, len) == 0
+                    && (p + len == eol || !(isalnum((unsigned char) p[len])
+                            || p[len] == '_'))) {
+                return -1;
+            }
+        }
+
+        p = eol + 1;
+    }
+
+    return 0;
+}
+
+int macro_unknown_token(const char *name) {
+    if (macro_rec_name && strcmp(name, macro_rec_name) == 0) {
+        /* Only reported if the macro is expanded */
+        yylval.sym = NULL;
+        return T_MACRO_CALL;
+    }
+
+    /* Bodies are recorded before they are expanded, so this can't tell yet
+     * whether the name is defined in the meantime.
+     */
+    if (!macro_recording()
+            && include_foreach(macro_find_def, (void *) name) < 0) {
+        yyerror("Macro used before definition");
+    }
+
+    return T_ERROR;
+}
+
+int macro_local_symbol_token(const char *name) {
+    if (macro_recording()) {
+        yylval.str = strdup(name);
+        return T_LSYMBOL;
+    }
+
+    yylval.sym = symtab_search(asm_local_table, name);
+    if (!yylval.sym) {
+        /* Forward reference within the scope */
+        yylval.sym = symtab_add(asm_local_table, name,
+                ST_UNDEF, SEC_UNDEF, 0);
+        if (!yylval.sym) {
+            return T_ERROR;
+        }
+    }
+
+    return T_LSYMBOL;
+}
+
+const struct macro *macro_get(const struct symbol_ent *sym) {
+    if (!sym || sym->type != ST_MACRO) {
+        return NULL;
+    }
+
+    return vector_get(&macro_defs, sym->value);
+}
+
+void macro_destroy(void) {
+    while (macro_depth > 0) {
+        macro_pop();
+    }
+
+    for (int i = 0; i < macro_defs.size; i++) {
+        macro_free(vector_get(&macro_defs, i));
+    }
+
+    vector_destroy(&macro_defs);
+    macro_defs.size = macro_defs.capacity = 0;
+    macro_defs.elements = NULL;
+}
+
+/* vim: set tw=80 ft=c: */
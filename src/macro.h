@@ -0,0 +1,132 @@
+/**
+ * @file macro.h
+ */
+
+#ifndef MACRO_H_
+#define MACRO_H_
+
+#include "symbol_table.h"
+#include "vector.h"
+
+/**
+ * Maximum depth of nested macro and .rept expansions.
+ * This is mostly to stop runaway recursive macros.
+ */
+#define MACRO_MAX_DEPTH 64
+
+/**
+ * A macro definition.
+ * The body is recorded once as a token stream; parameters are replaced by
+ * T_MACRO_ARG tokens holding the index of the parameter. The definition is
+ * private to macro.c since tokens hold parser values (YYSTYPE).
+ */
+struct macro;
+
+/**
+ * The actual scanner (flex or the hand-written one, see lex_set_scanner()).
+ * yylex() is a wrapper around this which replays macro expansions before
+ * reading new input.
+ */
+int yylex_raw(void);
+
+/**
+ * Reads the next token, either from the innermost expansion or from the
+ * scanner, and expands macro invocations.
+ * This is what the parser calls.
+ */
+int yylex(void);
+
+/**
+ * Defines a macro and records its body.
+ * This should be called once the header (.macro name params) has been parsed.
+ * All tokens up until the matching .endm are recorded.
+ * @param name Name of the macro. This is taken over by the macro.
+ * @param params Vector of parameter names (char *), or NULL if there are none.
+ * The vector and its elements are freed.
+ * @return 0 on success, -1 on failure.
+ */
+int macro_define(char *name, struct vector *params);
+
+/**
+ * Records the body of a .rept block and queues it to be replayed.
+ * All tokens up until the matching .endr are recorded.
+ * @param count Number of times to repeat the body.
+ * @return 0 on success, -1 on failure.
+ */
+int macro_rept(int count);
+
+/**
+ * Gets whether tokens are currently being recorded instead of parsed.
+ * Lexer actions with side effects (like defining labels) use this to defer the
+ * side effect until the token is replayed.
+ */
+int macro_recording(void);
+
+/**
+ * Gets whether tokens are currently coming from an expansion instead of from
+ * the scanner.
+ */
+int macro_replaying(void);
+
+/**
+ * Skips the false branch of a conditional in the expansions being replayed.
+ * Tokens are dropped without being handed to the parser (so labels in them are
+ * never defined) up until the matching .else or .endif. If the expansions run
+ * out first, skipping continues in the scanner.
+ */
+void macro_skip_cond(void);
+
+/**
+ * Produces a label token for a name, or defers the definition if recording.
+ * Defining a global label starts a new local label scope.
+ * @param name Name of the label (not null-terminated).
+ * @param len Length of @p name.
+ * @param local Whether the label is local to the last global label.
+ * @return Token type to return to the parser.
+ */
+int macro_label_token(const char *name, int len, int local);
+
+/**
+ * Produces a symbol token for a name. If recording a macro and the name is a
+ * parameter, a T_MACRO_ARG token is produced instead.
+ * @param name Name of the symbol (null-terminated).
+ * @return Token type to return to the parser.
+ */
+int macro_symbol_token(const char *name);
+
+/**
+ * Produces a token for a name in the place of an instruction which is neither
+ * an instruction nor a macro.
+ * If recording the definition of a macro with that name, a T_MACRO_CALL token
+ * without a symbol is produced, and the recursion is reported when the macro
+ * is invoked. Otherwise, if the name is defined as a macro later in the input,
+ * that is reported.
+ * @param name Name (null-terminated).
+ * @return Token type to return to the parser.
+ */
+int macro_unknown_token(const char *name);
+
+/**
+ * Produces a token referencing a local label.
+ * When recording, the name is kept instead since the label belongs to whatever
+ * scope the tokens are replayed in.
+ * @param name Name of the label (null-terminated).
+ * @return Token type to return to the parser.
+ */
+int macro_local_symbol_token(const char *name);
+
+/**
+ * Gets a macro from a symbol of type ST_MACRO.
+ * @param sym Symbol to look up.
+ * @return The macro, or NULL if @p sym is not a macro.
+ */
+const struct macro *macro_get(const struct symbol_ent *sym);
+
+/**
+ * Frees all macro definitions and pending expansions.
+ */
+void macro_destroy(void);
+
+#endif /* MACRO_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -5,123 +5,1107 @@
  * @date Last Modified: Tue, 06 Feb 2018
  */
 
+#include <getopt.h>
+#include <sys/stat.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
-
+#include "chunk.h"
+#include "disasm.h"
+#include "include.h"
+#include "lines.h"
+#include "link.h"
+#include "macro.h"
+#include "object.h"
 #include "opcode.h"
+#include "page.h"
+#include "scan.h"
+#include "snapshot.h"
+#include "stream.h"
 #include "tixasm.h"
+#include "tixe.h"
+#include "variant.h"
+#include "watch.h"
 #include "z80.tab.h"
 
 extern FILE *yyin;
-extern FILE *yyout;
 
-int main(int argc, char *argv[]) {
-    struct symbol_table st;
-    struct reloc_table rt;
+/**
+ * Number of times each file is scanned by --bench-scan.
+ */
+#define MAIN_BENCH_REPS 20
+
+/**
+ * Number of times each file is decoded by --bench-disasm.
+ */
+#define MAIN_BENCH_DISASM_REPS 50
+
+/**
+ * Formats a linked image can be written in.
+ */
+enum main_format {
+    MAIN_BINARY,
+    MAIN_DISASM,
+    MAIN_TIXE,
+    MAIN_PACKED_TIXE,
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-c] [-o output] [--gc-sections] [-e entry] [-j jobs] "
+            "[-b base] [file]\n"
+            "       %s link [-o output] [--gc-sections] [-e entry] [-b base] "
+            "object...\n"
+            "       %s dis [-o output] [-b base] binary\n"
+            "       %s snap -o output header\n"
+            "       %s --bench-scan file...\n"
+            "       %s --bench-disasm binary...\n"
+            "  -c             Output an object (.tixo) instead of linking\n"
+            "  -o             Output file (default: hex dump to stdout)\n"
+            "  --gc-sections  Remove code and data unreachable from the entry\n"
+            "  -e             Entry symbol (default: start of the text)\n"
+            "  -j             Processes to assemble large files with (default: "
+            "one per CPU)\n"
+            "  -b             Address of the start of the binary (default: 0)\n"
+            "  --disasm       Output a disassembly listing instead of binary\n"
+            "  --tixe         Output a relocatable TIXE executable\n"
+            "  --pack         Compress the image of the executable\n"
+            "  --pages        Place the output on 16 KB flash pages mapped at "
+            "the base\n"
+            "  --profile      File of NAME COUNT lines giving how often routines "
+            "are\n"
+            "                 called, to place the pages by\n"
+            "  --watch        Build again whenever an input changes\n"
+            "  --stream       Write the output while assembling, in bounded "
+            "memory\n"
+            "  --symbols      Symbol snapshot (from snap) to look up undefined "
+            "names in\n"
+            "  --variant      Link an image to PATH[@BASE][:SYM=VALUE,...] "
+            "instead of -o\n"
+            "  --scanner      Scanner to use: flex (default) or simd\n"
+            "  --bench-scan   Compare the throughput of the scanners\n"
+            "  --bench-disasm Measure the throughput of the disassembler\n",
+            prog, prog, prog, prog, prog, prog);
+}
+
+/**
+ * Adds a file from the include cache to the files a build depends on.
+ */
+static int main_add_dep(const struct include_file *file, void *arg) {
+    return watch_add(arg, file->path);
+}
+
+/**
+ * Assembles a source file (or stdin) into an object.
+ * @param deps If not NULL, the source file and the files it includes are added
+ * to this (even if assembly fails).
+ */
+static int main_assemble(struct object *obj, const char *path,
+        struct watch *deps) {
+    int ret = 0;
+
+    if (asm_init() < 0) {
+        return -1;
+    }
+
+    if (path) {
+        struct include_file *input = include_get(path);
+        if (!input) {
+            fprintf(stderr, "Could not open %s.\n", path);
+            asm_destroy();
+            return -1;
+        }
+
+        lex_push_file(input);
+    } else {
+        yyin = stdin;
+    }
+
+    if (yyparse() != 0) {
+        ret = -1;
+    }
+
+    asm_close_scope();
+
+    if (ret == 0) {
+        ret = asm_to_object(obj, path ? path : "<stdin>");
+    }
+
+    if (deps && include_foreach(main_add_dep, deps) < 0) {
+        ret = -1;
+    }
+
+    macro_destroy();
+    include_destroy();
+    asm_destroy();
+    return ret;
+}
+
+/**
+ * Assembles a header of equates into a symbol snapshot (see struct snapshot),
+ * which can be used instead of including the header.
+ */
+static int main_snapshot(const char *path, const char *output) {
+    struct object obj;
+    int ret;
+
+    if (main_assemble(&obj, path, NULL) < 0) {
+        return -1;
+    }
+
+    ret = snapshot_write(&obj, output);
+    object_destroy(&obj);
+    return ret;
+}
+
+/**
+ * Assembles a source file (or stdin) straight into a binary, which is written
+ * as it is assembled (see asm_set_stream()). The result is the same as linking
+ * the object of the file on its own.
+ */
+static int main_stream(const char *path, const char *output) {
+    const char *name = path ? path : "<stdin>";
+    struct stream st;
+    int ret = 0;
+
+    if (asm_init() < 0) {
+        return -1;
+    }
+
+    if (stream_open(&st, output, name) < 0) {
+        asm_destroy();
+        return -1;
+    }
+
+    asm_set_stream(&st);
+    if (path) {
+        struct include_file *input = include_get(path);
+        if (!input) {
+            fprintf(stderr, "Could not open %s.\n", path);
+            ret = -1;
+        } else {
+            lex_push_file(input);
+        }
+    } else {
+        yyin = stdin;
+    }
+
+    if (ret == 0 && yyparse() != 0) {
+        ret = -1;
+    }
+
+    asm_close_scope();
+
+    if (ret == 0) {
+        ret = asm_stream_finish();
+    }
+
+    macro_destroy();
+    include_destroy();
+    asm_destroy();
+    stream_close(&st);
+
+    /* Don't leave a partial image behind */
+    if (ret < 0) {
+        unlink(output);
+    }
+
+    return ret;
+}
+
+/**
+ * Scans files repeatedly with one scanner, without parsing them.
+ * @param scanner Scanner to use.
+ * @param paths Files to scan.
+ * @param count Number of files.
+ * @param[out] toks Set to the tokens from the first pass, to compare the
+ * scanners. This should be freed.
+ * @param[out] tok_count Number of tokens in @p toks.
+ * @return 0 on success, -1 on failure.
+ */
+static int main_bench_scanner(enum lex_scanner scanner,
+        char *const paths[], int count, int **toks, int *tok_count) {
+    struct timespec start, end;
+    size_t bytes = 0;
+    int tok_cap = 0;
+    int tok;
+
+    *toks = NULL;
+    *tok_count = 0;
+    lex_set_scanner(scanner);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int rep = 0; rep < MAIN_BENCH_REPS; rep++) {
+        /* Labels are defined as they are scanned, so start over each time */
+        if (asm_init() < 0) {
+            return -1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            struct include_file *file = include_get(paths[i]);
+            if (!file) {
+                fprintf(stderr, "Could not open %s.\n", paths[i]);
+                asm_destroy();
+                return -1;
+            }
+
+            lex_reset();
+            lex_push_file(file);
+            while ((tok = yylex_raw()) != 0) {
+                if (tok == T_STRING || tok == T_IDENT) {
+                    free(yylval.str);
+                }
+
+                if (rep > 0) {
+                    continue;
+                }
+
+                if (*tok_count == tok_cap) {
+                    int *new_toks;
+                    tok_cap = tok_cap ? tok_cap * 2 : 1024;
+                    new_toks = realloc(*toks, tok_cap * sizeof(**toks));
+                    if (!new_toks) {
+                        asm_destroy();
+                        return -1;
+                    }
+
+                    *toks = new_toks;
+                }
+
+                (*toks)[(*tok_count)++] = tok;
+            }
+
+            bytes += file->size;
+        }
+
+        lex_reset();
+        asm_destroy();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec)
+        + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-5s %9d tokens  %10zu bytes  %8.3f s  %8.1f MB/s\n",
+            scanner == LEX_SIMD ? "simd" : "flex", *tok_count * MAIN_BENCH_REPS,
+            bytes, secs, bytes / secs / 1e6);
+    return 0;
+}
+
+/**
+ * Compares the throughput of the flex and hand-written scanners on the same
+ * files, and checks that they produce the same tokens.
+ */
+static int main_bench_scan(char *const paths[], int count) {
+    int *flex_toks, *simd_toks;
+    int flex_count, simd_count;
+    int ret = -1;
+
+    if (main_bench_scanner(LEX_FLEX, paths, count,
+                &flex_toks, &flex_count) < 0) {
+        free(flex_toks);
+        goto BENCH_END;
+    }
+
+    if (main_bench_scanner(LEX_SIMD, paths, count,
+                &simd_toks, &simd_count) < 0) {
+        free(flex_toks);
+        free(simd_toks);
+        goto BENCH_END;
+    }
+
+    ret = 0;
+    for (int i = 0; i < flex_count || i < simd_count; i++) {
+        int t1 = i < flex_count ? flex_toks[i] : 0;
+        int t2 = i < simd_count ? simd_toks[i] : 0;
+        if (t1 != t2) {
+            fprintf(stderr, "Scanners differ at token %d (flex %d, simd %d).\n",
+                    i, t1, t2);
+            ret = -1;
+            break;
+        }
+    }
 
-    char *output;
-    size_t output_len;
+    free(flex_toks);
+    free(simd_toks);
 
-    symtab_init(&st);
-    reltab_init(&rt);
-    asm_symbol_table = &st;
-    asm_reloc_table = &rt;
+BENCH_END:
+    include_destroy();
+    lex_set_scanner(LEX_FLEX);
+    return ret;
+}
 
-    yyin = stdin;
-    yyout = open_memstream(&output, &output_len);
-    if (!yyout) {
+/**
+ * Writes the linked sections, either as a binary file or as a hex dump to
+ * stdout.
+ */
+static int main_output(const struct section_buf out[OBJ_SEC_COUNT],
+        const char *path) {
+    if (!path) {
+        /* Print in hex format */
+        for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+            for (int j = 0; j < out[i].size; j++) {
+                printf("%02X ", out[i].data[j]);
+            }
+        }
+
+        printf("\n");
+        return 0;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
         return -1;
     }
 
-    yyparse();
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        fwrite(out[i].data, 1, out[i].size, file);
+    }
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+/**
+ * Reads a whole file into memory.
+ * @param path File to read.
+ * @param[out] size Size of the file.
+ * @return The contents of the file, which should be freed, or NULL on failure.
+ */
+static uint8_t *main_read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long len;
+
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) < 0 || (len = ftell(file)) < 0
+            || fseek(file, 0, SEEK_SET) < 0) {
+        goto READ_END;
+    }
+
+    data = malloc(len ? len : 1);
+    if (data && fread(data, 1, len, file) != len) {
+        free(data);
+        data = NULL;
+    }
+
+    *size = len;
 
-    fclose(yyout);
+READ_END:
+    if (!data) {
+        fprintf(stderr, "Could not read %s.\n", path);
+    }
+
+    fclose(file);
+    return data;
+}
 
-    /* Perform relocations */
-    for (int i = 0; i < reltab_get_size(&rt); i++) {
-        const struct reloc_ent *ent = reltab_get(&rt, i);
-        enum reloc_type type;
-        int value, sym_value;
+/**
+ * Writes a disassembly listing of the linked sections, labelled with the
+ * symbols of the linked objects. The data section is listed as data and the
+ * others as code; the listing assembles back into the same output.
+ */
+static int main_disasm_output(const struct section_buf out[OBJ_SEC_COUNT],
+        struct symbol_table *symbols, const char *path) {
+    static const char *const sec_names[OBJ_SEC_COUNT] = {
+        "text", "data", "abs",
+    };
+    struct disasm_labels labels;
+    uint16_t addr = 0;
+    size_t size = 0;
+    int ret = 0;
 
-        if (!ent) {
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        size += out[i].size;
+    }
+
+    FILE *file = path ? fopen(path, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return -1;
+    }
+
+    if (disasm_labels_init(&labels) < 0
+            || disasm_labels_add_symbols(&labels, symbols, 0, size) < 0) {
+        ret = -1;
+        goto DISASM_END;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT && ret == 0; i++) {
+        if (out[i].size == 0) {
             continue;
         }
 
-        type = ent->type;
-        if (type & RT_EXPR) {
-            if (expr_eval(ent->expr) < 0) {
-                fprintf(stderr, "Error, could not resolve expression.\n");
-                continue;
+        fprintf(file, "; %s\n", sec_names[i]);
+        ret = disasm_listing(file, out[i].data, out[i].size, addr,
+                OBJ_IDX_SEC(i) != SEC_DATA, &labels);
+        addr += out[i].size;
+    }
+
+DISASM_END:
+    disasm_labels_destroy(&labels);
+    if (file != stdout && fclose(file) != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/**
+ * Links objects and writes the result.
+ * @param format Format to write the image in.
+ */
+static int main_link(const struct object *objs, int count,
+        const struct link_options *opts, enum main_format format,
+        const char *path) {
+    struct section_buf out[OBJ_SEC_COUNT];
+    struct link_options link_opts = *opts;
+    struct link_fixups fixups = { 0, 0, NULL };
+    struct symbol_table symbols;
+    int disasm = format == MAIN_DISASM;
+    int tixe = format == MAIN_TIXE || format == MAIN_PACKED_TIXE;
+    int ret = -1;
+
+    if (tixe) {
+        link_opts.fixups = &fixups;
+    }
+
+    if (disasm) {
+        if (symtab_init(&symbols) < 0) {
+            return -1;
+        }
+
+        link_opts.symbols = &symbols;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        secbuf_init(&out[i]);
+    }
+
+    if (link_objects(objs, count, &link_opts, out) == 0) {
+        if (tixe) {
+            ret = tixe_write(out, &fixups, format == MAIN_PACKED_TIXE, path);
+        } else {
+            ret = disasm ? main_disasm_output(out, &symbols, path)
+                : main_output(out, path);
+        }
+    }
+
+    free(fixups.offsets);
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        secbuf_destroy(&out[i]);
+    }
+
+    if (disasm) {
+        symtab_destroy(&symbols);
+    }
+
+    return ret;
+}
+
+/**
+ * Disassembles a raw binary.
+ */
+static int main_disasm(const char *input, uint16_t base, const char *path) {
+    struct disasm_labels labels;
+    size_t size;
+    int ret;
+
+    uint8_t *data = main_read_file(input, &size);
+    if (!data) {
+        return -1;
+    }
+
+    FILE *file = path ? fopen(path, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        free(data);
+        return -1;
+    }
+
+    ret = disasm_labels_init(&labels);
+    if (ret == 0) {
+        ret = disasm_listing(file, data, size, base, 1, &labels);
+        disasm_labels_destroy(&labels);
+    }
+
+    if (file != stdout && fclose(file) != 0) {
+        ret = -1;
+    }
+
+    free(data);
+    return ret;
+}
+
+/**
+ * Measures how fast binaries are decoded, and how fast they are listed.
+ */
+static int main_bench_disasm(char *const paths[], int count) {
+    struct timespec start, end;
+    size_t bytes = 0;
+    long instrs = 0;
+    double secs;
+
+    for (int i = 0; i < count; i++) {
+        size_t size;
+        uint8_t *data = main_read_file(paths[i], &size);
+        if (!data) {
+            return -1;
+        }
+
+        disasm_init();
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int rep = 0; rep < MAIN_BENCH_DISASM_REPS; rep++) {
+            struct disasm_instr di;
+            for (size_t j = 0; j < size; instrs++) {
+                j += disasm_decode(data + j, size - j, j, &di);
             }
+        }
 
-            switch (ent->expr->type) {
-            case ET_CONST:
-                sym_value = ent->expr->value;
-                break;
-            case ET_SYM:
-                fprintf(stderr, "Could not resolve symbol.");
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        bytes = size * MAIN_BENCH_DISASM_REPS;
+        printf("%s\n", paths[i]);
+        printf("decode %9ld instrs  %10zu bytes  %8.3f s  %8.1f MB/s\n",
+                instrs, bytes, secs, bytes / secs / 1e6);
+
+        /* Listing is bound by formatting and output, so only run it once */
+        struct disasm_labels labels;
+        FILE *null = fopen("/dev/null", "w");
+        if (!null || disasm_labels_init(&labels) < 0) {
+            if (null) {
+                fclose(null);
+            }
+
+            free(data);
+            return -1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        disasm_listing(null, data, size, 0, 1, &labels);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("list   %9s         %10zu bytes  %8.3f s  %8.1f MB/s\n",
+                "", size, secs, size / secs / 1e6);
+
+        disasm_labels_destroy(&labels);
+        fclose(null);
+        free(data);
+        instrs = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * Gets the milliseconds elapsed since a time.
+ */
+static double main_elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3
+        + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * Links objects, then links them again whenever one of them changes.
+ * Only the objects which were modified are read again.
+ * This only returns on failure.
+ */
+static int main_watch_link(char *const paths[], int count,
+        const struct link_options *opts, enum main_format format,
+        const char *output) {
+    struct object *objs = calloc(count, sizeof(*objs));
+    struct timespec *mtimes = calloc(count, sizeof(*mtimes));
+    struct timespec start;
+    struct watch w;
+
+    if (!objs || !mtimes || watch_init(&w) < 0) {
+        free(objs);
+        free(mtimes);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (watch_add(&w, paths[i]) < 0) {
+            goto WATCH_LINK_END;
+        }
+    }
+
+    do {
+        int loaded = 0, errors = 0;
+        struct stat st;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i++) {
+            if (stat(paths[i], &st) < 0) {
+                fprintf(stderr, "Could not open %s.\n", paths[i]);
+                errors++;
                 continue;
-            default:
-                /* Should be unreachable */
+            }
+
+            if (st.st_mtim.tv_sec == mtimes[i].tv_sec
+                    && st.st_mtim.tv_nsec == mtimes[i].tv_nsec) {
                 continue;
             }
-        } else {
-            sym_value = ent->sym->value;
+
+            object_destroy(&objs[i]);
+            if (object_read(&objs[i], paths[i]) < 0) {
+                /* Make sure it is read again next time */
+                mtimes[i] = (struct timespec) { 0, 0 };
+                errors++;
+            } else {
+                mtimes[i] = st.st_mtim;
+                loaded++;
+            }
         }
 
-        value = ent->value;
-        type &= type & ~RT_EXPR;
-        /* Have to do processing before range checking */
-        if (type == RT_REL_JUMP) {
-            value = sym_value - value;
-        } else {
-            value = sym_value + value;
+        if (errors == 0) {
+            main_link(objs, count, opts, format, output);
+
+            /* Output to stdout (e.g. through a pipe) has to show up before
+             * waiting for the next change, not when the buffer fills up.
+             */
+            fflush(stdout);
         }
 
-        if (!reltab_in_range(type, value)) {
-            fprintf(stderr, "Value %d out of range.\n", value);
+        fprintf(stderr, "Linked in %.1f ms (%d of %d objects read).\n",
+                main_elapsed_ms(&start), loaded, count);
+    } while (watch_wait(&w) == 0);
+
+WATCH_LINK_END:
+    for (int i = 0; i < count; i++) {
+        object_destroy(&objs[i]);
+    }
+
+    watch_destroy(&w);
+    free(objs);
+    free(mtimes);
+    return -1;
+}
+
+/**
+ * Assembles and links a source file, then does so again whenever it (or a file
+ * it includes) changes.
+ *
+ * Each line of the file is encoded on its own and the records are kept between
+ * builds (see struct lines), so only the lines which were edited are encoded
+ * again, and only the references which they affect are resolved again, before
+ * everything is relinked.
+ * Files which can't be handled that way are split into chunks as by
+ * chunk_assemble(), and the objects of the chunks are kept between builds, so
+ * only the chunks which were edited are assembled again. Files are split as
+ * finely as possible (whatever the number of CPUs), since that makes each edit
+ * cheaper to assemble again. Files which can't be split are assembled again as
+ * a whole.
+ *
+ * This only returns on failure.
+ */
+static int main_watch_assemble(const char *path,
+        const struct link_options *opts, enum main_format format,
+        const char *output) {
+    struct chunk_cache cache;
+    struct lines ls;
+    struct object obj;
+    struct timespec start;
+    struct watch w;
+
+    if (watch_init(&w) < 0) {
+        return -1;
+    }
+
+    if (lines_init(&ls) < 0) {
+        watch_destroy(&w);
+        return -1;
+    }
+
+    chunk_cache_init(&cache);
+    do {
+        int count;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        lex_reset();
+        watch_clear(&w);
+
+        if (lines_update(&ls, path, &obj) == 0) {
+            include_destroy();
+            main_link(&obj, 1, opts, format, output);
+            object_destroy(&obj);
+            fflush(stdout);
+            fprintf(stderr, "Built in %.1f ms (%d of %d lines encoded).\n",
+                    main_elapsed_ms(&start), ls.encoded, ls.count);
+
+            if (watch_add(&w, path) < 0) {
+                break;
+            }
+
             continue;
         }
 
-        switch (type) {
-        case RT_REL_JUMP:
-        case RT_8_BIT:
-        case RT_U_8_BIT:
-        case RT_S_8_BIT:
-            output[ent->offset] = value & 0xFF;
+        count = chunk_reassemble(path, CHUNK_MAX_JOBS, &cache);
+        include_destroy();
+
+        if (count > 0) {
+            main_link(cache.objs, count, opts, format, output);
+            fprintf(stderr, "Built in %.1f ms (%d of %d chunks assembled).\n",
+                    main_elapsed_ms(&start), cache.assembled, count);
+        } else {
+            if (main_assemble(&obj, path, &w) == 0) {
+                main_link(&obj, 1, opts, format, output);
+                object_destroy(&obj);
+            }
+
+            fprintf(stderr, "Built in %.1f ms.\n", main_elapsed_ms(&start));
+        }
+
+        fflush(stdout);
+
+        /* Wait on the file even if it could not be opened */
+        if (watch_add(&w, path) < 0) {
             break;
-        case RT_16_BIT:
-        case RT_U_16_BIT:
-        case RT_S_16_BIT:
-            output[ent->offset]   = value & 0xFF;
-            output[ent->offset+1] = (value >> 8) & 0xFF;
+        }
+    } while (watch_wait(&w) == 0);
+
+    chunk_cache_destroy(&cache);
+    lines_destroy(&ls);
+    watch_destroy(&w);
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "gc-sections", no_argument, NULL, 'g' },
+        { "scanner", required_argument, NULL, 's' },
+        { "bench-scan", no_argument, NULL, 'B' },
+        { "disasm", no_argument, NULL, 'd' },
+        { "bench-disasm", no_argument, NULL, 'D' },
+        { "watch", no_argument, NULL, 'w' },
+        { "stream", no_argument, NULL, 'S' },
+        { "symbols", required_argument, NULL, 'y' },
+        { "variant", required_argument, NULL, 'V' },
+        { "tixe", no_argument, NULL, 'x' },
+        { "pack", no_argument, NULL, 'p' },
+        { "pages", no_argument, NULL, 'P' },
+        { "profile", required_argument, NULL, 'f' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    static struct snapshot snaps[ASM_MAX_SNAPSHOTS];
+    int snap_count = 0;
+
+    static struct page_profile profile;
+
+    struct variant *vars = NULL;
+    int var_count = 0;
+
+    struct link_options link_opts = { 0, NULL, NULL, 0, NULL, 0, NULL };
+    const char *output = NULL;
+    int link_only = 0;
+    int disasm_only = 0;
+    int snap_only = 0;
+    int object_only = 0;
+    enum main_format format = MAIN_BINARY;
+    int watch = 0;
+    int stream = 0;
+    int pack = 0;
+    long base = 0;
+    int bench = 0;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int ret = 0;
+    int c;
+
+    if (argc > 1 && strcmp(argv[1], "link") == 0) {
+        link_only = 1;
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    } else if (argc > 1 && strcmp(argv[1], "dis") == 0) {
+        disasm_only = 1;
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    } else if (argc > 1 && strcmp(argv[1], "snap") == 0) {
+        snap_only = 1;
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+
+    while ((c = getopt_long(argc, argv, "b:ce:j:o:h", long_opts, NULL)) != -1) {
+        switch (c) {
+        case 'b':
+            base = strtol(optarg, NULL, 0);
+            if (base < 0 || base > 0xFFFF) {
+                usage(argv[0]);
+                return -1;
+            }
             break;
-        case RT_RST:
-            output[ent->offset] |= value & 0xFF;
-        case RT_IM:
-            if (value == 0) {
-                output[ent->offset] |= 0;
-            } else if (value == 1) {
-                output[ent->offset] |= 0x10;
-            } else if (value == 2) {
-                output[ent->offset] |= 0x18;
+        case 'c':
+            object_only = 1;
+            break;
+        case 'd':
+            format = MAIN_DISASM;
+            break;
+        case 'e':
+            link_opts.entry = optarg;
+            break;
+        case 'j':
+            jobs = strtol(optarg, NULL, 10);
+            if (jobs < 1) {
+                usage(argv[0]);
+                return -1;
             }
             break;
-        default:
+        case 'g':
+            link_opts.gc_sections = 1;
+            break;
+        case 'o':
+            output = optarg;
             break;
+        case 's':
+            if (strcmp(optarg, "flex") == 0) {
+                lex_set_scanner(LEX_FLEX);
+            } else if (strcmp(optarg, "simd") == 0) {
+                lex_set_scanner(LEX_SIMD);
+            } else {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'B':
+            bench = 1;
+            break;
+        case 'D':
+            bench = 2;
+            break;
+        case 'w':
+            watch = 1;
+            break;
+        case 'S':
+            stream = 1;
+            break;
+        case 'x':
+            format = MAIN_TIXE;
+            break;
+        case 'p':
+            pack = 1;
+            break;
+        case 'P':
+            link_opts.paged = 1;
+            break;
+        case 'f':
+            if (link_opts.profile) {
+                page_profile_destroy(&profile);
+            }
+
+            if (page_profile_read(&profile, optarg) < 0) {
+                return -1;
+            }
+
+            link_opts.profile = &profile;
+            break;
+        case 'y':
+            if (snap_count == ASM_MAX_SNAPSHOTS) {
+                fprintf(stderr, "Too many symbol snapshots.\n");
+                return -1;
+            }
+
+            if (snapshot_open(&snaps[snap_count], optarg) < 0) {
+                return -1;
+            }
+
+            asm_add_snapshot(&snaps[snap_count++]);
+            break;
+        case 'V': {
+            struct variant *more = realloc(vars, (var_count + 1) * sizeof(*more));
+            if (!more) {
+                return -1;
+            }
+
+            vars = more;
+            if (variant_parse(&vars[var_count], optarg) < 0) {
+                return -1;
+            }
+
+            var_count++;
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : -1;
         }
     }
 
-    /* Print in hex format */
-    for (int i = 0; i < output_len; i++) {
-        printf("%02X ", output[i] & 0xFF);
+    link_opts.base = base;
+
+    /* Variants are only made by linking, and replace the single output */
+    if (var_count > 0 && (output || object_only || format != MAIN_BINARY
+                || watch || stream || disasm_only || snap_only || bench)) {
+        usage(argv[0]);
+        return -1;
     }
-    printf("\n");
 
-    free(output);
-    symtab_destroy(&st);
-    reltab_destroy(&rt);
-    return 0;
+    /* Executables are linked at 0 and moved by the loader */
+    if (format == MAIN_TIXE && (!output || object_only || base != 0
+                || disasm_only || snap_only)) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if (pack) {
+        if (format != MAIN_TIXE) {
+            usage(argv[0]);
+            return -1;
+        }
+
+        format = MAIN_PACKED_TIXE;
+    }
+
+    /* Pages are only written as a binary, and the profile is only for them */
+    if ((link_opts.paged && (format != MAIN_BINARY || object_only || stream
+                    || disasm_only || snap_only))
+            || (link_opts.profile && !link_opts.paged)) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if (bench) {
+        if (optind == argc) {
+            usage(argv[0]);
+            return -1;
+        }
+
+        return bench == 2 ? main_bench_disasm(&argv[optind], argc - optind)
+            : main_bench_scan(&argv[optind], argc - optind);
+    }
+
+    if (disasm_only) {
+        if (argc - optind != 1) {
+            usage(argv[0]);
+            return -1;
+        }
+
+        return main_disasm(argv[optind], base, output);
+    }
+
+    if (snap_only) {
+        if (argc - optind != 1 || !output) {
+            usage(argv[0]);
+            return -1;
+        }
+
+        return main_snapshot(argv[optind], output);
+    }
+
+    if (watch) {
+        if (object_only || optind == argc || (!link_only && argc - optind > 1)) {
+            usage(argv[0]);
+            return -1;
+        }
+
+        return link_only
+            ? main_watch_link(&argv[optind], argc - optind, &link_opts, format,
+                    output)
+            : main_watch_assemble(argv[optind], &link_opts, format, output);
+    }
+
+    if (stream) {
+        /* Nothing is linked, so there is nothing to collect or list */
+        if (link_only || object_only || format != MAIN_BINARY
+                || link_opts.gc_sections || base != 0 || !output
+                || argc - optind > 1) {
+            usage(argv[0]);
+            return -1;
+        }
+
+        return main_stream(optind < argc ? argv[optind] : NULL, output);
+    }
+
+    if (link_only) {
+        int count = argc - optind;
+        struct object *objs;
+
+        if (count == 0 || object_only) {
+            usage(argv[0]);
+            return -1;
+        }
+
+        objs = calloc(count, sizeof(*objs));
+        if (!objs) {
+            return -1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (object_read(&objs[i], argv[optind + i]) < 0) {
+                ret = -1;
+            }
+        }
+
+        if (ret == 0) {
+            ret = var_count > 0
+                ? variant_link(objs, count, &link_opts, vars, var_count)
+                : main_link(objs, count, &link_opts, format, output);
+        }
+
+        for (int i = 0; i < count; i++) {
+            object_destroy(&objs[i]);
+        }
+
+        free(objs);
+        return ret;
+    }
+
+    if (!object_only && optind < argc && jobs > 1) {
+        struct object *objs;
+        int count = chunk_assemble(argv[optind], jobs, &objs);
+
+        if (count > 0) {
+            ret = var_count > 0
+                ? variant_link(objs, count, &link_opts, vars, var_count)
+                : main_link(objs, count, &link_opts, format, output);
+            for (int i = 0; i < count; i++) {
+                object_destroy(&objs[i]);
+            }
+
+            free(objs);
+            return ret;
+        }
+    }
+
+    struct object obj;
+    if (main_assemble(&obj, optind < argc ? argv[optind] : NULL, NULL) < 0) {
+        return -1;
+    }
+
+    if (object_only) {
+        FILE *file = output ? fopen(output, "wb") : stdout;
+        if (!file) {
+            fprintf(stderr, "Could not open %s.\n", output);
+            ret = -1;
+        } else {
+            ret = object_write(&obj, file);
+            if (file != stdout && fclose(file) != 0) {
+                ret = -1;
+            }
+        }
+    } else if (var_count > 0) {
+        ret = variant_link(&obj, 1, &link_opts, vars, var_count);
+    } else {
+        ret = main_link(&obj, 1, &link_opts, format, output);
+    }
+
+    object_destroy(&obj);
+    return ret;
 }
 
 /* vim: set tw=80 ft=c: */
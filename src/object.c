@@ -0,0 +1,514 @@
+/**
+ * @file object.c
+ *
+ * The .tixo format is, with all integers little-endian:
+ *
+ *   header:  "TIXO", u16 version, u16 reserved,
+ *            u32 section sizes (text, data, abs),
+ *            u32 symbol count, u32 relocation count, u32 string table size,
+ *            u32 fragment count, u32 expression operation count
+ *   section contents (text, data, abs)
+ *   symbols: u32 name offset, u8 section, u8[3] reserved, i32 value
+ *   relocs:  u8 type, u8 section, u8 target section, u8 reserved,
+ *            u32 offset, i32 value, i32 symbol index, i32 addend,
+ *            u32 expression start, u32 expression length
+ *   frags:   u8 section, u8 falls through, u8 pinned, u8 reserved,
+ *            u32 offset, i32 pc
+ *   exprs:   u8 type, u8[3] reserved, i32 value
+ *   string table (null-terminated names)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "object.h"
+
+#define OBJ_HEADER_SIZE 40
+#define OBJ_SYM_SIZE 12
+#define OBJ_RELOC_SIZE 28
+#define OBJ_FRAG_SIZE 12
+#define OBJ_EXPR_SIZE 8
+
+static void obj_put_u16(uint8_t *buf, uint16_t v) {
+    buf[0] = v & 0xFF;
+    buf[1] = v >> 8;
+}
+
+static void obj_put_u32(uint8_t *buf, uint32_t v) {
+    buf[0] = v & 0xFF;
+    buf[1] = (v >> 8) & 0xFF;
+    buf[2] = (v >> 16) & 0xFF;
+    buf[3] = v >> 24;
+}
+
+static uint16_t obj_get_u16(const uint8_t *buf) {
+    return buf[0] | buf[1] << 8;
+}
+
+static uint32_t obj_get_u32(const uint8_t *buf) {
+    return (uint32_t) buf[0] | (uint32_t) buf[1] << 8
+        | (uint32_t) buf[2] << 16 | (uint32_t) buf[3] << 24;
+}
+
+/**
+ * Gets the number of bytes patched by a relocation type.
+ */
+static int obj_reloc_width(enum reloc_type type) {
+    switch (type) {
+    case RT_16_BIT:
+    case RT_U_16_BIT:
+    case RT_S_16_BIT:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+int object_init(struct object *obj, const char *name) {
+    if (!obj) {
+        return -1;
+    }
+
+    memset(obj, 0, sizeof(*obj));
+    obj->name = strdup(name ? name : "");
+    if (!obj->name) {
+        return -1;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        if (secbuf_init(&obj->sections[i]) < 0) {
+            object_destroy(obj);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void object_destroy(struct object *obj) {
+    if (!obj) {
+        return;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        secbuf_destroy(&obj->sections[i]);
+    }
+
+    for (int i = 0; i < obj->sym_count; i++) {
+        free(obj->symbols[i].name);
+    }
+
+    free(obj->symbols);
+    free(obj->relocs);
+    free(obj->exprs);
+    free(obj->frags);
+    free(obj->name);
+    memset(obj, 0, sizeof(*obj));
+}
+
+int object_add_sym(struct object *obj,
+        const char *name, enum section sec, int value) {
+    if (obj->sym_count == obj->sym_capacity) {
+        int capacity = obj->sym_capacity ? obj->sym_capacity * 2 : 16;
+        struct obj_symbol *symbols = realloc(obj->symbols,
+                capacity * sizeof(*symbols));
+        if (!symbols) {
+            return -1;
+        }
+
+        obj->symbols = symbols;
+        obj->sym_capacity = capacity;
+    }
+
+    struct obj_symbol *sym = &obj->symbols[obj->sym_count];
+    sym->name = strdup(name);
+    if (!sym->name) {
+        return -1;
+    }
+
+    sym->sec = sec;
+    sym->value = value;
+    return obj->sym_count++;
+}
+
+int object_add_reloc(struct object *obj, const struct obj_reloc *rel) {
+    if (obj->reloc_count == obj->reloc_capacity) {
+        int capacity = obj->reloc_capacity ? obj->reloc_capacity * 2 : 16;
+        struct obj_reloc *relocs = realloc(obj->relocs,
+                capacity * sizeof(*relocs));
+        if (!relocs) {
+            return -1;
+        }
+
+        obj->relocs = relocs;
+        obj->reloc_capacity = capacity;
+    }
+
+    obj->relocs[obj->reloc_count++] = *rel;
+    return 0;
+}
+
+int object_add_expr_op(struct object *obj, enum expr_type type, int value) {
+    if (obj->expr_count == obj->expr_capacity) {
+        int capacity = obj->expr_capacity ? obj->expr_capacity * 2 : 16;
+        struct obj_expr_op *exprs = realloc(obj->exprs,
+                capacity * sizeof(*exprs));
+        if (!exprs) {
+            return -1;
+        }
+
+        obj->exprs = exprs;
+        obj->expr_capacity = capacity;
+    }
+
+    obj->exprs[obj->expr_count].type = type;
+    obj->exprs[obj->expr_count].value = value;
+    return obj->expr_count++;
+}
+
+int object_add_frag(struct object *obj, const struct obj_fragment *frag) {
+    if (obj->frag_count == obj->frag_capacity) {
+        int capacity = obj->frag_capacity ? obj->frag_capacity * 2 : 16;
+        struct obj_fragment *frags = realloc(obj->frags,
+                capacity * sizeof(*frags));
+        if (!frags) {
+            return -1;
+        }
+
+        obj->frags = frags;
+        obj->frag_capacity = capacity;
+    }
+
+    obj->frags[obj->frag_count++] = *frag;
+    return 0;
+}
+
+int object_write(const struct object *obj, FILE *stream) {
+    uint8_t header[OBJ_HEADER_SIZE] = { 0 };
+    uint32_t strtab_size = 0;
+
+    for (int i = 0; i < obj->sym_count; i++) {
+        strtab_size += strlen(obj->symbols[i].name) + 1;
+    }
+
+    memcpy(header, OBJ_MAGIC, 4);
+    obj_put_u16(&header[4], OBJ_VERSION);
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        obj_put_u32(&header[8 + 4*i], obj->sections[i].size);
+    }
+
+    obj_put_u32(&header[20], obj->sym_count);
+    obj_put_u32(&header[24], obj->reloc_count);
+    obj_put_u32(&header[28], strtab_size);
+    obj_put_u32(&header[32], obj->frag_count);
+    obj_put_u32(&header[36], obj->expr_count);
+
+    if (fwrite(header, 1, sizeof(header), stream) != sizeof(header)) {
+        return -1;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        const struct section_buf *buf = &obj->sections[i];
+        if (fwrite(buf->data, 1, buf->size, stream) != buf->size) {
+            return -1;
+        }
+    }
+
+    uint32_t name_off = 0;
+    for (int i = 0; i < obj->sym_count; i++) {
+        const struct obj_symbol *sym = &obj->symbols[i];
+        uint8_t rec[OBJ_SYM_SIZE] = { 0 };
+
+        obj_put_u32(&rec[0], name_off);
+        rec[4] = sym->sec;
+        obj_put_u32(&rec[8], sym->value);
+        if (fwrite(rec, 1, sizeof(rec), stream) != sizeof(rec)) {
+            return -1;
+        }
+
+        name_off += strlen(sym->name) + 1;
+    }
+
+    for (int i = 0; i < obj->reloc_count; i++) {
+        const struct obj_reloc *rel = &obj->relocs[i];
+        uint8_t rec[OBJ_RELOC_SIZE] = { 0 };
+
+        rec[0] = rel->type;
+        rec[1] = rel->sec;
+        rec[2] = rel->target_sec;
+        obj_put_u32(&rec[4], rel->offset);
+        obj_put_u32(&rec[8], rel->value);
+        obj_put_u32(&rec[12], rel->sym);
+        obj_put_u32(&rec[16], rel->addend);
+        obj_put_u32(&rec[20], rel->expr_start);
+        obj_put_u32(&rec[24], rel->expr_len);
+        if (fwrite(rec, 1, sizeof(rec), stream) != sizeof(rec)) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < obj->frag_count; i++) {
+        const struct obj_fragment *frag = &obj->frags[i];
+        uint8_t rec[OBJ_FRAG_SIZE] = { 0 };
+
+        rec[0] = frag->sec;
+        rec[1] = frag->falls_through != 0;
+        rec[2] = frag->pinned != 0;
+        obj_put_u32(&rec[4], frag->offset);
+        obj_put_u32(&rec[8], frag->pc);
+        if (fwrite(rec, 1, sizeof(rec), stream) != sizeof(rec)) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < obj->expr_count; i++) {
+        const struct obj_expr_op *op = &obj->exprs[i];
+        uint8_t rec[OBJ_EXPR_SIZE] = { 0 };
+
+        rec[0] = op->type;
+        obj_put_u32(&rec[4], op->value);
+        if (fwrite(rec, 1, sizeof(rec), stream) != sizeof(rec)) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < obj->sym_count; i++) {
+        const char *name = obj->symbols[i].name;
+        if (fwrite(name, 1, strlen(name) + 1, stream) != strlen(name) + 1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Checks that the expression of a relocation read from a file can be
+ * evaluated: each operation has enough operands, the result is a single value,
+ * and every symbol exists.
+ */
+static int obj_expr_valid(const struct object *obj, const struct obj_reloc *rel,
+        uint32_t expr_count) {
+    int depth = 0;
+
+    if (rel->expr_start < 0 || rel->expr_len < 0
+            || (uint32_t) rel->expr_start + rel->expr_len > expr_count) {
+        return 0;
+    }
+
+    for (int i = 0; i < rel->expr_len; i++) {
+        const struct obj_expr_op *op = &obj->exprs[rel->expr_start + i];
+
+        switch (op->type) {
+        case ET_SYM:
+            if (op->value < 0 || op->value >= obj->sym_count) {
+                return 0;
+            }
+            /* Fall through */
+        case ET_CONST:
+            depth++;
+            break;
+        case ET_NOT:
+        case ET_NEG:
+            if (depth < 1) {
+                return 0;
+            }
+            break;
+        case ET_ADD:
+        case ET_SUB:
+        case ET_MUL:
+        case ET_DIV:
+        case ET_MOD:
+        case ET_AND:
+        case ET_XOR:
+        case ET_OR:
+            if (depth < 2) {
+                return 0;
+            }
+
+            depth--;
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    return rel->expr_len == 0 || depth == 1;
+}
+
+/**
+ * Reads an entire file into memory.
+ */
+static uint8_t *obj_read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long len;
+
+    if (!file) {
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) < 0 || (len = ftell(file)) < 0) {
+        goto READ_FAIL;
+    }
+
+    rewind(file);
+    data = malloc(len ? len : 1);
+    if (!data || fread(data, 1, len, file) != len) {
+        goto READ_FAIL;
+    }
+
+    fclose(file);
+    *size = len;
+    return data;
+
+READ_FAIL:
+    free(data);
+    fclose(file);
+    return NULL;
+}
+
+int object_read(struct object *obj, const char *path) {
+    size_t size;
+    uint8_t *data = obj_read_file(path, &size);
+    int ret;
+
+    if (!data) {
+        fprintf(stderr, "Could not read object file %s.\n", path);
+        return -1;
+    }
+
+    ret = object_read_data(obj, data, size, path);
+    free(data);
+    return ret;
+}
+
+int object_read_data(struct object *obj,
+        const uint8_t *data, size_t size, const char *name) {
+    const uint8_t *ptr;
+    const uint8_t *exprs;
+    const char *strtab;
+    uint32_t sym_count, reloc_count, strtab_size, frag_count, expr_count;
+    size_t expected = OBJ_HEADER_SIZE;
+
+    if (object_init(obj, name) < 0) {
+        return -1;
+    }
+
+    if (size < OBJ_HEADER_SIZE || memcmp(data, OBJ_MAGIC, 4) != 0
+            || obj_get_u16(&data[4]) != OBJ_VERSION) {
+        goto READ_INVAL;
+    }
+
+    sym_count = obj_get_u32(&data[20]);
+    reloc_count = obj_get_u32(&data[24]);
+    strtab_size = obj_get_u32(&data[28]);
+    frag_count = obj_get_u32(&data[32]);
+    expr_count = obj_get_u32(&data[36]);
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        expected += obj_get_u32(&data[8 + 4*i]);
+    }
+
+    expected += (size_t) sym_count * OBJ_SYM_SIZE
+        + (size_t) reloc_count * OBJ_RELOC_SIZE
+        + (size_t) frag_count * OBJ_FRAG_SIZE
+        + (size_t) expr_count * OBJ_EXPR_SIZE + strtab_size;
+    if (expected != size || (strtab_size > 0 && data[size - 1] != 0)) {
+        goto READ_INVAL;
+    }
+
+    ptr = data + OBJ_HEADER_SIZE;
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        uint32_t sec_size = obj_get_u32(&data[8 + 4*i]);
+        uint8_t *bytes = secbuf_reserve(&obj->sections[i], sec_size);
+        if (!bytes) {
+            goto READ_FAIL;
+        }
+
+        memcpy(bytes, ptr, sec_size);
+        ptr += sec_size;
+    }
+
+    strtab = (const char *) data + size - strtab_size;
+    for (uint32_t i = 0; i < sym_count; i++, ptr += OBJ_SYM_SIZE) {
+        uint32_t name_off = obj_get_u32(&ptr[0]);
+        enum section sec = ptr[4];
+        if (name_off >= strtab_size || sec > SEC_ABS) {
+            goto READ_INVAL;
+        }
+
+        if (object_add_sym(obj, strtab + name_off, sec,
+                    (int32_t) obj_get_u32(&ptr[8])) < 0) {
+            goto READ_FAIL;
+        }
+    }
+
+    /* The expressions come after the fragments, but are needed to check the
+     * relocations
+     */
+    exprs = ptr + (size_t) reloc_count * OBJ_RELOC_SIZE
+        + (size_t) frag_count * OBJ_FRAG_SIZE;
+    for (uint32_t i = 0; i < expr_count; i++, exprs += OBJ_EXPR_SIZE) {
+        if (object_add_expr_op(obj, exprs[0],
+                    (int32_t) obj_get_u32(&exprs[4])) < 0) {
+            goto READ_FAIL;
+        }
+    }
+
+    for (uint32_t i = 0; i < reloc_count; i++, ptr += OBJ_RELOC_SIZE) {
+        struct obj_reloc rel = {
+            .type = ptr[0],
+            .sec = ptr[1],
+            .target_sec = ptr[2],
+            .offset = obj_get_u32(&ptr[4]),
+            .value = (int32_t) obj_get_u32(&ptr[8]),
+            .sym = (int32_t) obj_get_u32(&ptr[12]),
+            .addend = (int32_t) obj_get_u32(&ptr[16]),
+            .expr_start = (int32_t) obj_get_u32(&ptr[20]),
+            .expr_len = (int32_t) obj_get_u32(&ptr[24]),
+        };
+
+        if (rel.sec == SEC_UNDEF || rel.sec > SEC_ABS
+                || rel.target_sec > SEC_ABS
+                || rel.sym < -1 || rel.sym >= (int) sym_count
+                || !obj_expr_valid(obj, &rel, expr_count)
+                || rel.offset < 0 || rel.offset + obj_reloc_width(rel.type)
+                    > obj->sections[OBJ_SEC_IDX(rel.sec)].size) {
+            goto READ_INVAL;
+        }
+
+        if (object_add_reloc(obj, &rel) < 0) {
+            goto READ_FAIL;
+        }
+    }
+
+    for (uint32_t i = 0; i < frag_count; i++, ptr += OBJ_FRAG_SIZE) {
+        struct obj_fragment frag = {
+            .sec = ptr[0],
+            .falls_through = ptr[1],
+            .pinned = ptr[2],
+            .offset = obj_get_u32(&ptr[4]),
+            .pc = (int32_t) obj_get_u32(&ptr[8]),
+        };
+
+        if ((frag.sec != SEC_TEXT && frag.sec != SEC_DATA) || frag.offset < 0
+                || frag.offset > obj->sections[OBJ_SEC_IDX(frag.sec)].size) {
+            goto READ_INVAL;
+        }
+
+        if (object_add_frag(obj, &frag) < 0) {
+            goto READ_FAIL;
+        }
+    }
+
+    return 0;
+
+READ_INVAL:
+    fprintf(stderr, "%s is not a valid object file.\n", name);
+READ_FAIL:
+    object_destroy(obj);
+    return -1;
+}
+
+/* vim: set tw=80 ft=c: */
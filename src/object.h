@@ -0,0 +1,276 @@
+/**
+ * @file object.h
+ */
+
+#ifndef OBJECT_H_
+#define OBJECT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "reloc_table.h"
+#include "section.h"
+
+/**
+ * Magic number at the start of object (.tixo) files.
+ */
+#define OBJ_MAGIC "TIXO"
+
+/**
+ * Version of the object file format.
+ */
+#define OBJ_VERSION 4
+
+/**
+ * Number of sections in an object (text, data, and absolute).
+ */
+#define OBJ_SEC_COUNT 3
+
+/**
+ * Index of a section in struct object::sections.
+ * This is only valid for SEC_TEXT, SEC_DATA, and SEC_ABS.
+ */
+#define OBJ_SEC_IDX(sec) ((sec) - 1)
+
+/**
+ * Section at an index in struct object::sections.
+ */
+#define OBJ_IDX_SEC(idx) ((enum section) ((idx) + 1))
+
+/**
+ * A symbol defined or referenced by an object.
+ * All defined symbols are global.
+ */
+struct obj_symbol {
+    char *name;
+
+    /**
+     * Section the symbol is defined in, or SEC_UNDEF if the symbol is defined
+     * in another object.
+     */
+    enum section sec;
+
+    /**
+     * Value of the symbol. For section-relative symbols, this is relative to
+     * the start of the section in this object.
+     */
+    int value;
+};
+
+/**
+ * Operation of an expression which is evaluated by the linker (see
+ * struct obj_reloc).
+ */
+struct obj_expr_op {
+    /**
+     * ET_CONST (an absolute value), ET_SYM, or an operator.
+     */
+    enum expr_type type;
+
+    /**
+     * For ET_CONST, the value; for ET_SYM, the index of the symbol in
+     * struct object::symbols.
+     */
+    int value;
+};
+
+/**
+ * A relocation in an object.
+ * The target is usually of the form sym + addend, or an offset into one of the
+ * object's sections. Other expressions are resolved before the object is
+ * created, except for absolute expressions of symbols which the object leaves
+ * undefined (e.g. values given to --variant); those are kept for the linker
+ * to evaluate.
+ */
+struct obj_reloc {
+    /**
+     * Type of relocation (never RT_EXPR).
+     */
+    enum reloc_type type;
+
+    /**
+     * Section and offset in the section of the data to patch.
+     */
+    enum section sec;
+    int offset;
+
+    /**
+     * Type-dependent value, as in reloc_ent::value. For RT_REL_JUMP, this is
+     * relative to the start of @c sec in this object.
+     */
+    int value;
+
+    /**
+     * Index of the target symbol in struct object::symbols, or -1 if the
+     * target is relative to a section.
+     */
+    int sym;
+
+    /**
+     * If @c sym is -1, the section the target is relative to.
+     */
+    enum section target_sec;
+
+    /**
+     * Added to the target symbol or section.
+     */
+    int addend;
+
+    /**
+     * If @c expr_len is not 0, the target is instead the expression made of
+     * the operations starting at struct object::exprs[expr_start], in postfix
+     * order. The symbols in it have to be absolute, and so is the result (@c
+     * sym is -1 and @c target_sec is SEC_ABS).
+     */
+    int expr_start;
+    int expr_len;
+};
+
+/**
+ * Start of a fragment of a section: the unit of garbage collection.
+ * Fragments extend to the start of the next fragment in the same section.
+ */
+struct obj_fragment {
+    enum section sec;
+
+    /**
+     * Offset of the start of the fragment in the section.
+     */
+    int offset;
+
+    /**
+     * Program counter at the start of the fragment.
+     * The program counter and offset advance together within a fragment.
+     */
+    int pc;
+
+    /**
+     * Whether execution can continue from the end of the fragment into the
+     * next one, in which case the next one has to be kept with it.
+     */
+    int falls_through;
+
+    /**
+     * Whether the fragment has to be kept together with the next one (in
+     * either direction), since the distance between them was assembled into
+     * the code (by a relative jump or a label difference).
+     */
+    int pinned;
+};
+
+/**
+ * An assembled translation unit.
+ */
+struct object {
+    /**
+     * Name of the object, for error messages.
+     */
+    char *name;
+
+    struct section_buf sections[OBJ_SEC_COUNT];
+
+    int sym_count;
+    int sym_capacity;
+    struct obj_symbol *symbols;
+
+    int reloc_count;
+    int reloc_capacity;
+    struct obj_reloc *relocs;
+
+    /**
+     * Operations of the expressions of all relocations.
+     */
+    int expr_count;
+    int expr_capacity;
+    struct obj_expr_op *exprs;
+
+    /**
+     * Fragments of the text and data sections, in order of offset within each
+     * section. If there are none, each section is a single fragment.
+     */
+    int frag_count;
+    int frag_capacity;
+    struct obj_fragment *frags;
+};
+
+/**
+ * Initializes an empty object.
+ * @param obj Object to initialize.
+ * @param name Name of the object. This is copied.
+ * @return 0 on success, -1 on failure.
+ */
+int object_init(struct object *obj, const char *name);
+
+/**
+ * Destroys (frees) an object.
+ * @param obj Object to destroy.
+ */
+void object_destroy(struct object *obj);
+
+/**
+ * Adds a symbol to an object.
+ * @param obj Object to add to.
+ * @param name Name of the symbol. This is copied.
+ * @param sec Section of the symbol, or SEC_UNDEF for references.
+ * @param value Value of the symbol.
+ * @return Index of the symbol, or -1 on failure.
+ */
+int object_add_sym(struct object *obj,
+        const char *name, enum section sec, int value);
+
+/**
+ * Adds a relocation to an object.
+ * @param obj Object to add to.
+ * @param rel Relocation to add. This is copied.
+ * @return 0 on success, -1 on failure.
+ */
+int object_add_reloc(struct object *obj, const struct obj_reloc *rel);
+
+/**
+ * Adds an operation to the end of the expressions of an object.
+ * @param obj Object to add to.
+ * @param type Type of the operation.
+ * @param value Value of the operation.
+ * @return Index of the operation, or -1 on failure.
+ */
+int object_add_expr_op(struct object *obj, enum expr_type type, int value);
+
+/**
+ * Adds a fragment to an object.
+ * @param obj Object to add to.
+ * @param frag Fragment to add. This is copied.
+ * @return 0 on success, -1 on failure.
+ */
+int object_add_frag(struct object *obj, const struct obj_fragment *frag);
+
+/**
+ * Writes an object in the .tixo format.
+ * @param obj Object to write.
+ * @param stream Stream to write to.
+ * @return 0 on success, -1 on failure.
+ */
+int object_write(const struct object *obj, FILE *stream);
+
+/**
+ * Reads an object from a .tixo file.
+ * @param obj Object to initialize with the contents of the file.
+ * @param path Path of the file. This is used as the name of the object.
+ * @return 0 on success, -1 if the file could not be read or is not a valid
+ * object.
+ */
+int object_read(struct object *obj, const char *path);
+
+/**
+ * Reads an object from the contents of a .tixo file in memory.
+ * @param obj Object to initialize.
+ * @param data Contents of the file.
+ * @param size Size of @p data.
+ * @param name Name of the object.
+ * @return 0 on success, -1 if the data is not a valid object.
+ */
+int object_read_data(struct object *obj,
+        const uint8_t *data, size_t size, const char *name);
+
+#endif /* OBJECT_H_ */
+
+/* vim: set tw=80 ft=c: */
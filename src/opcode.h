@@ -91,8 +91,17 @@ enum operand_type {
 
     /* Flags */
     OP_fNZ, OP_fZ, OP_fNC, OP_fPO, OP_fPE, OP_fP, OP_fM,
+
+    /** Number of operand types (not including OP_INVAL) */
+    OP_TYPE_COUNT,
 };
 
+/**
+ * Combines the operand types produced by the parser into a single value, for
+ * matching instructions.
+ */
+#define OPCODE_KEY(t1, t2) ((t1) * OP_TYPE_COUNT + (t2))
+
 struct instruction {
     enum operand_type op1;
     enum operand_type op2;
@@ -112,10 +121,17 @@ struct instruction {
      * The bytes of the instruction.
      */
     uint8_t bytes[INSTR_MAX_LEN];
+
+    /**
+     * Whether this is another spelling of an instruction (e.g. "sub a, b" for
+     * "sub b"). Aliases are assembled, but never produced by the disassembler.
+     */
+    int alias;
 };
 
 /**
  * Stores the instructions associated with an opcode.
+ * These are generated from the instruction spec (z80.ops) by opgen.
  */
 struct opcode {
     /**
@@ -133,6 +149,14 @@ struct opcode {
      * TODO Indirect this so that user instructions can be added.
      */
     const struct instruction *instrs;
+
+    /**
+     * Finds the instruction which takes operands of the given types (as
+     * produced by the parser, so immediates are OP_IMM or OP_EXT).
+     * @return The instruction, or NULL if there is none.
+     */
+    const struct instruction *(*match)(enum operand_type t1,
+            enum operand_type t2);
 };
 
 struct operand {
@@ -148,10 +172,15 @@ struct operand {
 };
 
 /**
- * Array of all registered opcodes.
+ * Array of all registered opcodes, sorted by mnemonic.
  */
 extern const struct opcode opcodes_builtin[];
 
+/**
+ * Number of opcodes in opcodes_builtin.
+ */
+extern const int opcodes_builtin_count;
+
 enum operand_type op_type_indir(enum operand_type type);
 
 /**
@@ -165,12 +194,18 @@ const struct instruction *opcode_match(const struct opcode *oc,
         const struct operand *op1, const struct operand *op2);
 
 /**
- * Writes an instruction to a file stream.
+ * Gets whether an instruction never continues to the next one (an
+ * unconditional jump or return).
+ */
+int instr_is_terminal(const struct instruction *instr);
+
+/**
+ * Writes an instruction to the current section.
  * This creates a new relocation entry if necessary (depending on the types of
  * the operands).
  */
 int instr_output(const struct instruction *instr,
-        const struct operand *op1, const struct operand *op2, FILE *stream);
+        const struct operand *op1, const struct operand *op2);
 
 #endif /* OPCODE_H_ */
 
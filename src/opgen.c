@@ -0,0 +1,903 @@
+/**
+ * @file opgen.c
+ *
+ * Generates the opcode tables from the instruction spec (z80.ops).
+ *
+ * Every form in the spec is expanded into the instructions it describes, which
+ * are checked against the spec before anything is written: each opcode must
+ * decode to exactly one form, the unprefixed and cb groups must be complete,
+ * no two instructions of a mnemonic may take the same operands, and a set of
+ * known encodings must come out right.
+ *
+ * This runs at build time, before the rest of the assembler is built, so it
+ * only deals with the names of operand types.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARR_LEN(arr) (sizeof(arr) / sizeof(*(arr)))
+
+/**
+ * Longest instruction (dd cb d op, or dd op d n).
+ */
+#define GEN_MAX_LEN 4
+
+#define GEN_MAX_ROWS 2048
+#define GEN_MAX_MNEMONICS 128
+
+/**
+ * Operand placement.
+ */
+enum gen_place {
+    /** No value */
+    GP_NONE,
+    /** 8 or 16-bit value after the opcode (and displacement) */
+    GP_IMM8,
+    GP_IMM16,
+    /** Value which is applied to the opcode byte by a relocation */
+    GP_OPCODE,
+    /** Index displacement */
+    GP_DISP,
+};
+
+struct gen_operand {
+    /** Name in the spec */
+    const char *name;
+    /** Operand type written to the instruction */
+    const char *type;
+    /** Operand type which the parser produces for it */
+    const char *key;
+    enum gen_place place;
+};
+
+static const struct gen_operand gen_operands[] = {
+    { "a",      "OP_A",     "OP_A",     GP_NONE },
+    { "b",      "OP_B",     "OP_B",     GP_NONE },
+    { "c",      "OP_C",     "OP_C",     GP_NONE },
+    { "d",      "OP_D",     "OP_D",     GP_NONE },
+    { "e",      "OP_E",     "OP_E",     GP_NONE },
+    { "h",      "OP_H",     "OP_H",     GP_NONE },
+    { "l",      "OP_L",     "OP_L",     GP_NONE },
+    { "i",      "OP_I",     "OP_I",     GP_NONE },
+    { "r",      "OP_R",     "OP_R",     GP_NONE },
+    { "ixh",    "OP_IXH",   "OP_IXH",   GP_NONE },
+    { "ixl",    "OP_IXL",   "OP_IXL",   GP_NONE },
+    { "iyh",    "OP_IYH",   "OP_IYH",   GP_NONE },
+    { "iyl",    "OP_IYL",   "OP_IYL",   GP_NONE },
+    { "af",     "OP_AF",    "OP_AF",    GP_NONE },
+    { "bc",     "OP_BC",    "OP_BC",    GP_NONE },
+    { "de",     "OP_DE",    "OP_DE",    GP_NONE },
+    { "hl",     "OP_HL",    "OP_HL",    GP_NONE },
+    { "ix",     "OP_IX",    "OP_IX",    GP_NONE },
+    { "iy",     "OP_IY",    "OP_IY",    GP_NONE },
+    { "sp",     "OP_SP",    "OP_SP",    GP_NONE },
+    { "af'",    "OP_sAF",   "OP_sAF",   GP_NONE },
+    { "(bc)",   "OP_iBC",   "OP_iBC",   GP_NONE },
+    { "(de)",   "OP_iDE",   "OP_iDE",   GP_NONE },
+    { "(hl)",   "OP_iHL",   "OP_iHL",   GP_NONE },
+    { "(sp)",   "OP_iSP",   "OP_iSP",   GP_NONE },
+    { "(c)",    "OP_iC",    "OP_iC",    GP_NONE },
+    { "(ix)",   "OP_iIX",   "OP_iIX",   GP_NONE },
+    { "(iy)",   "OP_iIY",   "OP_iIY",   GP_NONE },
+    { "(ix+d)", "OP_iIX",   "OP_iIX",   GP_DISP },
+    { "(iy+d)", "OP_iIY",   "OP_iIY",   GP_DISP },
+    { "nz",     "OP_fNZ",   "OP_fNZ",   GP_NONE },
+    { "z",      "OP_fZ",    "OP_fZ",    GP_NONE },
+    { "nc",     "OP_fNC",   "OP_fNC",   GP_NONE },
+    { "po",     "OP_fPO",   "OP_fPO",   GP_NONE },
+    { "pe",     "OP_fPE",   "OP_fPE",   GP_NONE },
+    { "p",      "OP_fP",    "OP_fP",    GP_NONE },
+    { "m",      "OP_fM",    "OP_fM",    GP_NONE },
+    { "n",      "OP_IMM8",  "OP_IMM",   GP_IMM8 },
+    { "nn",     "OP_IMM16", "OP_IMM",   GP_IMM16 },
+    { "rel",    "OP_REL",   "OP_IMM",   GP_IMM8 },
+    { "(n)",    "OP_PORT",  "OP_EXT",   GP_IMM8 },
+    { "(nn)",   "OP_EXT",   "OP_EXT",   GP_IMM16 },
+    { "im",     "OP_IM",    "OP_IMM",   GP_OPCODE },
+    { "bit",    "OP_BIT",   "OP_IMM",   GP_OPCODE },
+    { "rst",    "OP_RST",   "OP_IMM",   GP_OPCODE },
+};
+
+/**
+ * Operand tables which are indexed by fields.
+ */
+struct gen_table {
+    const char *name;
+    int count;
+    const char *operands[8];
+};
+
+static const struct gen_table gen_tables[] = {
+    { "r",   8, { "b", "c", "d", "e", "h", "l", "(hl)", "a" } },
+    { "rp",  4, { "bc", "de", "hl", "sp" } },
+    { "rp2", 4, { "bc", "de", "hl", "af" } },
+    { "cc",  8, { "nz", "z", "nc", "c", "po", "pe", "p", "m" } },
+};
+
+/**
+ * Groups of opcodes (by prefix), for checking decoding.
+ */
+enum gen_group {
+    GG_NONE, GG_CB, GG_ED, GG_DD, GG_FD, GG_DDCB, GG_FDCB,
+    GG_COUNT,
+};
+
+static const char *const gen_group_names[] = {
+    "unprefixed", "cb", "ed", "dd", "fd", "ddcb", "fdcb",
+};
+
+/**
+ * An instruction.
+ */
+struct gen_row {
+    int mnemonic;
+    /** Indices into gen_operands, or -1 */
+    int ops[2];
+    int offs[2];
+    int size;
+    uint8_t bytes[GEN_MAX_LEN];
+    enum gen_group group;
+    /** Index of the opcode byte in @c bytes */
+    int opcode_off;
+    int alias;
+    /** Line of the spec it came from */
+    int line;
+};
+
+static const char *gen_mnemonics[GEN_MAX_MNEMONICS];
+static int gen_mnemonic_count = 0;
+
+static struct gen_row gen_rows[GEN_MAX_ROWS];
+static int gen_row_count = 0;
+
+static const char *gen_spec_path;
+
+/**
+ * Known encodings, checked against the generated instructions.
+ * Operands with values are left as 0, except for those applied to the opcode
+ * byte, which are given a value (0 by default).
+ */
+static const struct {
+    const char *mnemonic;
+    const char *op1, *op2;
+    int size;
+    uint8_t bytes[GEN_MAX_LEN];
+    int value;
+} gen_known[] = {
+    { "ld",   "c",      "d",      1, { 0x4A } },
+    { "ld",   "e",      "h",      1, { 0x5C } },
+    { "ld",   "a",      "l",      1, { 0x7D } },
+    { "ld",   "(hl)",   "a",      1, { 0x77 } },
+    { "ld",   "a",      "(nn)",   3, { 0x3A } },
+    { "ld",   "(nn)",   "hl",     3, { 0x22 } },
+    { "ld",   "hl",     "(nn)",   3, { 0x2A } },
+    { "ld",   "(nn)",   "de",     4, { 0xED, 0x53 } },
+    { "ld",   "sp",     "(nn)",   4, { 0xED, 0x7B } },
+    { "ld",   "(ix+d)", "n",      4, { 0xDD, 0x36 } },
+    { "ld",   "b",      "(iy+d)", 3, { 0xFD, 0x46 } },
+    { "ld",   "ixh",    "ixl",    2, { 0xDD, 0x65 } },
+    { "ld",   "sp",     "iy",     2, { 0xFD, 0xF9 } },
+    { "ld",   "a",      "r",      2, { 0xED, 0x5F } },
+    { "push", "bc",     NULL,     1, { 0xC5 } },
+    { "push", "af",     NULL,     1, { 0xF5 } },
+    { "push", "ix",     NULL,     2, { 0xDD, 0xE5 } },
+    { "pop",  "iy",     NULL,     2, { 0xFD, 0xE1 } },
+    { "inc",  "ix",     NULL,     2, { 0xDD, 0x23 } },
+    { "dec",  "iy",     NULL,     2, { 0xFD, 0x2B } },
+    { "inc",  "(ix+d)", NULL,     3, { 0xDD, 0x34 } },
+    { "add",  "ix",     "ix",     2, { 0xDD, 0x29 } },
+    { "adc",  "hl",     "sp",     2, { 0xED, 0x7A } },
+    { "sbc",  "a",      "n",      2, { 0xDE } },
+    { "cp",   "(hl)",   NULL,     1, { 0xBE } },
+    { "ex",   "de",     "hl",     1, { 0xEB } },
+    { "ex",   "(sp)",   "ix",     2, { 0xDD, 0xE3 } },
+    { "jp",   "(hl)",   NULL,     1, { 0xE9 } },
+    { "jp",   "(ix)",   NULL,     2, { 0xDD, 0xE9 } },
+    { "jp",   "pe",     "nn",     3, { 0xEA } },
+    { "jr",   "c",      "rel",    2, { 0x38 } },
+    { "call", "m",      "nn",     3, { 0xFC } },
+    { "ret",  "nz",     NULL,     1, { 0xC0 } },
+    { "rst",  "rst",    NULL,     1, { 0xC7 } },
+    { "rst",  "rst",    NULL,     1, { 0xFF }, 0x38 },
+    { "im",   "im",     NULL,     2, { 0xED, 0x46 } },
+    { "im",   "im",     NULL,     2, { 0xED, 0x56 }, 1 },
+    { "im",   "im",     NULL,     2, { 0xED, 0x5E }, 2 },
+    { "rlc",  "a",      NULL,     2, { 0xCB, 0x07 } },
+    { "sla",  "a",      NULL,     2, { 0xCB, 0x27 } },
+    { "srl",  "(iy+d)", NULL,     4, { 0xFD, 0xCB, 0x00, 0x3E } },
+    { "bit",  "bit",    "a",      2, { 0xCB, 0x47 } },
+    { "bit",  "bit",    "a",      2, { 0xCB, 0x7F }, 7 },
+    { "res",  "bit",    "(hl)",   2, { 0xCB, 0x86 } },
+    { "set",  "bit",    "(ix+d)", 4, { 0xDD, 0xCB, 0x00, 0xC6 } },
+    { "in",   "a",      "(n)",    2, { 0xDB } },
+    { "in",   "h",      "(c)",    2, { 0xED, 0x60 } },
+    { "out",  "(c)",    "e",      2, { 0xED, 0x59 } },
+    { "ldir", NULL,     NULL,     2, { 0xED, 0xB0 } },
+    { "otdr", NULL,     NULL,     2, { 0xED, 0xBB } },
+    { "halt", NULL,     NULL,     1, { 0x76 } },
+};
+
+/**
+ * Prints an error in the spec and exits.
+ * @param line Line of the spec, or 0 if the error is not on a particular line.
+ */
+static void gen_error(int line, const char *msg, const char *arg) {
+    if (line > 0) {
+        fprintf(stderr, "%s:%d: ", gen_spec_path, line);
+    } else {
+        fprintf(stderr, "%s: ", gen_spec_path);
+    }
+
+    fprintf(stderr, "%s%s%s\n", msg, arg ? ": " : "", arg ? arg : "");
+    exit(EXIT_FAILURE);
+}
+
+static int gen_find_operand(const char *name) {
+    for (int i = 0; i < ARR_LEN(gen_operands); i++) {
+        if (strcmp(gen_operands[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int gen_find_mnemonic(const char *name) {
+    for (int i = 0; i < gen_mnemonic_count; i++) {
+        if (strcmp(gen_mnemonics[i], name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int gen_add_mnemonic(const char *name, int line) {
+    int idx = gen_find_mnemonic(name);
+    if (idx >= 0) {
+        return idx;
+    }
+
+    if (gen_mnemonic_count >= GEN_MAX_MNEMONICS) {
+        gen_error(line, "Too many mnemonics", NULL);
+    }
+
+    gen_mnemonics[gen_mnemonic_count] = strdup(name);
+    return gen_mnemonic_count++;
+}
+
+/**
+ * Lays out an instruction and adds it.
+ * @param prefix Prefix bytes (dd cb for indexed cb instructions).
+ * @param prefix_len Number of prefix bytes.
+ * @param opcode Opcode byte.
+ * @param ops Operands (indices into gen_operands, or -1).
+ */
+static void gen_add_row(int mnemonic, const uint8_t *prefix, int prefix_len,
+        uint8_t opcode, const int ops[2], enum gen_group group, int alias,
+        int line) {
+    struct gen_row *row;
+    int disp = -1;
+    int imm = -1;
+    int pos = prefix_len;
+
+    if (gen_row_count >= GEN_MAX_ROWS) {
+        gen_error(line, "Too many instructions", NULL);
+    }
+
+    row = &gen_rows[gen_row_count++];
+    memset(row, 0, sizeof(*row));
+    row->mnemonic = mnemonic;
+    row->group = group;
+    row->alias = alias;
+    row->line = line;
+    memcpy(row->bytes, prefix, prefix_len);
+
+    for (int i = 0; i < 2; i++) {
+        row->ops[i] = ops[i];
+        if (ops[i] >= 0 && gen_operands[ops[i]].place == GP_DISP) {
+            disp = i;
+        }
+    }
+
+    /* The displacement comes before the opcode in indexed cb instructions */
+    if (disp >= 0 && (group == GG_DDCB || group == GG_FDCB)) {
+        row->offs[disp] = pos++;
+        row->opcode_off = pos++;
+    } else {
+        row->opcode_off = pos++;
+        if (disp >= 0) {
+            row->offs[disp] = pos++;
+        }
+    }
+
+    row->bytes[row->opcode_off] = opcode;
+
+    for (int i = 0; i < 2; i++) {
+        if (ops[i] < 0) {
+            row->offs[i] = -1;
+            continue;
+        }
+
+        switch (gen_operands[ops[i]].place) {
+        case GP_NONE:
+            row->offs[i] = -1;
+            break;
+        case GP_DISP:
+            break;
+        case GP_OPCODE:
+            row->offs[i] = row->opcode_off;
+            break;
+        case GP_IMM8:
+        case GP_IMM16:
+            if (imm >= 0) {
+                gen_error(line, "More than one immediate", NULL);
+            }
+
+            imm = i;
+            row->offs[i] = pos;
+            pos += gen_operands[ops[i]].place == GP_IMM16 ? 2 : 1;
+            break;
+        }
+    }
+
+    row->size = pos;
+}
+
+/**
+ * Adds the ix or iy form of an instruction, if it has one.
+ * @param row Instruction to add the form of. This is copied, since the rows
+ * can move.
+ * @param iy Whether to use iy instead of ix.
+ */
+static void gen_add_index(struct gen_row row, int iy, int nodisp) {
+    static const char *const hl_names[] = { "hl", "(hl)", "h", "l" };
+    const char *const idx_names[2][4] = {
+        { "ix", nodisp ? "(ix)" : "(ix+d)", "ixh", "ixl" },
+        { "iy", nodisp ? "(iy)" : "(iy+d)", "iyh", "iyl" },
+    };
+
+    int has_ind = 0;
+    int changed = 0;
+    int ops[2];
+    uint8_t prefix[2] = { iy ? 0xFD : 0xDD, 0xCB };
+    int cb = row.group == GG_CB;
+
+    for (int i = 0; i < 2; i++) {
+        if (row.ops[i] >= 0 && strcmp(gen_operands[row.ops[i]].name, "(hl)")
+                == 0) {
+            has_ind = 1;
+        }
+    }
+
+    /* h and l are only replaced if they aren't used with (ix+d), and only (hl)
+     * is replaced in the cb group
+     */
+    for (int i = 0; i < 2; i++) {
+        ops[i] = row.ops[i];
+        if (ops[i] < 0) {
+            continue;
+        }
+
+        for (int j = 0; j < ARR_LEN(hl_names); j++) {
+            if (strcmp(gen_operands[ops[i]].name, hl_names[j]) != 0
+                    || (j != 1 && (has_ind || cb))) {
+                continue;
+            }
+
+            ops[i] = gen_find_operand(idx_names[iy][j]);
+            changed = 1;
+            break;
+        }
+    }
+
+    if (!changed) {
+        return;
+    }
+
+    gen_add_row(row.mnemonic, prefix, cb ? 2 : 1,
+            row.bytes[row.opcode_off], ops,
+            cb ? (iy ? GG_FDCB : GG_DDCB) : (iy ? GG_FD : GG_DD),
+            row.alias, row.line);
+}
+
+/**
+ * A field of an opcode pattern.
+ */
+struct gen_field {
+    char name;
+    int shift;
+    int width;
+    /** Table of operands it indexes, or NULL if it holds a value */
+    const struct gen_table *table;
+    /** Which operand it belongs to */
+    int operand;
+};
+
+/**
+ * Parses an operand of a form.
+ * @return Index of the operand in gen_operands, or -1 if it is a field.
+ */
+static int gen_parse_operand(const char *text, int idx,
+        struct gen_field *fields, int field_count, int line) {
+    const char *colon = strchr(text, ':');
+    struct gen_field *field = NULL;
+    int op;
+
+    if (!colon) {
+        op = gen_find_operand(text);
+        if (op < 0) {
+            gen_error(line, "Unknown operand", text);
+        }
+
+        return op;
+    }
+
+    for (int i = 0; i < field_count; i++) {
+        if (fields[i].name == colon[1]) {
+            field = &fields[i];
+        }
+    }
+
+    if (!field || colon[2] != '\0') {
+        gen_error(line, "Unknown field", text);
+    }
+
+    field->operand = idx;
+    for (int i = 0; i < ARR_LEN(gen_tables); i++) {
+        if (strncmp(gen_tables[i].name, text, colon - text) == 0
+                && gen_tables[i].name[colon - text] == '\0') {
+            /* A narrower field indexes the start of the table (cc for jr) */
+            if (gen_tables[i].count < 1 << field->width) {
+                gen_error(line, "Field is too wide for table", text);
+            }
+
+            field->table = &gen_tables[i];
+            return -1;
+        }
+    }
+
+    /* Values applied to the opcode byte */
+    if (strncmp(text, "bit:", 4) == 0 || strncmp(text, "rst:", 4) == 0) {
+        if (field->width != 3) {
+            gen_error(line, "Field is the wrong size", text);
+        }
+
+        return strncmp(text, "bit", 3) == 0
+            ? gen_find_operand("bit") : gen_find_operand("rst");
+    }
+
+    gen_error(line, "Unknown table", text);
+    return -1;
+}
+
+/**
+ * Expands a line of the spec into instructions.
+ */
+static void gen_parse_line(char *text, int line) {
+    const char *delim = " \t\r\n";
+    char *mnemonic = strtok(text, delim);
+    char *prefix_text = strtok(NULL, delim);
+    char *pattern = strtok(NULL, delim);
+    char *operands = strtok(NULL, delim);
+    char *flag;
+
+    struct gen_field fields[8];
+    int field_count = 0;
+    int excluded[256] = { 0 };
+    int alias = 0, noix = 0, nodisp = 0;
+    uint8_t base = 0;
+    uint8_t prefix[1];
+    int prefix_len = 0;
+    enum gen_group group = GG_NONE;
+    int spec_ops[2] = { -1, -1 };
+    int mnem;
+    int combos = 1;
+
+    if (!mnemonic || mnemonic[0] == '#') {
+        return;
+    }
+
+    if (!prefix_text || !pattern || !operands) {
+        gen_error(line, "Incomplete form", NULL);
+    }
+
+    while ((flag = strtok(NULL, delim))) {
+        if (flag[0] == '!') {
+            excluded[strtol(flag + 1, NULL, 16) & 0xFF] = 1;
+        } else if (strcmp(flag, "alias") == 0) {
+            alias = 1;
+        } else if (strcmp(flag, "noix") == 0) {
+            noix = 1;
+        } else if (strcmp(flag, "nodisp") == 0) {
+            nodisp = 1;
+        } else if (flag[0] == '#') {
+            break;
+        } else {
+            gen_error(line, "Unknown flag", flag);
+        }
+    }
+
+    if (strcmp(prefix_text, "cb") == 0) {
+        prefix[prefix_len++] = 0xCB;
+        group = GG_CB;
+    } else if (strcmp(prefix_text, "ed") == 0) {
+        prefix[prefix_len++] = 0xED;
+        group = GG_ED;
+    } else if (strcmp(prefix_text, "-") != 0) {
+        gen_error(line, "Unknown prefix", prefix_text);
+    }
+
+    if (strlen(pattern) != 8) {
+        gen_error(line, "Pattern must have 8 bits", pattern);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        char c = pattern[i];
+        int bit = 7 - i;
+
+        if (c == '0' || c == '1') {
+            base |= (c - '0') << bit;
+        } else if (field_count > 0 && fields[field_count - 1].name == c
+                && fields[field_count - 1].shift == bit + 1) {
+            fields[field_count - 1].shift = bit;
+            fields[field_count - 1].width++;
+        } else {
+            for (int j = 0; j < field_count; j++) {
+                if (fields[j].name == c) {
+                    gen_error(line, "Field is not contiguous", pattern);
+                }
+            }
+
+            fields[field_count].name = c;
+            fields[field_count].shift = bit;
+            fields[field_count].width = 1;
+            fields[field_count].table = NULL;
+            fields[field_count].operand = -1;
+            field_count++;
+        }
+    }
+
+    if (strcmp(operands, "-") != 0) {
+        char *comma = strchr(operands, ',');
+        if (comma) {
+            *comma = '\0';
+            spec_ops[1] = gen_parse_operand(comma + 1, 1,
+                    fields, field_count, line);
+        }
+
+        spec_ops[0] = gen_parse_operand(operands, 0,
+                fields, field_count, line);
+    }
+
+    for (int i = 0; i < field_count; i++) {
+        if (fields[i].operand < 0) {
+            gen_error(line, "Field is not used by an operand", pattern);
+        }
+
+        if (fields[i].table) {
+            combos <<= fields[i].width;
+        }
+    }
+
+    mnem = gen_add_mnemonic(mnemonic, line);
+
+    /* Every combination of the fields which index tables */
+    for (int combo = 0; combo < combos; combo++) {
+        uint8_t opcode = base;
+        int ops[2] = { spec_ops[0], spec_ops[1] };
+        int rest = combo;
+
+        for (int i = 0; i < field_count; i++) {
+            const struct gen_table *table = fields[i].table;
+            if (!table) {
+                continue;
+            }
+
+            int value = rest & ((1 << fields[i].width) - 1);
+            rest >>= fields[i].width;
+
+            opcode |= value << fields[i].shift;
+            ops[fields[i].operand] = gen_find_operand(table->operands[value]);
+        }
+
+        if (excluded[opcode]) {
+            continue;
+        }
+
+        gen_add_row(mnem, prefix, prefix_len, opcode, ops, group, alias, line);
+        if (!noix && group != GG_ED) {
+            int idx = gen_row_count - 1;
+            gen_add_index(gen_rows[idx], 0, nodisp);
+            gen_add_index(gen_rows[idx], 1, nodisp);
+        }
+    }
+}
+
+static void gen_read_spec(const char *path) {
+    char buf[256];
+    int line = 0;
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(buf, sizeof(buf), file)) {
+        gen_parse_line(buf, ++line);
+    }
+
+    fclose(file);
+}
+
+/**
+ * Checks that every opcode decodes to at most one instruction, and that the
+ * unprefixed and cb groups are complete.
+ */
+static void gen_check_decode(void) {
+    static int decoded[GG_COUNT][256];
+
+    for (int i = 0; i < gen_row_count; i++) {
+        const struct gen_row *row = &gen_rows[i];
+        uint8_t opcode = row->bytes[row->opcode_off];
+        uint8_t opcodes[8];
+        int count = 1;
+
+        if (row->alias) {
+            continue;
+        }
+
+        opcodes[0] = opcode;
+        for (int j = 0; j < 2; j++) {
+            if (row->ops[j] < 0
+                    || gen_operands[row->ops[j]].place != GP_OPCODE) {
+                continue;
+            }
+
+            if (strcmp(gen_operands[row->ops[j]].name, "im") == 0) {
+                /* Modes 0, 1, and 2 (as in reltab_encode()) */
+                opcodes[1] = opcode | 0x10;
+                opcodes[2] = opcode | 0x18;
+                count = 3;
+            } else {
+                for (int k = 0; k < 8; k++) {
+                    opcodes[k] = opcode | k << 3;
+                }
+
+                count = 8;
+            }
+        }
+
+        for (int j = 0; j < count; j++) {
+            int *slot = &decoded[row->group][opcodes[j]];
+            if (*slot) {
+                char buf[64];
+                snprintf(buf, sizeof(buf), "%s %02X (also on line %d)",
+                        gen_group_names[row->group], opcodes[j],
+                        gen_rows[*slot - 1].line);
+                gen_error(row->line, "Opcode is ambiguous", buf);
+            }
+
+            *slot = i + 1;
+        }
+    }
+
+    for (int op = 0; op < 256; op++) {
+        char buf[64];
+
+        if (!decoded[GG_NONE][op] && op != 0xCB && op != 0xDD && op != 0xED
+                && op != 0xFD) {
+            snprintf(buf, sizeof(buf), "%s %02X",
+                    gen_group_names[GG_NONE], op);
+            gen_error(0, "Opcode is missing", buf);
+        }
+
+        if (!decoded[GG_CB][op]) {
+            snprintf(buf, sizeof(buf), "%s %02X", gen_group_names[GG_CB], op);
+            gen_error(0, "Opcode is missing", buf);
+        }
+    }
+}
+
+/**
+ * Checks that no two instructions of a mnemonic take the same operands (which
+ * would make the second one unreachable).
+ */
+static void gen_check_operands(void) {
+    for (int i = 0; i < gen_row_count; i++) {
+        for (int j = 0; j < i; j++) {
+            const struct gen_row *a = &gen_rows[i], *b = &gen_rows[j];
+            int same = a->mnemonic == b->mnemonic;
+
+            for (int k = 0; k < 2 && same; k++) {
+                if (a->ops[k] < 0 || b->ops[k] < 0) {
+                    same = a->ops[k] == b->ops[k];
+                } else {
+                    same = strcmp(gen_operands[a->ops[k]].key,
+                            gen_operands[b->ops[k]].key) == 0;
+                }
+            }
+
+            if (same) {
+                char buf[64];
+                snprintf(buf, sizeof(buf), "%s (also on line %d)",
+                        gen_mnemonics[a->mnemonic], b->line);
+                gen_error(a->line, "Operands are ambiguous", buf);
+            }
+        }
+    }
+}
+
+/**
+ * Applies the value of an operand to the opcode byte, as reltab_encode() does.
+ */
+static uint8_t gen_apply_value(int op, uint8_t opcode, int value) {
+    if (strcmp(gen_operands[op].name, "im") == 0) {
+        return value == 0 ? opcode
+            : value == 1 ? opcode | 0x10 : opcode | 0x18;
+    } else if (strcmp(gen_operands[op].name, "rst") == 0) {
+        return opcode | value;
+    } else {
+        return opcode | value << 3;
+    }
+}
+
+/**
+ * Checks the known encodings.
+ */
+static void gen_check_known(void) {
+    for (int i = 0; i < ARR_LEN(gen_known); i++) {
+        int mnem = gen_find_mnemonic(gen_known[i].mnemonic);
+        int op1 = gen_known[i].op1 ? gen_find_operand(gen_known[i].op1) : -1;
+        int op2 = gen_known[i].op2 ? gen_find_operand(gen_known[i].op2) : -1;
+        const struct gen_row *row = NULL;
+        uint8_t bytes[GEN_MAX_LEN];
+
+        for (int j = 0; j < gen_row_count; j++) {
+            if (gen_rows[j].mnemonic == mnem && gen_rows[j].ops[0] == op1
+                    && gen_rows[j].ops[1] == op2) {
+                row = &gen_rows[j];
+                break;
+            }
+        }
+
+        if (!row) {
+            gen_error(0, "Missing instruction", gen_known[i].mnemonic);
+        }
+
+        memcpy(bytes, row->bytes, row->size);
+        for (int j = 0; j < 2; j++) {
+            if (row->ops[j] >= 0
+                    && gen_operands[row->ops[j]].place == GP_OPCODE) {
+                bytes[row->opcode_off] = gen_apply_value(row->ops[j],
+                        bytes[row->opcode_off], gen_known[i].value);
+            }
+        }
+
+        if (row->size != gen_known[i].size
+                || memcmp(bytes, gen_known[i].bytes, row->size) != 0) {
+            gen_error(row->line, "Wrong encoding", gen_known[i].mnemonic);
+        }
+    }
+}
+
+static int gen_compare_mnemonics(const void *a, const void *b) {
+    return strcmp(gen_mnemonics[*(const int *) a],
+            gen_mnemonics[*(const int *) b]);
+}
+
+static void gen_write(FILE *out) {
+    int order[GEN_MAX_MNEMONICS];
+
+    fprintf(out,
+            "/* Generated by opgen from %s; do not edit. */\n\n"
+            "#include <stddef.h>\n\n"
+            "#include \"opcode.h\"\n",
+            gen_spec_path);
+
+    for (int m = 0; m < gen_mnemonic_count; m++) {
+        int index = 0;
+
+        order[m] = m;
+        fprintf(out, "\nstatic const struct instruction %s_instrs[] = {\n",
+                gen_mnemonics[m]);
+
+        for (int i = 0; i < gen_row_count; i++) {
+            const struct gen_row *row = &gen_rows[i];
+            char types[2][16];
+
+            if (row->mnemonic != m) {
+                continue;
+            }
+
+            /* Pad after the commas to line up the columns */
+            for (int j = 0; j < 2; j++) {
+                snprintf(types[j], sizeof(types[j]), "%s,", row->ops[j] >= 0
+                        ? gen_operands[row->ops[j]].type : "OP_NONE");
+            }
+
+            fprintf(out, "    {%-10s %-10s %d, %2d, %2d, {", types[0], types[1],
+                    row->size, row->offs[0], row->offs[1]);
+            for (int j = 0; j < row->size; j++) {
+                fprintf(out, "%s0x%02X", j ? ", " : "", row->bytes[j]);
+            }
+
+            fprintf(out, "}%s},\n", row->alias ? ", 1" : "");
+        }
+
+        fprintf(out, "};\n");
+
+        fprintf(out,
+                "\nstatic const struct instruction *%s_match("
+                "enum operand_type t1,\n"
+                "        enum operand_type t2) {\n"
+                "    switch (OPCODE_KEY(t1, t2)) {\n",
+                gen_mnemonics[m]);
+
+        for (int i = 0; i < gen_row_count; i++) {
+            const struct gen_row *row = &gen_rows[i];
+            if (row->mnemonic != m) {
+                continue;
+            }
+
+            fprintf(out, "    case OPCODE_KEY(%s, %s): return &%s_instrs[%d];\n",
+                    row->ops[0] >= 0 ? gen_operands[row->ops[0]].key
+                        : "OP_NONE",
+                    row->ops[1] >= 0 ? gen_operands[row->ops[1]].key
+                        : "OP_NONE",
+                    gen_mnemonics[m], index++);
+        }
+
+        fprintf(out,
+                "    default: return NULL;\n"
+                "    }\n"
+                "}\n");
+    }
+
+    qsort(order, gen_mnemonic_count, sizeof(*order), gen_compare_mnemonics);
+
+    fprintf(out, "\nconst struct opcode opcodes_builtin[] = {\n");
+    for (int i = 0; i < gen_mnemonic_count; i++) {
+        const char *name = gen_mnemonics[order[i]];
+        fprintf(out, "    {\"%s\", sizeof(%s_instrs) / sizeof(*%s_instrs), "
+                "%s_instrs, %s_match},\n", name, name, name, name, name);
+    }
+
+    fprintf(out, "};\n\nconst int opcodes_builtin_count = %d;\n",
+            gen_mnemonic_count);
+}
+
+int main(int argc, char *argv[]) {
+    FILE *out;
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s spec output\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    gen_spec_path = argv[1];
+    gen_read_spec(gen_spec_path);
+    gen_check_decode();
+    gen_check_operands();
+    gen_check_known();
+
+    out = fopen(argv[2], "w");
+    if (!out) {
+        fprintf(stderr, "Could not open %s.\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    gen_write(out);
+    if (fclose(out) != 0) {
+        remove(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,262 @@
+/**
+ * @file pack.c
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pack.h"
+
+#define PACK_HASH_BITS 16
+
+/**
+ * Positions given to each thread at least, so that small inputs don't start
+ * threads for nothing.
+ */
+#define PACK_MIN_SLICE 4096
+
+/**
+ * Longest match at each position, shared by the threads finding them.
+ */
+struct pack_ctx {
+    const uint8_t *data;
+    size_t size;
+
+    /**
+     * Previous position whose first bytes have the same hash, or -1.
+     */
+    const int *prev;
+
+    /**
+     * Length (0 if there is none) and distance of the longest match.
+     */
+    uint8_t *len;
+    uint16_t *dist;
+};
+
+struct pack_thread {
+    struct pack_ctx *ctx;
+    size_t start;
+    size_t end;
+    pthread_t thread;
+
+    /**
+     * Set if creating the thread failed, in which case it was run inline.
+     */
+    int inline_run;
+};
+
+static uint32_t pack_hash(const uint8_t *ptr) {
+    uint32_t v = ptr[0] | ptr[1] << 8 | ptr[2] << 16;
+    return (v * 2654435761u) >> (32 - PACK_HASH_BITS);
+}
+
+/**
+ * Finds the longest match at each position in a thread's range.
+ */
+static void *pack_find_matches(void *arg) {
+    struct pack_thread *t = arg;
+    const struct pack_ctx *ctx = t->ctx;
+    const uint8_t *data = ctx->data;
+
+    for (size_t i = t->start; i < t->end; i++) {
+        size_t max = ctx->size - i;
+        size_t best = 0;
+        int tries = 0;
+
+        ctx->len[i] = 0;
+        if (max < PACK_MATCH_MIN) {
+            continue;
+        }
+
+        if (max > PACK_MATCH_MAX) {
+            max = PACK_MATCH_MAX;
+        }
+
+        for (int j = ctx->prev[i]; j >= 0 && tries < PACK_MAX_CHAIN;
+                j = ctx->prev[j], tries++) {
+            size_t len = 0;
+
+            /* Only a longer match is any use */
+            if (data[j + best] != data[i + best]) {
+                continue;
+            }
+
+            while (len < max && data[j + len] == data[i + len]) {
+                len++;
+            }
+
+            if (len > best) {
+                best = len;
+                ctx->dist[i] = i - j;
+                if (best == max) {
+                    break;
+                }
+            }
+        }
+
+        if (best >= PACK_MATCH_MIN) {
+            ctx->len[i] = best;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Finds the longest match at every position, splitting the positions between
+ * threads.
+ */
+static void pack_run(struct pack_ctx *ctx) {
+    struct pack_thread threads[PACK_MAX_THREADS];
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (count > (long) (ctx->size / PACK_MIN_SLICE)) {
+        count = ctx->size / PACK_MIN_SLICE;
+    }
+
+    if (count > PACK_MAX_THREADS) {
+        count = PACK_MAX_THREADS;
+    }
+
+    if (count < 1) {
+        count = 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        threads[i].ctx = ctx;
+        threads[i].start = ctx->size * i / count;
+        threads[i].end = ctx->size * (i + 1) / count;
+        threads[i].inline_run = pthread_create(&threads[i].thread, NULL,
+                pack_find_matches, &threads[i]) != 0;
+        if (threads[i].inline_run) {
+            pack_find_matches(&threads[i]);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!threads[i].inline_run) {
+            pthread_join(threads[i].thread, NULL);
+        }
+    }
+}
+
+int pack_compress(const uint8_t *data, size_t size, struct section_buf *out,
+        long *cycles) {
+    struct pack_ctx ctx = { .data = data, .size = size };
+    int *head = malloc((1 << PACK_HASH_BITS) * sizeof(*head));
+    int *prev = malloc((size + 1) * sizeof(*prev));
+    uint32_t *bytes = malloc((size + 1) * sizeof(*bytes));
+    uint32_t *clocks = malloc((size + 1) * sizeof(*clocks));
+    int *step = malloc((size + 1) * sizeof(*step));
+    int ret = -1;
+
+    ctx.prev = prev;
+    ctx.len = malloc(size + 1);
+    ctx.dist = malloc((size + 1) * sizeof(*ctx.dist));
+    if (!head || !prev || !bytes || !clocks || !step || !ctx.len || !ctx.dist
+            || size > 0x10000) {
+        goto COMPRESS_END;
+    }
+
+    /* Chain the positions which start with the same bytes */
+    for (int i = 0; i < (1 << PACK_HASH_BITS); i++) {
+        head[i] = -1;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        if (i + PACK_MATCH_MIN <= size) {
+            uint32_t hash = pack_hash(&data[i]);
+            prev[i] = head[hash];
+            head[hash] = i;
+        } else {
+            prev[i] = -1;
+        }
+    }
+
+    pack_run(&ctx);
+
+    /* Cheapest way to encode everything from each position on, with steps
+     * above 0 being literals, and below 0 matches
+     */
+    bytes[size] = 1;
+    clocks[size] = PACK_END_CYCLES;
+    for (size_t i = size; i-- > 0;) {
+        uint32_t best_bytes = UINT32_MAX, best_clocks = UINT32_MAX;
+
+        for (size_t n = 1; n <= PACK_LITERAL_MAX && i + n <= size; n++) {
+            uint32_t b = 1 + n + bytes[i + n];
+            uint32_t c = PACK_LITERAL_CYCLES(n) + clocks[i + n];
+            if (b < best_bytes || (b == best_bytes && c < best_clocks)) {
+                best_bytes = b;
+                best_clocks = c;
+                step[i] = n;
+            }
+        }
+
+        for (size_t n = PACK_MATCH_MIN; n <= ctx.len[i]; n++) {
+            uint32_t b = 3 + bytes[i + n];
+            uint32_t c = PACK_MATCH_CYCLES(n) + clocks[i + n];
+            if (b < best_bytes || (b == best_bytes && c < best_clocks)) {
+                best_bytes = b;
+                best_clocks = c;
+                step[i] = -(int) n;
+            }
+        }
+
+        bytes[i] = best_bytes;
+        clocks[i] = best_clocks;
+    }
+
+    for (size_t i = 0; i < size;) {
+        uint8_t *dst;
+
+        if (step[i] > 0) {
+            dst = secbuf_reserve(out, 1 + step[i]);
+            if (!dst) {
+                goto COMPRESS_END;
+            }
+
+            dst[0] = step[i] - 1;
+            memcpy(&dst[1], &data[i], step[i]);
+            i += step[i];
+        } else {
+            uint16_t offset = -ctx.dist[i];
+
+            dst = secbuf_reserve(out, 3);
+            if (!dst) {
+                goto COMPRESS_END;
+            }
+
+            dst[0] = PACK_MATCH - step[i] - PACK_MATCH_MIN;
+            dst[1] = offset & 0xFF;
+            dst[2] = offset >> 8;
+            i -= step[i];
+        }
+    }
+
+    if (!secbuf_reserve(out, 1)) {
+        goto COMPRESS_END;
+    }
+
+    out->data[out->size - 1] = PACK_END;
+    if (cycles) {
+        *cycles = PACK_SETUP_CYCLES + clocks[0];
+    }
+
+    ret = 0;
+
+COMPRESS_END:
+    free(head);
+    free(prev);
+    free(bytes);
+    free(clocks);
+    free(step);
+    free(ctx.len);
+    free(ctx.dist);
+    return ret;
+}
+
+/* vim: set tw=80 ft=c: */
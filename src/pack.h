@@ -0,0 +1,75 @@
+/**
+ * @file pack.h
+ */
+
+#ifndef PACK_H_
+#define PACK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "section.h"
+
+/*
+ * Commands of a packed stream. Each one is copied with a single ldir by the
+ * unpacker (lib/tixe_unpack.asm), which keeps it fast on the Z80.
+ */
+
+/**
+ * 0x00 - 0x7F: copy (value + 1) bytes which follow.
+ */
+#define PACK_LITERAL_MAX 128
+
+/**
+ * 0x80 - 0xFE, then a 16-bit word: copy (value - 0x7D) bytes from earlier in
+ * the output, at the negated word from the current position.
+ */
+#define PACK_MATCH 0x80
+#define PACK_MATCH_MIN 3
+#define PACK_MATCH_MAX (0xFE - PACK_MATCH + PACK_MATCH_MIN)
+
+/**
+ * 0xFF: end of the stream.
+ */
+#define PACK_END 0xFF
+
+/**
+ * Number of earlier positions compared with each position to find the longest
+ * match.
+ */
+#define PACK_MAX_CHAIN 4096
+
+/**
+ * Maximum number of threads used to find matches.
+ */
+#define PACK_MAX_THREADS 16
+
+/*
+ * T-states the unpacker takes for each command (the copies take 21 for each
+ * byte, and 16 for the last one), and to set up.
+ */
+#define PACK_SETUP_CYCLES 18
+#define PACK_LITERAL_CYCLES(n) (40 + 21 * (n))
+#define PACK_MATCH_CYCLES(n) (127 + 21 * (n))
+#define PACK_END_CYCLES 76
+
+/**
+ * Compresses data.
+ *
+ * The longest match at each position is found in parallel, then the commands
+ * are chosen from the end of the data backwards, so that the output is as small
+ * as possible (and among equally small outputs, as fast as possible to unpack).
+ *
+ * @param data Data to compress.
+ * @param size Size of @p data, at most 0x10000.
+ * @param out Buffer to append the packed stream to.
+ * @param[out] cycles If not NULL, set to the number of T-states the unpacker
+ * takes.
+ * @return 0 on success, -1 on failure.
+ */
+int pack_compress(const uint8_t *data, size_t size, struct section_buf *out,
+        long *cycles);
+
+#endif /* PACK_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,850 @@
+/**
+ * @file page.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "page.h"
+
+/**
+ * Maximum number of passes moving clusters between pages.
+ */
+#define PAGE_REFINE_PASSES 16
+
+/**
+ * Calls between two clusters (units which have to stay together), with @c a
+ * less than @c b.
+ */
+struct page_edge {
+    int a;
+    int b;
+    long weight;
+};
+
+/**
+ * Trampoline needed on a page.
+ */
+struct page_tramp {
+    int page;
+    int to;
+    int target;
+};
+
+/**
+ * Group of clusters to place together.
+ */
+struct page_group {
+    int size;
+    int root;
+};
+
+/**
+ * Clusters, the calls between them, and their placement.
+ */
+struct page_plan {
+    int count;
+    int *size;
+
+    /**
+     * Calls from each cluster, as a range of @c adj_other and @c adj_weight
+     * (every edge is listed from both ends).
+     */
+    int *adj_start;
+    int *adj_other;
+    long *adj_weight;
+
+    /**
+     * Edges, heaviest first.
+     */
+    int edge_count;
+    struct page_edge *edges;
+
+    /**
+     * Page of each cluster, bytes used on each page, and the weight of calls
+     * to each page (scratch space).
+     */
+    int *page;
+    int *used;
+    long *score;
+    int page_count;
+
+    /**
+     * Groups of clusters merged to be placed together: the root of each one,
+     * its size, and its members as linked lists.
+     */
+    int *group;
+    int *group_size;
+    int *group_head;
+    int *group_next;
+
+    /**
+     * Groups, in the order they are placed.
+     */
+    struct page_group *order;
+
+    /**
+     * Scratch space for merging groups: the calls between groups, and whether
+     * each group was merged in the current round.
+     */
+    struct page_edge *merge;
+    int *matched;
+};
+
+static int page_find(int *parent, int x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+
+    return x;
+}
+
+/**
+ * Joins the sets of two elements, keeping the smaller root.
+ * @return Root of the joined set.
+ */
+static int page_union(int *parent, int x, int y) {
+    x = page_find(parent, x);
+    y = page_find(parent, y);
+    if (x < y) {
+        parent[y] = x;
+        return x;
+    }
+
+    parent[x] = y;
+    return y;
+}
+
+static int page_edge_cmp(const void *a, const void *b) {
+    const struct page_edge *e1 = a, *e2 = b;
+    if (e1->a != e2->a) {
+        return e1->a - e2->a;
+    }
+
+    return e1->b - e2->b;
+}
+
+static int page_weight_cmp(const void *a, const void *b) {
+    const struct page_edge *e1 = a, *e2 = b;
+    if (e1->weight != e2->weight) {
+        return e1->weight < e2->weight ? 1 : -1;
+    }
+
+    return page_edge_cmp(a, b);
+}
+
+/**
+ * Orders groups from the largest, then by their first cluster.
+ */
+static int page_group_cmp(const void *a, const void *b) {
+    const struct page_group *g1 = a, *g2 = b;
+    if (g1->size != g2->size) {
+        return g2->size - g1->size;
+    }
+
+    return g1->root - g2->root;
+}
+
+/**
+ * Compares trampolines by the address they call, which has one branch table
+ * entry no matter which pages call it.
+ */
+static int page_branch_cmp(const void *a, const void *b) {
+    const struct page_tramp *t1 = a, *t2 = b;
+    if (t1->to != t2->to) {
+        return t1->to - t2->to;
+    }
+
+    return t1->target - t2->target;
+}
+
+static int page_tramp_cmp(const void *a, const void *b) {
+    const struct page_tramp *t1 = a, *t2 = b;
+    if (t1->page != t2->page) {
+        return t1->page - t2->page;
+    }
+
+    return page_branch_cmp(a, b);
+}
+
+/**
+ * Finds the clusters and the calls between them.
+ * @param cluster Cluster of each unit.
+ */
+static int page_build(struct page_plan *plan, const struct page_graph *graph,
+        const int *cluster) {
+    int count = plan->count;
+    struct page_edge *edges = malloc((graph->call_count + 1) * sizeof(*edges));
+    int *fill;
+    int n = 0;
+
+    if (!edges) {
+        return -1;
+    }
+
+    for (int i = 0; i < graph->call_count; i++) {
+        const struct page_call *call = &graph->calls[i];
+        int a = cluster[call->from], b = cluster[call->to];
+
+        if (a == b || call->weight <= 0) {
+            continue;
+        }
+
+        edges[n++] = (struct page_edge) {
+            a < b ? a : b, a < b ? b : a, call->weight
+        };
+    }
+
+    /* Add up the calls between each pair */
+    qsort(edges, n, sizeof(*edges), page_edge_cmp);
+    plan->edges = edges;
+    plan->edge_count = 0;
+    for (int i = 0; i < n; i++) {
+        int last = plan->edge_count - 1;
+        if (last >= 0 && edges[last].a == edges[i].a
+                && edges[last].b == edges[i].b) {
+            edges[last].weight += edges[i].weight;
+        } else {
+            edges[plan->edge_count++] = edges[i];
+        }
+    }
+
+    plan->adj_start = calloc(count + 1, sizeof(*plan->adj_start));
+    plan->adj_other = malloc((2 * plan->edge_count + 1)
+            * sizeof(*plan->adj_other));
+    plan->adj_weight = malloc((2 * plan->edge_count + 1)
+            * sizeof(*plan->adj_weight));
+    fill = malloc((count + 1) * sizeof(*fill));
+    if (!plan->adj_start || !plan->adj_other || !plan->adj_weight || !fill) {
+        free(fill);
+        return -1;
+    }
+
+    for (int i = 0; i < plan->edge_count; i++) {
+        plan->adj_start[edges[i].a + 1]++;
+        plan->adj_start[edges[i].b + 1]++;
+    }
+
+    for (int c = 0; c < count; c++) {
+        plan->adj_start[c + 1] += plan->adj_start[c];
+        fill[c] = plan->adj_start[c];
+    }
+
+    for (int i = 0; i < plan->edge_count; i++) {
+        int pos = fill[edges[i].a]++;
+        plan->adj_other[pos] = edges[i].b;
+        plan->adj_weight[pos] = edges[i].weight;
+
+        pos = fill[edges[i].b]++;
+        plan->adj_other[pos] = edges[i].a;
+        plan->adj_weight[pos] = edges[i].weight;
+    }
+
+    free(fill);
+    qsort(edges, plan->edge_count, sizeof(*edges), page_weight_cmp);
+    return 0;
+}
+
+/**
+ * Sums the weight of the calls from a cluster to each page.
+ */
+static void page_score(struct page_plan *plan, int c) {
+    for (int i = plan->adj_start[c]; i < plan->adj_start[c + 1]; i++) {
+        int p = plan->page[plan->adj_other[i]];
+        if (p >= 0) {
+            plan->score[p] += plan->adj_weight[i];
+        }
+    }
+}
+
+/**
+ * Places the clusters on pages, using at most @p limit bytes of each page
+ * (unless a cluster is larger than that by itself).
+ */
+static void page_place(struct page_plan *plan, int limit) {
+    int count = plan->count;
+    struct page_group *order = plan->order;
+    int group_count = 0;
+
+    /* Merge the groups joined by the heaviest calls while they fit */
+    for (int c = 0; c < count; c++) {
+        plan->group[c] = c;
+        plan->group_size[c] = plan->size[c];
+        plan->page[c] = -1;
+    }
+
+    for (;;) {
+        struct page_edge *merge = plan->merge;
+        int n = 0, m = 0, merged = 0;
+
+        for (int i = 0; i < plan->edge_count; i++) {
+            int a = page_find(plan->group, plan->edges[i].a);
+            int b = page_find(plan->group, plan->edges[i].b);
+            if (a != b) {
+                merge[n++] = (struct page_edge) {
+                    a < b ? a : b, a < b ? b : a, plan->edges[i].weight
+                };
+            }
+        }
+
+        qsort(merge, n, sizeof(*merge), page_edge_cmp);
+        for (int i = 0; i < n; i++) {
+            if (m > 0 && merge[m - 1].a == merge[i].a
+                    && merge[m - 1].b == merge[i].b) {
+                merge[m - 1].weight += merge[i].weight;
+            } else {
+                merge[m++] = merge[i];
+            }
+        }
+
+        qsort(merge, m, sizeof(*merge), page_weight_cmp);
+        for (int c = 0; c < count; c++) {
+            plan->matched[c] = 0;
+        }
+
+        for (int i = 0; i < m; i++) {
+            int a = merge[i].a, b = merge[i].b;
+            int size = plan->group_size[a] + plan->group_size[b];
+
+            if (!plan->matched[a] && !plan->matched[b] && size <= limit) {
+                plan->group_size[page_union(plan->group, a, b)] = size;
+                plan->matched[a] = plan->matched[b] = 1;
+                merged = 1;
+            }
+        }
+
+        if (!merged) {
+            break;
+        }
+    }
+
+    for (int c = 0; c < count; c++) {
+        plan->group_head[c] = -1;
+        if (page_find(plan->group, c) == c) {
+            order[group_count++] = (struct page_group) {
+                plan->group_size[c], c
+            };
+        }
+    }
+
+    for (int c = count; c-- > 0;) {
+        int root = page_find(plan->group, c);
+        plan->group_next[c] = plan->group_head[root];
+        plan->group_head[root] = c;
+    }
+
+    qsort(order, group_count, sizeof(*order), page_group_cmp);
+
+    /* Put each group on the page it calls most, or the first it fits on */
+    plan->page_count = 0;
+    for (int i = 0; i < group_count; i++) {
+        int g = order[i].root, best = -1;
+
+        memset(plan->score, 0, plan->page_count * sizeof(*plan->score));
+        for (int c = plan->group_head[g]; c >= 0; c = plan->group_next[c]) {
+            page_score(plan, c);
+        }
+
+        for (int p = 0; p < plan->page_count; p++) {
+            if (plan->used[p] + plan->group_size[g] <= limit
+                    && (best < 0 || plan->score[p] > plan->score[best])) {
+                best = p;
+            }
+        }
+
+        if (best < 0) {
+            best = plan->page_count++;
+            plan->used[best] = 0;
+        }
+
+        for (int c = plan->group_head[g]; c >= 0; c = plan->group_next[c]) {
+            plan->page[c] = best;
+        }
+
+        plan->used[best] += plan->group_size[g];
+    }
+}
+
+/**
+ * Places the clusters on pages in order, starting a new page whenever the next
+ * one doesn't fit. This keeps code from the same source together.
+ */
+static void page_place_in_order(struct page_plan *plan, int limit) {
+    plan->page_count = 0;
+    for (int c = 0; c < plan->count; c++) {
+        int p = plan->page_count - 1;
+
+        if (p < 0 || plan->used[p] + plan->size[c] > limit) {
+            p = plan->page_count++;
+            plan->used[p] = 0;
+        }
+
+        plan->page[c] = p;
+        plan->used[p] += plan->size[c];
+    }
+}
+
+/**
+ * Sums the weight of the calls between pages.
+ */
+static long page_cost(const struct page_plan *plan) {
+    long cost = 0;
+
+    for (int i = 0; i < plan->edge_count; i++) {
+        if (plan->page[plan->edges[i].a] != plan->page[plan->edges[i].b]) {
+            cost += plan->edges[i].weight;
+        }
+    }
+
+    return cost;
+}
+
+/**
+ * Moves a cluster to another page, updating the weight of calls from its
+ * neighbors to each page.
+ * @param conn Weight of the calls from each cluster to each page.
+ */
+static void page_move(struct page_plan *plan, long *conn, int c, int to) {
+    int from = plan->page[c];
+
+    for (int i = plan->adj_start[c]; i < plan->adj_start[c + 1]; i++) {
+        long *other = &conn[(size_t) plan->adj_other[i] * plan->page_count];
+        other[from] -= plan->adj_weight[i];
+        other[to] += plan->adj_weight[i];
+    }
+
+    plan->used[from] -= plan->size[c];
+    plan->used[to] += plan->size[c];
+    plan->page[c] = to;
+}
+
+/**
+ * Moves single clusters, or swaps pairs of them, while that lowers the weight
+ * of the calls between pages (and the pages still fit in @p limit).
+ * @return 0 on success, -1 on failure.
+ */
+static int page_refine(struct page_plan *plan, int limit) {
+    int count = plan->count, pages = plan->page_count;
+    long *conn = calloc((size_t) count * pages + 1, sizeof(*conn));
+    long *shared = plan->score;
+
+    if (!conn) {
+        return -1;
+    }
+
+    for (int c = 0; c < count; c++) {
+        for (int i = plan->adj_start[c]; i < plan->adj_start[c + 1]; i++) {
+            conn[(size_t) c * pages + plan->page[plan->adj_other[i]]] +=
+                plan->adj_weight[i];
+        }
+
+        shared[c] = 0;
+    }
+
+    for (int pass = 0; pass < PAGE_REFINE_PASSES; pass++) {
+        int moved = 0;
+
+        for (int c = 0; c < count; c++) {
+            const long *from_c = &conn[(size_t) c * pages];
+            int p = plan->page[c];
+            long best_gain = 0;
+            int best_page = -1, best_swap = -1;
+
+            for (int i = plan->adj_start[c]; i < plan->adj_start[c + 1]; i++) {
+                shared[plan->adj_other[i]] = plan->adj_weight[i];
+            }
+
+            for (int q = 0; q < pages; q++) {
+                long gain = from_c[q] - from_c[p];
+
+                /* Only pages which c calls more are worth moving it to */
+                if (q == p || gain <= 0) {
+                    continue;
+                }
+
+                if (plan->used[q] + plan->size[c] <= limit) {
+                    if (gain > best_gain) {
+                        best_gain = gain;
+                        best_page = q;
+                        best_swap = -1;
+                    }
+
+                    continue;
+                }
+
+                /* Otherwise make room by sending a cluster back */
+                for (int d = 0; d < count; d++) {
+                    const long *from_d = &conn[(size_t) d * pages];
+                    long swap_gain;
+
+                    if (plan->page[d] != q
+                            || plan->used[q] - plan->size[d] + plan->size[c]
+                                > limit
+                            || plan->used[p] - plan->size[c] + plan->size[d]
+                                > limit) {
+                        continue;
+                    }
+
+                    swap_gain = gain + from_d[p] - from_d[q] - 2 * shared[d];
+                    if (swap_gain > best_gain) {
+                        best_gain = swap_gain;
+                        best_page = q;
+                        best_swap = d;
+                    }
+                }
+            }
+
+            for (int i = plan->adj_start[c]; i < plan->adj_start[c + 1]; i++) {
+                shared[plan->adj_other[i]] = 0;
+            }
+
+            if (best_page >= 0) {
+                page_move(plan, conn, c, best_page);
+                if (best_swap >= 0) {
+                    page_move(plan, conn, best_swap, p);
+                }
+
+                moved = 1;
+            }
+        }
+
+        if (!moved) {
+            break;
+        }
+    }
+
+    free(conn);
+    return 0;
+}
+
+/**
+ * Counts the trampolines each page needs.
+ * @param tramps Space for a trampoline per call.
+ * @param[out] counts Number of trampolines on each page.
+ * @return Number of entries in the branch table.
+ */
+static int page_count_tramps(const struct page_plan *plan,
+        const struct page_graph *graph, const int *cluster,
+        struct page_tramp *tramps, int *counts) {
+    int branches = 0;
+    int n = 0;
+
+    for (int i = 0; i < graph->call_count; i++) {
+        const struct page_call *call = &graph->calls[i];
+        int from = plan->page[cluster[call->from]];
+
+        if (from != plan->page[cluster[call->to]]) {
+            tramps[n++] = (struct page_tramp) { from, call->to, call->target };
+        }
+    }
+
+    qsort(tramps, n, sizeof(*tramps), page_tramp_cmp);
+    memset(counts, 0, plan->page_count * sizeof(*counts));
+    for (int i = 0; i < n; i++) {
+        if (i == 0 || page_tramp_cmp(&tramps[i - 1], &tramps[i]) != 0) {
+            counts[tramps[i].page]++;
+        }
+    }
+
+    qsort(tramps, n, sizeof(*tramps), page_branch_cmp);
+    for (int i = 0; i < n; i++) {
+        if (i == 0 || page_branch_cmp(&tramps[i - 1], &tramps[i]) != 0) {
+            branches++;
+        }
+    }
+
+    return branches;
+}
+
+int page_assign(const struct page_graph *graph, int capacity, int *pages) {
+    struct page_plan plan = { 0 };
+    int units = graph->unit_count;
+    int *cluster = malloc((units + 1) * sizeof(*cluster));
+    int *numbers = NULL;
+    int *best = NULL;
+    int *counts = NULL;
+    struct page_tramp *tramps = NULL;
+    int reserve = 0;
+    int ret = -1;
+
+    if (!cluster) {
+        return -1;
+    }
+
+    /* Group the units which have to stay together (using the pages as the
+     * sets until the units are numbered by cluster)
+     */
+    for (int u = 0; u < units; u++) {
+        pages[u] = u;
+    }
+
+    for (int i = 0; i < graph->link_count; i++) {
+        page_union(pages, graph->links[i][0], graph->links[i][1]);
+    }
+
+    /* Roots are the first unit of each cluster, so the clusters are numbered
+     * in order of their first units
+     */
+    for (int u = 0; u < units; u++) {
+        int root = page_find(pages, u);
+        cluster[u] = root == u ? plan.count++ : cluster[root];
+    }
+
+    plan.size = calloc(plan.count + 1, sizeof(*plan.size));
+    plan.page = malloc((plan.count + 1) * sizeof(*plan.page));
+    plan.used = malloc((plan.count + 1) * sizeof(*plan.used));
+    plan.score = malloc((plan.count + 1) * sizeof(*plan.score));
+    plan.group = malloc((plan.count + 1) * sizeof(*plan.group));
+    plan.group_size = malloc((plan.count + 1) * sizeof(*plan.group_size));
+    plan.group_head = malloc((plan.count + 1) * sizeof(*plan.group_head));
+    plan.group_next = malloc((plan.count + 1) * sizeof(*plan.group_next));
+    plan.order = malloc((plan.count + 1) * sizeof(*plan.order));
+    plan.merge = malloc((graph->call_count + 1) * sizeof(*plan.merge));
+    plan.matched = malloc((plan.count + 1) * sizeof(*plan.matched));
+    numbers = malloc((plan.count + 1) * sizeof(*numbers));
+    best = malloc((plan.count + 1) * sizeof(*best));
+    counts = malloc((plan.count + 1) * sizeof(*counts));
+    tramps = malloc((graph->call_count + 1) * sizeof(*tramps));
+    if (!plan.size || !plan.page || !plan.used || !plan.score || !plan.group
+            || !plan.group_size || !plan.group_head || !plan.group_next
+            || !plan.order || !plan.merge || !plan.matched
+            || !numbers || !best || !counts || !tramps
+            || page_build(&plan, graph, cluster) < 0) {
+        goto ASSIGN_END;
+    }
+
+    for (int u = 0; u < units; u++) {
+        plan.size[cluster[u]] += graph->sizes[u];
+    }
+
+    for (int c = 0; c < plan.count; c++) {
+        if (plan.size[c] > capacity) {
+            fprintf(stderr, "%d bytes of code and data have to stay on one "
+                    "page, but a page only holds %d.\n", plan.size[c],
+                    capacity);
+            goto ASSIGN_END;
+        }
+    }
+
+    /* Keep more space for trampolines until they fit */
+    for (;;) {
+        int limit = capacity - reserve;
+        long best_cost = -1;
+        int best_count = 0;
+        int overflow = 0;
+        int branches;
+
+        /* Refine both placements, and keep the cheaper one */
+        for (int start = 0; start < 2; start++) {
+            long cost;
+
+            if (start == 0) {
+                page_place(&plan, limit);
+            } else {
+                page_place_in_order(&plan, limit);
+            }
+
+            if (page_refine(&plan, limit) < 0) {
+                goto ASSIGN_END;
+            }
+
+            cost = page_cost(&plan);
+            if (best_cost < 0 || cost < best_cost
+                    || (cost == best_cost && plan.page_count < best_count)) {
+                best_cost = cost;
+                best_count = plan.page_count;
+                memcpy(best, plan.page, plan.count * sizeof(*best));
+            }
+        }
+
+        memcpy(plan.page, best, plan.count * sizeof(*plan.page));
+        plan.page_count = best_count;
+        memset(plan.used, 0, best_count * sizeof(*plan.used));
+        for (int c = 0; c < plan.count; c++) {
+            plan.used[plan.page[c]] += plan.size[c];
+        }
+
+        branches = page_count_tramps(&plan, graph, cluster, tramps, counts);
+        for (int p = 0; p < plan.page_count; p++) {
+            int over = plan.used[p] + counts[p] * PAGE_TRAMPOLINE_SIZE
+                - capacity;
+
+            /* The first unit's page becomes the first page */
+            if (units > 0 && p == plan.page[cluster[0]]) {
+                over += branches * PAGE_BRANCH_SIZE;
+            }
+
+            if (over > overflow) {
+                overflow = over;
+            }
+        }
+
+        if (overflow == 0) {
+            break;
+        }
+
+        if (reserve >= capacity) {
+            fprintf(stderr, "Code and data which have to stay on one page "
+                    "don't fit with the trampolines and branch table they "
+                    "need.\n");
+            goto ASSIGN_END;
+        }
+
+        reserve += overflow;
+    }
+
+    /* Number the pages in order of their first units, skipping empty ones */
+    ret = 0;
+    for (int p = 0; p < plan.page_count; p++) {
+        numbers[p] = -1;
+    }
+
+    for (int u = 0; u < units; u++) {
+        int p = plan.page[cluster[u]];
+        if (numbers[p] < 0) {
+            numbers[p] = ret++;
+        }
+
+        pages[u] = numbers[p];
+    }
+
+ASSIGN_END:
+    free(cluster);
+    free(numbers);
+    free(best);
+    free(counts);
+    free(tramps);
+    free(plan.size);
+    free(plan.adj_start);
+    free(plan.adj_other);
+    free(plan.adj_weight);
+    free(plan.edges);
+    free(plan.page);
+    free(plan.used);
+    free(plan.score);
+    free(plan.group);
+    free(plan.group_size);
+    free(plan.group_head);
+    free(plan.group_next);
+    free(plan.order);
+    free(plan.merge);
+    free(plan.matched);
+    return ret;
+}
+
+static int page_ent_cmp(const void *a, const void *b) {
+    const struct page_profile_ent *e1 = a, *e2 = b;
+    return strcmp(e1->name, e2->name);
+}
+
+int page_profile_read(struct page_profile *prof, const char *path) {
+    FILE *file = fopen(path, "r");
+    char line[1024];
+    int capacity = 0;
+    int line_no = 0;
+    int count = 0;
+    int ret = -1;
+
+    prof->count = 0;
+    prof->ents = NULL;
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        char *name = strtok(line, " \t\r\n");
+        char *number = strtok(NULL, " \t\r\n");
+        char *end = NULL;
+        long calls = number ? strtol(number, &end, 0) : -1;
+
+        line_no++;
+        if (!name || *name == ';') {
+            continue;
+        }
+
+        if (!number || *end || calls < 0 || strtok(NULL, " \t\r\n")) {
+            fprintf(stderr, "Invalid line %d in %s.\n", line_no, path);
+            goto READ_END;
+        }
+
+        if (prof->count == capacity) {
+            struct page_profile_ent *ents;
+
+            capacity = capacity ? capacity * 2 : 64;
+            ents = realloc(prof->ents, capacity * sizeof(*ents));
+            if (!ents) {
+                goto READ_END;
+            }
+
+            prof->ents = ents;
+        }
+
+        prof->ents[prof->count].name = strdup(name);
+        if (!prof->ents[prof->count].name) {
+            goto READ_END;
+        }
+
+        prof->ents[prof->count++].calls = calls;
+    }
+
+    if (ferror(file)) {
+        fprintf(stderr, "Could not read %s.\n", path);
+        goto READ_END;
+    }
+
+    /* Sort by name and add up the counts of duplicates */
+    qsort(prof->ents, prof->count, sizeof(*prof->ents), page_ent_cmp);
+    for (int i = 0; i < prof->count; i++) {
+        if (count > 0 && page_ent_cmp(&prof->ents[count - 1],
+                    &prof->ents[i]) == 0) {
+            prof->ents[count - 1].calls += prof->ents[i].calls;
+            free(prof->ents[i].name);
+        } else {
+            prof->ents[count++] = prof->ents[i];
+        }
+    }
+
+    prof->count = count;
+    ret = 0;
+
+READ_END:
+    fclose(file);
+    if (ret < 0) {
+        page_profile_destroy(prof);
+    }
+
+    return ret;
+}
+
+void page_profile_destroy(struct page_profile *prof) {
+    for (int i = 0; i < prof->count; i++) {
+        free(prof->ents[i].name);
+    }
+
+    free(prof->ents);
+    prof->ents = NULL;
+    prof->count = 0;
+}
+
+int page_profile_find(const struct page_profile *prof, const char *name) {
+    int lo = 0, hi = prof->count - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(prof->ents[mid].name, name);
+        if (cmp == 0) {
+            return mid;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return -1;
+}
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,147 @@
+/**
+ * @file page.h
+ */
+
+#ifndef PAGE_H_
+#define PAGE_H_
+
+/**
+ * Size of a flash page. Every page is mapped at the same address (the base
+ * address of the link) when it runs.
+ */
+#define PAGE_CAPACITY 0x4000
+
+/**
+ * Calls to a routine on another page go through the OS's bcall mechanism. The
+ * first page holds a branch table with an entry for each routine called from
+ * another page:
+ *
+ *   .dw routine
+ *   .db page
+ *
+ * where the page is counted from the first page of the output. The call itself
+ * goes to a trampoline on the caller's page:
+ *
+ *   rst 28h
+ *   .dw entry
+ *   ret
+ *
+ * The OS handler of the restart reads the address of the branch table entry
+ * after it, maps the entry's page, calls the routine, maps the caller's page
+ * again, and returns after the entry address. The ret then returns to the
+ * caller, which makes the trampoline work for jumps as well as calls.
+ */
+#define PAGE_TRAMPOLINE_SIZE 4
+#define PAGE_TRAMPOLINE_RST 0xEF
+#define PAGE_TRAMPOLINE_RET 0xC9
+#define PAGE_BRANCH_SIZE 3
+
+/**
+ * Byte that the unused end of each page is filled with (erased flash).
+ */
+#define PAGE_FILL 0xFF
+
+/**
+ * Call from one unit (a block of code or data placed as a whole) to another.
+ */
+struct page_call {
+    int from;
+    int to;
+
+    /**
+     * Identifies the called address within @c to; calls from one page to the
+     * same address share a trampoline.
+     */
+    int target;
+
+    /**
+     * Number of times the call is made (or an estimate).
+     */
+    long weight;
+};
+
+/**
+ * Units to place on pages, and how they refer to each other.
+ */
+struct page_graph {
+    int unit_count;
+    const int *sizes;
+
+    /**
+     * Pairs of units which have to be on the same page, e.g. because one
+     * falls through into the other, or refers to it other than by calling it.
+     */
+    int link_count;
+    const int (*links)[2];
+
+    int call_count;
+    const struct page_call *calls;
+};
+
+/**
+ * Number of times a routine is called.
+ */
+struct page_profile_ent {
+    char *name;
+    long calls;
+};
+
+/**
+ * Call counts of routines, e.g. from a profiler.
+ */
+struct page_profile {
+    int count;
+
+    /**
+     * Routines in strcmp() order of their names (which are allocated with
+     * malloc()).
+     */
+    struct page_profile_ent *ents;
+};
+
+/**
+ * Reads a profile. Each line of the file is the name of a routine and the
+ * number of times it is called, separated by whitespace; empty lines and lines
+ * starting with ';' are ignored. Counts of names listed more than once are
+ * added up.
+ *
+ * @param prof Profile to read into.
+ * @param path Path of the file.
+ * @return 0 on success, -1 on failure (which is reported).
+ */
+int page_profile_read(struct page_profile *prof, const char *path);
+
+/**
+ * Frees the memory used by a profile.
+ */
+void page_profile_destroy(struct page_profile *prof);
+
+/**
+ * Finds a routine in a profile.
+ * @return Index of the routine in the profile, or -1 if it is not listed.
+ */
+int page_profile_find(const struct page_profile *prof, const char *name);
+
+/**
+ * Assigns units to pages so that the total weight of calls between pages is
+ * small, and every page (including its trampolines, and the branch table on
+ * the first page) fits.
+ *
+ * Units which have to stay together are grouped first. Groups joined by the
+ * heaviest calls are then merged while they fit on a page, the merged groups
+ * are placed on the pages they call most (largest first), and single groups
+ * are moved between pages while that lowers the cost. If trampolines make a
+ * page overflow, the space kept for them is increased and the placement redone.
+ *
+ * @param graph Units and calls.
+ * @param capacity Size of a page.
+ * @param[out] pages Page of each unit. The first unit is always on page 0, and
+ * pages are otherwise numbered in the order of their first units.
+ * @return Number of pages used, or -1 if units which have to stay together
+ * don't fit on a page (which is reported) or on failure.
+ */
+int page_assign(const struct page_graph *graph, int capacity, int *pages);
+
+#endif /* PAGE_H_ */
+
+/* vim: set tw=80 ft=c: */
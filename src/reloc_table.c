@@ -5,8 +5,19 @@
  * @date Last Modified: Tue, 06 Feb 2018
  */
 
+#include "include.h"
 #include "reloc_table.h"
 
+/**
+ * Records where a relocation was made (while parsing).
+ */
+static void reltab_set_origin(struct reloc_ent *ent) {
+    const struct include_file *file = lex_current_file();
+
+    ent->path = file ? file->path : NULL;
+    ent->line = lex_line();
+}
+
 int reltab_in_range(enum reloc_type type, int value) {
     switch (type) {
     case RT_8_BIT:
@@ -31,12 +42,101 @@ int reltab_in_range(enum reloc_type type, int value) {
         return !(value & ~0x38);
     case RT_IM:
         return value == 0 || value == 1 || value == 2;
+    case RT_BIT:
+        return 0 <= value && value <= 7;
+    default:
+        return 0;
+    }
+}
+
+int reltab_encode(enum reloc_type type, int value, int target,
+        uint8_t bytes[2]) {
+    /* Have to do processing before range checking */
+    if (type == RT_REL_JUMP) {
+        value = target - value;
+    } else if (type != RT_RST && type != RT_IM && type != RT_BIT) {
+        value = target + value;
+    }
+
+    if (!reltab_in_range(type,
+                type == RT_RST || type == RT_IM || type == RT_BIT
+                ? target : value)) {
+        return -1;
+    }
+
+    switch (type) {
+    case RT_REL_JUMP:
+    case RT_8_BIT:
+    case RT_U_8_BIT:
+    case RT_S_8_BIT:
+        bytes[0] = value & 0xFF;
+        return 1;
+    case RT_16_BIT:
+    case RT_U_16_BIT:
+    case RT_S_16_BIT:
+        bytes[0] = value & 0xFF;
+        bytes[1] = (value >> 8) & 0xFF;
+        return 2;
+    case RT_RST:
+        /* The value is the instruction byte without the restart address */
+        bytes[0] = (value | target) & 0xFF;
+        return 1;
+    case RT_IM:
+        if (target == 0) {
+            bytes[0] = value & 0xFF;
+        } else if (target == 1) {
+            bytes[0] = (value | 0x10) & 0xFF;
+        } else {
+            bytes[0] = (value | 0x18) & 0xFF;
+        }
+        return 1;
+    case RT_BIT:
+        bytes[0] = (value | target << 3) & 0xFF;
+        return 1;
     default:
+        return -1;
+    }
+}
+
+int reltab_encode_expr(enum reloc_type type, enum section sec, int value,
+        const struct expr_node *expr, uint8_t bytes[2]) {
+    const struct expr_node *res;
+    int ret;
+
+    if (!expr || expr_find_undef(expr)) {
         return 0;
     }
+
+    res = expr_eval(expr);
+    if (!res || res->type == ET_INVAL) {
+        return -1;
+    }
+
+    /* Values relative to a section aren't known until it is placed, except
+     * for relative jumps within the same section.
+     */
+    if (res->type != ET_CONST) {
+        ret = 0;
+    } else if (res->sec == SEC_ABS) {
+        ret = reltab_encode(type, value, res->value, bytes);
+    } else if (type == RT_REL_JUMP && res->sec == sec) {
+        ret = reltab_encode(type, value, res->value, bytes);
+        if (ret > 0) {
+            /* The jump is relative to its end, which may already be in the
+             * next fragment, so pin from its last byte instead
+             */
+            expr_pin(sec, value - 1, res->value);
+        }
+    } else {
+        ret = 0;
+    }
+
+    return ret;
 }
 
 int reltab_init(struct reloc_table *rt) {
+    rt->retired = 0;
+    rt->patch = NULL;
     return vector_init(&rt->relocs);
 }
 
@@ -97,9 +197,25 @@ int reltab_add_sym(struct reloc_table *rt,
     ent->offset = offset;
     ent->value = value;
     ent->sym = symbol;
+    ent->next_fixup = NULL;
+    ent->prev_fixup = NULL;
+    reltab_set_origin(ent);
     return 0;
 }
 
+/**
+ * Adds an entry to the front of the fixup chain of a symbol.
+ */
+static void reltab_chain(struct symbol_ent *sym, struct reloc_ent *ent) {
+    ent->prev_fixup = NULL;
+    ent->next_fixup = sym->fixups;
+    if (sym->fixups) {
+        sym->fixups->prev_fixup = ent;
+    }
+
+    sym->fixups = ent;
+}
+
 int reltab_add_expr(struct reloc_table *rt,
         enum reloc_type type, enum section sec, int offset, int value,
         const struct expr_node *expr) {
@@ -122,8 +238,197 @@ int reltab_add_expr(struct reloc_table *rt,
     ent->offset = offset;
     ent->value = value;
     ent->expr = expr_clone(expr);
+    ent->next_fixup = NULL;
+    ent->prev_fixup = NULL;
+    reltab_set_origin(ent);
+
+    /* Wait on the first undefined symbol (there could be more, but this entry
+     * can't be resolved until this one is defined anyway).
+     */
+    struct symbol_ent *sym = (struct symbol_ent *) expr_find_undef(ent->expr);
+    if (sym) {
+        reltab_chain(sym, ent);
+    }
+
     return 0;
 }
 
+/**
+ * Retires an entry once it has been resolved and patched.
+ */
+static void reltab_retire(struct reloc_table *rt, struct reloc_ent *ent) {
+    if (ent->type & RT_EXPR) {
+        expr_free(ent->expr);
+    }
+
+    ent->type = RT_UNDEF;
+    ent->expr = NULL;
+    rt->retired++;
+}
+
+void reltab_retire_at(struct reloc_table *rt, int idx) {
+    struct reloc_ent *ent = rt ? vector_get(&rt->relocs, idx) : NULL;
+    if (ent && ent->type != RT_UNDEF) {
+        reltab_retire(rt, ent);
+    }
+}
+
+void reltab_detach_at(struct reloc_table *rt, int idx) {
+    struct reloc_ent *ent = rt ? vector_get(&rt->relocs, idx) : NULL;
+    struct symbol_ent *sym;
+
+    if (!ent || ent->type == RT_UNDEF) {
+        return;
+    }
+
+    /* The chain is the one of the first undefined symbol (see
+     * reltab_add_expr())
+     */
+    sym = ent->type & RT_EXPR
+        ? (struct symbol_ent *) expr_find_undef(ent->expr) : NULL;
+    if (sym && (ent->prev_fixup || sym->fixups == ent)) {
+        if (ent->prev_fixup) {
+            ent->prev_fixup->next_fixup = ent->next_fixup;
+        } else {
+            sym->fixups = ent->next_fixup;
+        }
+
+        if (ent->next_fixup) {
+            ent->next_fixup->prev_fixup = ent->prev_fixup;
+        }
+
+        ent->next_fixup = NULL;
+        ent->prev_fixup = NULL;
+    }
+
+    reltab_retire(rt, ent);
+}
+
+void reltab_resolve_sym(struct reloc_table *rt, struct symbol_ent *sym) {
+    struct reloc_ent *ent;
+    struct reloc_ent *next;
+
+    if (!rt || !sym || sym->type == ST_UNDEF) {
+        return;
+    }
+
+    ent = sym->fixups;
+    sym->fixups = NULL;
+    for (; ent; ent = next) {
+        uint8_t bytes[2];
+        int len;
+
+        next = ent->next_fixup;
+        ent->next_fixup = NULL;
+        ent->prev_fixup = NULL;
+        if (!(ent->type & RT_EXPR)) {
+            continue;
+        }
+
+        /* Might still be waiting on something else */
+        struct symbol_ent *undef =
+            (struct symbol_ent *) expr_find_undef(ent->expr);
+        if (undef) {
+            reltab_chain(undef, ent);
+            continue;
+        }
+
+        if (!rt->patch) {
+            continue;
+        }
+
+        len = reltab_encode_expr(ent->type & ~RT_EXPR, ent->sec, ent->value,
+                ent->expr, bytes);
+        if (len < 0) {
+            /* Leave it for the final pass to report */
+            continue;
+        } else if (len > 0 && rt->patch(ent->sec, ent->offset, bytes, len) == 0) {
+            reltab_retire(rt, ent);
+        }
+    }
+}
+
+void reltab_compact(struct reloc_table *rt) {
+    int j = 0;
+
+    if (!rt || rt->retired == 0) {
+        return;
+    }
+
+    for (int i = 0; i < rt->relocs.size; i++) {
+        struct reloc_ent *ent = rt->relocs.elements[i];
+        if (ent->type == RT_UNDEF) {
+            free(ent);
+        } else {
+            rt->relocs.elements[j++] = ent;
+        }
+    }
+
+    rt->relocs.size = j;
+    rt->retired = 0;
+}
+
+void reltab_clear(struct reloc_table *rt) {
+    if (!rt) {
+        return;
+    }
+
+    for (int i = 0; i < rt->relocs.size; i++) {
+        struct reloc_ent *ent = rt->relocs.elements[i];
+        if (ent->type & RT_EXPR) {
+            /* Every entry in the chain is being freed, so just drop it */
+            struct symbol_ent *sym =
+                (struct symbol_ent *) expr_find_undef(ent->expr);
+            if (sym) {
+                sym->fixups = NULL;
+            }
+
+            expr_free(ent->expr);
+        }
+
+        free(ent);
+    }
+
+    rt->relocs.size = 0;
+    rt->retired = 0;
+}
+
+int reltab_resolve_scope(struct reloc_table *rt, int start,
+        const struct symbol_table *scope) {
+    int errors = 0;
+
+    if (!rt || !scope) {
+        return 0;
+    }
+
+    for (int i = start; i < rt->relocs.size; i++) {
+        struct reloc_ent *ent = vector_get(&rt->relocs, i);
+        if (ent->type == RT_UNDEF) {
+            continue;
+        } else if (ent->type & RT_EXPR) {
+            ent->expr = expr_resolve_scope(ent->expr, scope);
+            if (!ent->expr || ent->expr->type == ET_INVAL) {
+                errors++;
+            }
+        } else if (symtab_search(scope, ent->sym->name) == ent->sym) {
+            /* Turn it into a constant expression so it doesn't point to the
+             * freed symbol
+             */
+            const struct symbol_ent *sym = ent->sym;
+            ent->type |= RT_EXPR;
+            if (sym->type == ST_UNDEF) {
+                ent->expr = expr_alloc_inval("Undefined local label");
+                errors++;
+            } else {
+                ent->expr = expr_alloc_const(sym->sec, sym->value);
+                if (!ent->expr) {
+                    errors++;
+                }
+            }
+        }
+    }
+
+    return errors;
+}
 
 /* vim: set tw=80 ft=c: */
@@ -8,6 +8,8 @@
 #ifndef RELOC_TABLE_H_
 #define RELOC_TABLE_H_
 
+#include <stdint.h>
+
 #include "expr.h"
 #include "section.h"
 #include "symbol_table.h"
@@ -38,6 +40,11 @@ enum reloc_type {
     RT_RST,
     RT_IM,
 
+    /**
+     * Bit index of bit, res, and set, which goes in bits 3 - 5 of the opcode.
+     */
+    RT_BIT,
+
     /**
      * For use only in assembling.
      * Indicates that the relocation points to an expression, not a symbol.
@@ -55,8 +62,8 @@ struct reloc_ent {
      * For symbols, this is an addend to the symbol.
      * For RT_REL_JUMP, this is the program counter which the relative jump is
      * relative to.
-     * For RT_RST and RT_IM, this is the instruction byte without the value
-     * applied.
+     * For RT_RST, RT_IM, and RT_BIT, this is the instruction byte without the
+     * value applied.
      */
     int value;
 
@@ -64,10 +71,47 @@ struct reloc_ent {
         const struct symbol_ent *sym;
         struct expr_node *expr;
     };
+
+    /**
+     * File (NULL for the standard input) and line the relocation was made on,
+     * for error messages.
+     */
+    const char *path;
+    int line;
+
+    /**
+     * Next and previous relocations in the fixup chain of the undefined symbol
+     * this one is waiting on.
+     */
+    struct reloc_ent *next_fixup;
+    struct reloc_ent *prev_fixup;
 };
 
+/**
+ * Function used to write resolved relocations into the output.
+ * @param sec Section of the data.
+ * @param offset Offset in @p sec.
+ * @param bytes Bytes to write.
+ * @param len Number of bytes.
+ * @return 0 on success, -1 on failure.
+ */
+typedef int (*reltab_patch_fn)(enum section sec, int offset,
+        const uint8_t *bytes, int len);
+
 struct reloc_table {
     struct vector relocs;
+
+    /**
+     * Number of entries which have been resolved and patched, but are still in
+     * @c relocs (with type RT_UNDEF).
+     */
+    int retired;
+
+    /**
+     * Used to patch relocations which are resolved before the end of
+     * assembly. If NULL, relocations are only resolved at the end.
+     */
+    reltab_patch_fn patch;
 };
 
 
@@ -80,6 +124,31 @@ struct reloc_table {
  */
 int reltab_in_range(enum reloc_type type, int value);
 
+/**
+ * Computes the bytes of a relocation.
+ * @param type Relocation type (without RT_EXPR).
+ * @param value Value field of the relocation entry.
+ * @param target Value of the symbol or expression the relocation references.
+ * @param[out] bytes Place to store the bytes (at most 2).
+ * @return Number of bytes written, or -1 if the result is out of range.
+ */
+int reltab_encode(enum reloc_type type, int value, int target,
+        uint8_t bytes[2]);
+
+/**
+ * Computes the bytes for an expression if it can be fully resolved now.
+ * The expression is not modified.
+ * @param type Relocation type (without RT_EXPR).
+ * @param sec Section the data is in.
+ * @param value Value field the relocation entry would have.
+ * @param expr Expression to evaluate.
+ * @param[out] bytes Place to store the bytes (at most 2).
+ * @return Number of bytes written, 0 if a relocation is still needed, or -1 if
+ * the expression is invalid or the result is out of range.
+ */
+int reltab_encode_expr(enum reloc_type type, enum section sec, int value,
+        const struct expr_node *expr, uint8_t bytes[2]);
+
 /**
  * Initialize a relocation table.
  * @param rt Table to initialize.
@@ -133,8 +202,11 @@ int reltab_add_sym(struct reloc_table *rt,
 
 /**
  * Adds an entry to a relocation table referencing an expression.
- * A deep clone of the expression will be made, so the original one can be freed
- * and/or modified.
+ * The entry holds its own reference to the expression (see expr_clone()), so
+ * the caller's can be released.
+ * If the expression references an undefined symbol, the entry is put in that
+ * symbol's fixup chain. Callers should try reltab_encode_expr() first: this
+ * never resolves the entry immediately.
  * @param rt Relocation table to add to.
  * @param type Type of the relocation.
  * @param sec Section of the relocation.
@@ -147,6 +219,59 @@ int reltab_add_expr(struct reloc_table *rt,
         enum reloc_type type, enum section sec, int offset, int value,
         const struct expr_node *expr);
 
+/**
+ * Patches the relocations waiting on a symbol which has just been defined.
+ * Entries which are fully resolved are written through the table's patch
+ * function and retired; entries still waiting on other undefined symbols are
+ * moved to their fixup chains. Entries which resolve to a section-relative
+ * value are left for the final pass.
+ * @param rt Relocation table.
+ * @param sym Symbol which was defined.
+ */
+void reltab_resolve_sym(struct reloc_table *rt, struct symbol_ent *sym);
+
+/**
+ * Retires an entry which has been applied outside of the table (it must not be
+ * waiting on any symbol). It is freed by the next reltab_compact().
+ * @param rt Relocation table.
+ * @param idx Index of the entry.
+ */
+void reltab_retire_at(struct reloc_table *rt, int idx);
+
+/**
+ * Retires an entry which is still waiting on a symbol, once it has been saved
+ * elsewhere. It is taken out of the symbol's fixup chain, and freed by the next
+ * reltab_compact().
+ * @param rt Relocation table.
+ * @param idx Index of the entry.
+ */
+void reltab_detach_at(struct reloc_table *rt, int idx);
+
+/**
+ * Removes retired entries from a relocation table.
+ * This changes the indices of the remaining entries.
+ * @param rt Relocation table.
+ */
+void reltab_compact(struct reloc_table *rt);
+
+/**
+ * Removes every entry from a relocation table, including ones still waiting on
+ * undefined symbols (which are taken out of the symbols' fixup chains).
+ * @param rt Relocation table.
+ */
+void reltab_clear(struct reloc_table *rt);
+
+/**
+ * Resolves references to the symbols of a local label scope in all relocation
+ * entries starting at an index.
+ * @param rt Relocation table.
+ * @param start Index of the first entry which could reference @p scope.
+ * @param scope Table of the symbols to resolve.
+ * @return Number of entries which reference undefined symbols in @p scope.
+ */
+int reltab_resolve_scope(struct reloc_table *rt, int start,
+        const struct symbol_table *scope);
+
 #endif /* RELOC_TABLE_H_ */
 
 /* vim: set tw=80 ft=c: */
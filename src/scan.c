@@ -0,0 +1,1099 @@
+/**
+ * @file scan.c
+ *
+ * Hand-written scanner, producing the same tokens as the flex one in z80.l.
+ * The rules (and their precedence) mirror z80.l; see there for the grammar of
+ * each token.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "cond.h"
+#include "include.h"
+#include "macro.h"
+#include "opcode.h"
+#include "scan.h"
+#include "tixasm.h"
+
+#include "z80.tab.h"
+
+extern FILE *yyin;
+extern int yylineno;
+void yyerror(char *s);
+
+#define ARR_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+/*
+ * Vector operations used to classify many bytes at once. Each mask has one bit
+ * per byte, set if the byte is in the class.
+ */
+#if defined(__AVX2__)
+#define SCAN_VEC_SIZE 32
+#define SCAN_VEC_ALL 0xFFFFFFFFu
+typedef __m256i scan_vec;
+#define scan_load(p)    _mm256_loadu_si256((const __m256i *) (p))
+#define scan_set1(c)    _mm256_set1_epi8(c)
+#define scan_eq(a, b)   _mm256_cmpeq_epi8(a, b)
+#define scan_gt(a, b)   _mm256_cmpgt_epi8(a, b)
+#define scan_or(a, b)   _mm256_or_si256(a, b)
+#define scan_and(a, b)  _mm256_and_si256(a, b)
+#define scan_mask(a)    ((uint32_t) _mm256_movemask_epi8(a))
+#elif defined(__SSE2__)
+#define SCAN_VEC_SIZE 16
+#define SCAN_VEC_ALL 0xFFFFu
+typedef __m128i scan_vec;
+#define scan_load(p)    _mm_loadu_si128((const __m128i *) (p))
+#define scan_set1(c)    _mm_set1_epi8(c)
+#define scan_eq(a, b)   _mm_cmpeq_epi8(a, b)
+#define scan_gt(a, b)   _mm_cmpgt_epi8(a, b)
+#define scan_or(a, b)   _mm_or_si128(a, b)
+#define scan_and(a, b)  _mm_and_si128(a, b)
+#define scan_mask(a)    ((uint32_t) _mm_movemask_epi8(a))
+#endif
+
+/**
+ * Start conditions, as in z80.l.
+ */
+enum scan_state {
+    SCAN_INITIAL,
+    SCAN_OPCODE,
+    SCAN_OPERAND,
+    SCAN_DIR_OP,
+    SCAN_MACRO_DEF,
+    SCAN_COND_SKIP,
+};
+
+/**
+ * A keyword (directive or register/flag name).
+ */
+struct scan_keyword {
+    /**
+     * Name in lowercase, without the '.' for directives.
+     */
+    const char *name;
+
+    /**
+     * Token to return, or 0 for none (.once).
+     */
+    int token;
+
+    /**
+     * State to switch to, or -1 to stay in the current one.
+     */
+    int state;
+};
+
+static const struct scan_keyword scan_directives[] = {
+    { "text",       T_TEXT,     -1 },
+    { "data",       T_DATA,     -1 },
+    { "abs",        T_ABS,      -1 },
+    { "org",        T_ORG,      SCAN_DIR_OP },
+    { "db",         T_DB,       SCAN_DIR_OP },
+    { "dw",         T_DW,       SCAN_DIR_OP },
+    { "fill",       T_FILL,     SCAN_DIR_OP },
+    { "equ",        T_EQU,      SCAN_DIR_OP },
+    { "define",     T_DEFINE,   SCAN_DIR_OP },
+    { "undefine",   T_UNDEFINE, SCAN_DIR_OP },
+    { "if",         T_IF,       SCAN_DIR_OP },
+    { "ifdef",      T_IFDEF,    SCAN_DIR_OP },
+    { "ifndef",     T_IFNDEF,   SCAN_DIR_OP },
+    { "else",       T_ELSE,     -1 },
+    { "endif",      T_ENDIF,    -1 },
+    { "include",    T_INCLUDE,  SCAN_DIR_OP },
+    { "incbin",     T_INCBIN,   SCAN_DIR_OP },
+    { "once",       0,          -1 },
+    { "macro",      T_MACRO,    SCAN_MACRO_DEF },
+    { "endm",       T_ENDM,     -1 },
+    { "rept",       T_REPT,     SCAN_DIR_OP },
+    { "endr",       T_ENDR,     -1 },
+};
+
+static const struct scan_keyword scan_registers[] = {
+    { "a",      T_A,    -1 },
+    { "b",      T_B,    -1 },
+    { "c",      T_C,    -1 },
+    { "d",      T_D,    -1 },
+    { "e",      T_E,    -1 },
+    { "f",      T_F,    -1 },
+    { "h",      T_H,    -1 },
+    { "l",      T_L,    -1 },
+    { "ixh",    T_IXH,  -1 },
+    { "ixl",    T_IXL,  -1 },
+    { "iyh",    T_IYH,  -1 },
+    { "iyl",    T_IYL,  -1 },
+    { "i",      T_I,    -1 },
+    { "r",      T_R,    -1 },
+    { "af",     T_AF,   -1 },
+    { "bc",     T_BC,   -1 },
+    { "de",     T_DE,   -1 },
+    { "hl",     T_HL,   -1 },
+    { "sp",     T_SP,   -1 },
+    { "ix",     T_IX,   -1 },
+    { "iy",     T_IY,   -1 },
+    { "nz",     T_fNZ,  -1 },
+    { "z",      T_fZ,   -1 },
+    { "nc",     T_fNC,  -1 },
+    { "po",     T_fPO,  -1 },
+    { "pe",     T_fPE,  -1 },
+    { "p",      T_fP,   -1 },
+    { "m",      T_fM,   -1 },
+};
+
+/**
+ * Length of the longest directive name.
+ */
+#define SCAN_MAX_DIRECTIVE 8
+
+/**
+ * Sizes of the keyword hash tables and the multipliers of their hash
+ * functions (see scan_hash()). These were chosen so that no two keywords in
+ * the same table collide, which scan_init_keywords() checks.
+ */
+#define SCAN_DIR_TABLE_SIZE 32
+#define SCAN_REG_TABLE_SIZE 64
+static const unsigned scan_dir_mult[3] = { 6, 13, 29 };
+static const unsigned scan_reg_mult[3] = { 2, 1, 39 };
+
+static const struct scan_keyword *scan_dir_table[SCAN_DIR_TABLE_SIZE];
+static const struct scan_keyword *scan_reg_table[SCAN_REG_TABLE_SIZE];
+static int scan_keywords_ready = 0;
+
+/**
+ * Input being scanned, and that of the files which included it.
+ */
+struct scan_input {
+    /**
+     * File being scanned, or NULL for yyin.
+     */
+    struct include_file *file;
+
+    const char *start;
+    const char *ptr;
+    const char *end;
+
+    /**
+     * Line number to resume at.
+     */
+    int lineno;
+};
+
+static struct scan_input scan_stack[INCLUDE_MAX_DEPTH];
+static int scan_depth = 0;
+
+static struct scan_input scan_cur = { NULL, NULL, NULL, NULL, 1 };
+
+/**
+ * Whether there is any input (a file was pushed or yyin was read).
+ */
+static int scan_loaded = 0;
+
+/**
+ * Contents of yyin, if it is being scanned.
+ */
+static char *scan_stream = NULL;
+
+static enum scan_state scan_state = SCAN_INITIAL;
+
+/**
+ * Nesting level of conditionals inside the branch being skipped.
+ */
+static int scan_skip_level = 0;
+
+/**
+ * Null-terminated copy of the current identifier.
+ */
+static char *scan_text = NULL;
+static size_t scan_text_cap = 0;
+
+static inline int scan_is_alpha(char c) {
+    return ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c == '_';
+}
+
+static inline int scan_is_ident(char c) {
+    return scan_is_alpha(c) || (c >= '0' && c <= '9');
+}
+
+static inline int scan_is_hex(char c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+#ifdef SCAN_VEC_SIZE
+/**
+ * Gets the mask of identifier characters ([0-9A-Za-z_]) in a vector.
+ * Bytes above 0x7F are negative in the signed comparisons, so they are never
+ * in a range.
+ */
+static inline uint32_t scan_ident_mask(scan_vec v) {
+    scan_vec lower = scan_or(v, scan_set1(0x20));
+    scan_vec alpha = scan_and(scan_gt(lower, scan_set1('a' - 1)),
+            scan_gt(scan_set1('z' + 1), lower));
+    scan_vec digit = scan_and(scan_gt(v, scan_set1('0' - 1)),
+            scan_gt(scan_set1('9' + 1), v));
+    scan_vec under = scan_eq(v, scan_set1('_'));
+    return scan_mask(scan_or(scan_or(alpha, digit), under));
+}
+#endif
+
+/**
+ * Finds the end of the line (the newline or the end of the input).
+ * This is also how comments are skipped.
+ */
+static const char *scan_find_eol(const char *p, const char *end) {
+#ifdef SCAN_VEC_SIZE
+    const scan_vec nl = scan_set1('\n');
+    while (end - p >= SCAN_VEC_SIZE) {
+        uint32_t mask = scan_mask(scan_eq(scan_load(p), nl));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+
+        p += SCAN_VEC_SIZE;
+    }
+#endif
+
+    while (p < end && *p != '\n') {
+        p++;
+    }
+
+    return p;
+}
+
+/**
+ * Finds the end of a run of spaces and tabs.
+ */
+static const char *scan_skip_blank(const char *p, const char *end) {
+#ifdef SCAN_VEC_SIZE
+    const scan_vec space = scan_set1(' ');
+    const scan_vec tab = scan_set1('\t');
+    while (end - p >= SCAN_VEC_SIZE) {
+        scan_vec v = scan_load(p);
+        uint32_t stop = ~scan_mask(scan_or(scan_eq(v, space), scan_eq(v, tab)))
+            & SCAN_VEC_ALL;
+        if (stop) {
+            return p + __builtin_ctz(stop);
+        }
+
+        p += SCAN_VEC_SIZE;
+    }
+#endif
+
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+
+    return p;
+}
+
+/**
+ * Finds the end of a run of identifier characters.
+ */
+static const char *scan_ident_end(const char *p, const char *end) {
+#ifdef SCAN_VEC_SIZE
+    while (end - p >= SCAN_VEC_SIZE) {
+        uint32_t stop = ~scan_ident_mask(scan_load(p)) & SCAN_VEC_ALL;
+        if (stop) {
+            return p + __builtin_ctz(stop);
+        }
+
+        p += SCAN_VEC_SIZE;
+    }
+#endif
+
+    while (p < end && scan_is_ident(*p)) {
+        p++;
+    }
+
+    return p;
+}
+
+/**
+ * Hashes a keyword candidate from its length and its first, second, and last
+ * characters (case-insensitively).
+ */
+static unsigned scan_hash(const char *s, size_t len,
+        const unsigned mult[3], unsigned size) {
+    unsigned c0 = (unsigned char) (s[0] | 0x20);
+    unsigned c1 = (unsigned char) ((len > 1 ? s[1] : s[0]) | 0x20);
+    unsigned cn = (unsigned char) (s[len-1] | 0x20);
+    return (c0 * mult[0] + c1 * mult[1] + cn * mult[2] + len) & (size - 1);
+}
+
+/**
+ * Fills a keyword hash table.
+ * @return 0 on success, -1 if two keywords collide.
+ */
+static int scan_fill_table(const struct scan_keyword **table, unsigned size,
+        const unsigned mult[3], const struct scan_keyword *kws, int count) {
+    for (int i = 0; i < count; i++) {
+        unsigned h = scan_hash(kws[i].name, strlen(kws[i].name), mult, size);
+        if (table[h]) {
+            return -1;
+        }
+
+        table[h] = &kws[i];
+    }
+
+    return 0;
+}
+
+static int scan_init_keywords(void) {
+    if (scan_keywords_ready) {
+        return 0;
+    }
+
+    if (scan_fill_table(scan_dir_table, SCAN_DIR_TABLE_SIZE, scan_dir_mult,
+                scan_directives, ARR_LEN(scan_directives)) < 0
+            || scan_fill_table(scan_reg_table, SCAN_REG_TABLE_SIZE,
+                scan_reg_mult, scan_registers, ARR_LEN(scan_registers)) < 0) {
+        fprintf(stderr, "Keyword hash tables are not perfect.\n");
+        return -1;
+    }
+
+    scan_keywords_ready = 1;
+    return 0;
+}
+
+/**
+ * Looks up a keyword in a hash table.
+ * @return The keyword, or NULL if @p s is not one.
+ */
+static const struct scan_keyword *scan_lookup(
+        const struct scan_keyword *const *table, unsigned size,
+        const unsigned mult[3], const char *s, size_t len) {
+    const struct scan_keyword *kw = table[scan_hash(s, len, mult, size)];
+    /* The name is only known to be at least len characters long once the
+     * bounded compare has matched (identifier text never contains a null).
+     */
+    if (kw && strncasecmp(kw->name, s, len) == 0 && kw->name[len] == '\0') {
+        return kw;
+    }
+
+    return NULL;
+}
+
+static const struct scan_keyword *scan_directive(const char *s, size_t len) {
+    return scan_lookup(scan_dir_table, SCAN_DIR_TABLE_SIZE, scan_dir_mult,
+            s, len);
+}
+
+static const struct scan_keyword *scan_register(const char *s, size_t len) {
+    return scan_lookup(scan_reg_table, SCAN_REG_TABLE_SIZE, scan_reg_mult,
+            s, len);
+}
+
+/**
+ * Makes a null-terminated copy of text from the input.
+ * @return The copy, which is valid until the next call, or NULL on failure.
+ */
+static const char *scan_copy(const char *s, size_t len) {
+    if (len + 1 > scan_text_cap) {
+        size_t cap = scan_text_cap ? scan_text_cap : 64;
+        while (cap < len + 1) {
+            cap *= 2;
+        }
+
+        char *text = realloc(scan_text, cap);
+        if (!text) {
+            return NULL;
+        }
+
+        scan_text = text;
+        scan_text_cap = cap;
+    }
+
+    memcpy(scan_text, s, len);
+    scan_text[len] = '\0';
+    return scan_text;
+}
+
+/**
+ * Reports a character no rule matches, like the catch-all rule in z80.l.
+ */
+static int scan_unknown(void) {
+    printf("Error: unknown token: %c\n", *scan_cur.ptr);
+    exit(EXIT_FAILURE);
+}
+
+static inline int scan_at_bol(void) {
+    return scan_cur.ptr == scan_cur.start || scan_cur.ptr[-1] == '\n';
+}
+
+static int scan_escape(int c) {
+    switch (c) {
+    case '0':
+        return 0;
+    case 'b':
+        return '\b';
+    case 'f':
+        return '\f';
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    case 't':
+        return '\t';
+    case 'v':
+        return '\v';
+    default:
+        /* Including '\\', '\'', and '"' */
+        return c;
+    }
+}
+
+/**
+ * Applies a directive.
+ * @return The token, or -1 if there is none.
+ */
+static int scan_apply_directive(const struct scan_keyword *kw) {
+    if (kw->state >= 0) {
+        scan_state = kw->state;
+    }
+
+    if (kw->token == 0) {
+        include_mark_once();
+        return -1;
+    }
+
+    return kw->token;
+}
+
+/**
+ * Parses a literal from a run of identifier characters.
+ * Every number rule has to be followed by a non-identifier character, so the
+ * literal has to span the whole run.
+ * @param p Start of the run.
+ * @param q End of the run.
+ * @return T_LITERAL, or -1 if the run is not a number.
+ */
+static int scan_number(const char *p, const char *q) {
+    size_t len = q - p;
+    char last = p[len-1] | 0x20;
+    const char *digits_end = q;
+    const char *text;
+    int base;
+    int i;
+
+    if (len >= 2 && last == 'b') {
+        for (i = 0; i < len - 1 && (p[i] == '0' || p[i] == '1'); i++);
+        if (i == len - 1) {
+            base = 2;
+            digits_end = q - 1;
+            goto NUMBER_PARSE;
+        }
+    }
+
+    if (len >= 2 && p[0] == '0') {
+        for (i = 1; i < len && p[i] >= '0' && p[i] <= '7'; i++);
+        if (i == len) {
+            base = 8;
+            goto NUMBER_PARSE;
+        }
+    }
+
+    for (i = 0; i < len && p[i] >= '0' && p[i] <= '9'; i++);
+    if (i == len) {
+        base = 10;
+        goto NUMBER_PARSE;
+    }
+
+    if (len >= 2 && last == 'h') {
+        for (i = 0; i < len - 1 && scan_is_hex(p[i]); i++);
+        if (i == len - 1) {
+            base = 16;
+            digits_end = q - 1;
+            goto NUMBER_PARSE;
+        }
+    }
+
+    return -1;
+
+NUMBER_PARSE:
+    if (!(text = scan_copy(p, digits_end - p))) {
+        return T_ERROR;
+    }
+
+    yylval.i = strtol(text, NULL, base);
+    scan_cur.ptr = q;
+    return T_LITERAL;
+}
+
+/**
+ * Parses a literal with a prefix ('%' for binary, '$' for hexadecimal).
+ * @return T_LITERAL, or -1 if the prefix is not followed by a number.
+ */
+static int scan_prefixed_number(int base) {
+    const char *p = scan_cur.ptr + 1;
+    const char *q = scan_ident_end(p, scan_cur.end);
+    const char *text;
+    const char *i;
+
+    if (p == q) {
+        return -1;
+    }
+
+    for (i = p; i < q; i++) {
+        if (base == 2 ? *i != '0' && *i != '1' : !scan_is_hex(*i)) {
+            return -1;
+        }
+    }
+
+    if (!(text = scan_copy(p, q - p))) {
+        return T_ERROR;
+    }
+
+    yylval.i = strtol(text, NULL, base);
+    scan_cur.ptr = q;
+    return T_LITERAL;
+}
+
+/**
+ * Parses a character literal.
+ */
+static int scan_char(void) {
+    const char *p = scan_cur.ptr;
+    const char *end = scan_cur.end;
+
+    if (end - p >= 3 && p[1] != '\'' && p[1] != '\\' && p[2] == '\'') {
+        yylval.i = p[1];
+        scan_cur.ptr = p + 3;
+        return T_LITERAL;
+    }
+
+    if (end - p >= 4 && p[1] == '\\' && p[2] != '\n' && p[3] == '\'') {
+        yylval.i = scan_escape(p[2]);
+        scan_cur.ptr = p + 4;
+        return T_LITERAL;
+    }
+
+    return scan_unknown();
+}
+
+/**
+ * Parses a string literal, unescaping it.
+ */
+static int scan_string(void) {
+    const char *p = scan_cur.ptr + 1;
+    const char *end = scan_cur.end;
+    const char *q;
+    char *dst;
+
+    /* Find the end first, since nothing matches an unterminated string */
+    for (q = p; q < end && *q != '"'; q++) {
+        if (*q == '\\') {
+            if (q + 1 >= end || q[1] == '\n') {
+                return scan_unknown();
+            }
+
+            q++;
+        }
+    }
+
+    if (q >= end) {
+        return scan_unknown();
+    }
+
+    yylval.str = malloc(q - p + 1);
+    if (!yylval.str) {
+        return T_ERROR;
+    }
+
+    for (dst = yylval.str; p < q; p++) {
+        *dst++ = *p == '\\' ? scan_escape(*++p) : *p;
+    }
+
+    *dst = '\0';
+    scan_cur.ptr = q + 1;
+    return T_STRING;
+}
+
+/**
+ * Scans a token at the start of a line (the INITIAL state).
+ */
+static int scan_initial(void) {
+    const char *p = scan_cur.ptr;
+    const char *end = scan_cur.end;
+    const char *q;
+    const char *text;
+
+    if (*p == '.') {
+        if (p + 1 >= end || !scan_is_alpha(p[1])) {
+            return scan_unknown();
+        }
+
+        q = scan_ident_end(p + 1, end);
+        if (q < end && *q == ':') {
+            scan_cur.ptr = q + 1;
+            return macro_label_token(p + 1, q - p - 1, 1);
+        }
+
+        scan_cur.ptr = q;
+
+        /* Directives win over labels of the same length */
+        const struct scan_keyword *kw = scan_directive(p + 1, q - p - 1);
+        if (kw) {
+            return scan_apply_directive(kw);
+        }
+
+        return macro_label_token(p + 1, q - p - 1, 0);
+    }
+
+    if (!scan_is_alpha(*p)) {
+        return scan_unknown();
+    }
+
+    q = scan_ident_end(p, end);
+    if (q < end && *q == ':') {
+        scan_cur.ptr = q + 1;
+        return macro_label_token(p, q - p, 0);
+    }
+
+    scan_cur.ptr = q;
+    if (!(text = scan_copy(p, q - p))) {
+        return T_ERROR;
+    }
+
+    /* Only accept macros, not other symbols. */
+    yylval.sym = symtab_search(asm_symbol_table, text);
+    if ((yylval.sym && yylval.sym->type == ST_MACRO)
+            || macro_unknown_token(text) == T_MACRO_CALL) {
+        scan_state = SCAN_OPERAND;
+        return T_MACRO_CALL;
+    }
+
+    return T_ERROR;
+}
+
+/**
+ * Scans an opcode or directive after leading whitespace (the OPCODE state).
+ */
+static int scan_opcode(void) {
+    const char *p = scan_cur.ptr;
+    const char *end = scan_cur.end;
+    const char *q;
+    const char *text;
+
+    if (*p == '.') {
+        /* There are no labels here, so the longest directive which is a
+         * prefix of the identifier matches.
+         */
+        q = scan_ident_end(p + 1, end);
+        size_t len = q - p - 1;
+        if (len > SCAN_MAX_DIRECTIVE) {
+            len = SCAN_MAX_DIRECTIVE;
+        }
+
+        for (; len > 0; len--) {
+            const struct scan_keyword *kw = scan_directive(p + 1, len);
+            if (kw) {
+                scan_cur.ptr = p + 1 + len;
+                return scan_apply_directive(kw);
+            }
+        }
+
+        return scan_unknown();
+    }
+
+    if (!scan_is_alpha(*p)) {
+        return scan_unknown();
+    }
+
+    q = scan_ident_end(p, end);
+    scan_cur.ptr = q;
+    if (!(text = scan_copy(p, q - p))) {
+        return T_ERROR;
+    }
+
+    yylval.oc = opcode_search(text);
+    if (yylval.oc) {
+        scan_state = SCAN_OPERAND;
+        return T_OPCODE;
+    }
+
+    /* Arguments are lexed as operands; yylex() collects and expands them */
+    yylval.sym = symtab_search(asm_symbol_table, text);
+    if ((yylval.sym && yylval.sym->type == ST_MACRO)
+            || macro_unknown_token(text) == T_MACRO_CALL) {
+        scan_state = SCAN_OPERAND;
+        return T_MACRO_CALL;
+    }
+
+    return 2;
+}
+
+/**
+ * Scans an operand of an instruction or directive (the OPERAND and DIR_OP
+ * states).
+ */
+static int scan_operand(void) {
+    const char *p = scan_cur.ptr;
+    const char *end = scan_cur.end;
+    char next = p + 1 < end ? p[1] : '\0';
+    const char *q;
+    const char *text;
+    int tok;
+
+    switch (*p) {
+    case '=':
+    case '!':
+        if (next != '=') {
+            return scan_unknown();
+        }
+
+        scan_cur.ptr += 2;
+        return *p == '=' ? T_EQ : T_NE;
+    case '<':
+    case '>':
+        /* ">=" is T_LE too, as in z80.l */
+        scan_cur.ptr += next == '=' ? 2 : 1;
+        return next == '=' ? T_LE : *p;
+    case '&':
+    case '|':
+        scan_cur.ptr += next == *p ? 2 : 1;
+        if (next == *p) {
+            return *p == '&' ? T_LAND : T_LOR;
+        }
+
+        return *p;
+    case '%':
+    case '$':
+        /* A number is longer than just the character */
+        tok = scan_prefixed_number(*p == '%' ? 2 : 16);
+        if (tok >= 0) {
+            return tok;
+        }
+
+        scan_cur.ptr++;
+        return *p;
+    case ',':
+    case '(':
+    case ')':
+    case '#':
+    case '+':
+    case '-':
+    case '*':
+    case '/':
+    case '^':
+        scan_cur.ptr++;
+        return *p;
+    case '\'':
+        return scan_char();
+    case '"':
+        /* Also in the OPERAND state, for macro arguments */
+        return scan_string();
+    case '.':
+        if (!scan_is_alpha(next)) {
+            return scan_unknown();
+        }
+
+        q = scan_ident_end(p + 1, end);
+        scan_cur.ptr = q;
+        if (!(text = scan_copy(p + 1, q - p - 1))) {
+            return T_ERROR;
+        }
+
+        return macro_local_symbol_token(text);
+    default:
+        break;
+    }
+
+    if (!scan_is_ident(*p)) {
+        return scan_unknown();
+    }
+
+    q = scan_ident_end(p, end);
+    if (scan_is_hex(*p) && (tok = scan_number(p, q)) >= 0) {
+        return tok;
+    } else if (!scan_is_alpha(*p)) {
+        return scan_unknown();
+    }
+
+    scan_cur.ptr = q;
+    if (scan_state == SCAN_OPERAND) {
+        const struct scan_keyword *kw;
+
+        if (q < end && *q == '\'' && q - p == 2
+                && strncasecmp(p, "af", 2) == 0) {
+            scan_cur.ptr++;
+            return T_sAF;
+        } else if ((kw = scan_register(p, q - p))) {
+            return kw->token;
+        }
+    }
+
+    if (!(text = scan_copy(p, q - p))) {
+        return T_ERROR;
+    }
+
+    /* This also turns macro parameters into argument slots when recording */
+    return macro_symbol_token(text);
+}
+
+/**
+ * Scans a parameter list of a macro definition (the MACRO_DEF state).
+ */
+static int scan_macro_def(void) {
+    const char *p = scan_cur.ptr;
+    const char *q;
+
+    if (*p == ',') {
+        scan_cur.ptr++;
+        return ',';
+    } else if (!scan_is_alpha(*p)) {
+        return scan_unknown();
+    }
+
+    q = scan_ident_end(p, scan_cur.end);
+    scan_cur.ptr = q;
+
+    /* Parameter names are not symbols, so don't touch the symbol table */
+    yylval.str = strndup(p, q - p);
+    return T_IDENT;
+}
+
+/**
+ * Determines whether a word matches a conditional directive name.
+ */
+static int scan_word_is(const char *word, size_t len, const char *name) {
+    return strncasecmp(word, name, len) == 0 && name[len] == '\0';
+}
+
+/**
+ * Skips lines of a false conditional branch (the COND_SKIP state).
+ * Only lines starting with a conditional directive are looked at.
+ * @return 0 if the input ended first, -1 once the branch is done.
+ */
+static int scan_cond_skip(void) {
+    while (scan_cur.ptr < scan_cur.end) {
+        const char *eol = scan_find_eol(scan_cur.ptr, scan_cur.end);
+        const char *p = scan_skip_blank(scan_cur.ptr, eol);
+
+        if (scan_at_bol() && p < eol && *p == '.') {
+            const char *q = scan_ident_end(p + 1, eol);
+            size_t len = q - p - 1;
+
+            /* The directive has to be followed by the end of the line, a
+             * blank, or a comment.
+             */
+            if (q == eol || *q == ' ' || *q == '\t' || *q == ';') {
+                if (scan_word_is(p + 1, len, "if")
+                        || scan_word_is(p + 1, len, "ifdef")
+                        || scan_word_is(p + 1, len, "ifndef")) {
+                    scan_skip_level++;
+                } else if (scan_word_is(p + 1, len, "else")) {
+                    if (scan_skip_level == 0 && cond_skip_else()) {
+                        scan_cur.ptr = eol;
+                        scan_state = SCAN_INITIAL;
+                        return -1;
+                    }
+                } else if (scan_word_is(p + 1, len, "endif")) {
+                    if (scan_skip_level == 0) {
+                        cond_skip_endif();
+                        scan_cur.ptr = eol;
+                        scan_state = SCAN_INITIAL;
+                        return -1;
+                    }
+
+                    scan_skip_level--;
+                }
+            }
+        }
+
+        scan_cur.ptr = eol;
+        if (scan_cur.ptr < scan_cur.end) {
+            scan_cur.ptr++;
+            yylineno++;
+        }
+    }
+
+    yyerror("Missing .endif");
+    scan_state = SCAN_INITIAL;
+    return 0;
+}
+
+/**
+ * Reads all of yyin (or stdin) to be scanned.
+ * @return 0 on success, -1 on failure.
+ */
+static int scan_load_stream(void) {
+    FILE *stream = yyin ? yyin : stdin;
+    size_t size = 0, cap = 4096;
+    size_t n;
+
+    scan_stream = malloc(cap);
+    if (!scan_stream) {
+        return -1;
+    }
+
+    while ((n = fread(scan_stream + size, 1, cap - size, stream)) > 0) {
+        size += n;
+        if (size == cap) {
+            char *data = realloc(scan_stream, cap * 2);
+            if (!data) {
+                free(scan_stream);
+                scan_stream = NULL;
+                return -1;
+            }
+
+            scan_stream = data;
+            cap *= 2;
+        }
+    }
+
+    scan_cur.file = NULL;
+    scan_cur.start = scan_cur.ptr = scan_stream;
+    scan_cur.end = scan_stream + size;
+    scan_loaded = 1;
+    yylineno = 1;
+    return 0;
+}
+
+int scan_push_file(struct include_file *file) {
+    if (scan_depth >= INCLUDE_MAX_DEPTH) {
+        yyerror("Includes nested too deeply");
+        return -1;
+    }
+
+    if (scan_init_keywords() < 0) {
+        return -1;
+    }
+
+    scan_cur.lineno = yylineno;
+    scan_stack[scan_depth++] = scan_cur;
+
+    scan_cur.file = file;
+    scan_cur.start = scan_cur.ptr = file->data;
+    scan_cur.end = file->data + file->size;
+    scan_state = SCAN_INITIAL;
+    file->open_count++;
+    file->active++;
+    scan_loaded = 1;
+    yylineno = 1;
+    return 0;
+}
+
+/**
+ * Returns to the file which included the current one.
+ * @return 0 on success, -1 if the current file is the top-level one.
+ */
+static int scan_pop_file(void) {
+    if (scan_depth == 0 || !scan_stack[scan_depth-1].start) {
+        /* The top-level input is never popped, so it stays at its end */
+        return -1;
+    }
+
+    scan_cur.file->active--;
+    scan_cur = scan_stack[--scan_depth];
+    yylineno = scan_cur.lineno;
+    return 0;
+}
+
+int scan_next(void) {
+    int tok;
+
+    if (!scan_loaded && (scan_init_keywords() < 0 || scan_load_stream() < 0)) {
+        return 0;
+    }
+
+    for (;;) {
+        if (scan_state == SCAN_COND_SKIP) {
+            if (scan_cond_skip() == 0) {
+                return 0;
+            }
+
+            continue;
+        }
+
+        if (scan_cur.ptr == scan_cur.end) {
+            if (scan_pop_file() < 0) {
+                return 0;
+            }
+
+            /* The last line of an included file may not have a newline */
+            scan_state = SCAN_INITIAL;
+            return T_EOL;
+        }
+
+        switch (*scan_cur.ptr) {
+        case ' ':
+        case '\t':
+            if (scan_at_bol()) {
+                scan_state = SCAN_OPCODE;
+            }
+
+            scan_cur.ptr = scan_skip_blank(scan_cur.ptr, scan_cur.end);
+            continue;
+        case ';':
+            scan_cur.ptr = scan_find_eol(scan_cur.ptr, scan_cur.end);
+            continue;
+        case '\n':
+            scan_cur.ptr++;
+            yylineno++;
+            scan_state = SCAN_INITIAL;
+            return T_EOL;
+        case '\\':
+            scan_cur.ptr++;
+            scan_state = SCAN_INITIAL;
+            return T_EOL;
+        default:
+            break;
+        }
+
+        switch (scan_state) {
+        case SCAN_INITIAL:
+            tok = scan_initial();
+            break;
+        case SCAN_OPCODE:
+            tok = scan_opcode();
+            break;
+        case SCAN_MACRO_DEF:
+            tok = scan_macro_def();
+            break;
+        default:
+            tok = scan_operand();
+            break;
+        }
+
+        /* Some rules (.once) don't return anything */
+        if (tok >= 0) {
+            return tok;
+        }
+    }
+}
+
+void scan_skip_cond(void) {
+    scan_skip_level = 0;
+    scan_state = SCAN_COND_SKIP;
+}
+
+struct include_file *scan_current_file(void) {
+    return scan_cur.file;
+}
+
+void scan_reset(void) {
+    while (scan_pop_file() == 0);
+
+    scan_depth = 0;
+    scan_cur.file = NULL;
+    scan_cur.start = scan_cur.ptr = scan_cur.end = NULL;
+    scan_loaded = 0;
+    scan_state = SCAN_INITIAL;
+
+    free(scan_stream);
+    scan_stream = NULL;
+    free(scan_text);
+    scan_text = NULL;
+    scan_text_cap = 0;
+    yylineno = 1;
+}
+
+/* vim: set tw=80 ft=c: */
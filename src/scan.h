@@ -0,0 +1,72 @@
+/**
+ * @file scan.h
+ */
+
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include "include.h"
+
+/**
+ * Scanners which can tokenize the input.
+ * Both produce the same tokens; the hand-written one avoids the size of the
+ * flex DFA and its backtracking over trailing context, and scans line ends and
+ * identifiers several bytes at a time with SIMD instructions when they are
+ * available (SSE2, or AVX2 if compiled with -mavx2).
+ */
+enum lex_scanner {
+    LEX_FLEX,
+    LEX_SIMD,
+};
+
+/* These are implemented in z80.l, next to the other lex_*() functions. */
+
+/**
+ * Selects the scanner used by yylex_raw(), lex_push_file(), etc.
+ * This should be done before any input is pushed (or after lex_reset()).
+ * @param scanner Scanner to use.
+ */
+void lex_set_scanner(enum lex_scanner scanner);
+
+/**
+ * Drops all of the input of the current scanner, so that a new top-level file
+ * can be pushed.
+ */
+void lex_reset(void);
+
+/* The hand-written scanner. These correspond to the lex_*() functions. */
+
+/**
+ * Reads the next token.
+ * If no file has been pushed, the whole of yyin (or stdin) is read and
+ * scanned.
+ * @return The token, or 0 at the end of the input.
+ */
+int scan_next(void);
+
+/**
+ * Starts scanning a file, as with lex_push_file().
+ * @param file File to scan.
+ * @return 0 on success, -1 if includes are nested too deeply.
+ */
+int scan_push_file(struct include_file *file);
+
+/**
+ * Skips the rest of a false conditional branch, as with lex_skip_cond().
+ */
+void scan_skip_cond(void);
+
+/**
+ * Gets the file currently being scanned.
+ * @return The file, or NULL if reading from yyin.
+ */
+struct include_file *scan_current_file(void);
+
+/**
+ * Drops all of the input, as with lex_reset().
+ */
+void scan_reset(void);
+
+#endif /* SCAN_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,60 @@
+/**
+ * @file section.c
+ */
+
+#include <stdlib.h>
+
+#include "section.h"
+
+int secbuf_init(struct section_buf *buf) {
+    if (!buf) {
+        return -1;
+    }
+
+    buf->data = malloc(SECBUF_DEF_INIT_CAP);
+    if (!buf->data) {
+        return -1;
+    }
+
+    buf->size = 0;
+    buf->capacity = SECBUF_DEF_INIT_CAP;
+    return 0;
+}
+
+void secbuf_destroy(struct section_buf *buf) {
+    if (!buf) {
+        return;
+    }
+
+    free(buf->data);
+    buf->data = NULL;
+    buf->size = buf->capacity = 0;
+}
+
+uint8_t *secbuf_reserve(struct section_buf *buf, size_t n) {
+    if (!buf) {
+        return NULL;
+    }
+
+    if (buf->size + n > buf->capacity) {
+        /* Multiply the capacity by 2 until it fits */
+        size_t capacity = buf->capacity ? buf->capacity : SECBUF_DEF_INIT_CAP;
+        while (capacity < buf->size + n) {
+            capacity *= 2;
+        }
+
+        uint8_t *data = realloc(buf->data, capacity);
+        if (!data) {
+            return NULL;
+        }
+
+        buf->data = data;
+        buf->capacity = capacity;
+    }
+
+    uint8_t *ptr = buf->data + buf->size;
+    buf->size += n;
+    return ptr;
+}
+
+/* vim: set tw=80 ft=c: */
@@ -8,6 +8,14 @@
 #ifndef SECTION_H_
 #define SECTION_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Default initial capacity of a section buffer.
+ */
+#define SECBUF_DEF_INIT_CAP 256
+
 /**
  * Section identifiers.
  */
@@ -22,6 +30,46 @@ enum section {
     SEC_ABS = SEC_DATA | SEC_TEXT,
 };
 
+/**
+ * Contiguous, growable buffer holding the bytes of a section.
+ */
+struct section_buf {
+    /**
+     * Number of bytes in the section.
+     */
+    size_t size;
+
+    /**
+     * Allocated size of @c data.
+     */
+    size_t capacity;
+
+    uint8_t *data;
+};
+
+/**
+ * Initializes a section buffer with the default capacity.
+ * @param buf Buffer to initialize.
+ * @return 0 on success, -1 on failure.
+ */
+int secbuf_init(struct section_buf *buf);
+
+/**
+ * Destroys (frees) a section buffer.
+ * @param buf Buffer to destroy.
+ */
+void secbuf_destroy(struct section_buf *buf);
+
+/**
+ * Appends space for bytes to a section buffer.
+ * The returned pointer is only valid until the next call, as the buffer may be
+ * moved when it grows.
+ * @param buf Buffer to append to.
+ * @param n Number of bytes to reserve.
+ * @return Pointer to the reserved bytes, or NULL on failure.
+ */
+uint8_t *secbuf_reserve(struct section_buf *buf, size_t n);
+
 #endif /* SECTION_H_ */
 
 /* vim: set tw=80 ft=c: */
@@ -0,0 +1,351 @@
+/**
+ * @file snapshot.c
+ *
+ * The .tixs format is, with all integers little-endian:
+ *
+ *   header:  "TIXS", u16 version, u16 reserved,
+ *            u32 symbol count, u32 bucket count, u32 string table size
+ *   buckets: u32 displacement
+ *   symbols: u32 name offset, i32 value (in the slot given by the hash)
+ *   string table (null-terminated names)
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+#define SNAP_HEADER_SIZE 20
+#define SNAP_SYM_SIZE 8
+
+static void snap_put_u16(uint8_t *buf, uint16_t v) {
+    buf[0] = v & 0xFF;
+    buf[1] = v >> 8;
+}
+
+static void snap_put_u32(uint8_t *buf, uint32_t v) {
+    buf[0] = v & 0xFF;
+    buf[1] = (v >> 8) & 0xFF;
+    buf[2] = (v >> 16) & 0xFF;
+    buf[3] = v >> 24;
+}
+
+static uint16_t snap_get_u16(const uint8_t *buf) {
+    return buf[0] | buf[1] << 8;
+}
+
+static uint32_t snap_get_u32(const uint8_t *buf) {
+    return (uint32_t) buf[0] | (uint32_t) buf[1] << 8
+        | (uint32_t) buf[2] << 16 | (uint32_t) buf[3] << 24;
+}
+
+/**
+ * Hash of a name, from a family of hash functions picked by @p seed.
+ */
+static uint32_t snap_hash(const char *name, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed * 0x9E3779B9u;
+    while (*name) {
+        hash ^= (uint8_t) *name++;
+        hash *= 16777619u;
+    }
+
+    /* Mix the last characters into the upper bits too */
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * Bucket of the index while it is built.
+ */
+struct snap_bucket {
+    int count;
+    int first;
+};
+
+static int snap_bucket_cmp(const void *a, const void *b) {
+    const struct snap_bucket *b1 = a;
+    const struct snap_bucket *b2 = b;
+    return b2->count - b1->count;
+}
+
+/**
+ * Finds a displacement for each bucket so that every symbol gets its own slot.
+ * Larger buckets are placed first, while there are more free slots.
+ * @param syms Symbols to place.
+ * @param count Number of symbols.
+ * @param bucket_count Number of buckets.
+ * @param[out] disps Displacement of each bucket.
+ * @param[out] slots Index in @p syms of the symbol in each slot.
+ * @return 0 on success, -1 on failure.
+ */
+static int snap_build_index(const struct obj_symbol *syms, uint32_t count,
+        uint32_t bucket_count, uint32_t *disps, uint32_t *slots) {
+    struct snap_bucket *buckets = calloc(bucket_count, sizeof(*buckets));
+    int *order = malloc(count * sizeof(*order));
+    int *next = malloc(count * sizeof(*next));
+    uint32_t *tried = calloc(count, sizeof(*tried));
+    int ret = -1;
+
+    if (!buckets || !order || !next || !tried) {
+        goto BUILD_END;
+    }
+
+    /* Link the symbols of each bucket together */
+    for (uint32_t i = 0; i < bucket_count; i++) {
+        buckets[i].first = -1;
+        disps[i] = 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        struct snap_bucket *b = &buckets[snap_hash(syms[i].name, 0)
+            % bucket_count];
+        next[i] = b->first;
+        b->first = i;
+        b->count++;
+        slots[i] = UINT32_MAX;
+    }
+
+    /* Sorting loses the bucket indices, so recompute them from a member */
+    qsort(buckets, bucket_count, sizeof(*buckets), snap_bucket_cmp);
+    for (uint32_t i = 0; i < bucket_count && buckets[i].count > 0; i++) {
+        const struct snap_bucket *b = &buckets[i];
+        uint32_t idx = snap_hash(syms[b->first].name, 0) % bucket_count;
+        uint32_t d;
+
+        for (d = 1; d < SNAPSHOT_MAX_TRIES; d++) {
+            int n = 0;
+
+            for (int s = b->first; s >= 0; s = next[s], n++) {
+                uint32_t slot = snap_hash(syms[s].name, d) % count;
+
+                /* Slots taken by earlier members for this displacement are
+                 * marked with it
+                 */
+                if (slots[slot] != UINT32_MAX || tried[slot] == d) {
+                    break;
+                }
+
+                tried[slot] = d;
+                order[n] = slot;
+            }
+
+            if (n == b->count) {
+                break;
+            }
+
+            /* Clear the marks for the next displacement */
+            for (int j = 0; j < n; j++) {
+                tried[order[j]] = 0;
+            }
+        }
+
+        if (d == SNAPSHOT_MAX_TRIES) {
+            goto BUILD_END;
+        }
+
+        disps[idx] = d;
+        for (int s = b->first, n = 0; s >= 0; s = next[s], n++) {
+            slots[order[n]] = s;
+        }
+    }
+
+    ret = 0;
+
+BUILD_END:
+    free(buckets);
+    free(order);
+    free(next);
+    free(tried);
+    return ret;
+}
+
+int snapshot_write(const struct object *obj, const char *path) {
+    uint8_t header[SNAP_HEADER_SIZE] = { 0 };
+    uint32_t count = obj->sym_count;
+    uint32_t bucket_count = count / SNAPSHOT_BUCKET_SIZE + 1;
+    uint32_t strtab_size = 0;
+    uint32_t *disps = malloc(bucket_count * sizeof(*disps));
+    uint32_t *slots = malloc((count + 1) * sizeof(*slots));
+    uint32_t *name_offs = malloc((count + 1) * sizeof(*name_offs));
+    FILE *file = NULL;
+    int ret = -1;
+
+    if (!disps || !slots || !name_offs) {
+        goto WRITE_END;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        if (obj->sections[i].size > 0) {
+            fprintf(stderr, "%s has output, which can't be put in a "
+                    "snapshot.\n", obj->name);
+            goto WRITE_END;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const struct obj_symbol *sym = &obj->symbols[i];
+        if (sym->sec != SEC_ABS) {
+            fprintf(stderr, "Symbol %s in %s is not absolute, so it can't be "
+                    "put in a snapshot.\n", sym->name, obj->name);
+            goto WRITE_END;
+        }
+
+        name_offs[i] = strtab_size;
+        strtab_size += strlen(sym->name) + 1;
+    }
+
+    if (count > 0 && snap_build_index(obj->symbols, count, bucket_count,
+                disps, slots) < 0) {
+        fprintf(stderr, "Could not build the index of %s.\n", path);
+        goto WRITE_END;
+    }
+
+    file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        goto WRITE_END;
+    }
+
+    memcpy(header, SNAPSHOT_MAGIC, 4);
+    snap_put_u16(&header[4], SNAPSHOT_VERSION);
+    snap_put_u32(&header[8], count);
+    snap_put_u32(&header[12], bucket_count);
+    snap_put_u32(&header[16], strtab_size);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        goto WRITE_FAIL;
+    }
+
+    for (uint32_t i = 0; i < bucket_count; i++) {
+        uint8_t rec[4];
+        snap_put_u32(rec, disps[i]);
+        if (fwrite(rec, 1, sizeof(rec), file) != sizeof(rec)) {
+            goto WRITE_FAIL;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t rec[SNAP_SYM_SIZE];
+        snap_put_u32(&rec[0], name_offs[slots[i]]);
+        snap_put_u32(&rec[4], obj->symbols[slots[i]].value);
+        if (fwrite(rec, 1, sizeof(rec), file) != sizeof(rec)) {
+            goto WRITE_FAIL;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const char *name = obj->symbols[i].name;
+        if (fwrite(name, 1, strlen(name) + 1, file) != strlen(name) + 1) {
+            goto WRITE_FAIL;
+        }
+    }
+
+    ret = 0;
+    goto WRITE_END;
+
+WRITE_FAIL:
+    fprintf(stderr, "Could not write %s.\n", path);
+
+WRITE_END:
+    if (file && fclose(file) != 0) {
+        ret = -1;
+    }
+
+    free(disps);
+    free(slots);
+    free(name_offs);
+    return ret;
+}
+
+int snapshot_open(struct snapshot *snap, const char *path) {
+    struct stat st;
+    const uint8_t *data;
+    uint64_t expected;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    if (st.st_size < SNAP_HEADER_SIZE) {
+        close(fd);
+        goto OPEN_INVALID;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Could not map %s.\n", path);
+        return -1;
+    }
+
+    snap->data = data;
+    snap->size = st.st_size;
+    snap->count = snap_get_u32(&data[8]);
+    snap->bucket_count = snap_get_u32(&data[12]);
+    snap->names_size = snap_get_u32(&data[16]);
+
+    expected = SNAP_HEADER_SIZE + (uint64_t) snap->bucket_count * 4
+        + (uint64_t) snap->count * SNAP_SYM_SIZE + snap->names_size;
+    if (memcmp(data, SNAPSHOT_MAGIC, 4) != 0
+            || snap_get_u16(&data[4]) != SNAPSHOT_VERSION
+            || snap->bucket_count == 0 || expected != snap->size
+            || (snap->names_size > 0 && data[snap->size - 1] != '\0')) {
+        snapshot_close(snap);
+        goto OPEN_INVALID;
+    }
+
+    snap->disps = &data[SNAP_HEADER_SIZE];
+    snap->syms = &snap->disps[snap->bucket_count * 4];
+    snap->names = (const char *) &snap->syms[snap->count * SNAP_SYM_SIZE];
+    return 0;
+
+OPEN_INVALID:
+    fprintf(stderr, "%s is not a symbol snapshot.\n", path);
+    return -1;
+}
+
+void snapshot_close(struct snapshot *snap) {
+    if (snap->data) {
+        munmap((void *) snap->data, snap->size);
+        snap->data = NULL;
+    }
+}
+
+int snapshot_find(const struct snapshot *snap, const char *name, int *value) {
+    uint32_t disp, name_off;
+    const uint8_t *sym;
+
+    if (snap->count == 0) {
+        return 0;
+    }
+
+    disp = snap_get_u32(&snap->disps[
+            snap_hash(name, 0) % snap->bucket_count * 4]);
+    sym = &snap->syms[snap_hash(name, disp) % snap->count * SNAP_SYM_SIZE];
+
+    /* Names which aren't in the table still land in some slot */
+    name_off = snap_get_u32(&sym[0]);
+    if (name_off >= snap->names_size
+            || strcmp(&snap->names[name_off], name) != 0) {
+        return 0;
+    }
+
+    *value = (int32_t) snap_get_u32(&sym[4]);
+    return 1;
+}
+
+/* vim: set tw=80 ft=c: */
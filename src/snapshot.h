@@ -0,0 +1,90 @@
+/**
+ * @file snapshot.h
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "object.h"
+
+#define SNAPSHOT_MAGIC "TIXS"
+
+#define SNAPSHOT_VERSION 1
+
+/**
+ * Average number of symbols in each bucket of the index. Fewer makes the index
+ * larger, but faster to build.
+ */
+#define SNAPSHOT_BUCKET_SIZE 4
+
+/**
+ * Number of displacements tried for a bucket before building the index fails.
+ */
+#define SNAPSHOT_MAX_TRIES 0x1000000
+
+/**
+ * Precompiled table of absolute symbols (like the equates of an OS header),
+ * which is mapped into memory and searched in place.
+ *
+ * Symbols are found through a minimal perfect hash: the name's hash picks a
+ * bucket, and the bucket's displacement picks a second hash function, which
+ * gives a different slot for every symbol in the table. Each lookup reads one
+ * displacement and one slot, and compares one name (to reject names which are
+ * not in the table).
+ */
+struct snapshot {
+    /**
+     * Mapped contents of the file.
+     */
+    const uint8_t *data;
+    size_t size;
+
+    uint32_t count;
+    uint32_t bucket_count;
+
+    /**
+     * Displacements of the buckets, symbol slots, and null-terminated names.
+     */
+    const uint8_t *disps;
+    const uint8_t *syms;
+    const char *names;
+    uint32_t names_size;
+};
+
+/**
+ * Writes the symbols of an object to a snapshot. The object may only define
+ * absolute symbols, and can't have any output.
+ * @param obj Object to take the symbols from.
+ * @param path Path of the snapshot.
+ * @return 0 on success, -1 on failure (which is reported).
+ */
+int snapshot_write(const struct object *obj, const char *path);
+
+/**
+ * Maps a snapshot into memory.
+ * @param snap Snapshot to initialize.
+ * @param path Path of the snapshot.
+ * @return 0 on success, -1 on failure (which is reported).
+ */
+int snapshot_open(struct snapshot *snap, const char *path);
+
+/**
+ * Unmaps a snapshot.
+ */
+void snapshot_close(struct snapshot *snap);
+
+/**
+ * Searches for a symbol in a snapshot.
+ * @param snap Snapshot to search.
+ * @param name Name of the symbol.
+ * @param[out] value Value of the symbol, if found.
+ * @return 1 if the symbol was found, 0 if not.
+ */
+int snapshot_find(const struct snapshot *snap, const char *name, int *value);
+
+#endif /* SNAPSHOT_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,407 @@
+/**
+ * @file stream.c
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "reloc_table.h"
+#include "stream.h"
+
+/**
+ * Where a spilled expression was made, written before its operations.
+ */
+struct stream_expr_origin {
+    const char *path;
+    int line;
+};
+
+/**
+ * Opens an anonymous temporary file.
+ * @return Its descriptor, or -1 on failure.
+ */
+static int stream_tmp(void) {
+    FILE *file = tmpfile();
+    int fd;
+
+    if (!file) {
+        return -1;
+    }
+
+    /* Keep the file open after the stdio stream is closed */
+    fd = dup(fileno(file));
+    fclose(file);
+    return fd;
+}
+
+int stream_open(struct stream *st, const char *path, const char *name) {
+    st->name = name;
+    st->spill_count = 0;
+    st->spilled = 0;
+    st->spill_fd = -1;
+    st->expr_fd = -1;
+    st->expr_buffered = 0;
+    st->expr_size = 0;
+    st->resolve = NULL;
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        st->sec_fd[i] = -1;
+        st->size[i] = 0;
+    }
+
+    st->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (st->fd < 0) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return -1;
+    }
+
+    st->sec_fd[OBJ_SEC_IDX(SEC_TEXT)] = st->fd;
+    st->sec_fd[OBJ_SEC_IDX(SEC_DATA)] = stream_tmp();
+    st->sec_fd[OBJ_SEC_IDX(SEC_ABS)] = stream_tmp();
+    st->spill_fd = stream_tmp();
+    st->expr_fd = stream_tmp();
+    if (st->sec_fd[OBJ_SEC_IDX(SEC_DATA)] < 0
+            || st->sec_fd[OBJ_SEC_IDX(SEC_ABS)] < 0 || st->spill_fd < 0
+            || st->expr_fd < 0) {
+        perror("tmpfile");
+        stream_close(st);
+        return -1;
+    }
+
+    return 0;
+}
+
+void stream_close(struct stream *st) {
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        if (st->sec_fd[i] >= 0 && st->sec_fd[i] != st->fd) {
+            close(st->sec_fd[i]);
+        }
+
+        st->sec_fd[i] = -1;
+    }
+
+    if (st->spill_fd >= 0) {
+        close(st->spill_fd);
+        st->spill_fd = -1;
+    }
+
+    if (st->expr_fd >= 0) {
+        close(st->expr_fd);
+        st->expr_fd = -1;
+    }
+
+    if (st->fd >= 0) {
+        close(st->fd);
+        st->fd = -1;
+    }
+}
+
+/**
+ * Writes a whole buffer at an offset of a file.
+ * @return 0 on success, -1 on failure.
+ */
+static int stream_pwrite(int fd, const void *data, size_t n, off_t offset) {
+    const uint8_t *ptr = data;
+
+    while (n > 0) {
+        ssize_t len = pwrite(fd, ptr, n, offset);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            perror("pwrite");
+            return -1;
+        }
+
+        ptr += len;
+        offset += len;
+        n -= len;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads up to @p n bytes at an offset of a file.
+ * @return Number of bytes read (less than @p n only at the end of the file), or
+ * -1 on failure.
+ */
+static ssize_t stream_pread(int fd, void *data, size_t n, off_t offset) {
+    uint8_t *ptr = data;
+    size_t total = 0;
+
+    while (total < n) {
+        ssize_t len = pread(fd, ptr + total, n - total, offset + total);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            perror("pread");
+            return -1;
+        } else if (len == 0) {
+            break;
+        }
+
+        total += len;
+    }
+
+    return total;
+}
+
+int stream_write(struct stream *st, enum section sec,
+        const uint8_t *data, size_t n) {
+    int idx = OBJ_SEC_IDX(sec);
+
+    if (stream_pwrite(st->sec_fd[idx], data, n, st->size[idx]) < 0) {
+        return -1;
+    }
+
+    st->size[idx] += n;
+    return 0;
+}
+
+int stream_patch(struct stream *st, enum section sec, int offset,
+        const uint8_t *bytes, int len) {
+    int idx = OBJ_SEC_IDX(sec);
+
+    if (offset < 0 || offset + len > st->size[idx]) {
+        return -1;
+    }
+
+    return stream_pwrite(st->sec_fd[idx], bytes, len, offset);
+}
+
+/**
+ * Writes the buffered spilled relocations to the spill file.
+ * @return 0 on success, -1 on failure.
+ */
+static int stream_flush_spill(struct stream *st) {
+    off_t offset = (st->spilled - st->spill_count) * sizeof(st->spill[0]);
+
+    if (stream_pwrite(st->spill_fd, st->spill,
+                st->spill_count * sizeof(st->spill[0]), offset) < 0) {
+        return -1;
+    }
+
+    st->spill_count = 0;
+    return 0;
+}
+
+int stream_spill(struct stream *st, const struct obj_reloc *rel) {
+    if (rel->sym >= 0) {
+        return -1;
+    }
+
+    st->spill[st->spill_count++] = *rel;
+    st->spilled++;
+    if (st->spill_count == STREAM_SPILL_BATCH) {
+        return stream_flush_spill(st);
+    }
+
+    return 0;
+}
+
+/**
+ * Writes the buffered expressions to their spill file.
+ * @return 0 on success, -1 on failure.
+ */
+static int stream_flush_exprs(struct stream *st) {
+    if (stream_pwrite(st->expr_fd, st->exprs, st->expr_buffered,
+                st->expr_size - st->expr_buffered) < 0) {
+        return -1;
+    }
+
+    st->expr_buffered = 0;
+    return 0;
+}
+
+/**
+ * Appends bytes to the spilled expressions.
+ * @return 0 on success, -1 on failure.
+ */
+static int stream_add_expr(struct stream *st, const void *data, size_t n) {
+    if (st->expr_buffered + n > sizeof(st->exprs)
+            && stream_flush_exprs(st) < 0) {
+        return -1;
+    }
+
+    /* Ones too big to buffer are written directly */
+    if (n > sizeof(st->exprs)) {
+        if (stream_pwrite(st->expr_fd, data, n, st->expr_size) < 0) {
+            return -1;
+        }
+    } else {
+        memcpy(st->exprs + st->expr_buffered, data, n);
+        st->expr_buffered += n;
+    }
+
+    st->expr_size += n;
+    return 0;
+}
+
+int stream_spill_expr(struct stream *st, const struct obj_reloc *rel,
+        const struct stream_expr_op *ops, int count, const char *path,
+        int line) {
+    struct stream_expr_origin origin = { path, line };
+    struct obj_reloc spilled = *rel;
+
+    if (count <= 0) {
+        return -1;
+    }
+
+    spilled.expr_start = st->expr_size;
+    spilled.expr_len = count;
+    if (stream_add_expr(st, &origin, sizeof(origin)) < 0
+            || stream_add_expr(st, ops, count * sizeof(*ops)) < 0) {
+        return -1;
+    }
+
+    return stream_spill(st, &spilled);
+}
+
+/**
+ * Reads back the expression of a spilled relocation and resolves its target.
+ * @return 0 on success, or -1 if the target can't be resolved (which is
+ * reported) or on failure.
+ */
+static int stream_resolve(struct stream *st, struct obj_reloc *rel) {
+    struct stream_expr_origin origin;
+    size_t n = rel->expr_len * sizeof(struct stream_expr_op);
+    struct stream_expr_op *ops = malloc(n);
+    int ret = -1;
+
+    if (ops && st->resolve
+            && stream_pread(st->expr_fd, &origin, sizeof(origin),
+                rel->expr_start) == sizeof(origin)
+            && stream_pread(st->expr_fd, ops, n,
+                rel->expr_start + sizeof(origin)) == (ssize_t) n) {
+        ret = st->resolve(rel, ops, origin.path, origin.line);
+    }
+
+    free(ops);
+    return ret;
+}
+
+/**
+ * Gets the final address of a value in a section.
+ */
+static int stream_address(const struct stream *st, enum section sec,
+        int value) {
+    /* As in link_objects(): text starts at 0 and data follows it, and
+     * absolute values keep the addresses they were assembled at
+     */
+    if (sec == SEC_DATA) {
+        return st->size[OBJ_SEC_IDX(SEC_TEXT)] + value;
+    }
+
+    return value;
+}
+
+int stream_encode(const struct stream *st, const struct obj_reloc *rel,
+        uint8_t bytes[2]) {
+    int target = stream_address(st, rel->target_sec, rel->addend);
+    int value = rel->value;
+    int len;
+
+    /* Relative jumps are from the final address of the instruction */
+    if (rel->type == RT_REL_JUMP && rel->sec != SEC_ABS) {
+        value = stream_address(st, rel->sec, value);
+    }
+
+    len = reltab_encode(rel->type, value, target, bytes);
+    if (len < 0) {
+        fprintf(stderr, "Value %d out of range in %s.\n", target, st->name);
+    }
+
+    return len;
+}
+
+/**
+ * Appends a section's temporary file to the output.
+ * @param offset Offset of the section in the output.
+ * @return 0 on success, -1 on failure.
+ */
+static int stream_append(struct stream *st, enum section sec, off_t offset) {
+    int idx = OBJ_SEC_IDX(sec);
+    uint8_t *buf = malloc(STREAM_COPY_SIZE);
+    int ret = 0;
+
+    if (!buf) {
+        return -1;
+    }
+
+    for (size_t done = 0; done < st->size[idx] && ret == 0;) {
+        size_t n = st->size[idx] - done;
+        if (n > STREAM_COPY_SIZE) {
+            n = STREAM_COPY_SIZE;
+        }
+
+        if (stream_pread(st->sec_fd[idx], buf, n, done) != (ssize_t) n
+                || stream_pwrite(st->fd, buf, n, offset + done) < 0) {
+            ret = -1;
+        }
+
+        done += n;
+    }
+
+    free(buf);
+    return ret;
+}
+
+int stream_finish(struct stream *st) {
+    size_t text_size = st->size[OBJ_SEC_IDX(SEC_TEXT)];
+    size_t data_size = st->size[OBJ_SEC_IDX(SEC_DATA)];
+    int errors = 0;
+
+    if ((st->spill_count > 0 && stream_flush_spill(st) < 0)
+            || (st->expr_buffered > 0 && stream_flush_exprs(st) < 0)) {
+        return -1;
+    }
+
+    for (long i = 0; i < st->spilled; i += STREAM_SPILL_BATCH) {
+        int count = st->spilled - i < STREAM_SPILL_BATCH
+            ? st->spilled - i : STREAM_SPILL_BATCH;
+        size_t n = count * sizeof(st->spill[0]);
+
+        if (stream_pread(st->spill_fd, st->spill, n,
+                    i * sizeof(st->spill[0])) != (ssize_t) n) {
+            return -1;
+        }
+
+        for (int j = 0; j < count; j++) {
+            struct obj_reloc rel = st->spill[j];
+            uint8_t bytes[2];
+            int len;
+
+            if (rel.expr_len > 0 && stream_resolve(st, &rel) < 0) {
+                errors++;
+                continue;
+            }
+
+            len = stream_encode(st, &rel, bytes);
+            if (len < 0) {
+                errors++;
+            } else if (stream_patch(st, rel.sec, rel.offset, bytes, len) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    if (errors > 0) {
+        return -1;
+    }
+
+    if (stream_append(st, SEC_DATA, text_size) < 0
+            || stream_append(st, SEC_ABS, text_size + data_size) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,207 @@
+/**
+ * @file stream.h
+ */
+
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "expr.h"
+#include "object.h"
+#include "section.h"
+
+/**
+ * Number of relocations buffered before they are written to the spill file.
+ */
+#define STREAM_SPILL_BATCH 1024
+
+/**
+ * Size of the blocks the temporary files are copied in.
+ */
+#define STREAM_COPY_SIZE 0x10000
+
+/**
+ * Number of expression operations buffered before they are written to their
+ * spill file.
+ */
+#define STREAM_EXPR_BATCH 1024
+
+/**
+ * Operation of the expression of a spilled relocation, in postfix order (see
+ * stream_spill_expr()).
+ */
+struct stream_expr_op {
+    enum expr_type type;
+
+    /**
+     * For ET_CONST, the section the value is in.
+     */
+    enum section sec;
+
+    /**
+     * For ET_CONST, the value; for ET_SYM, an index given by the caller.
+     */
+    int value;
+};
+
+/**
+ * Computes the target of a spilled relocation with an expression once every
+ * section has been written.
+ * @param[in,out] rel Relocation, whose @c target_sec and @c addend are to be
+ * set.
+ * @param ops Operations of the expression.
+ * @param path File the relocation was made in (NULL for the standard input).
+ * @param line Line the relocation was made on.
+ * @return 0 on success, or -1 if the expression can't be resolved (which is
+ * reported) or on failure.
+ */
+typedef int (*stream_resolve_fn)(struct obj_reloc *rel,
+        const struct stream_expr_op *ops, const char *path, int line);
+
+/**
+ * Output of a build which is written as it is assembled, instead of being
+ * linked from an object at the end.
+ *
+ * The image is laid out as by link_objects() for a single object: the text
+ * section at the start of the file, followed by the data section, followed by
+ * the absolute section. Text is written straight to the output, but since the
+ * size of the text is not known until the end, data and absolute bytes go to
+ * temporary files which are appended to it at the end.
+ *
+ * Relocations which can only be applied once the sections are placed (those
+ * relative to the data section) are spilled to another temporary file and
+ * applied at the end. So are relocations which are still waiting on symbols
+ * once the bytes they patch have been written out, along with their
+ * expressions, so that they don't have to be kept in memory.
+ */
+struct stream {
+    /**
+     * Name of the source, for error messages.
+     */
+    const char *name;
+
+    /**
+     * Descriptor of the output file.
+     */
+    int fd;
+
+    /**
+     * Descriptor the bytes of each section are written to (the output for
+     * text, temporary files for the others).
+     */
+    int sec_fd[OBJ_SEC_COUNT];
+
+    /**
+     * Number of bytes of each section which have been written.
+     */
+    size_t size[OBJ_SEC_COUNT];
+
+    /**
+     * Temporary file of spilled relocations, and relocations waiting to be
+     * written to it.
+     */
+    int spill_fd;
+    int spill_count;
+    struct obj_reloc spill[STREAM_SPILL_BATCH];
+
+    /**
+     * Total number of relocations spilled.
+     */
+    long spilled;
+
+    /**
+     * Temporary file of the expressions of spilled relocations (each an
+     * origin followed by its operations), and bytes of it waiting to be
+     * written.
+     */
+    int expr_fd;
+    int expr_buffered;
+    uint8_t exprs[STREAM_EXPR_BATCH * sizeof(struct stream_expr_op)];
+
+    /**
+     * Number of bytes of expressions spilled.
+     */
+    long expr_size;
+
+    /**
+     * Resolves relocations spilled with stream_spill_expr().
+     */
+    stream_resolve_fn resolve;
+};
+
+/**
+ * Creates the output file and the temporary files of a stream.
+ * @param st Stream to initialize.
+ * @param path Path of the output.
+ * @param name Name of the source, for error messages.
+ * @return 0 on success, -1 on failure.
+ */
+int stream_open(struct stream *st, const char *path, const char *name);
+
+/**
+ * Closes the files of a stream. The output is left as it is (so it is
+ * incomplete if stream_finish() was not called, or failed).
+ */
+void stream_close(struct stream *st);
+
+/**
+ * Appends bytes to a section.
+ * @return 0 on success, -1 on failure.
+ */
+int stream_write(struct stream *st, enum section sec,
+        const uint8_t *data, size_t n);
+
+/**
+ * Writes bytes over ones already written to a section.
+ * @return 0 on success, -1 on failure.
+ */
+int stream_patch(struct stream *st, enum section sec, int offset,
+        const uint8_t *bytes, int len);
+
+/**
+ * Adds a relocation to apply once the sections are placed. Only relocations
+ * relative to a section (with @c sym of -1) are supported.
+ * @return 0 on success, -1 on failure.
+ */
+int stream_spill(struct stream *st, const struct obj_reloc *rel);
+
+/**
+ * Adds a relocation whose target is an expression which can't be evaluated
+ * yet. The stream's resolve function computes its target at the end.
+ * @param rel Relocation (with @c sym of -1).
+ * @param ops Operations of the expression, in postfix order.
+ * @param count Number of operations.
+ * @param path File the relocation was made in, for error messages (this has
+ * to stay valid until stream_finish()).
+ * @param line Line the relocation was made on.
+ * @return 0 on success, -1 on failure.
+ */
+int stream_spill_expr(struct stream *st, const struct obj_reloc *rel,
+        const struct stream_expr_op *ops, int count, const char *path,
+        int line);
+
+/**
+ * Computes the bytes of a relocation relative to a section (with @c sym of -1),
+ * as link_objects() would. Relocations involving the data section can only be
+ * encoded once the text section has been completely written.
+ * @param st Stream the relocation is in.
+ * @param rel Relocation to encode.
+ * @param[out] bytes Place to store the bytes (at most 2).
+ * @return Number of bytes, or -1 if the value is out of range (which is
+ * reported).
+ */
+int stream_encode(const struct stream *st, const struct obj_reloc *rel,
+        uint8_t bytes[2]);
+
+/**
+ * Applies the spilled relocations and puts the sections together in the
+ * output. Every section has to be completely written first.
+ * @return 0 on success, -1 if any relocation was out of range or on failure.
+ */
+int stream_finish(struct stream *st);
+
+#endif /* STREAM_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -12,35 +12,130 @@
 
 struct symbol_table *symbol_table;
 
-static struct symbol_ent *syment_alloc(const char *name,
-        enum section sec, enum symbol_type type, int value) {
-    struct symbol_ent *ent = malloc(sizeof(*ent));
-    if (!ent) {
-        return NULL;
+/**
+ * FNV-1a hash of a name.
+ */
+static uint32_t symtab_hash(const char *name, int len) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash ^= (uint8_t) name[i];
+        hash *= 16777619u;
     }
 
-    ent->name = strdup(name);
-    ent->sec = sec;
-    ent->type = type;
-    ent->value = value;
-    return ent;
+    return hash;
 }
 
-static void syment_free(struct symbol_ent *ent) {
-    if (!ent) {
-        return;
+static struct symbol_ent *symtab_ent(const struct symbol_table *st, int idx) {
+    return &st->blocks[idx / SYMTAB_BLOCK_SIZE][idx % SYMTAB_BLOCK_SIZE];
+}
+
+/**
+ * Finds the slot of a name in the index: either the one holding its symbol, or
+ * the empty one it would be put in.
+ */
+static uint32_t *symtab_slot(const struct symbol_table *st,
+        const char *name, int len) {
+    size_t mask = st->slot_count - 1;
+    size_t i = symtab_hash(name, len) & mask;
+
+    for (;; i = (i + 1) & mask) {
+        uint32_t *slot = &st->slots[i];
+        if (*slot == 0) {
+            return slot;
+        }
+
+        const char *other = symtab_ent(st, *slot - 1)->name;
+        if (strncmp(other, name, len) == 0 && other[len] == '\0') {
+            return slot;
+        }
+    }
+}
+
+/**
+ * Doubles the number of slots in the index.
+ * @return 0 on success, -1 on failure.
+ */
+static int symtab_grow_slots(struct symbol_table *st) {
+    size_t count = st->slot_count * 2;
+    uint32_t *slots = calloc(count, sizeof(*slots));
+    if (!slots) {
+        return -1;
+    }
+
+    free(st->slots);
+    st->slots = slots;
+    st->slot_count = count;
+
+    for (int i = 0; i < st->count; i++) {
+        const char *name = symtab_ent(st, i)->name;
+        *symtab_slot(st, name, strlen(name)) = i + 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Copies a name into the table's pool.
+ * @return The interned copy, or NULL on failure.
+ */
+static const char *symtab_intern(struct symbol_table *st,
+        const char *name, int len) {
+    struct symtab_pool *pool = st->pool;
+    char *str;
+
+    if (!pool || pool->used + len + 1 > pool->size) {
+        size_t size = len + 1 > SYMTAB_POOL_SIZE ? len + 1 : SYMTAB_POOL_SIZE;
+        pool = malloc(sizeof(*pool) + size);
+        if (!pool) {
+            return NULL;
+        }
+
+        pool->size = size;
+        pool->used = 0;
+
+        /* Keep filling the current block if this name got one of its own */
+        if (st->pool && size > SYMTAB_POOL_SIZE) {
+            pool->next = st->pool->next;
+            st->pool->next = pool;
+        } else {
+            pool->next = st->pool;
+            st->pool = pool;
+        }
     }
 
-    free(ent->name);
-    free(ent);
+    str = &pool->data[pool->used];
+    memcpy(str, name, len);
+    str[len] = '\0';
+    pool->used += len + 1;
+    return str;
 }
 
 int symtab_init(struct symbol_table *st) {
+    return symtab_init_size(st, SYMTAB_DEF_SLOT_COUNT);
+}
+
+int symtab_init_size(struct symbol_table *st, size_t slot_count) {
+    size_t count = 8;
+
     if (!st) {
         return -1;
     }
 
-    return hashtab_init_size(&st->symbols, 128);
+    while (count < slot_count) {
+        count *= 2;
+    }
+
+    st->count = 0;
+    st->block_count = 0;
+    st->blocks = NULL;
+    st->pool = NULL;
+    st->sorted_count = 0;
+    st->sorted_valid = 0;
+    st->sorted = NULL;
+
+    st->slot_count = count;
+    st->slots = calloc(count, sizeof(*st->slots));
+    return st->slots ? 0 : -1;
 }
 
 void symtab_destroy(struct symbol_table *st) {
@@ -48,70 +143,230 @@ void symtab_destroy(struct symbol_table *st) {
         return;
     }
 
-    hashtab_free_all(&st->symbols);
-    hashtab_destroy(&st->symbols);
+    for (int i = 0; i < st->block_count; i++) {
+        free(st->blocks[i]);
+    }
+
+    while (st->pool) {
+        struct symtab_pool *next = st->pool->next;
+        free(st->pool);
+        st->pool = next;
+    }
+
+    free(st->blocks);
+    free(st->slots);
+    free(st->sorted);
+    st->blocks = NULL;
+    st->slots = NULL;
+    st->sorted = NULL;
+    st->count = 0;
+    st->block_count = 0;
+}
+
+int symtab_get_size(const struct symbol_table *st) {
+    return st ? st->count : 0;
+}
+
+const struct symbol_ent *symtab_get(const struct symbol_table *st, int idx) {
+    if (!st || idx < 0 || idx >= st->count) {
+        return NULL;
+    }
+
+    return symtab_ent(st, idx);
 }
 
 const struct symbol_ent *symtab_search(
         const struct symbol_table *st, const char *name) {
-    if (!st) {
+    if (!name) {
         return NULL;
     }
 
-    return hashtab_get(&st->symbols, name);
+    return symtab_search_len(st, name, strlen(name));
 }
 
 const struct symbol_ent *symtab_search_len(const struct symbol_table *st,
         const char *name, int name_len) {
-    /* Just copy the string then free it later */
-    char *name_nt = strndup(name, name_len);
-    const struct symbol_ent *ret = symtab_search(st, name_nt);
-    free(name_nt);
-    return ret;
+    uint32_t idx;
+
+    if (!st || !name) {
+        return NULL;
+    }
+
+    idx = *symtab_slot(st, name, name_len);
+    return idx ? symtab_ent(st, idx - 1) : NULL;
 }
 
 const struct symbol_ent *symtab_add(struct symbol_table *st, const char *name,
         enum symbol_type type, enum section sec, int value) {
-    /* I know it's REALLY bad to cast away const-ness, but it's okay here since
-     * this structure "owns" the entry anyway: symtab_search() could be replaced
-     * with hashtab_get() with the same effect.
-     */
-    struct symbol_ent *ent = (struct symbol_ent *) symtab_search(st, name);
-
-    if (!ent) {
-        ent = syment_alloc(name, sec, type, value);
-        if (!ent) {
-            return NULL;
-        }
+    if (!name) {
+        return NULL;
+    }
+
+    return symtab_add_len(st, name, strlen(name), type, sec, value);
+}
 
-        if (hashtab_set(&st->symbols, name, ent) < 0) {
-            syment_free(ent);
+const struct symbol_ent *symtab_add_len(struct symbol_table *st,
+        const char *name, int name_len,
+        enum symbol_type type, enum section sec, int value) {
+    struct symbol_ent *ent;
+    uint32_t *slot;
+
+    if (!st || !name) {
+        return NULL;
+    }
+
+    slot = symtab_slot(st, name, name_len);
+    if (*slot != 0) {
+        ent = symtab_ent(st, *slot - 1);
+        if (ent->type != ST_UNDEF) {
+            /* Symbol exists */
             return NULL;
         }
 
-        /* Sucessfully allocated and added */
-        return ent;
-    } else if (ent->type == ST_UNDEF) {
         /* This will overwrite an undefined symbol */
         ent->sec = sec;
         ent->type = type;
         ent->value = value;
+        st->sorted_valid = 0;
         return ent;
-    } else {
-        /* Symbol exists */
+    }
+
+    /* Keep the index at most half full */
+    if ((size_t) (st->count + 1) * 2 > st->slot_count) {
+        if (symtab_grow_slots(st) < 0) {
+            return NULL;
+        }
+
+        slot = symtab_slot(st, name, name_len);
+    }
+
+    if (st->count == st->block_count * SYMTAB_BLOCK_SIZE) {
+        struct symbol_ent **blocks = realloc(st->blocks,
+                (st->block_count + 1) * sizeof(*blocks));
+        if (!blocks) {
+            return NULL;
+        }
+
+        st->blocks = blocks;
+        blocks[st->block_count] =
+            malloc(SYMTAB_BLOCK_SIZE * sizeof(*blocks[0]));
+        if (!blocks[st->block_count]) {
+            return NULL;
+        }
+
+        st->block_count++;
+    }
+
+    ent = symtab_ent(st, st->count);
+    ent->name = symtab_intern(st, name, name_len);
+    if (!ent->name) {
         return NULL;
     }
+
+    ent->sec = sec;
+    ent->type = type;
+    ent->value = value;
+    ent->fixups = NULL;
+
+    *slot = ++st->count;
+    st->sorted_valid = 0;
+    return ent;
 }
 
-const struct symbol_ent *symtab_add_len(struct symbol_table *st,
-        const char *name, int name_len,
-        enum symbol_type type, enum section sec, int value) {
-    /* Just copy the string then free it later */
-    char *name_nt = strndup(name, name_len);
-    const struct symbol_ent *ret =
-        symtab_add(st, name_nt, sec, type, value);
-    free(name_nt);
-    return ret;
+void symtab_undefine(struct symbol_table *st, const struct symbol_ent *sym) {
+    /* The table owns the symbol, so this is okay */
+    struct symbol_ent *ent = (struct symbol_ent *) sym;
+
+    ent->type = ST_UNDEF;
+    ent->sec = SEC_UNDEF;
+    ent->value = 0;
+    ent->fixups = NULL;
+    st->sorted_valid = 0;
+}
+
+static int symtab_sorted_cmp(const void *a, const void *b) {
+    const struct symtab_sorted *s1 = a;
+    const struct symtab_sorted *s2 = b;
+
+    if (s1->value != s2->value) {
+        return s1->value < s2->value ? -1 : 1;
+    }
+
+    return s1->idx < s2->idx ? -1 : s1->idx > s2->idx;
+}
+
+/**
+ * Builds the sorted index, if it is out of date.
+ * @return 0 on success, -1 on failure.
+ */
+static int symtab_sort(struct symbol_table *st) {
+    struct symtab_sorted *sorted;
+    int count = 0;
+
+    if (st->sorted_valid) {
+        return 0;
+    }
+
+    sorted = realloc(st->sorted, (st->count + 1) * sizeof(*sorted));
+    if (!sorted) {
+        return -1;
+    }
+
+    st->sorted = sorted;
+    for (int i = 0; i < st->count; i++) {
+        const struct symbol_ent *ent = symtab_ent(st, i);
+        if (ent->type == ST_OBJECT) {
+            sorted[count].value = ent->value;
+            sorted[count].idx = i;
+            count++;
+        }
+    }
+
+    qsort(sorted, count, sizeof(*sorted), symtab_sorted_cmp);
+    st->sorted_count = count;
+    st->sorted_valid = 1;
+    return 0;
+}
+
+/**
+ * Finds the position of the first sorted symbol with a value of at least
+ * @p value.
+ */
+static int symtab_lower_bound(const struct symbol_table *st, int value) {
+    int lo = 0;
+    int hi = st->sorted_count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (st->sorted[mid].value < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+int symtab_range(struct symbol_table *st, int start, int end, int *first) {
+    int last;
+
+    if (!st || symtab_sort(st) < 0) {
+        return -1;
+    }
+
+    *first = symtab_lower_bound(st, start);
+    last = end > start ? symtab_lower_bound(st, end) : *first;
+    return last - *first;
+}
+
+const struct symbol_ent *symtab_get_sorted(const struct symbol_table *st,
+        int pos) {
+    if (!st || !st->sorted_valid || pos < 0 || pos >= st->sorted_count) {
+        return NULL;
+    }
+
+    return symtab_ent(st, st->sorted[pos].idx);
 }
 
 /* vim: set tw=80 ft=c: */
@@ -8,8 +8,26 @@
 #ifndef SYMTABLE_H_
 #define SYMTABLE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "section.h"
-#include "hash_table.h"
+
+/**
+ * Number of symbols in each block of a symbol_table.
+ */
+#define SYMTAB_BLOCK_SIZE 256
+
+/**
+ * Size of each block of interned names (longer names get a block of their
+ * own).
+ */
+#define SYMTAB_POOL_SIZE 4096
+
+/**
+ * Default initial number of slots in the index of a symbol_table.
+ */
+#define SYMTAB_DEF_SLOT_COUNT 128
 
 enum symbol_type {
     ST_UNDEF = 0,
@@ -22,15 +40,85 @@ enum symbol_type {
     ST_MACRO,
 };
 
+struct reloc_ent;
+
+/**
+ * Record of a symbol. Records are owned by their table and never move, so they
+ * can be referred to by pointer.
+ */
 struct symbol_ent {
-    char *name;
-    enum symbol_type type;
-    enum section sec;
+    /**
+     * Name, interned in the table.
+     */
+    const char *name;
+
+    /**
+     * While the symbol is undefined, the relocations waiting on it (linked
+     * through reloc_ent::next_fixup). These are patched as soon as the symbol
+     * is defined.
+     */
+    struct reloc_ent *fixups;
+
+    int value;
+
+    /**
+     * enum symbol_type and enum section, packed.
+     */
+    uint8_t type;
+    uint8_t sec;
+};
+
+/**
+ * Block of interned names.
+ */
+struct symtab_pool {
+    struct symtab_pool *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+/**
+ * Entry of the sorted index of a symbol_table.
+ */
+struct symtab_sorted {
     int value;
+    uint32_t idx;
 };
 
+/**
+ * Table of symbols, stored as a dense array of records (in the order they were
+ * added) with an open-addressed index by name, and an index sorted by value
+ * which is built when it is needed.
+ */
 struct symbol_table {
-    struct hash_table symbols;
+    /**
+     * Records, in blocks of SYMTAB_BLOCK_SIZE so that they never move.
+     */
+    int count;
+    int block_count;
+    struct symbol_ent **blocks;
+
+    /**
+     * Blocks of interned names, the newest first.
+     */
+    struct symtab_pool *pool;
+
+    /**
+     * Index of each symbol + 1 (or 0 for an empty slot) by the hash of its
+     * name. The number of slots is a power of 2, and at least twice the number
+     * of symbols.
+     */
+    size_t slot_count;
+    uint32_t *slots;
+
+    /**
+     * Defined symbols (of type ST_OBJECT) sorted by value, and then by index.
+     * This is only valid if @c sorted_valid is set.
+     */
+    int sorted_count;
+    int sorted_valid;
+    struct symtab_sorted *sorted;
 };
 
 
@@ -41,12 +129,33 @@ struct symbol_table {
  */
 int symtab_init(struct symbol_table *st);
 
+/**
+ * Initialize a symbol table with space for a specified number of symbols.
+ * Small tables (like the ones for local label scopes) should start smaller.
+ * The table grows as symbols are added either way.
+ * @param st Table to initialize.
+ * @param slot_count Number of index slots to start with.
+ * @return 0 on success, -1 on failure.
+ */
+int symtab_init_size(struct symbol_table *st, size_t slot_count);
+
 /**
  * Destroys (frees) a symbol table and all of its entries.
  * @param st Table to destroy.
  */
 void symtab_destroy(struct symbol_table *st);
 
+/**
+ * Gets the number of symbols in a table.
+ */
+int symtab_get_size(const struct symbol_table *st);
+
+/**
+ * Gets a symbol by its index (the order the symbols were added in).
+ * @return The symbol, or NULL if @p idx is out of range.
+ */
+const struct symbol_ent *symtab_get(const struct symbol_table *st, int idx);
+
 /**
  * Searches for a symbol in the table.
  * @param st Symbol table to search in.
@@ -99,6 +208,34 @@ const struct symbol_ent *symtab_add_len(struct symbol_table *st,
         const char *name, int name_len,
         enum symbol_type type, enum section sec, int value);
 
+/**
+ * Makes a symbol of a table undefined again, dropping the relocations waiting
+ * on it.
+ * @param st Table which owns the symbol.
+ * @param sym Symbol to undefine.
+ */
+void symtab_undefine(struct symbol_table *st, const struct symbol_ent *sym);
+
+/**
+ * Finds the defined symbols (of type ST_OBJECT) with values in a range, in
+ * order of their values. Ties are kept in the order the symbols were added.
+ * The sorted index is built on the first call after the table changes.
+ * @param st Table to search.
+ * @param start First value of the range.
+ * @param end Value after the end of the range.
+ * @param[out] first Position of the first matching symbol, for
+ * symtab_get_sorted().
+ * @return Number of matching symbols, or -1 on failure.
+ */
+int symtab_range(struct symbol_table *st, int start, int end, int *first);
+
+/**
+ * Gets a symbol by its position in the sorted index (from symtab_range()).
+ * @return The symbol, or NULL if @p pos is out of range.
+ */
+const struct symbol_ent *symtab_get_sorted(const struct symbol_table *st,
+        int pos);
+
 #endif /* SYMTABLE_H_ */
 
 /* vim: set tw=80 ft=c: */
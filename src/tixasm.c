@@ -5,34 +5,297 @@
  * @date Last Modified: Tue, 06 Feb 2018
  */
 
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hash_table.h"
 #include "tixasm.h"
 
 /**
  * Different program counters are used for each section. Switching sections just
  * switches which one of these asm_pc points to.
  */
-static struct expr_node *asm_text_pc = NULL,
-                        *asm_data_pc = NULL,
-                        *asm_abs_pc  = NULL;
+static struct asm_pc asm_text_pc = { SEC_TEXT, 0 },
+                     asm_data_pc = { SEC_DATA, 0 },
+                     asm_abs_pc  = { SEC_ABS, 0 };
+
+static struct asm_pc *asm_pc = NULL;
+
+/**
+ * Section which output currently goes to.
+ */
+static enum section asm_sec = SEC_ABS;
+
+/**
+ * Output of each section, switched along with the program counters.
+ */
+static struct section_buf asm_text_buf = { 0, 0, NULL },
+                          asm_data_buf = { 0, 0, NULL },
+                          asm_abs_buf  = { 0, 0, NULL };
 
-static struct expr_node **asm_pc = NULL;
+static struct section_buf *asm_buf = NULL;
+
+/**
+ * Fragments the text and data sections are split into (at global labels and
+ * .org), for --gc-sections.
+ */
+static struct obj_fragment *asm_frags = NULL;
+static int asm_frag_count = 0, asm_frag_capacity = 0;
+
+/**
+ * Index in asm_frags of the last fragment of each section, or -1 for the
+ * absolute section (which is never split).
+ */
+static int asm_cur_frag[OBJ_SEC_COUNT];
+
+/**
+ * Indices in asm_frags of the fragments of a section, in order.
+ */
+struct asm_frag_index {
+    int *frags;
+    int count;
+    int capacity;
+
+    /**
+     * Whether the program counters of the fragments are increasing, so that
+     * they can be binary searched (an .org can move them backwards).
+     */
+    int sorted;
+};
+
+static struct asm_frag_index asm_frag_index[OBJ_SEC_COUNT];
+
+/**
+ * Whether the last output in each section was an instruction which never
+ * continues to the next one (like an unconditional jump or return).
+ */
+static int asm_terminal[OBJ_SEC_COUNT];
 
 struct symbol_table *asm_symbol_table = NULL;
 struct reloc_table *asm_reloc_table = NULL;
+struct symbol_table *asm_local_table = NULL;
 
-int asm_init(void) {
-    asm_text_pc = expr_alloc_const(SEC_TEXT, 0);
-    if (!asm_text_pc) {
-        goto INIT_FAIL;
+/**
+ * Number of index slots local label tables start with. These usually only hold
+ * a handful of labels.
+ */
+#define ASM_LOCAL_SLOT_COUNT 16
+
+/**
+ * Index of the first relocation created in the current local scope. Earlier
+ * ones cannot reference its labels.
+ */
+static int asm_scope_reloc_start = 0;
+
+/**
+ * Number of scopes opened since asm_init().
+ */
+static int asm_scope_count = 0;
+
+static asm_define_fn asm_define_callback = NULL;
+
+/**
+ * Output of a streaming build, or NULL.
+ */
+static struct stream *asm_stream = NULL;
+
+/**
+ * Number of bytes at the start of each section which have been written to
+ * asm_stream (and removed from its buffer).
+ */
+static int asm_flushed[OBJ_SEC_COUNT];
+
+/**
+ * Number of bytes buffered in each section at which to try writing it out
+ * again.
+ */
+static size_t asm_flush_at[OBJ_SEC_COUNT];
+
+/**
+ * Number of relocations of a streaming build found to be out of range (or
+ * otherwise reported before the end).
+ */
+static int asm_stream_errors = 0;
+
+/**
+ * Index in asm_reloc_table from which to look for the pending relocations of
+ * each section in a streaming build. The entries are in the order they were
+ * made, which is the order of their offsets in each section, so the ones
+ * before this are all retired or in other sections.
+ */
+static int asm_stream_next[OBJ_SEC_COUNT];
+
+/**
+ * Symbols used by the expressions spilled to the stream (which refer to them
+ * by index), and the index + 1 of each by name.
+ */
+static const struct symbol_ent **asm_stream_syms = NULL;
+static int asm_stream_sym_count = 0, asm_stream_sym_capacity = 0;
+static struct hash_table asm_stream_sym_indices;
+
+/**
+ * Operations of an expression which is being spilled.
+ */
+static struct stream_expr_op *asm_stream_ops = NULL;
+static int asm_stream_op_count = 0, asm_stream_op_capacity = 0;
+
+/**
+ * Snapshots to look up missing global symbols in.
+ */
+static const struct snapshot *asm_snapshots[ASM_MAX_SNAPSHOTS];
+static int asm_snapshot_count = 0;
+
+/**
+ * Empties the fragment indices of the sections.
+ */
+static void asm_clear_frag_index(void) {
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        asm_frag_index[i].count = 0;
+        asm_frag_index[i].sorted = 1;
     }
+}
 
-    asm_data_pc = expr_alloc_const(SEC_DATA, 0);
-    if (!asm_data_pc) {
-        goto INIT_FAIL;
+/**
+ * Starts a new fragment in a section.
+ */
+static int asm_add_fragment(enum section sec, int offset, int pc) {
+    struct asm_frag_index *index = &asm_frag_index[OBJ_SEC_IDX(sec)];
+
+    if (index->count == index->capacity) {
+        int capacity = index->capacity ? index->capacity * 2 : 64;
+        int *frags = realloc(index->frags, capacity * sizeof(*frags));
+        if (!frags) {
+            return -1;
+        }
+
+        index->frags = frags;
+        index->capacity = capacity;
     }
 
-    asm_abs_pc = expr_alloc_const(SEC_ABS, 0);
-    if (!asm_abs_pc) {
+    if (asm_frag_count == asm_frag_capacity) {
+        int capacity = asm_frag_capacity ? asm_frag_capacity * 2 : 64;
+        struct obj_fragment *frags = realloc(asm_frags,
+                capacity * sizeof(*frags));
+        if (!frags) {
+            return -1;
+        }
+
+        asm_frags = frags;
+        asm_frag_capacity = capacity;
+    }
+
+    asm_frags[asm_frag_count] = (struct obj_fragment) {
+        .sec = sec,
+        .offset = offset,
+        .pc = pc,
+        .falls_through = 1,
+        .pinned = 0,
+    };
+
+    if (index->count > 0 && pc < asm_frags[index->frags[index->count - 1]].pc) {
+        index->sorted = 0;
+    }
+
+    index->frags[index->count++] = asm_frag_count;
+    asm_cur_frag[OBJ_SEC_IDX(sec)] = asm_frag_count++;
+    return 0;
+}
+
+/**
+ * Finds the last fragment of a section starting at or before a program
+ * counter value.
+ * Program counters normally increase from one fragment to the next, so this is
+ * a binary search; if an .org moved the program counter backwards, it falls
+ * back to a scan.
+ */
+static int asm_frag_by_pc(enum section sec, int pc) {
+    const struct asm_frag_index *index = &asm_frag_index[OBJ_SEC_IDX(sec)];
+    int lo = 0, hi = index->count - 1;
+
+    if (!index->sorted) {
+        for (int i = index->count - 1; i >= 0; i--) {
+            if (asm_frags[index->frags[i]].pc <= pc) {
+                return index->frags[i];
+            }
+        }
+
+        return -1;
+    }
+
+    if (index->count == 0 || asm_frags[index->frags[0]].pc > pc) {
+        return -1;
+    }
+
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (asm_frags[index->frags[mid]].pc <= pc) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return index->frags[lo];
+}
+
+/**
+ * Keeps the fragments between two values together, since the distance between
+ * them has been folded into the code. This is the pin function of expressions.
+ */
+static void asm_pin(enum section sec, int pc1, int pc2) {
+    int first, last;
+
+    if (sec != SEC_TEXT && sec != SEC_DATA) {
+        return;
+    }
+
+    /* Usually both are in the current fragment (e.g. a short loop) */
+    const struct obj_fragment *cur = &asm_frags[asm_cur_frag[OBJ_SEC_IDX(sec)]];
+    if (pc1 >= cur->pc && pc2 >= cur->pc) {
+        return;
+    }
+
+    first = asm_frag_by_pc(sec, pc1 < pc2 ? pc1 : pc2);
+    last = asm_frag_by_pc(sec, pc1 < pc2 ? pc2 : pc1);
+    if (first < 0 || last < 0) {
+        return;
+    }
+
+    if (first > last) {
+        int tmp = first;
+        first = last;
+        last = tmp;
+    }
+
+    /* Every fragment of the section up to the last one is pinned to its
+     * successor
+     */
+    int prev = -1;
+    for (int i = first; i <= last; i++) {
+        if (asm_frags[i].sec != sec) {
+            continue;
+        }
+
+        if (prev >= 0) {
+            asm_frags[prev].pinned = 1;
+        }
+
+        prev = i;
+    }
+}
+
+int asm_init(void) {
+    asm_text_pc.sec = SEC_TEXT;
+    asm_text_pc.value = 0;
+    asm_data_pc.sec = SEC_DATA;
+    asm_data_pc.value = 0;
+    asm_abs_pc.sec = SEC_ABS;
+    asm_abs_pc.value = 0;
+
+    if (secbuf_init(&asm_text_buf) < 0
+            || secbuf_init(&asm_data_buf) < 0
+            || secbuf_init(&asm_abs_buf) < 0) {
         goto INIT_FAIL;
     }
 
@@ -46,7 +309,36 @@ int asm_init(void) {
         goto INIT_FAIL;
     }
 
+    asm_reloc_table->patch = asm_patch;
+
+    asm_frag_count = 0;
+    asm_clear_frag_index();
+    asm_scope_count = 0;
+    asm_cur_frag[OBJ_SEC_IDX(SEC_ABS)] = -1;
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        asm_terminal[i] = 0;
+        asm_flushed[i] = 0;
+        asm_flush_at[i] = ASM_STREAM_FLUSH_SIZE;
+        asm_stream_next[i] = 0;
+    }
+
+    asm_stream = NULL;
+    asm_stream_errors = 0;
+
+    if (asm_add_fragment(SEC_TEXT, 0, 0) < 0
+            || asm_add_fragment(SEC_DATA, 0, 0) < 0) {
+        goto INIT_FAIL;
+    }
+
+    expr_set_pin_fn(asm_pin);
+
+    if (asm_open_scope() < 0) {
+        goto INIT_FAIL;
+    }
+
     asm_pc = &asm_abs_pc;
+    asm_buf = &asm_abs_buf;
+    asm_sec = SEC_ABS;
     return 0;
 
 INIT_FAIL:
@@ -55,52 +347,1131 @@ INIT_FAIL:
 }
 
 void asm_destroy(void) {
-    expr_free(asm_text_pc);
-    expr_free(asm_data_pc);
-    expr_free(asm_abs_pc);
+    secbuf_destroy(&asm_text_buf);
+    secbuf_destroy(&asm_data_buf);
+    secbuf_destroy(&asm_abs_buf);
 
     symtab_destroy(asm_symbol_table);
     free(asm_symbol_table);
 
+    symtab_destroy(asm_local_table);
+    free(asm_local_table);
+    asm_local_table = NULL;
+
     reltab_destroy(asm_reloc_table);
     free(asm_reloc_table);
 
+    expr_set_pin_fn(NULL);
+    free(asm_frags);
+    asm_frags = NULL;
+    asm_frag_count = asm_frag_capacity = 0;
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        free(asm_frag_index[i].frags);
+        asm_frag_index[i].frags = NULL;
+        asm_frag_index[i].count = asm_frag_index[i].capacity = 0;
+    }
+
+    if (asm_stream_sym_capacity > 0) {
+        hashtab_destroy(&asm_stream_sym_indices);
+    }
+
+    free(asm_stream_syms);
+    asm_stream_syms = NULL;
+    asm_stream_sym_count = asm_stream_sym_capacity = 0;
+    free(asm_stream_ops);
+    asm_stream_ops = NULL;
+    asm_stream_op_count = asm_stream_op_capacity = 0;
+
     asm_pc = NULL;
+    asm_buf = NULL;
+    asm_stream = NULL;
+}
+
+int asm_open_scope(void) {
+    struct symbol_table *scope = malloc(sizeof(*scope));
+    if (!scope || symtab_init_size(scope, ASM_LOCAL_SLOT_COUNT) < 0) {
+        free(scope);
+        return -1;
+    }
+
+    asm_local_table = scope;
+    asm_scope_reloc_start = reltab_get_size(asm_reloc_table);
+    asm_scope_count++;
+    return 0;
+}
+
+int asm_get_scope_count(void) {
+    return asm_scope_count;
+}
+
+/**
+ * Drops the relocations which have been patched, once they make up half of the
+ * table (so that this takes constant time per relocation), and moves the
+ * indices into the table down to match.
+ */
+static void asm_compact_relocs(void) {
+    int *indices[OBJ_SEC_COUNT + 1] = {
+        &asm_scope_reloc_start,
+        &asm_stream_next[0], &asm_stream_next[1], &asm_stream_next[2],
+    };
+    int size = reltab_get_size(asm_reloc_table);
+    int below[OBJ_SEC_COUNT + 1] = { 0 };
+
+    if (asm_reloc_table->retired == 0
+            || asm_reloc_table->retired * 2 < size) {
+        return;
+    }
+
+    for (int i = 0; i < size; i++) {
+        if (reltab_get(asm_reloc_table, i)->type != RT_UNDEF) {
+            continue;
+        }
+
+        for (int j = 0; j < OBJ_SEC_COUNT + 1; j++) {
+            if (i < *indices[j]) {
+                below[j]++;
+            }
+        }
+    }
+
+    reltab_compact(asm_reloc_table);
+    for (int j = 0; j < OBJ_SEC_COUNT + 1; j++) {
+        *indices[j] -= below[j];
+    }
+}
+
+int asm_close_scope(void) {
+    int errors;
+
+    if (!asm_local_table) {
+        return 0;
+    }
+
+    errors = reltab_resolve_scope(asm_reloc_table,
+            asm_scope_reloc_start, asm_local_table);
+    if (errors > 0) {
+        fprintf(stderr, "%d reference(s) to undefined local labels.\n", errors);
+    }
+
+    symtab_destroy(asm_local_table);
+    free(asm_local_table);
+    asm_local_table = NULL;
+
+    /* Entries before the next scope can't be looked at again, so this is a
+     * good time to drop the ones which have been patched.
+     */
+    asm_compact_relocs();
+    return errors > 0 ? -1 : 0;
+}
+
+void asm_define_sym(const struct symbol_ent *sym) {
+    expr_invalidate();
+
+    if (asm_define_callback && sym) {
+        asm_define_callback(sym, asm_local_table
+                && symtab_search(asm_local_table, sym->name) == sym);
+    }
+
+    /* The table owns the symbol, so this is okay (see symtab_add()) */
+    reltab_resolve_sym(asm_reloc_table, (struct symbol_ent *) sym);
+}
+
+void asm_set_define_fn(asm_define_fn fn) {
+    asm_define_callback = fn;
+}
+
+void asm_undefine_sym(const struct symbol_ent *sym) {
+    if (asm_local_table && symtab_search(asm_local_table, sym->name) == sym) {
+        symtab_undefine(asm_local_table, sym);
+    } else {
+        symtab_undefine(asm_symbol_table, sym);
+    }
+
+    expr_invalidate();
+}
+
+void asm_clear_output(void) {
+    asm_text_buf.size = 0;
+    asm_data_buf.size = 0;
+    asm_abs_buf.size = 0;
+
+    asm_text_pc = (struct asm_pc) { SEC_TEXT, 0 };
+    asm_data_pc = (struct asm_pc) { SEC_DATA, 0 };
+    asm_abs_pc = (struct asm_pc) { SEC_ABS, 0 };
+
+    reltab_clear(asm_reloc_table);
+    asm_scope_reloc_start = 0;
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        asm_stream_next[i] = 0;
+    }
+
+    /* These can't fail, since there is already room for them */
+    asm_frag_count = 0;
+    asm_clear_frag_index();
+    asm_add_fragment(SEC_TEXT, 0, 0);
+    asm_add_fragment(SEC_DATA, 0, 0);
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        asm_terminal[i] = 0;
+        asm_flushed[i] = 0;
+    }
+}
+
+static struct section_buf *asm_sec_buf(enum section sec) {
+    switch (sec) {
+    case SEC_TEXT:
+        return &asm_text_buf;
+    case SEC_DATA:
+        return &asm_data_buf;
+    case SEC_ABS:
+        return &asm_abs_buf;
+    default:
+        return NULL;
+    }
+}
+
+int asm_patch(enum section sec, int offset, const uint8_t *bytes, int len) {
+    struct section_buf *buf = asm_sec_buf(sec);
+    int flushed;
+
+    if (!buf || offset < 0) {
+        return -1;
+    }
+
+    /* Bytes which were already streamed out are patched in the output */
+    flushed = asm_flushed[OBJ_SEC_IDX(sec)];
+    if (offset < flushed) {
+        int n = offset + len > flushed ? flushed - offset : len;
+        if (stream_patch(asm_stream, sec, offset, bytes, n) < 0) {
+            return -1;
+        }
+
+        offset += n;
+        bytes += n;
+        len -= n;
+        if (len == 0) {
+            return 0;
+        }
+    }
+
+    offset -= flushed;
+    if (offset + len > buf->size) {
+        return -1;
+    }
+
+    memcpy(buf->data + offset, bytes, len);
+    return 0;
+}
+
+const struct section_buf *asm_get_section(enum section sec) {
+    return asm_sec_buf(sec);
+}
+
+int asm_get_offset(void) {
+    return asm_flushed[OBJ_SEC_IDX(asm_sec)] + asm_buf->size;
+}
+
+/**
+ * Reports an error in a relocation, at the place it was made.
+ * @param path File the relocation was made in, or NULL for the standard input.
+ * @param line Line the relocation was made on.
+ * @param fmt Message, which may contain a %s for @p name.
+ */
+static void asm_reloc_error(const char *path, int line, const char *fmt,
+        const char *name) {
+    if (path) {
+        fprintf(stderr, "Error in %s on line %d: ", path, line);
+    } else {
+        fprintf(stderr, "Error on line %d: ", line);
+    }
+
+    fprintf(stderr, fmt, name);
+    fprintf(stderr, ".\n");
+}
+
+/**
+ * Reports an expression of a streaming build which can't be resolved by the
+ * end.
+ * @param path File the expression was used in, or NULL for the standard input.
+ * @param line Line the expression was used on.
+ */
+static void asm_stream_report(const char *path, int line,
+        const struct expr_node *expr) {
+    const struct expr_node *res = expr_eval(expr);
+    const struct symbol_ent *undef = expr_find_undef(expr);
+
+    if (res && res->type == ET_SYM) {
+        fprintf(stderr, "Undefined symbol %s in %s.\n",
+                res->sym->name, asm_stream->name);
+    } else if (undef) {
+        asm_reloc_error(path, line, "Undefined symbol %s in expression",
+                undef->name);
+    } else if (!res || res->type == ET_INVAL) {
+        asm_reloc_error(path, line, "Could not resolve expression", NULL);
+    } else {
+        asm_reloc_error(path, line, "Expression is too complex to relocate",
+                NULL);
+    }
+}
+
+/**
+ * Applies a relocation of a streaming build which no longer waits on any
+ * symbol, or spills it to the stream if it depends on where the data section
+ * is placed.
+ * @return 1 if the relocation was handled (even if it was out of range, which
+ * is reported), 0 if it is still pending, or -1 on failure.
+ */
+static int asm_stream_reloc(const struct reloc_ent *ent) {
+    const struct expr_node *res;
+    struct obj_reloc rel;
+    uint8_t bytes[2];
+    int len;
+
+    if (!(ent->type & RT_EXPR) || expr_find_undef(ent->expr)) {
+        return 0;
+    }
+
+    /* Anything else is reported by asm_stream_finish() */
+    res = expr_eval(ent->expr);
+    if (!res || res->type != ET_CONST) {
+        return 0;
+    }
+
+    rel.type = ent->type & ~RT_EXPR;
+    rel.sec = ent->sec;
+    rel.offset = ent->offset;
+    rel.value = ent->value;
+    rel.sym = -1;
+    rel.target_sec = res->sec;
+    rel.addend = res->value;
+    rel.expr_start = 0;
+    rel.expr_len = 0;
+
+    /* The text section starts at 0, but the data section's address isn't
+     * known until the text is complete
+     */
+    if (res->sec == SEC_DATA
+            || (rel.type == RT_REL_JUMP && rel.sec == SEC_DATA)) {
+        return stream_spill(asm_stream, &rel) < 0 ? -1 : 1;
+    }
+
+    len = stream_encode(asm_stream, &rel, bytes);
+    if (len < 0) {
+        asm_stream_errors++;
+        return 1;
+    }
+
+    return asm_patch(rel.sec, rel.offset, bytes, len) < 0 ? -1 : 1;
+}
+
+/**
+ * Adds an operation to the expression being spilled.
+ * @return 0 on success, -1 on failure.
+ */
+static int asm_stream_add_op(enum expr_type type, enum section sec,
+        int value) {
+    if (asm_stream_op_count == asm_stream_op_capacity) {
+        int capacity = asm_stream_op_capacity ? asm_stream_op_capacity * 2 : 16;
+        struct stream_expr_op *ops = realloc(asm_stream_ops,
+                capacity * sizeof(*ops));
+        if (!ops) {
+            return -1;
+        }
+
+        asm_stream_ops = ops;
+        asm_stream_op_capacity = capacity;
+    }
+
+    asm_stream_ops[asm_stream_op_count++] = (struct stream_expr_op) {
+        type, sec, value
+    };
+    return 0;
+}
+
+/**
+ * Gets the index of a symbol in asm_stream_syms, adding it if it is not there.
+ * @return The index, or -1 on failure.
+ */
+static int asm_stream_sym(const struct symbol_ent *sym) {
+    intptr_t idx;
+
+    if (asm_stream_sym_capacity == 0
+            && hashtab_init(&asm_stream_sym_indices) < 0) {
+        return -1;
+    }
+
+    idx = (intptr_t) hashtab_get(&asm_stream_sym_indices, sym->name);
+    if (idx > 0) {
+        return idx - 1;
+    }
+
+    if (asm_stream_sym_count == asm_stream_sym_capacity) {
+        int capacity = asm_stream_sym_capacity
+            ? asm_stream_sym_capacity * 2 : 16;
+        const struct symbol_ent **syms = realloc(asm_stream_syms,
+                capacity * sizeof(*syms));
+        if (!syms) {
+            return -1;
+        }
+
+        asm_stream_syms = syms;
+        asm_stream_sym_capacity = capacity;
+    }
+
+    idx = asm_stream_sym_count;
+    if (hashtab_set(&asm_stream_sym_indices, sym->name,
+                (void *) (idx + 1)) < 0) {
+        return -1;
+    }
+
+    asm_stream_syms[asm_stream_sym_count++] = sym;
+    return idx;
+}
+
+/**
+ * Adds the operations of an expression which waits on undefined symbols to
+ * asm_stream_ops, in postfix order.
+ * @return 0 on success, 1 if the expression can't be spilled (it is invalid or
+ * waits on a local label), or -1 on failure.
+ */
+static int asm_stream_expr(const struct expr_node *expr) {
+    const struct expr_node *res = expr_eval(expr);
+    int ret;
+
+    if (!res) {
+        return -1;
+    }
+
+    if (res->type == ET_CONST) {
+        return asm_stream_add_op(ET_CONST, res->sec, res->value);
+    }
+
+    if (res->type == ET_SYM) {
+        int sym;
+
+        /* Local labels go away with their scope */
+        if (asm_local_table
+                && symtab_search(asm_local_table, res->sym->name) == res->sym) {
+            return 1;
+        }
+
+        sym = asm_stream_sym(res->sym);
+        if (sym < 0 || asm_stream_add_op(ET_SYM, SEC_UNDEF, sym) < 0) {
+            return -1;
+        }
+
+        if (res->addend != 0
+                && (asm_stream_add_op(ET_CONST, SEC_ABS, res->addend) < 0
+                    || asm_stream_add_op(ET_ADD, SEC_UNDEF, 0) < 0)) {
+            return -1;
+        }
+
+        return 0;
+    }
+
+    if (!EXPR_IS_OP(expr)) {
+        return 1;
+    }
+
+    for (int i = 0; i < 2 && expr->operands[i]; i++) {
+        ret = asm_stream_expr(expr->operands[i]);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    return asm_stream_add_op(expr->type, SEC_UNDEF, 0);
+}
+
+/**
+ * Rebuilds the expression of a relocation spilled by asm_stream_retire() and
+ * resolves it (stream_resolve_fn).
+ */
+static int asm_stream_resolve(struct obj_reloc *rel,
+        const struct stream_expr_op *ops, const char *path, int line) {
+    struct expr_node *stack[rel->expr_len];
+    const struct expr_node *res;
+    int depth = 0;
+    int ret = -1;
+
+    /* The operations were written by asm_stream_expr(), so they are
+     * well-formed
+     */
+    for (int i = 0; i < rel->expr_len; i++) {
+        const struct stream_expr_op *op = &ops[i];
+
+        switch (op->type) {
+        case ET_CONST:
+            stack[depth++] = expr_alloc_const(op->sec, op->value);
+            break;
+        case ET_SYM:
+            stack[depth++] = expr_alloc_sym(asm_stream_syms[op->value]);
+            break;
+        case ET_NOT:
+        case ET_NEG:
+            stack[depth - 1] = expr_alloc(op->type, stack[depth - 1], NULL);
+            break;
+        default:
+            depth--;
+            stack[depth - 1] = expr_alloc(op->type,
+                    stack[depth - 1], stack[depth]);
+            break;
+        }
+
+        if (!stack[depth - 1]) {
+            depth--;
+            goto RESOLVE_END;
+        }
+    }
+
+    res = expr_eval(stack[0]);
+    if (res && res->type == ET_CONST) {
+        rel->target_sec = res->sec;
+        rel->addend = res->value;
+        ret = 0;
+    } else {
+        asm_stream_report(path, line, stack[0]);
+    }
+
+RESOLVE_END:
+    while (depth > 0) {
+        expr_free(stack[--depth]);
+    }
+
+    return ret;
+}
+
+/**
+ * Takes a relocation of a streaming build out of memory once the bytes it
+ * patches have been written out: it is spilled to the stream with its
+ * expression if it waits on global symbols, or reported if it can't be
+ * resolved.
+ * @param idx Index of the relocation in asm_reloc_table.
+ * @return 1 if the relocation was taken out, 0 if it has to stay, or -1 on
+ * failure.
+ */
+static int asm_stream_retire(int idx) {
+    const struct reloc_ent *ent = reltab_get(asm_reloc_table, idx);
+    struct obj_reloc rel;
+    int ret;
+
+    if (!(ent->type & RT_EXPR)) {
+        return 0;
+    }
+
+    if (!expr_find_undef(ent->expr)) {
+        asm_stream_report(ent->path, ent->line, ent->expr);
+        asm_stream_errors++;
+        reltab_retire_at(asm_reloc_table, idx);
+        return 1;
+    }
+
+    asm_stream_op_count = 0;
+    ret = asm_stream_expr(ent->expr);
+    if (ret != 0) {
+        return ret < 0 ? -1 : 0;
+    }
+
+    rel.type = ent->type & ~RT_EXPR;
+    rel.sec = ent->sec;
+    rel.offset = ent->offset;
+    rel.value = ent->value;
+    rel.sym = -1;
+    rel.target_sec = SEC_UNDEF;
+    rel.addend = 0;
+    if (stream_spill_expr(asm_stream, &rel, asm_stream_ops,
+                asm_stream_op_count, ent->path, ent->line) < 0) {
+        return -1;
+    }
+
+    reltab_detach_at(asm_reloc_table, idx);
+    return 1;
+}
+
+/**
+ * Applies or spills the relocations of a streaming build which can be, and
+ * finds the lowest offset in a section which still has a pending relocation.
+ * Relocations which are still pending once they are more than
+ * ASM_STREAM_MAX_SIZE bytes behind the end are spilled with
+ * asm_stream_retire().
+ * @param sec Section to find the watermark of.
+ * @return The watermark, or the end of the section if nothing is pending, or
+ * -1 on failure.
+ */
+static int asm_stream_watermark(enum section sec) {
+    int idx = OBJ_SEC_IDX(sec);
+    int flushed = asm_flushed[idx];
+    int mark = flushed + asm_sec_buf(sec)->size;
+    int window = mark - ASM_STREAM_MAX_SIZE;
+    int blocked = 0;
+
+    for (int i = asm_stream_next[idx];
+            i < reltab_get_size(asm_reloc_table); i++) {
+        const struct reloc_ent *ent = reltab_get(asm_reloc_table, i);
+        int ret = 0;
+
+        if (ent->type != RT_UNDEF && ent->sec == sec) {
+            ret = asm_stream_reloc(ent);
+            if (ret == 0 && ent->offset < window) {
+                ret = asm_stream_retire(i);
+            }
+
+            if (ret < 0) {
+                return -1;
+            } else if (ret > 0) {
+                reltab_retire_at(asm_reloc_table, i);
+            } else if (ent->offset >= flushed) {
+                mark = ent->offset;
+                break;
+            } else {
+                /* Ones below what was written out are patched in the output
+                 * once they are resolved, but have to be looked at again
+                 */
+                blocked = 1;
+            }
+        }
+
+        if (!blocked) {
+            asm_stream_next[idx] = i + 1;
+        }
+    }
+
+    asm_compact_relocs();
+    return mark;
+}
+
+/**
+ * Writes out the bytes of a section below its watermark, or all of them if
+ * that would leave too many buffered.
+ * @param sec Section to write out.
+ * @param all Whether to write out every byte.
+ * @return 0 on success, -1 on failure.
+ */
+static int asm_stream_flush(enum section sec, int all) {
+    int idx = OBJ_SEC_IDX(sec);
+    struct section_buf *buf = asm_sec_buf(sec);
+    int end = asm_flushed[idx] + buf->size;
+    int mark = asm_stream_watermark(sec);
+    int n;
+
+    if (mark < 0) {
+        return -1;
+    }
+
+    if (all || end - mark > ASM_STREAM_MAX_SIZE) {
+        mark = end;
+    }
+
+    n = mark - asm_flushed[idx];
+    if (n > 0) {
+        if (stream_write(asm_stream, sec, buf->data, n) < 0) {
+            return -1;
+        }
+
+        memmove(buf->data, buf->data + n, buf->size - n);
+        buf->size -= n;
+        asm_flushed[idx] = mark;
+    }
+
+    /* Don't look for the watermark again until more has been buffered */
+    asm_flush_at[idx] = buf->size + ASM_STREAM_FLUSH_SIZE;
+    return 0;
+}
+
+uint8_t *asm_emit_reserve(size_t n) {
+    uint8_t *ptr;
+
+    if (asm_stream && asm_buf->size + n > asm_flush_at[OBJ_SEC_IDX(asm_sec)]
+            && asm_stream_flush(asm_sec, 0) < 0) {
+        return NULL;
+    }
+
+    ptr = secbuf_reserve(asm_buf, n);
+    if (ptr) {
+        asm_inc_pc(n);
+        asm_terminal[OBJ_SEC_IDX(asm_sec)] = 0;
+    }
+
+    return ptr;
+}
+
+void asm_set_terminal(int terminal) {
+    asm_terminal[OBJ_SEC_IDX(asm_sec)] = terminal;
+}
+
+int asm_get_terminal(void) {
+    return asm_terminal[OBJ_SEC_IDX(asm_sec)];
+}
+
+int asm_split_fragment(void) {
+    enum section sec = asm_sec;
+    int idx = OBJ_SEC_IDX(sec);
+    struct obj_fragment *cur;
+
+    if (sec == SEC_ABS) {
+        return 0;
+    }
+
+    /* Nothing has been output in the current fragment, so just move it */
+    cur = &asm_frags[asm_cur_frag[idx]];
+    if (cur->offset == asm_get_offset()) {
+        struct asm_frag_index *index = &asm_frag_index[idx];
+        cur->pc = asm_pc->value;
+        if (index->count > 1
+                && cur->pc < asm_frags[index->frags[index->count - 2]].pc) {
+            index->sorted = 0;
+        }
+
+        return 0;
+    }
+
+    cur->falls_through = !asm_terminal[idx];
+    return asm_add_fragment(sec, asm_get_offset(), asm_pc->value);
+}
+
+int asm_emit(const void *data, size_t n) {
+    uint8_t *ptr = asm_emit_reserve(n);
+    if (!ptr) {
+        return -1;
+    }
+
+    memcpy(ptr, data, n);
+    return 0;
 }
 
 void asm_set_sec(enum section sec) {
     switch (sec) {
     case SEC_TEXT:
         asm_pc = &asm_text_pc;
+        asm_buf = &asm_text_buf;
         break;
     case SEC_DATA:
         asm_pc = &asm_data_pc;
+        asm_buf = &asm_data_buf;
         break;
     case SEC_ABS:
         asm_pc = &asm_abs_pc;
+        asm_buf = &asm_abs_buf;
         break;
     default:
-        break;
+        return;
     }
+
+    asm_sec = sec;
+}
+
+enum section asm_get_sec(void) {
+    return asm_sec;
+}
+
+const struct asm_pc *asm_get_pc(void) {
+    return asm_pc;
+}
+
+struct expr_node *asm_pc_expr(void) {
+    return expr_alloc_const(asm_pc->sec, asm_pc->value);
 }
 
 void asm_set_pc(uint16_t pc) {
-    enum section sec = (*asm_pc)->sec;
-    expr_free(*asm_pc);
-    *asm_pc = expr_alloc_const(sec, pc);
+    asm_pc->value = pc;
+    asm_split_fragment();
 }
 
-void asm_set_pc_expr(const struct expr_node *pc) {
-    if (!pc) {
-        return;
+int asm_set_pc_expr(struct expr_node *pc) {
+    const struct expr_node *res = expr_eval(pc);
+    int ret = 0;
+
+    if (!res || res->type != ET_CONST) {
+        fprintf(stderr, "ORG address must be constant.\n");
+        ret = -1;
+    } else {
+        asm_pc->sec = res->sec;
+        asm_pc->value = res->value;
+        asm_split_fragment();
     }
 
-    expr_free(*asm_pc);
-    *asm_pc = expr_clone(pc);
+    expr_free(pc);
+    return ret;
 }
 
-void asm_inc_pc(uint16_t off) {
-    *asm_pc = expr_alloc('+', *asm_pc, expr_alloc_const(SEC_ABS, off));
+int asm_equ(const struct symbol_ent *sym, struct expr_node *value) {
+    const struct expr_node *res = expr_eval(value);
+    int ret = 0;
+
+    if (!res || res->type != ET_CONST) {
+        fprintf(stderr, "EQU value must be constant.\n");
+        ret = -1;
+    } else {
+        sym = symtab_add(asm_symbol_table, sym->name, ST_OBJECT,
+                res->sec, res->value);
+        if (!sym) {
+            fprintf(stderr, "Symbol already defined.\n");
+            ret = -1;
+        } else {
+            asm_define_sym(sym);
+        }
+    }
+
+    expr_free(value);
+    return ret;
+}
+
+void asm_inc_pc(uint32_t off) {
+    asm_pc->value += off;
+}
+
+int asm_abs_value(struct expr_node *expr, const char *what, int *value) {
+    const struct expr_node *res = expr_eval(expr);
+    int ret = 0;
+
+    if (!EXPR_IS_ABS(res)) {
+        fprintf(stderr, "%s must be absolute.\n", what);
+        ret = -1;
+    } else {
+        *value = res->value;
+    }
+
+    expr_free(expr);
+    return ret;
+}
+
+int asm_fill(struct expr_node *len_expr, struct expr_node *byte_expr) {
+    int len, byte = 0;
+    uint8_t *bytes;
+
+    if (asm_abs_value(len_expr, "FILL length", &len) < 0) {
+        expr_free(byte_expr);
+        return -1;
+    }
+
+    if (byte_expr && asm_abs_value(byte_expr, "FILL value", &byte) < 0) {
+        return -1;
+    }
+
+    if (len < 0 || len > 0x10000) {
+        fprintf(stderr, "FILL length out of range.\n");
+        return -1;
+    }
+
+    if (byte < -0x80 || byte > 0xFF) {
+        fprintf(stderr, "FILL value out of range.\n");
+        return -1;
+    }
+
+    bytes = asm_emit_reserve(len);
+    if (!bytes) {
+        return -1;
+    }
+
+    memset(bytes, byte & 0xFF, len);
+    return 0;
+}
+
+/**
+ * Gets the index of a symbol in an object being created from the assembler
+ * state, adding it as a reference if it is not already there.
+ */
+static int asm_object_sym(struct object *obj, struct hash_table *indices,
+        const char *name) {
+    intptr_t idx = (intptr_t) hashtab_get(indices, name);
+    if (idx > 0) {
+        return idx - 1;
+    }
+
+    idx = object_add_sym(obj, name, SEC_UNDEF, 0);
+    if (idx < 0 || hashtab_set(indices, name, (void *) (idx + 1)) < 0) {
+        return -1;
+    }
+
+    return idx;
+}
+
+/**
+ * Adds an expression which the linker has to evaluate (since it uses symbols
+ * which are not defined yet) to an object, in postfix order. Its operands have
+ * to be absolute values or undefined symbols.
+ * @return 0 on success, 1 if the expression has other operands, or -1 on
+ * failure.
+ */
+static int asm_object_expr(struct object *obj, struct hash_table *indices,
+        const struct expr_node *expr) {
+    const struct expr_node *res = expr_eval(expr);
+    int ret;
+
+    if (!res) {
+        return -1;
+    }
+
+    if (res->type == ET_CONST) {
+        if (res->sec != SEC_ABS) {
+            return 1;
+        }
+
+        return object_add_expr_op(obj, ET_CONST, res->value) < 0 ? -1 : 0;
+    }
+
+    if (res->type == ET_SYM) {
+        int sym = asm_object_sym(obj, indices, res->sym->name);
+        if (sym < 0 || object_add_expr_op(obj, ET_SYM, sym) < 0) {
+            return -1;
+        }
+
+        if (res->addend != 0
+                && (object_add_expr_op(obj, ET_CONST, res->addend) < 0
+                    || object_add_expr_op(obj, ET_ADD, 0) < 0)) {
+            return -1;
+        }
+
+        return 0;
+    }
+
+    /* Only operators can be split up further */
+    if (!EXPR_IS_OP(expr)) {
+        return 1;
+    }
+
+    for (int i = 0; i < 2 && expr->operands[i]; i++) {
+        ret = asm_object_expr(obj, indices, expr->operands[i]);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    return object_add_expr_op(obj, expr->type, 0) < 0 ? -1 : 0;
+}
+
+int asm_to_object(struct object *obj, const char *name) {
+    /* Index + 1 of each symbol in the object, so that NULL means not added */
+    struct hash_table indices;
+    int errors = 0;
+
+    if (object_init(obj, name) < 0) {
+        return -1;
+    }
+
+    if (hashtab_init_size(&indices,
+                symtab_get_size(asm_symbol_table) + 1) < 0) {
+        object_destroy(obj);
+        return -1;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        const struct section_buf *buf = asm_sec_buf(OBJ_IDX_SEC(i));
+        uint8_t *bytes = secbuf_reserve(&obj->sections[i], buf->size);
+        if (!bytes) {
+            goto TO_OBJ_FAIL;
+        }
+
+        memcpy(bytes, buf->data, buf->size);
+    }
+
+    for (int i = 0; i < asm_frag_count; i++) {
+        struct obj_fragment frag = asm_frags[i];
+        if (asm_cur_frag[OBJ_SEC_IDX(frag.sec)] == i) {
+            frag.falls_through = !asm_terminal[OBJ_SEC_IDX(frag.sec)];
+        }
+
+        if (object_add_frag(obj, &frag) < 0) {
+            goto TO_OBJ_FAIL;
+        }
+    }
+
+    /* Export every defined symbol; undefined ones are only added if they are
+     * referenced.
+     */
+    for (int i = 0; i < symtab_get_size(asm_symbol_table); i++) {
+        const struct symbol_ent *sym = symtab_get(asm_symbol_table, i);
+        if (sym->type != ST_OBJECT) {
+            continue;
+        }
+
+        intptr_t idx = object_add_sym(obj, sym->name, sym->sec, sym->value);
+        if (idx < 0
+                || hashtab_set(&indices, sym->name, (void *) (idx + 1)) < 0) {
+            goto TO_OBJ_FAIL;
+        }
+    }
+
+    for (int i = 0; i < reltab_get_size(asm_reloc_table); i++) {
+        const struct reloc_ent *ent = reltab_get(asm_reloc_table, i);
+        struct obj_reloc rel;
+
+        /* Already patched during assembly */
+        if (!ent || ent->type == RT_UNDEF) {
+            continue;
+        }
+
+        rel.type = ent->type & ~RT_EXPR;
+        rel.sec = ent->sec;
+        rel.offset = ent->offset;
+        rel.value = ent->value;
+        rel.target_sec = SEC_UNDEF;
+        rel.addend = 0;
+        rel.expr_start = 0;
+        rel.expr_len = 0;
+
+        if (ent->type & RT_EXPR) {
+            /* The expression has to reduce to a single symbol or section
+             * offset for the linker to handle it, unless it is an absolute
+             * expression of undefined symbols.
+             */
+            const struct expr_node *expr = expr_eval(ent->expr);
+            const struct symbol_ent *undef = expr_find_undef(ent->expr);
+            if (!expr) {
+                goto TO_OBJ_FAIL;
+            }
+
+            if (expr->type == ET_CONST) {
+                rel.sym = -1;
+                rel.target_sec = expr->sec;
+                rel.addend = expr->value;
+            } else if (expr->type == ET_SYM) {
+                rel.sym = asm_object_sym(obj, &indices, expr->sym->name);
+                rel.addend = expr->addend;
+            } else if (undef) {
+                int ret;
+
+                rel.sym = -1;
+                rel.target_sec = SEC_ABS;
+                rel.expr_start = obj->expr_count;
+                ret = asm_object_expr(obj, &indices, ent->expr);
+                if (ret < 0) {
+                    goto TO_OBJ_FAIL;
+                } else if (ret > 0) {
+                    obj->expr_count = rel.expr_start;
+                    asm_reloc_error(ent->path, ent->line, "Expression using "
+                            "%s is too complex to relocate", undef->name);
+                    errors++;
+                    continue;
+                }
+
+                rel.expr_len = obj->expr_count - rel.expr_start;
+            } else {
+                asm_reloc_error(ent->path, ent->line,
+                        "Could not resolve expression", NULL);
+                errors++;
+                continue;
+            }
+        } else {
+            rel.sym = asm_object_sym(obj, &indices, ent->sym->name);
+        }
+
+        /* No symbol and no section means adding the symbol failed */
+        if ((rel.sym < 0 && rel.target_sec == SEC_UNDEF)
+                || object_add_reloc(obj, &rel) < 0) {
+            goto TO_OBJ_FAIL;
+        }
+    }
+
+    hashtab_destroy(&indices);
+    if (errors > 0) {
+        object_destroy(obj);
+        return -1;
+    }
+
+    return 0;
+
+TO_OBJ_FAIL:
+    hashtab_destroy(&indices);
+    object_destroy(obj);
+    return -1;
+}
+
+void asm_set_stream(struct stream *st) {
+    asm_stream = st;
+    if (st) {
+        st->resolve = asm_stream_resolve;
+    }
+}
+
+int asm_stream_finish(void) {
+    int errors = 0;
+
+    for (int i = 0; i < reltab_get_size(asm_reloc_table); i++) {
+        const struct reloc_ent *ent = reltab_get(asm_reloc_table, i);
+        int ret;
+
+        if (ent->type == RT_UNDEF) {
+            continue;
+        }
+
+        ret = asm_stream_reloc(ent);
+        if (ret < 0) {
+            return -1;
+        } else if (ret > 0) {
+            reltab_retire_at(asm_reloc_table, i);
+            continue;
+        }
+
+        /* Nothing else can be linked in, so anything left is an error */
+        if (ent->type & RT_EXPR) {
+            asm_stream_report(ent->path, ent->line, ent->expr);
+        } else {
+            fprintf(stderr, "Undefined symbol %s in %s.\n",
+                    ent->sym->name, asm_stream->name);
+        }
+
+        errors++;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        if (asm_stream_flush(OBJ_IDX_SEC(i), 1) < 0) {
+            return -1;
+        }
+    }
+
+    /* This also reports the spilled relocations which can't be resolved */
+    if (stream_finish(asm_stream) < 0) {
+        return -1;
+    }
+
+    return errors + asm_stream_errors > 0 ? -1 : 0;
+}
+
+int asm_add_snapshot(const struct snapshot *snap) {
+    if (asm_snapshot_count == ASM_MAX_SNAPSHOTS) {
+        return -1;
+    }
+
+    asm_snapshots[asm_snapshot_count++] = snap;
+    return 0;
+}
+
+const struct symbol_ent *asm_snapshot_sym(const char *name) {
+    int value;
+
+    for (int i = 0; i < asm_snapshot_count; i++) {
+        if (snapshot_find(asm_snapshots[i], name, &value)) {
+            /* Nothing can be waiting on a symbol which wasn't in the table, so
+             * this doesn't have to go through asm_define_sym()
+             */
+            return symtab_add(asm_symbol_table, name, ST_OBJECT, SEC_ABS,
+                    value);
+        }
+    }
+
+    return NULL;
+}
+
+int asm_snapshot_has(const char *name, int len) {
+    char *str;
+    int value;
+    int found = 0;
+
+    if (asm_snapshot_count == 0) {
+        return 0;
+    }
+
+    str = strndup(name, len);
+    if (!str) {
+        return -1;
+    }
+
+    for (int i = 0; i < asm_snapshot_count && !found; i++) {
+        found = snapshot_find(asm_snapshots[i], str, &value);
+    }
+
+    free(str);
+    return found;
 }
 
 /* vim: set tw=80 ft=c: */
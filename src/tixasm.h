@@ -11,18 +11,286 @@
 #include <stdint.h>
 
 #include "expr.h"
+#include "object.h"
 #include "reloc_table.h"
+#include "snapshot.h"
+#include "stream.h"
 #include "symbol_table.h"
 
+/**
+ * Bytes buffered in a section before a streaming build tries to write them
+ * out (see asm_set_stream()).
+ */
+#define ASM_STREAM_FLUSH_SIZE 0x10000
+
+/**
+ * Bytes a streaming build may keep buffered in a section while they wait on
+ * forward references. Beyond this, they are written out anyway, and the
+ * references are spilled to the stream (see stream_spill_expr()) to be patched
+ * in the output at the end. References to local labels stay in memory until
+ * their scope is closed.
+ */
+#define ASM_STREAM_MAX_SIZE 0x100000
+
+/**
+ * Maximum number of symbol snapshots which can be used at once.
+ */
+#define ASM_MAX_SNAPSHOTS 8
+
 extern struct symbol_table *asm_symbol_table;
 extern struct reloc_table *asm_reloc_table;
 
+/**
+ * Table of the local labels since the last global label.
+ */
+extern struct symbol_table *asm_local_table;
+
 int asm_init(void);
 void asm_destroy(void);
 
+/**
+ * Starts a new scope for local labels.
+ * This is done whenever a global label is defined.
+ * @return 0 on success, -1 on failure.
+ */
+int asm_open_scope(void);
+
+/**
+ * Ends the current local label scope.
+ * Relocations referencing the scope's labels are resolved, and then the labels
+ * are freed.
+ * @return 0 on success, -1 if undefined local labels were referenced.
+ */
+int asm_close_scope(void);
+
+/**
+ * Gets the number of local label scopes which have been opened, which changes
+ * whenever a global label is defined.
+ */
+int asm_get_scope_count(void);
+
+/**
+ * Patches the relocations waiting on a symbol which has just been defined.
+ * @param sym Newly defined symbol. Nothing is done if this is NULL.
+ */
+void asm_define_sym(const struct symbol_ent *sym);
+
+/**
+ * Function called whenever a symbol is defined (see asm_set_define_fn()).
+ * @param sym Symbol which was defined.
+ * @param local Whether the symbol is a local label.
+ */
+typedef void (*asm_define_fn)(const struct symbol_ent *sym, int local);
+
+/**
+ * Sets the function called by asm_define_sym().
+ * @param fn Function to call, or NULL for none.
+ */
+void asm_set_define_fn(asm_define_fn fn);
+
+/**
+ * Makes a defined symbol undefined again, so that it can be defined somewhere
+ * else. Expressions which already folded its value are not affected.
+ * @param sym Symbol to undefine.
+ */
+void asm_undefine_sym(const struct symbol_ent *sym);
+
+/**
+ * Discards the output of every section, along with the relocations and
+ * fragments, and resets the program counters to 0. Symbols and the current
+ * section are kept.
+ * This lets pieces of a file be assembled separately in the same state.
+ */
+void asm_clear_output(void);
+
+/**
+ * Writes bytes over previously output data.
+ * This is the patch function of asm_reloc_table.
+ */
+int asm_patch(enum section sec, int offset, const uint8_t *bytes, int len);
+
+/**
+ * Gets the output buffer of a section.
+ * In a streaming build, this only holds the bytes which have not been written
+ * out yet.
+ * @param sec Section to get.
+ * @return The buffer, or NULL if @p sec is not a valid section.
+ */
+const struct section_buf *asm_get_section(enum section sec);
+
+/**
+ * Gets the offset into the current section's buffer at which the next byte
+ * will be output. This differs from the program counter after an .org.
+ */
+int asm_get_offset(void);
+
+/**
+ * Reserves space for bytes in the current section and advances the program
+ * counter past them.
+ * Encoders write directly to the returned pointer; it is only valid until the
+ * next call that outputs to the section. The contents are uninitialized.
+ * @param n Number of bytes.
+ * @return Pointer to the bytes, or NULL on failure.
+ */
+uint8_t *asm_emit_reserve(size_t n);
+
+/**
+ * Evaluates an expression which must be absolute, then frees it.
+ * @param expr Expression to evaluate.
+ * @param what Description of the value for error messages.
+ * @param value Set to the value on success.
+ * @return 0 on success, -1 if the expression is not absolute.
+ */
+int asm_abs_value(struct expr_node *expr, const char *what, int *value);
+
+/**
+ * Outputs a run of a single byte (.fill). The expressions are freed.
+ * @param len_expr Number of bytes.
+ * @param byte_expr Value of the bytes, or NULL for zero.
+ * @return 0 on success, -1 on failure.
+ */
+int asm_fill(struct expr_node *len_expr, struct expr_node *byte_expr);
+
+/**
+ * Marks whether the last output to the current section was an instruction
+ * which never continues to the next one, or data (which is never executed
+ * into). Any other output clears this.
+ * @param terminal Whether the output is terminal.
+ */
+void asm_set_terminal(int terminal);
+
+/**
+ * Gets whether the last output to the current section never continues to the
+ * next one (see asm_set_terminal()).
+ */
+int asm_get_terminal(void);
+
+/**
+ * Starts a new fragment of the current section at the current position.
+ * Fragments are the units removed by --gc-sections; they are started by global
+ * labels and .org.
+ * @return 0 on success, -1 on failure.
+ */
+int asm_split_fragment(void);
+
+/**
+ * Outputs bytes to the current section.
+ * @param data Bytes to output.
+ * @param n Number of bytes.
+ * @return 0 on success, -1 on failure.
+ */
+int asm_emit(const void *data, size_t n);
+
+/**
+ * Program counter of a section: an offset into a section (which is usually the
+ * section it belongs to, unless it was set to an absolute address by .org).
+ */
+struct asm_pc {
+    enum section sec;
+    uint32_t value;
+};
+
 void asm_set_sec(enum section sec);
+
+/**
+ * Gets the section output currently goes to.
+ */
+enum section asm_get_sec(void);
+
+/**
+ * Gets the program counter of the current section.
+ */
+const struct asm_pc *asm_get_pc(void);
+
+/**
+ * Creates an expression for the program counter of the current section (for
+ * `$').
+ * @return Newly allocated expression node, or NULL if there is an error.
+ */
+struct expr_node *asm_pc_expr(void);
+
 void asm_set_pc(uint16_t pc);
-void asm_inc_pc(uint16_t off);
+
+/**
+ * Sets the program counter of the current section (for .org).
+ * @param pc New program counter. This must evaluate to a constant, and is
+ * freed.
+ * @return 0 on success, -1 if @p pc is not constant.
+ */
+int asm_set_pc_expr(struct expr_node *pc);
+
+/**
+ * Defines a symbol as the value of an expression (for .equ).
+ * @param sym Symbol to define, which has to be undefined.
+ * @param value Value of the symbol. This must evaluate to a constant, and is
+ * freed.
+ * @return 0 on success, -1 if @p value is not constant or the symbol is
+ * already defined (which is reported).
+ */
+int asm_equ(const struct symbol_ent *sym, struct expr_node *value);
+
+void asm_inc_pc(uint32_t off);
+
+/**
+ * Creates an object from the assembled sections, symbols, and remaining
+ * relocations. This should be called once assembly is done (after the last
+ * scope is closed).
+ * @param obj Object to initialize.
+ * @param name Name of the object, for error messages.
+ * @return 0 on success, -1 if a relocation cannot be represented in an object
+ * (or on allocation failure).
+ */
+int asm_to_object(struct object *obj, const char *name);
+
+/**
+ * Makes a streaming build: output is written to a stream as it is assembled,
+ * instead of being kept for asm_to_object().
+ *
+ * The bytes of a section below the lowest offset with a pending relocation (the
+ * watermark) are written out and freed whenever enough have been buffered.
+ * Relocations are applied as soon as the symbols they use are defined, except
+ * those which depend on where the data section ends up, which are spilled to
+ * the stream until the end.
+ * This should be called right after asm_init().
+ * @param st Stream to write to, or NULL for a normal build.
+ */
+void asm_set_stream(struct stream *st);
+
+/**
+ * Applies the remaining relocations of a streaming build and finishes its
+ * output. This should be called once assembly is done (after the last scope is
+ * closed).
+ * @return 0 on success, -1 if there were undefined symbols, invalid
+ * expressions, or values out of range (or on failure).
+ */
+int asm_stream_finish(void);
+
+/**
+ * Adds a snapshot to look up global symbols in when they are not in the symbol
+ * table (as if the header it was made from were included first). Snapshots
+ * are kept across asm_init() and asm_destroy(), and are searched in the order
+ * they were added.
+ * @param snap Snapshot to add, which has to stay open while it is used.
+ * @return 0 on success, -1 if there are too many.
+ */
+int asm_add_snapshot(const struct snapshot *snap);
+
+/**
+ * Looks up a symbol which is not in the symbol table in the snapshots, and
+ * adds it to the table (as an absolute symbol) if it is found.
+ * @param name Name of the symbol.
+ * @return The added symbol, or NULL if no snapshot has it.
+ */
+const struct symbol_ent *asm_snapshot_sym(const char *name);
+
+/**
+ * Checks whether a snapshot defines a symbol, so that it can't be defined
+ * again.
+ * @param name Name of the symbol (not necessarily null-terminated).
+ * @param len Length of the name.
+ * @return 1 if a snapshot has the symbol, 0 if not, or -1 on failure.
+ */
+int asm_snapshot_has(const char *name, int len);
 
 #endif /* TIXASM_H_ */
 
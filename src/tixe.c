@@ -0,0 +1,215 @@
+/**
+ * @file tixe.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pack.h"
+#include "tixe.h"
+
+static void tixe_put_u16(uint8_t *buf, uint16_t v) {
+    buf[0] = v & 0xFF;
+    buf[1] = v >> 8;
+}
+
+/**
+ * Appends bytes to the relocation table.
+ */
+static int tixe_emit(struct section_buf *table, const uint8_t *bytes,
+        size_t len) {
+    uint8_t *dst = secbuf_reserve(table, len);
+    if (!dst) {
+        return -1;
+    }
+
+    memcpy(dst, bytes, len);
+    return 0;
+}
+
+int tixe_encode(const struct link_fixups *fixups, struct section_buf *table) {
+    const int *offsets = fixups->offsets;
+    uint8_t entry[3];
+    int cursor = 0;
+    int i = 0;
+
+    while (i < fixups->count) {
+        int gap = offsets[i] - cursor;
+
+        if (gap < 0) {
+            fprintf(stderr, "Relocated fields at offsets %d and %d overlap.\n",
+                    offsets[i - 1], offsets[i]);
+            return -1;
+        }
+
+        if (gap == 0) {
+            int n = 1;
+            while (i + n < fixups->count && n < TIXE_RUN_MAX
+                    && offsets[i + n] == offsets[i + n - 1] + 2) {
+                n++;
+            }
+
+            /* A single field is cheaper to fix as a short entry */
+            if (n > 1) {
+                entry[0] = TIXE_RUN + n - 1;
+                if (tixe_emit(table, entry, 1) < 0) {
+                    return -1;
+                }
+
+                cursor = offsets[i] + 2 * n;
+                i += n;
+                continue;
+            }
+        }
+
+        if (gap > TIXE_LONG_MAX) {
+            entry[0] = TIXE_SKIP;
+            tixe_put_u16(&entry[1], gap);
+            if (tixe_emit(table, entry, 3) < 0) {
+                return -1;
+            }
+
+            gap = 0;
+        }
+
+        if (gap <= TIXE_SHORT_MAX) {
+            entry[0] = gap;
+            if (tixe_emit(table, entry, 1) < 0) {
+                return -1;
+            }
+        } else {
+            entry[0] = TIXE_LONG | gap >> 8;
+            entry[1] = gap & 0xFF;
+            if (tixe_emit(table, entry, 2) < 0) {
+                return -1;
+            }
+        }
+
+        cursor = offsets[i] + 2;
+        i++;
+    }
+
+    entry[0] = TIXE_SKIP;
+    tixe_put_u16(&entry[1], 0);
+    return tixe_emit(table, entry, 3);
+}
+
+/**
+ * Packs the sections of an image, and reports how much smaller it is.
+ */
+static int tixe_pack(const struct section_buf out[OBJ_SEC_COUNT], size_t size,
+        struct section_buf *packed) {
+    uint8_t *image = malloc(size ? size : 1);
+    size_t offset = 0;
+    long cycles;
+    int ret;
+
+    if (!image) {
+        return -1;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        memcpy(&image[offset], out[i].data, out[i].size);
+        offset += out[i].size;
+    }
+
+    ret = pack_compress(image, size, packed, &cycles);
+    if (ret == 0) {
+        fprintf(stderr, "Packed %zu bytes into %zu (%.1f%%); unpacking takes "
+                "%ld T-states (%.1f ms at 6 MHz).\n", size, packed->size,
+                size ? 100.0 * packed->size / size : 100.0, cycles,
+                cycles / 6e3);
+    }
+
+    free(image);
+    return ret;
+}
+
+int tixe_write(const struct section_buf out[OBJ_SEC_COUNT],
+        const struct link_fixups *fixups, int pack, const char *path) {
+    uint8_t header[TIXE_HEADER_SIZE] = { 0 };
+    struct section_buf table;
+    struct section_buf packed;
+    size_t size = 0;
+    FILE *file = NULL;
+    int ret = -1;
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        size += out[i].size;
+    }
+
+    if (size > 0xFFFF) {
+        fprintf(stderr, "The image is too large for an executable.\n");
+        return -1;
+    }
+
+    if (secbuf_init(&table) < 0) {
+        return -1;
+    }
+
+    if (secbuf_init(&packed) < 0) {
+        secbuf_destroy(&table);
+        return -1;
+    }
+
+    if (tixe_encode(fixups, &table) < 0
+            || (pack && tixe_pack(out, size, &packed) < 0)) {
+        goto WRITE_END;
+    }
+
+    if (pack && packed.size >= size) {
+        fprintf(stderr, "The packed image is no smaller, so it is stored "
+                "unpacked.\n");
+        pack = 0;
+    }
+
+    file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        goto WRITE_END;
+    }
+
+    memcpy(header, TIXE_MAGIC, 4);
+    header[4] = TIXE_VERSION;
+    header[5] = pack ? TIXE_PACKED : 0;
+    tixe_put_u16(&header[6], size);
+    tixe_put_u16(&header[8], fixups->count);
+    tixe_put_u16(&header[10], table.size);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        goto WRITE_FAIL;
+    }
+
+    if (pack) {
+        if (fwrite(packed.data, 1, packed.size, file) != packed.size) {
+            goto WRITE_FAIL;
+        }
+    } else {
+        for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+            if (fwrite(out[i].data, 1, out[i].size, file) != out[i].size) {
+                goto WRITE_FAIL;
+            }
+        }
+    }
+
+    if (fwrite(table.data, 1, table.size, file) != table.size) {
+        goto WRITE_FAIL;
+    }
+
+    ret = 0;
+    goto WRITE_END;
+
+WRITE_FAIL:
+    fprintf(stderr, "Could not write %s.\n", path);
+
+WRITE_END:
+    if (file && fclose(file) != 0) {
+        ret = -1;
+    }
+
+    secbuf_destroy(&table);
+    secbuf_destroy(&packed);
+    return ret;
+}
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,92 @@
+/**
+ * @file tixe.h
+ */
+
+#ifndef TIXE_H_
+#define TIXE_H_
+
+#include "link.h"
+#include "object.h"
+#include "section.h"
+
+#define TIXE_MAGIC "TIXE"
+
+#define TIXE_VERSION 1
+
+#define TIXE_HEADER_SIZE 12
+
+/**
+ * Flag set if the image is packed (see pack.h).
+ */
+#define TIXE_PACKED 0x01
+
+/*
+ * Entries of the relocation table. A cursor starts at the beginning of the
+ * image, and each entry moves it forward; "fix" means adding the load address
+ * to the 16-bit field at the cursor and moving past it.
+ */
+
+/**
+ * 0x00 - 0x7F: move forward by the value, then fix.
+ */
+#define TIXE_SHORT_MAX 0x7F
+
+/**
+ * 0x80 - 0xBF, then a byte: move forward by the lower 6 bits of the first byte
+ * (high) and the second byte (low), then fix.
+ */
+#define TIXE_LONG 0x80
+#define TIXE_LONG_MAX 0x3FFF
+
+/**
+ * 0xC0 - 0xFE: fix (value - 0xBF) fields in a row, as in a table of addresses.
+ */
+#define TIXE_RUN 0xC0
+#define TIXE_RUN_MAX (0xFE - TIXE_RUN + 1)
+
+/**
+ * 0xFF, then a 16-bit word: move forward by the word without fixing anything,
+ * or stop if it is 0.
+ */
+#define TIXE_SKIP 0xFF
+
+/**
+ * Encodes the relocation table of an image.
+ *
+ * Gaps between fields are what is stored, so most entries are a single byte,
+ * and the loader only has to add each one to its cursor. Adjacent fields are
+ * grouped into runs, which the loader fixes in a tight loop.
+ *
+ * @param fixups Fields to fix, as collected by link_objects().
+ * @param table Buffer to append the table to.
+ * @return 0 on success, -1 if fields overlap (which is reported) or on failure.
+ */
+int tixe_encode(const struct link_fixups *fixups, struct section_buf *table);
+
+/**
+ * Writes a TIXE executable. All integers are little-endian:
+ *
+ *   header: "TIXE", u8 version, u8 flags, u16 image size,
+ *           u16 relocation count, u16 relocation table size
+ *   image (linked at address 0), or the packed image
+ *   relocation table
+ *
+ * To load the executable, the image is copied (or unpacked, by
+ * lib/tixe_unpack.asm, which leaves the registers set up for the loader) to its
+ * load address, and the loader (lib/tixe_load.asm) adds that address to every
+ * field in the table.
+ *
+ * @param out Sections of the image, linked at address 0.
+ * @param fixups Fields holding addresses, as collected by link_objects().
+ * @param pack Whether to pack the image. The sizes and the time to unpack it
+ * are reported, and the image is stored unpacked if packing doesn't make it
+ * smaller.
+ * @param path Path to write to.
+ * @return 0 on success, -1 on failure (which is reported).
+ */
+int tixe_write(const struct section_buf out[OBJ_SEC_COUNT],
+        const struct link_fixups *fixups, int pack, const char *path);
+
+#endif /* TIXE_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,304 @@
+/**
+ * @file variant.c
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "variant.h"
+
+/**
+ * Parses a number in the range of a 16-bit address or value.
+ * @param str String to parse.
+ * @param len Length of @p str.
+ * @param[out] value Parsed value.
+ * @return 0 on success, -1 if @p str is not a number in range.
+ */
+static int variant_number(const char *str, int len, int *value) {
+    char buf[16];
+    char *end;
+    long n;
+    int base = 0;
+
+    if (len <= 0 || len >= (int) sizeof(buf)) {
+        return -1;
+    }
+
+    memcpy(buf, str, len);
+    buf[len] = '\0';
+    if (buf[0] == '$') {
+        buf[0] = '0';
+        base = 16;
+    }
+
+    n = strtol(buf, &end, base);
+    if (*end || end == buf || n < -0x8000 || n > 0xFFFF) {
+        return -1;
+    }
+
+    *value = n;
+    return 0;
+}
+
+int variant_parse(struct variant *var, const char *spec) {
+    const char *end = spec + strcspn(spec, "@:");
+    const char *ptr;
+
+    var->path = strndup(spec, end - spec);
+    var->has_base = 0;
+    var->base = 0;
+    var->sym_count = 0;
+    var->syms = NULL;
+    if (!var->path) {
+        return -1;
+    }
+
+    if (end == spec) {
+        goto PARSE_INVALID;
+    }
+
+    ptr = end;
+    if (*ptr == '@') {
+        end = ptr + 1 + strcspn(ptr + 1, ":");
+        if (variant_number(ptr + 1, end - ptr - 1, &var->base) < 0
+                || var->base < 0) {
+            goto PARSE_INVALID;
+        }
+
+        var->has_base = 1;
+        ptr = end;
+    }
+
+    while (*ptr == ':' || *ptr == ',') {
+        const char *name = ptr + 1;
+        const char *eq = name + strcspn(name, "=,");
+        struct variant_sym *sym;
+        struct variant_sym *syms;
+
+        if (*eq != '=' || eq == name) {
+            goto PARSE_INVALID;
+        }
+
+        end = eq + 1 + strcspn(eq + 1, ",");
+        syms = realloc(var->syms, (var->sym_count + 1) * sizeof(*syms));
+        if (!syms) {
+            variant_destroy(var);
+            return -1;
+        }
+
+        var->syms = syms;
+        sym = &syms[var->sym_count];
+        if (variant_number(eq + 1, end - eq - 1, &sym->value) < 0) {
+            goto PARSE_INVALID;
+        }
+
+        sym->name = strndup(name, eq - name);
+        if (!sym->name) {
+            variant_destroy(var);
+            return -1;
+        }
+
+        var->sym_count++;
+        ptr = end;
+    }
+
+    if (*ptr) {
+        goto PARSE_INVALID;
+    }
+
+    return 0;
+
+PARSE_INVALID:
+    fprintf(stderr, "Invalid variant %s.\n", spec);
+    variant_destroy(var);
+    return -1;
+}
+
+void variant_destroy(struct variant *var) {
+    for (int i = 0; i < var->sym_count; i++) {
+        free(var->syms[i].name);
+    }
+
+    free(var->syms);
+    free(var->path);
+    var->syms = NULL;
+    var->path = NULL;
+    var->sym_count = 0;
+}
+
+/**
+ * Writes the sections of an image to a file.
+ */
+static int variant_write(const struct section_buf out[OBJ_SEC_COUNT],
+        const char *path) {
+    FILE *file = fopen(path, "wb");
+    int ret = 0;
+
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\n", path);
+        return -1;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        if (fwrite(out[i].data, 1, out[i].size, file) != out[i].size) {
+            ret = -1;
+        }
+    }
+
+    if (fclose(file) != 0 || ret < 0) {
+        fprintf(stderr, "Could not write %s.\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Links and writes one variant.
+ * @param objs Objects to link, with a free element at the end for the
+ * variant's symbols.
+ * @param count Number of objects (without the free element).
+ */
+static int variant_build(struct object *objs, int count,
+        const struct link_options *opts, const struct variant *var) {
+    struct link_options var_opts = *opts;
+    struct section_buf out[OBJ_SEC_COUNT];
+    struct object *syms = &objs[count];
+    int ret = -1;
+
+    if (object_init(syms, var->path) < 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < var->sym_count; i++) {
+        if (object_add_sym(syms, var->syms[i].name, SEC_ABS,
+                    var->syms[i].value) < 0) {
+            goto BUILD_END;
+        }
+    }
+
+    if (var->has_base) {
+        var_opts.base = var->base;
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        secbuf_init(&out[i]);
+    }
+
+    if (link_objects(objs, count + 1, &var_opts, out) == 0) {
+        ret = variant_write(out, var->path);
+    }
+
+    for (int i = 0; i < OBJ_SEC_COUNT; i++) {
+        secbuf_destroy(&out[i]);
+    }
+
+BUILD_END:
+    object_destroy(syms);
+    return ret;
+}
+
+/**
+ * State shared by the threads linking variants.
+ */
+struct variant_ctx {
+    const struct object *objs;
+    int count;
+    const struct link_options *opts;
+    const struct variant *vars;
+    int var_count;
+
+    pthread_mutex_t lock;
+    int next;
+    int errors;
+};
+
+static void *variant_thread(void *arg) {
+    struct variant_ctx *ctx = arg;
+    struct object *objs = malloc((ctx->count + 1) * sizeof(*objs));
+    int errors = 0;
+
+    if (!objs) {
+        pthread_mutex_lock(&ctx->lock);
+        ctx->errors++;
+        pthread_mutex_unlock(&ctx->lock);
+        return NULL;
+    }
+
+    /* Objects are only read by the linker, so each thread can have a shallow
+     * copy of the list to put its own symbols at the end of
+     */
+    memcpy(objs, ctx->objs, ctx->count * sizeof(*objs));
+    for (;;) {
+        int idx;
+
+        pthread_mutex_lock(&ctx->lock);
+        idx = ctx->next++;
+        pthread_mutex_unlock(&ctx->lock);
+        if (idx >= ctx->var_count) {
+            break;
+        }
+
+        if (variant_build(objs, ctx->count, ctx->opts, &ctx->vars[idx]) < 0) {
+            errors++;
+        }
+    }
+
+    free(objs);
+    pthread_mutex_lock(&ctx->lock);
+    ctx->errors += errors;
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+int variant_link(const struct object *objs, int count,
+        const struct link_options *opts,
+        const struct variant *vars, int var_count) {
+    struct variant_ctx ctx = {
+        .objs = objs,
+        .count = count,
+        .opts = opts,
+        .vars = vars,
+        .var_count = var_count,
+        .next = 0,
+        .errors = 0,
+    };
+    pthread_t threads[VARIANT_MAX_THREADS];
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    int started = 0;
+
+    if (thread_count > var_count) {
+        thread_count = var_count;
+    }
+
+    if (thread_count > VARIANT_MAX_THREADS) {
+        thread_count = VARIANT_MAX_THREADS;
+    }
+
+    pthread_mutex_init(&ctx.lock, NULL);
+
+    /* The first batch is linked on this thread, which also picks up the work
+     * of any threads which couldn't be started
+     */
+    for (int i = 1; i < thread_count; i++) {
+        if (pthread_create(&threads[started], NULL, variant_thread, &ctx)
+                != 0) {
+            break;
+        }
+
+        started++;
+    }
+
+    variant_thread(&ctx);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&ctx.lock);
+    return ctx.errors > 0 ? -1 : 0;
+}
+
+/* vim: set tw=80 ft=c: */
@@ -0,0 +1,80 @@
+/**
+ * @file variant.h
+ */
+
+#ifndef VARIANT_H_
+#define VARIANT_H_
+
+#include "link.h"
+#include "object.h"
+
+/**
+ * Maximum number of variants linked at the same time.
+ */
+#define VARIANT_MAX_THREADS 8
+
+struct variant_sym {
+    char *name;
+    int value;
+};
+
+/**
+ * One image built from objects which are shared with other variants: the
+ * objects are linked at a different base address, with values supplied for
+ * symbols which they leave undefined.
+ *
+ * Since the symbols are undefined when the source is assembled, every use of
+ * them is left as a relocation, so they can be used wherever a relocatable
+ * value can (a symbol plus a constant), but not in conditionals or other
+ * directives which need their values right away.
+ */
+struct variant {
+    /**
+     * Path the image is written to.
+     */
+    char *path;
+
+    /**
+     * Whether a base address was given (otherwise the one from the link
+     * options is used), and the address.
+     */
+    int has_base;
+    int base;
+
+    int sym_count;
+    struct variant_sym *syms;
+};
+
+/**
+ * Parses a variant from a command line argument, of the form
+ * PATH[@BASE][:SYMBOL=VALUE[,SYMBOL=VALUE]...]. Numbers are decimal, or
+ * hexadecimal with a 0x or $ prefix.
+ * @param var Variant to initialize.
+ * @param spec Argument to parse.
+ * @return 0 on success, -1 if the argument is invalid (which is reported) or on
+ * failure.
+ */
+int variant_parse(struct variant *var, const char *spec);
+
+/**
+ * Frees a variant.
+ */
+void variant_destroy(struct variant *var);
+
+/**
+ * Links and writes the images of several variants of the same objects. The
+ * variants are linked in parallel.
+ * @param objs Objects to link.
+ * @param count Number of objects.
+ * @param opts Options to link with (the base address may be replaced).
+ * @param vars Variants to build.
+ * @param var_count Number of variants.
+ * @return 0 on success, -1 if any variant failed to link or be written.
+ */
+int variant_link(const struct object *objs, int count,
+        const struct link_options *opts,
+        const struct variant *vars, int var_count);
+
+#endif /* VARIANT_H_ */
+
+/* vim: set tw=80 ft=c: */
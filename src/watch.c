@@ -0,0 +1,208 @@
+/**
+ * @file watch.c
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "watch.h"
+
+/**
+ * Events on a directory which may change one of the files in it.
+ */
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE)
+
+/**
+ * Number of buckets in the table of files.
+ */
+#define WATCH_BUCKET_COUNT 64
+
+int watch_init(struct watch *w) {
+    w->dir_count = 0;
+    w->dir_capacity = 0;
+    w->dirs = NULL;
+
+    w->fd = inotify_init1(IN_CLOEXEC);
+    if (w->fd < 0) {
+        perror("inotify_init1");
+        return -1;
+    }
+
+    if (hashtab_init_size(&w->files, WATCH_BUCKET_COUNT) < 0) {
+        close(w->fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+void watch_destroy(struct watch *w) {
+    for (int i = 0; i < w->dir_count; i++) {
+        free(w->dirs[i].path);
+    }
+
+    free(w->dirs);
+    hashtab_destroy(&w->files);
+    close(w->fd);
+}
+
+/**
+ * Starts watching a directory, if it is not already watched.
+ * @param dir Canonical path of the directory.
+ * @return 0 on success, -1 on failure.
+ */
+static int watch_add_dir(struct watch *w, const char *dir) {
+    for (int i = 0; i < w->dir_count; i++) {
+        if (strcmp(w->dirs[i].path, dir) == 0) {
+            return 0;
+        }
+    }
+
+    if (w->dir_count == w->dir_capacity) {
+        int capacity = w->dir_capacity ? w->dir_capacity * 2 : 8;
+        struct watch_dir *dirs = realloc(w->dirs, capacity * sizeof(*dirs));
+        if (!dirs) {
+            return -1;
+        }
+
+        w->dirs = dirs;
+        w->dir_capacity = capacity;
+    }
+
+    struct watch_dir *wdir = &w->dirs[w->dir_count];
+    wdir->wd = inotify_add_watch(w->fd, dir, WATCH_EVENTS);
+    if (wdir->wd < 0) {
+        fprintf(stderr, "Could not watch %s: %s.\n", dir, strerror(errno));
+        return -1;
+    }
+
+    wdir->path = strdup(dir);
+    if (!wdir->path) {
+        inotify_rm_watch(w->fd, wdir->wd);
+        return -1;
+    }
+
+    w->dir_count++;
+    return 0;
+}
+
+int watch_add(struct watch *w, const char *path) {
+    char real[PATH_MAX];
+    char dir[PATH_MAX];
+    const char *slash;
+
+    /* A missing file is resolved through its directory */
+    if (!realpath(path, real)) {
+        const char *name;
+
+        slash = strrchr(path, '/');
+        name = slash ? slash + 1 : path;
+        if (!slash) {
+            strcpy(dir, ".");
+        } else if (slash == path) {
+            strcpy(dir, "/");
+        } else {
+            snprintf(dir, sizeof(dir), "%.*s", (int) (slash - path), path);
+        }
+
+        if (!realpath(dir, real)
+                || strlen(real) + strlen(name) + 2 > sizeof(real)) {
+            fprintf(stderr, "Could not watch %s.\n", path);
+            return -1;
+        }
+
+        strcat(real, real[1] ? "/" : "");
+        strcat(real, name);
+    }
+
+    slash = strrchr(real, '/');
+    snprintf(dir, sizeof(dir), "%.*s", slash == real ? 1 : (int) (slash - real),
+            real);
+
+    if (watch_add_dir(w, dir) < 0) {
+        return -1;
+    }
+
+    return hashtab_set(&w->files, real, w) < 0 ? -1 : 0;
+}
+
+void watch_clear(struct watch *w) {
+    hashtab_clear(&w->files);
+}
+
+/**
+ * Reads the pending events.
+ * @return 1 if any of them was on a watched file, 0 if not, or -1 on failure.
+ */
+static int watch_read(struct watch *w) {
+    char buf[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[PATH_MAX];
+    ssize_t len;
+    int changed = 0;
+
+    len = read(w->fd, buf, sizeof(buf));
+    if (len < 0) {
+        return errno == EINTR || errno == EAGAIN ? 0 : -1;
+    }
+
+    for (char *ptr = buf; ptr < buf + len;) {
+        const struct inotify_event *ev = (const struct inotify_event *) ptr;
+        ptr += sizeof(*ev) + ev->len;
+
+        if (ev->len == 0) {
+            continue;
+        }
+
+        for (int i = 0; i < w->dir_count; i++) {
+            const char *dir = w->dirs[i].path;
+            if (w->dirs[i].wd != ev->wd) {
+                continue;
+            }
+
+            snprintf(path, sizeof(path), "%s%s%s", dir, dir[1] ? "/" : "",
+                    ev->name);
+            if (hashtab_get(&w->files, path)) {
+                changed = 1;
+            }
+            break;
+        }
+    }
+
+    return changed;
+}
+
+int watch_wait(struct watch *w) {
+    struct pollfd pfd = { .fd = w->fd, .events = POLLIN };
+    int ret;
+
+    do {
+        ret = watch_read(w);
+    } while (ret == 0);
+
+    if (ret < 0) {
+        perror("inotify");
+        return -1;
+    }
+
+    /* Let the rest of the save finish */
+    while ((ret = poll(&pfd, 1, WATCH_SETTLE_MS)) != 0) {
+        if (ret < 0 && errno != EINTR) {
+            return -1;
+        }
+
+        if (ret > 0 && watch_read(w) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* vim: set tw=80 ft=c: */
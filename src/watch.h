@@ -0,0 +1,90 @@
+/**
+ * @file watch.h
+ */
+
+#ifndef WATCH_H_
+#define WATCH_H_
+
+#include "hash_table.h"
+
+/**
+ * Time (in milliseconds) the input has to be quiet after a change before
+ * watch_wait() returns, so that a save which touches a file several times only
+ * causes one rebuild.
+ */
+#define WATCH_SETTLE_MS 15
+
+/**
+ * A directory watched for changes.
+ */
+struct watch_dir {
+    /**
+     * inotify watch descriptor.
+     */
+    int wd;
+
+    /**
+     * Canonical path of the directory.
+     */
+    char *path;
+};
+
+/**
+ * Set of files to wait on changes to.
+ *
+ * The directories containing the files are watched rather than the files
+ * themselves, since editors often save by writing a new file and renaming it
+ * over the old one (which a watch on the old file would miss).
+ */
+struct watch {
+    /**
+     * inotify instance.
+     */
+    int fd;
+
+    int dir_count;
+    int dir_capacity;
+    struct watch_dir *dirs;
+
+    /**
+     * Canonical paths of the files to wait on.
+     */
+    struct hash_table files;
+};
+
+/**
+ * Initializes an empty watch set.
+ * @return 0 on success, -1 on failure.
+ */
+int watch_init(struct watch *w);
+
+/**
+ * Stops watching and frees a watch set.
+ */
+void watch_destroy(struct watch *w);
+
+/**
+ * Adds a file to wait on. The file does not have to exist (but its directory
+ * does), so that a file which failed to open can be waited on.
+ * @param w Watch set.
+ * @param path Path of the file.
+ * @return 0 on success, -1 on failure.
+ */
+int watch_add(struct watch *w, const char *path);
+
+/**
+ * Removes all of the files (e.g. before adding the files a new build depends
+ * on).
+ */
+void watch_clear(struct watch *w);
+
+/**
+ * Waits until one of the files is written, created, or replaced, and then
+ * until there have been no changes for WATCH_SETTLE_MS.
+ * @return 0 on success, -1 on failure.
+ */
+int watch_wait(struct watch *w);
+
+#endif /* WATCH_H_ */
+
+/* vim: set tw=80 ft=c: */
@@ -9,12 +9,14 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "cond.h"
 #include "expr.h"
+#include "include.h"
+#include "macro.h"
 #include "opcode.h"
 #include "tixasm.h"
 
 extern int yylineno;
-FILE *yyout;
 
 int yylex(void);
 void yyerror(char *);
@@ -34,17 +36,23 @@ int instr_match_and_output(const struct opcode *oc,
     struct operand op;
     const struct opcode *oc;
     const struct symbol_ent *sym;
+    struct vector *vec;
 }
 
 %token T_EOL T_ERROR
 
 %token T_TEXT T_DATA T_ABS T_ORG T_DB T_DW T_FILL T_EQU T_DEFINE T_UNDEFINE
+%token T_MACRO T_ENDM T_REPT T_ENDR T_INCLUDE T_INCBIN
+%token T_IF T_IFDEF T_IFNDEF T_ELSE T_ENDIF
 
 %token <i> T_LITERAL
 %token <str> T_STRING
 /* TODO Split up directives like registers are? */
 %token <oc> T_OPCODE
-%token <sym> T_SYMBOL T_LABEL T_LLABEL T_FLABEL
+%token <sym> T_SYMBOL T_LABEL T_LLABEL T_FLABEL T_LSYMBOL
+%token <str> T_IDENT
+%token <i> T_MACRO_ARG
+%token <sym> T_MACRO_CALL
 
 %token <i> T_A T_B T_C T_D T_E T_F T_H T_L T_IXH T_IXL T_IYH T_IYL T_I T_R
 %token <i> T_AF T_BC T_DE T_HL T_SP T_IX T_IY T_sAF
@@ -66,6 +74,7 @@ int instr_match_and_output(const struct opcode *oc,
 %right '~' '!' UNARY
 
 %type <sym> label
+%type <vec> macro_params macro_param_list
 
 %type <expr> expr_top
 %type <expr> expr
@@ -92,8 +101,21 @@ line:
     | label instruction
     | instruction
     | directive
+    | include line
     ;
 
+/* The end of the line is part of the rule, so the included file is pushed
+ * once the line has been read, and before anything after it.
+ */
+include: T_INCLUDE T_STRING T_EOL {
+            if (include_push($2) < 0) {
+                yyerror("Could not include file");
+            }
+
+            free($2);
+        }
+       ;
+
 label: T_LABEL
      | T_LLABEL
      | T_FLABEL
@@ -106,51 +128,123 @@ directive: T_TEXT                   { asm_set_sec(SEC_TEXT); }
                 /* TODO Allow setting inside a section? */
                 asm_set_pc_expr($2);
             }
-         | T_DB db_operand_list
-         | T_DW dw_operand_list
-         | T_FILL expr {
-                if (!EXPR_IS_ABS($2)) {
-                    fprintf(stderr, "ORG address must be defined.\n");
-                }
-
-                int len = $2->value;
-                asm_inc_pc(len);
-                while (len --> 0) {
-                    fputc(0, yyout);
-                }
+         | data {
+                /* Execution never continues into what follows data, so
+                 * --gc-sections can drop it unless it is referenced.
+                 */
+                asm_set_terminal(1);
             }
-         | T_FILL expr ',' expr {
-                if (!EXPR_IS_ABS($2) || !EXPR_IS_ABS($4)) {
-                    fprintf(stderr, "FILL values must be absolute");
-                }
-
-                int len = $2->value;
-                int byte = $4->value & 0xFF;
-                asm_inc_pc(len);
-                while (len --> 0) {
-                    fputc(byte, yyout);
+         | T_EQU T_SYMBOL expr {
+                if (asm_equ($2, $3) < 0) {
+                    YYERROR;
                 }
             }
-         | T_EQU T_SYMBOL expr
          | T_DEFINE T_SYMBOL {
-                symtab_add(asm_symbol_table, $2->name, ST_OBJECT, SEC_ABS, 1);
+                asm_define_sym(symtab_add(asm_symbol_table,
+                            $2->name, ST_OBJECT, SEC_ABS, 1));
             }
          | T_UNDEFINE T_SYMBOL {
                 symtab_add(asm_symbol_table, $2->name, ST_UNDEF, SEC_UNDEF, 0);
             }
+         | T_IF expr {
+                /* The end of the line has already been read (as the lookahead),
+                 * so a false branch is skipped starting on the next line.
+                 */
+                const struct expr_node *res = expr_eval($2);
+                if (!EXPR_IS_ABS(res)) {
+                    fprintf(stderr, "IF condition must be absolute.\n");
+                    cond_if(0);
+                } else {
+                    cond_if(res->value != 0);
+                }
+
+                expr_free($2);
+            }
+         | T_IFDEF T_SYMBOL         { cond_if($2->type != ST_UNDEF); }
+         | T_IFNDEF T_SYMBOL        { cond_if($2->type == ST_UNDEF); }
+         | T_ELSE                   { cond_else(); }
+         | T_ENDIF                  { cond_endif(); }
+         | T_MACRO T_IDENT macro_params {
+                /* The lookahead (end of the line) has already been read, so
+                 * the body starts with the next token.
+                 */
+                macro_define($2, $3);
+            }
+         | T_REPT expr {
+                const struct expr_node *res = expr_eval($2);
+                if (!EXPR_IS_ABS(res)) {
+                    fprintf(stderr, "REPT count must be absolute.\n");
+                } else {
+                    macro_rept(res->value);
+                }
+
+                expr_free($2);
+            }
          ;
 
+data: T_DB db_operand_list
+    | T_DW dw_operand_list
+    | T_FILL expr {
+            asm_fill($2, NULL);
+        }
+    | T_FILL expr ',' expr {
+            asm_fill($2, $4);
+        }
+    | T_INCBIN T_STRING {
+            include_binary($2, 0, -1);
+            free($2);
+        }
+    | T_INCBIN T_STRING ',' expr {
+            int offset;
+            if (asm_abs_value($4, "INCBIN offset", &offset) == 0) {
+                include_binary($2, offset, -1);
+            }
+
+            free($2);
+        }
+    | T_INCBIN T_STRING ',' expr ',' expr {
+            int offset, len;
+            if (asm_abs_value($4, "INCBIN offset", &offset) == 0
+                    && asm_abs_value($6, "INCBIN length", &len) == 0) {
+                include_binary($2, offset, len);
+            }
+
+            free($2);
+        }
+    ;
+
+macro_params: /* empty */       { $$ = NULL; }
+            | macro_param_list  { $$ = $1; }
+            ;
+
+macro_param_list: T_IDENT {
+                    $$ = malloc(sizeof(*$$));
+                    if ($$ && vector_init($$) == 0) {
+                        vector_add($$, $1);
+                    }
+                }
+                | macro_param_list ',' T_IDENT {
+                    $$ = $1;
+                    if ($$) {
+                        vector_add($$, $3);
+                    }
+                }
+                ;
+
 db_operand: expr {
-                reltab_add_expr(asm_reloc_table,
-                        RT_8_BIT, asm_get_pc()->sec, asm_get_pc()->value, 0, $1);
+                enum section sec = asm_get_sec();
+                int offset = asm_get_offset();
+                uint8_t bytes[2] = { 0, 0 };
+                if (reltab_encode_expr(RT_8_BIT, sec, 0, $1, bytes) == 0) {
+                    reltab_add_expr(asm_reloc_table,
+                            RT_8_BIT, sec, offset, 0, $1);
+                }
+
                 expr_free($1);
-                fputc(0, yyout);
-                asm_inc_pc(1);
+                asm_emit(bytes, 1);
             }
           | T_STRING {
-                int len = strlen($1);
-                fwrite($1, 1, len, yyout);
-                asm_inc_pc(len);
+                asm_emit($1, strlen($1));
                 free($1);
             }
           ;
@@ -160,11 +254,16 @@ db_operand_list: db_operand
                ;
 
 dw_operand: expr {
-                reltab_add_expr(asm_reloc_table,
-                        RT_16_BIT, asm_get_pc()->sec, asm_get_pc()->value, 0, $1);
+                enum section sec = asm_get_sec();
+                int offset = asm_get_offset();
+                uint8_t bytes[2] = { 0, 0 };
+                if (reltab_encode_expr(RT_16_BIT, sec, 0, $1, bytes) == 0) {
+                    reltab_add_expr(asm_reloc_table,
+                            RT_16_BIT, sec, offset, 0, $1);
+                }
+
                 expr_free($1);
-                fputc(0, yyout);
-                asm_inc_pc(2);
+                asm_emit(bytes, 2);
             }
           ;
 
@@ -268,9 +367,10 @@ flag: T_fNZ { $$.type = OP_fNZ; }
     | T_fM  { $$.type = OP_fM; }
     ;
 
-expr_top: '$'                   { $$ = expr_clone(asm_get_pc()); }
+expr_top: '$'                   { $$ = asm_pc_expr(); }
         | T_LITERAL             { $$ = expr_alloc_const(SEC_ABS, $1); }
         | T_SYMBOL              { $$ = expr_alloc_sym($1); }
+        | T_LSYMBOL             { $$ = expr_alloc_sym($1); }
         | '+' expr              { $$ = $2; }
         | '-' expr %prec UNARY  { $$ = expr_alloc(ET_NEG, $2, NULL); }
         | '~' expr              { $$ = expr_alloc('~', $2, NULL); }
@@ -296,7 +396,7 @@ int instr_match_and_output(const struct opcode *oc,
     int ret;
 
     if (instr) {
-        ret = instr_output(instr, op1, op2, yyout);
+        ret = instr_output(instr, op1, op2);
     } else {
         yyerror("Undefined instruction");
         ret = -1;
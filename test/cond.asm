@@ -0,0 +1,19 @@
+; Only the bytes of the true branches are emitted, including in nested blocks
+.define FLAG
+.equ LEVEL 2
+.ifdef FLAG
+    .db 1
+.else
+    .db $FF
+.endif
+.ifndef FLAG
+    .db $FF
+.endif
+.if LEVEL - 1
+    .db 2
+.if LEVEL - 2
+    .db $FF
+.else
+    .db 3
+.endif
+.endif
@@ -0,0 +1,5 @@
+; .incbin takes an optional offset and length, and .fill an optional value
+    .incbin "bytes.txt"
+    .incbin "bytes.txt", 2, 3
+    .fill 2
+    .fill 3, $AB
@@ -0,0 +1,12 @@
+; Forward references are backpatched once their labels are defined
+.text
+start:
+    jp later
+    ld hl, later + 2
+    jr later
+    .dw table
+later:
+    ret
+.data
+table:
+    .db 1, 2
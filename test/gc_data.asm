@@ -0,0 +1,10 @@
+; --gc-sections keeps table, which is referenced, but drops junk: execution
+; never continues from the data in table into it.
+.text
+start:
+    ld hl, table
+    ret
+table:
+    .db 1, 2, 3
+junk:
+    .db 4, 5, 6
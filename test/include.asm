@@ -0,0 +1,5 @@
+; once.inc is marked .once, so its second include is skipped
+    .db 1
+.include "once.inc"
+.include "once.inc"
+    .db 3
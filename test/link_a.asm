@@ -0,0 +1,6 @@
+; Calls into link_b.asm, which is linked after this object
+.text
+start:
+    call helper
+    ld hl, value
+    ret
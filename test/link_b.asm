@@ -0,0 +1,7 @@
+.text
+helper:
+    ld a, 7
+    ret
+.data
+value:
+    .dw helper
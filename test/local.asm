@@ -0,0 +1,14 @@
+; Each global label starts a new scope, so both loops can use .loop
+.text
+first:
+.loop:
+    djnz .loop
+    jr .done
+    nop
+.done:
+    ret
+second:
+    nop
+.loop:
+    djnz .loop
+    ret
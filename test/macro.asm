@@ -0,0 +1,12 @@
+; Parameters are matched by case, and .rept repeats its body the given number
+; of times (including macro calls)
+.macro pair Val, val
+    .db Val, val
+.endm
+    pair 1, 2
+.rept 2
+    pair 3, 4
+.endr
+.rept 0
+    .db $FF
+.endr
@@ -0,0 +1,17 @@
+; Repetitive code and data with many absolute addresses, so that both the
+; packed image and the relocation table have runs and matches
+.text
+start:
+.rept 16
+    call routine
+    ld hl, table
+.endr
+    ret
+routine:
+    .fill 40, 0
+    ret
+.data
+table:
+.rept 8
+    .dw start, routine, table
+.endr
@@ -0,0 +1,11 @@
+; far can't share a page with start, so the call to it goes through a
+; trampoline and the branch table
+.text
+start:
+    call far
+    ret
+    .fill 12288, 0
+far:
+    ld a, 1
+    ret
+    .fill 12288, 0
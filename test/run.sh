@@ -0,0 +1,176 @@
+#!/bin/sh
+#
+# run.sh
+# Runs the tests against an assembler binary:
+#   sh test/run.sh [path/to/tixasm]
+#
+
+TIXASM=${1:-bin/tixasm}
+DIR=$(dirname "$0")
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+failed=0
+
+# Prints the output as hex bytes
+dump() {
+    od -An -v -tx1 "$TMP/out" | tr -s ' \n' '  ' | sed 's/^ //; s/ $//'
+}
+
+# Assembles with the given arguments and prints the output
+hex() {
+    "$TIXASM" -o "$TMP/out" "$@" 2>"$TMP/err" && dump
+}
+
+# byte OFFSET / word OFFSET
+# Reads a (little-endian) value from the output
+byte() {
+    od -An -tu1 -j "$1" -N1 "$TMP/out" | tr -d ' '
+}
+
+word() {
+    echo $(($(byte "$1") + $(byte $(($1 + 1))) * 256))
+}
+
+# Follows the call at the start of a paged output (linked at 0x4000) through
+# its trampoline and branch table entry, and prints the opcodes of the
+# trampoline, whether the entry is on the first page, the page it names, and
+# the first bytes of the routine it leads to
+follow_call() {
+    tramp=$(($(word 1) - 0x4000))
+    entry=$(($(word $((tramp + 1))) - 0x4000))
+    page=$(byte $((entry + 2)))
+    target=$((page * 0x4000 + $(word "$entry") - 0x4000))
+    first=no
+    if [ "$entry" -ge 0 ] && [ "$entry" -lt $((0x4000)) ]; then
+        first=yes
+    fi
+
+    printf '%x %x %s %d %x %x\n' "$(byte "$tramp")" \
+        "$(byte $((tramp + 3)))" "$first" "$page" \
+        "$(byte "$target")" "$(byte $((target + 1)))"
+}
+
+# variant SYM=VALUE,... ARGS...
+# Links a variant image with the given symbol values and prints it
+variant() {
+    values=$1
+    shift
+    "$TIXASM" "$@" --variant "$TMP/out:$values" 2>"$TMP/err" && dump
+}
+
+# untixe BASE
+# Loads the TIXE executable in the output at an address, as lib/tixe_unpack.asm
+# and lib/tixe_load.asm would, and prints the image
+untixe() {
+    od -An -v -tu1 "$TMP/out" | awk -v base="$1" '
+        function fix() {
+            v = img[cur] + img[cur + 1] * 256 + base
+            img[cur] = v % 256
+            img[cur + 1] = int(v / 256) % 256
+            cur += 2
+        }
+
+        { for (i = 1; i <= NF; i++) b[n++] = $i }
+
+        END {
+            size = b[6] + b[7] * 256
+            pos = 12
+            if (b[5] % 2 == 0) {
+                for (out = 0; out < size; out++) img[out] = b[pos++]
+            } else {
+                out = 0
+                while ((c = b[pos++]) != 255) {
+                    if (c < 128) {
+                        for (k = 0; k <= c; k++) img[out++] = b[pos++]
+                    } else {
+                        off = b[pos] + b[pos + 1] * 256 - 65536
+                        pos += 2
+                        for (k = 0; k < c - 125; k++) {
+                            img[out] = img[out + off]
+                            out++
+                        }
+                    }
+                }
+            }
+
+            cur = 0
+            for (;;) {
+                c = b[pos++]
+                if (c < 128) {
+                    cur += c
+                    fix()
+                } else if (c < 192) {
+                    cur += (c - 128) * 256 + b[pos++]
+                    fix()
+                } else if (c < 255) {
+                    for (k = 0; k < c - 191; k++) fix()
+                } else {
+                    gap = b[pos] + b[pos + 1] * 256
+                    pos += 2
+                    if (gap == 0) break
+                    cur += gap
+                }
+            }
+
+            for (k = 0; k < size; k++) {
+                printf "%s%02x", k ? " " : "", img[k]
+            }
+        }'
+}
+
+# expect NAME EXPECTED ACTUAL
+expect() {
+    if [ "$2" = "$3" ]; then
+        echo "ok $1"
+    else
+        echo "FAIL $1"
+        echo "  expected: $2"
+        echo "  got:      $3"
+        failed=1
+    fi
+}
+
+expect macro "01 02 03 04 03 04" "$(hex "$DIR/macro.asm")"
+expect include-once "01 02 03" "$(hex "$DIR/include.asm")"
+expect cond "01 02 03" "$(hex "$DIR/cond.asm")"
+expect local-labels "10 fe 18 01 00 c9 00 10 fe c9" "$(hex "$DIR/local.asm")"
+expect forward "c3 0a 00 21 0c 00 18 02 0b 00 c9 01 02" \
+    "$(hex "$DIR/forward.asm")"
+expect incbin-fill "54 49 58 41 53 4d 58 41 53 00 00 ab ab ab" \
+    "$(hex "$DIR/data.asm")"
+
+"$TIXASM" -c -o "$TMP/a.tixo" "$DIR/link_a.asm"
+"$TIXASM" -c -o "$TMP/b.tixo" "$DIR/link_b.asm"
+expect link "cd 07 00 21 0a 00 c9 3e 07 c9 07 00" \
+    "$("$TIXASM" link -o "$TMP/out" "$TMP/a.tixo" "$TMP/b.tixo" && dump)"
+
+"$TIXASM" snap -o "$TMP/header.tixs" "$DIR/header.inc"
+expect snapshot "d3 10 21 41 93 c9" \
+    "$(hex --symbols "$TMP/header.tixs" "$DIR/snapshot.asm")"
+
+# Streaming, TIXE and packed output should all give the same image as a plain
+# build
+for f in forward pack; do
+    plain=$(hex -b 0x9000 "$DIR/$f.asm")
+    expect "stream-$f" "$(hex "$DIR/$f.asm")" \
+        "$(hex --stream "$DIR/$f.asm")"
+    expect "tixe-$f" "$plain" \
+        "$(hex --tixe "$DIR/$f.asm" >/dev/null && untixe $((0x9000)))"
+    expect "packed-$f" "$plain" \
+        "$(hex --tixe --pack "$DIR/$f.asm" >/dev/null && untixe $((0x9000)))"
+done
+
+expect gc-data "21 04 00 c9 01 02 03" "$(hex --gc-sections "$DIR/gc_data.asm")"
+expect gc-data-kept "21 04 00 c9 01 02 03 04 05 06" "$(hex "$DIR/gc_data.asm")"
+
+expect variant-expr "11 06 00 3e 04 c9" \
+    "$(variant VAL=3 "$DIR/variant_expr.asm")"
+"$TIXASM" -c -o "$TMP/variant.tixo" "$DIR/variant_expr.asm"
+expect variant-expr-link "11 fe ff 3e 00 c9" \
+    "$(variant VAL=-1 link "$TMP/variant.tixo")"
+
+hex --pages -b 0x4000 "$DIR/pages.asm" >/dev/null
+expect pages-branch "ef c9 yes 1 3e 1" "$(follow_call)"
+
+exit $failed
@@ -0,0 +1,5 @@
+; PORT and SCREEN come from the snapshot of header.inc
+.text
+    out (PORT), a
+    ld hl, SCREEN + 1
+    ret
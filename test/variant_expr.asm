@@ -0,0 +1,6 @@
+; VAL is only given a value by --variant, so the linker has to evaluate the
+; expressions using it for each image
+.text
+    ld de, VAL * 2
+    ld a, VAL + 1
+    ret